@@ -0,0 +1,448 @@
+#include "accel/binnedbvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include "common/stopwatch.h"
+#include "common/threadpool.h"
+
+namespace
+{
+	const uint32_t InvalidTriangle = 0xffffffff;
+
+	inline bool IsValid(const Aabb & a)
+	{
+		return a.pMin.x <= a.pMax.x && a.pMin.y <= a.pMax.y && a.pMin.z <= a.pMax.z;
+	}
+
+	inline Float SafeArea(const Aabb & a)
+	{
+		return IsValid(a) ? a.surfaceArea() : 0.0f;
+	}
+
+	inline Vec3 Centroid(const Aabb & a)
+	{
+		return a.computeCentroid();
+	}
+
+	// maps centroids to bins. axes without extent put everything into bin 0
+	struct BinMapping
+	{
+		BinMapping(const Aabb & centroidBbox, const size_t numBins):
+			mMin(centroidBbox.pMin),
+			mNumBins(numBins)
+		{
+			const Vec3 extent = centroidBbox.pMax - centroidBbox.pMin;
+			for (int axis = 0;axis < 3;axis++)
+			{
+				mScale[axis] = (extent[axis] > 0.0f) ? static_cast<Float>(numBins) / extent[axis] : 0.0f;
+			}
+		}
+
+		inline size_t operator()(const Vec3 & centroid, const int axis) const
+		{
+			const int bin = static_cast<int>((centroid[axis] - mMin[axis]) * mScale[axis]);
+			return static_cast<size_t>(Math::Clamp(bin, 0, static_cast<int>(mNumBins) - 1));
+		}
+
+		Vec3	mMin;
+		Vec3	mScale;
+		size_t	mNumBins;
+	};
+
+	// splits [0, n) into chunks for the parallel passes over the top levels
+	inline size_t NumChunks(const size_t n)
+	{
+		const size_t minChunkSize = 4096;
+		return std::max<size_t>(1, std::min(ThreadPool::Instance().numThreads() * 4, n / minChunkSize));
+	}
+}
+
+BinnedBvhAccel::BinnedBvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes):
+	BinnedBvhAccel(meshes, BuildSetting())
+{
+}
+
+BinnedBvhAccel::BinnedBvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes, const BuildSetting & setting):
+	mSetting(setting)
+{
+	assert(mSetting.mNumBins >= 2 && mSetting.mNumBins <= MaxNumBins);
+
+	StopWatch sw;
+	sw.reset();
+	ThreadPool & pool = ThreadPool::Instance();
+
+	for (const shared_ptr<TriangleMesh> & mesh : meshes)
+	{
+		for (const Triangle & triangle : mesh->mTriangles) { mTriangles.push_back(&triangle); }
+	}
+
+	// degenerated triangles can't be hit (same as meshBound)
+	mRefs.resize(mTriangles.size());
+	pool.parallelFor(0, mTriangles.size(), [&](const size_t i)
+	{
+		const Triangle & triangle = *mTriangles[i];
+		const std::vector<glm::vec3> & vertices = triangle.mTriMeshPtr->mVertices;
+		const bool isDegenerated = !(Triangle::ComputeArea(vertices[triangle.mVertexIndices[0]], vertices[triangle.mVertexIndices[1]], vertices[triangle.mVertexIndices[2]]) > 0.0f);
+		mRefs[i].mBbox = triangle.computeBbox();
+		mRefs[i].mTriIndex = isDegenerated ? InvalidTriangle : static_cast<uint32_t>(i);
+	}, 4096);
+	mRefs.erase(std::remove_if(mRefs.begin(), mRefs.end(), [](const Reference & ref) { return ref.mTriIndex == InvalidTriangle; }), mRefs.end());
+
+	const size_t numChunks = NumChunks(mRefs.size());
+	const size_t chunkSize = (mRefs.size() + numChunks - 1) / numChunks;
+	std::vector<Aabb> chunkBboxes(numChunks);
+	pool.parallelFor(0, numChunks, [&](const size_t chunk)
+	{
+		const size_t end = std::min(mRefs.size(), (chunk + 1) * chunkSize);
+		for (size_t i = chunk * chunkSize;i < end;i++) { chunkBboxes[chunk] = Aabb::Union(chunkBboxes[chunk], mRefs[i].mBbox); }
+	});
+	Aabb bbox;
+	for (const Aabb & chunkBbox : chunkBboxes) { bbox = Aabb::Union(bbox, chunkBbox); }
+
+	mStats.mNumTriangles = mTriangles.size();
+	if (mRefs.empty())
+	{
+		std::vector<Node> nodes;
+		createLeaf(&nodes, { 0, 0, bbox, 0 });
+		mNodes = MappedArray<Node>(std::move(nodes));
+	}
+	else
+	{
+		mTempRefs.resize(mRefs.size());
+		buildTop({ 0, mRefs.size(), bbox, 0 });
+		std::vector<Reference>().swap(mTempRefs);
+
+		// largest first so the last tasks are short
+		std::vector<size_t> order(mSubtreeRanges.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b)
+		{
+			return mSubtreeRanges[a].mEnd - mSubtreeRanges[a].mBegin > mSubtreeRanges[b].mEnd - mSubtreeRanges[b].mBegin;
+		});
+
+		mSubtreeNodes.resize(mSubtreeRanges.size());
+		pool.parallelFor(0, order.size(), [&](const size_t i)
+		{
+			const Range & range = mSubtreeRanges[order[i]];
+			mSubtreeNodes[order[i]].reserve((range.mEnd - range.mBegin) * 2 / mSetting.mMaxLeafSize + 1);
+			buildSubtree(&mSubtreeNodes[order[i]], range);
+		});
+
+		size_t numNodes = 0;
+		for (const std::vector<Node> & nodes : mSubtreeNodes) { numNodes += nodes.size(); }
+		mNodes.reserve(mTopNodes.size() + numNodes);
+		flatten(0);
+
+		std::vector<TopNode>().swap(mTopNodes);
+		std::vector<Range>().swap(mSubtreeRanges);
+		std::vector<std::vector<Node>>().swap(mSubtreeNodes);
+	}
+
+	// leaves refer to ranges of mRefs, which is in leaf order now
+	mReferences.resize(mRefs.size());
+	for (size_t i = 0;i < mRefs.size();i++) { mReferences[i] = mRefs[i].mTriIndex; }
+	std::vector<Reference>().swap(mRefs);
+
+	mStats.mNumReferences = mReferences.size();
+	mStats.mNumNodes = mNodes.size();
+	for (const Node & node : mNodes) { mStats.mNumLeaves += (node.mNumRefs > 0) ? 1 : 0; }
+	mStats.mSahCost = computeSahCost(mSetting.mTraversalCost, mSetting.mIntersectCost);
+	mStats.mBuildTimeMs = sw.timeMilliSec();
+
+	std::cout << "binned bvh : " << mStats.mNumTriangles << " triangles, " << mStats.mNumNodes << " nodes, sah " << mStats.mSahCost << ", "
+		<< mStats.mBuildTimeMs << "ms on " << pool.numThreads() << " threads" << std::endl;
+}
+
+// one node at a time, each pass over the references is spread over the pool. the stable partition keeps the
+// result independent of the number of threads
+int BinnedBvhAccel::buildTop(const Range & range)
+{
+	const size_t n = range.mEnd - range.mBegin;
+	if (n <= mSetting.mMinParallelRefs || range.mDepth + 1 >= mSetting.mMaxDepth)
+	{
+		TopNode subtree;
+		subtree.mBbox = range.mBbox;
+		subtree.mSubtree = static_cast<int>(mSubtreeRanges.size());
+		mSubtreeRanges.push_back(range);
+		mTopNodes.push_back(subtree);
+		return static_cast<int>(mTopNodes.size() - 1);
+	}
+
+	ThreadPool & pool = ThreadPool::Instance();
+	Reference * refs = mRefs.data() + range.mBegin;
+	const size_t numChunks = NumChunks(n);
+	const size_t chunkSize = (n + numChunks - 1) / numChunks;
+
+	std::vector<Aabb> chunkCentroidBboxes(numChunks);
+	pool.parallelFor(0, numChunks, [&](const size_t chunk)
+	{
+		const size_t end = std::min(n, (chunk + 1) * chunkSize);
+		for (size_t i = chunk * chunkSize;i < end;i++) { chunkCentroidBboxes[chunk] = Aabb::Union(chunkCentroidBboxes[chunk], Centroid(refs[i].mBbox)); }
+	});
+	Aabb centroidBbox;
+	for (const Aabb & chunkBbox : chunkCentroidBboxes) { centroidBbox = Aabb::Union(centroidBbox, chunkBbox); }
+
+	std::vector<Bins> chunkBins(numChunks);
+	pool.parallelFor(0, numChunks, [&](const size_t chunk)
+	{
+		const size_t begin = chunk * chunkSize;
+		binReferences(&chunkBins[chunk], refs + begin, std::min(n, begin + chunkSize) - begin, centroidBbox);
+	});
+	Bins bins = chunkBins[0];
+	for (size_t chunk = 1;chunk < numChunks;chunk++)
+	{
+		for (int axis = 0;axis < 3;axis++)
+		{
+			for (size_t i = 0;i < mSetting.mNumBins;i++)
+			{
+				bins.mBboxes[axis][i] = Aabb::Union(bins.mBboxes[axis][i], chunkBins[chunk].mBboxes[axis][i]);
+				bins.mCounts[axis][i] += chunkBins[chunk].mCounts[axis][i];
+			}
+		}
+	}
+
+	const Split split = findSplit(bins, centroidBbox, SafeArea(range.mBbox));
+	size_t mid;
+	Aabb leftBbox, rightBbox;
+	int axis;
+	if (split.mAxis < 0)
+	{
+		mid = splitMedian(range, &leftBbox, &rightBbox, &axis);
+	}
+	else
+	{
+		axis = split.mAxis;
+		leftBbox = split.mLeftBbox;
+		rightBbox = split.mRightBbox;
+
+		// count, scatter to mTempRefs and copy back
+		const BinMapping mapping(centroidBbox, mSetting.mNumBins);
+		std::vector<size_t> numLefts(numChunks, 0);
+		pool.parallelFor(0, numChunks, [&](const size_t chunk)
+		{
+			const size_t end = std::min(n, (chunk + 1) * chunkSize);
+			for (size_t i = chunk * chunkSize;i < end;i++) { numLefts[chunk] += (mapping(Centroid(refs[i].mBbox), axis) < split.mBin) ? 1 : 0; }
+		});
+
+		const size_t numLeft = std::accumulate(numLefts.begin(), numLefts.end(), size_t(0));
+		std::vector<size_t> leftOffsets(numChunks), rightOffsets(numChunks);
+		for (size_t chunk = 0, left = 0, right = numLeft;chunk < numChunks;chunk++)
+		{
+			const size_t chunkEnd = std::min(n, (chunk + 1) * chunkSize);
+			leftOffsets[chunk] = left;
+			rightOffsets[chunk] = right;
+			left += numLefts[chunk];
+			right += chunkEnd - chunk * chunkSize - numLefts[chunk];
+		}
+
+		Reference * tempRefs = mTempRefs.data() + range.mBegin;
+		pool.parallelFor(0, numChunks, [&](const size_t chunk)
+		{
+			size_t left = leftOffsets[chunk];
+			size_t right = rightOffsets[chunk];
+			const size_t end = std::min(n, (chunk + 1) * chunkSize);
+			for (size_t i = chunk * chunkSize;i < end;i++)
+			{
+				const bool isLeft = mapping(Centroid(refs[i].mBbox), axis) < split.mBin;
+				tempRefs[isLeft ? left++ : right++] = refs[i];
+			}
+		});
+		pool.parallelFor(0, numChunks, [&](const size_t chunk)
+		{
+			const size_t end = std::min(n, (chunk + 1) * chunkSize);
+			std::copy(tempRefs + chunk * chunkSize, tempRefs + end, refs + chunk * chunkSize);
+		});
+		mid = range.mBegin + numLeft;
+	}
+
+	TopNode node;
+	node.mBbox = range.mBbox;
+	node.mAxis = static_cast<uint8_t>(axis);
+	mTopNodes.push_back(node);
+	const int nodeIndex = static_cast<int>(mTopNodes.size() - 1);
+
+	const int leftIndex = buildTop({ range.mBegin, mid, leftBbox, range.mDepth + 1 });
+	const int rightIndex = buildTop({ mid, range.mEnd, rightBbox, range.mDepth + 1 });
+	mTopNodes[nodeIndex].mChildren[0] = leftIndex;
+	mTopNodes[nodeIndex].mChildren[1] = rightIndex;
+	return nodeIndex;
+}
+
+// depth first into nodes, the offsets of interior nodes are relative to nodes
+uint32_t BinnedBvhAccel::buildSubtree(std::vector<Node> * nodesPtr, const Range & range)
+{
+	const size_t n = range.mEnd - range.mBegin;
+	if (n <= 1 || range.mDepth + 1 >= mSetting.mMaxDepth)
+	{
+		return createLeaf(nodesPtr, range);
+	}
+
+	Reference * refs = mRefs.data() + range.mBegin;
+	Aabb centroidBbox;
+	for (size_t i = 0;i < n;i++) { centroidBbox = Aabb::Union(centroidBbox, Centroid(refs[i].mBbox)); }
+
+	Bins bins;
+	binReferences(&bins, refs, n, centroidBbox);
+	const Split split = findSplit(bins, centroidBbox, SafeArea(range.mBbox));
+
+	const Float leafCost = mSetting.mIntersectCost * n;
+	if (n <= mSetting.mMaxLeafSize && leafCost <= split.mCost)
+	{
+		return createLeaf(nodesPtr, range);
+	}
+
+	size_t mid;
+	Aabb leftBbox, rightBbox;
+	int axis;
+	if (split.mAxis < 0)
+	{
+		// all centroids in one bin
+		mid = splitMedian(range, &leftBbox, &rightBbox, &axis);
+	}
+	else
+	{
+		const BinMapping mapping(centroidBbox, mSetting.mNumBins);
+		axis = split.mAxis;
+		leftBbox = split.mLeftBbox;
+		rightBbox = split.mRightBbox;
+		mid = std::partition(refs, refs + n, [&](const Reference & ref) { return mapping(Centroid(ref.mBbox), axis) < split.mBin; }) - mRefs.data();
+	}
+
+	Node node;
+	node.mBbox = range.mBbox;
+	node.mOffset = 0;
+	node.mNumRefs = 0;
+	node.mAxis = static_cast<uint8_t>(axis);
+	node.mPad = 0;
+	nodesPtr->push_back(node);
+	const uint32_t nodeIndex = static_cast<uint32_t>(nodesPtr->size() - 1);
+
+	buildSubtree(nodesPtr, { range.mBegin, mid, leftBbox, range.mDepth + 1 });
+	const uint32_t rightIndex = buildSubtree(nodesPtr, { mid, range.mEnd, rightBbox, range.mDepth + 1 });
+	(*nodesPtr)[nodeIndex].mOffset = rightIndex;
+	return nodeIndex;
+}
+
+void BinnedBvhAccel::flatten(const int topIndex)
+{
+	const TopNode topNode = mTopNodes[topIndex];
+	if (topNode.mSubtree >= 0)
+	{
+		const uint32_t base = static_cast<uint32_t>(mNodes.size());
+		for (Node node : mSubtreeNodes[topNode.mSubtree])
+		{
+			if (node.mNumRefs == 0) { node.mOffset += base; }
+			mNodes.push_back(node);
+		}
+		std::vector<Node>().swap(mSubtreeNodes[topNode.mSubtree]);
+		return;
+	}
+
+	Node node;
+	node.mBbox = topNode.mBbox;
+	node.mOffset = 0;
+	node.mNumRefs = 0;
+	node.mAxis = topNode.mAxis;
+	node.mPad = 0;
+	mNodes.push_back(node);
+	const size_t nodeIndex = mNodes.size() - 1;
+
+	flatten(topNode.mChildren[0]);
+	mNodes[nodeIndex].mOffset = static_cast<uint32_t>(mNodes.size());
+	flatten(topNode.mChildren[1]);
+}
+
+BinnedBvhAccel::Split BinnedBvhAccel::findSplit(const Bins & bins, const Aabb & centroidBbox, const Float nodeArea) const
+{
+	Split result;
+	const size_t numBins = mSetting.mNumBins;
+	const Float invNodeArea = (nodeArea > 0.0f) ? 1.0f / nodeArea : 0.0f;
+	for (int axis = 0;axis < 3;axis++)
+	{
+		if (!(centroidBbox.pMax[axis] > centroidBbox.pMin[axis])) { continue; }
+
+		Aabb rightBboxes[MaxNumBins];
+		size_t rightCounts[MaxNumBins];
+		Aabb rightBbox;
+		size_t rightCount = 0;
+		for (size_t i = numBins - 1;i > 0;i--)
+		{
+			rightBbox = Aabb::Union(rightBbox, bins.mBboxes[axis][i]);
+			rightCount += bins.mCounts[axis][i];
+			rightBboxes[i] = rightBbox;
+			rightCounts[i] = rightCount;
+		}
+
+		Aabb leftBbox;
+		size_t leftCount = 0;
+		for (size_t i = 1;i < numBins;i++)
+		{
+			leftBbox = Aabb::Union(leftBbox, bins.mBboxes[axis][i - 1]);
+			leftCount += bins.mCounts[axis][i - 1];
+			if (leftCount == 0 || rightCounts[i] == 0) { continue; }
+
+			const Float cost = mSetting.mTraversalCost + mSetting.mIntersectCost * (SafeArea(leftBbox) * leftCount + SafeArea(rightBboxes[i]) * rightCounts[i]) * invNodeArea;
+			if (cost < result.mCost)
+			{
+				result.mCost = cost;
+				result.mAxis = axis;
+				result.mBin = i;
+				result.mLeftBbox = leftBbox;
+				result.mRightBbox = rightBboxes[i];
+			}
+		}
+	}
+	return result;
+}
+
+void BinnedBvhAccel::binReferences(Bins * binsPtr, const Reference * refs, const size_t numRefs, const Aabb & centroidBbox) const
+{
+	Bins & bins = *binsPtr;
+	const BinMapping mapping(centroidBbox, mSetting.mNumBins);
+	for (size_t i = 0;i < numRefs;i++)
+	{
+		const Vec3 centroid = Centroid(refs[i].mBbox);
+		for (int axis = 0;axis < 3;axis++)
+		{
+			const size_t bin = mapping(centroid, axis);
+			bins.mBboxes[axis][bin] = Aabb::Union(bins.mBboxes[axis][bin], refs[i].mBbox);
+			bins.mCounts[axis][bin]++;
+		}
+	}
+}
+
+// half of the references by centroid along the largest axis of the node
+size_t BinnedBvhAccel::splitMedian(const Range & range, Aabb * leftBboxPtr, Aabb * rightBboxPtr, int * axisPtr)
+{
+	const int axis = static_cast<int>(range.mBbox.maxExtent());
+	const size_t mid = range.mBegin + (range.mEnd - range.mBegin) / 2;
+	std::nth_element(mRefs.begin() + range.mBegin, mRefs.begin() + mid, mRefs.begin() + range.mEnd, [axis](const Reference & a, const Reference & b)
+	{
+		const Float ca = a.mBbox.pMin[axis] + a.mBbox.pMax[axis];
+		const Float cb = b.mBbox.pMin[axis] + b.mBbox.pMax[axis];
+		return (ca < cb) || (ca == cb && a.mTriIndex < b.mTriIndex);
+	});
+
+	*leftBboxPtr = Aabb();
+	*rightBboxPtr = Aabb();
+	for (size_t i = range.mBegin;i < mid;i++) { *leftBboxPtr = Aabb::Union(*leftBboxPtr, mRefs[i].mBbox); }
+	for (size_t i = mid;i < range.mEnd;i++) { *rightBboxPtr = Aabb::Union(*rightBboxPtr, mRefs[i].mBbox); }
+	*axisPtr = axis;
+	return mid;
+}
+
+uint32_t BinnedBvhAccel::createLeaf(std::vector<Node> * nodesPtr, const Range & range) const
+{
+	assert(range.mEnd - range.mBegin <= std::numeric_limits<uint16_t>::max());
+
+	Node node;
+	node.mBbox = range.mBbox;
+	node.mOffset = static_cast<uint32_t>(range.mBegin);
+	node.mNumRefs = static_cast<uint16_t>(range.mEnd - range.mBegin);
+	node.mAxis = 0;
+	node.mPad = 0;
+	nodesPtr->push_back(node);
+	return static_cast<uint32_t>(nodesPtr->size() - 1);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+
+#include "common/reflectcuts.h"
+#include "accel/bvh.h"
+#include "common/util.h"
+
+// binned sah bvh (wald 2007, on fast construction of sah-based bounding volume hierarchies) built on all cores.
+// the top levels are split one node at a time with the binning and the partitioning spread over the thread pool.
+// once a range is small enough it becomes a subtree task, built by one thread with the same splits. the subtrees are
+// stitched into the depth first layout of BvhAccel at the end. the result doesn't depend on the number of threads.
+class BinnedBvhAccel : public BvhAccel
+{
+public:
+	static const size_t MaxNumBins = 32;
+
+	struct BuildSetting
+	{
+		size_t	mMaxLeafSize = 4;
+		size_t	mNumBins = 16;					// per axis, up to MaxNumBins
+		Float	mTraversalCost = 1.0f;
+		Float	mIntersectCost = 1.0f;
+		size_t	mMaxDepth = 64;					// traversal stack size
+		size_t	mMinParallelRefs = 1 << 16;		// smaller ranges are built as subtree tasks
+
+		// part of the key of a saved bvh
+		uint64_t hash(uint64_t hash) const
+		{
+			const uint64_t sizes[] = { mMaxLeafSize, mNumBins, mMaxDepth, mMinParallelRefs };
+			const Float costs[] = { mTraversalCost, mIntersectCost };
+			hash = Util::HashFnv1a(sizes, sizeof(sizes), hash);
+			return Util::HashFnv1a(costs, sizeof(costs), hash);
+		}
+	};
+
+	BinnedBvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes);
+	BinnedBvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes, const BuildSetting & setting);
+
+	BuildSetting					mSetting;
+
+private:
+	struct Reference
+	{
+		Aabb		mBbox;
+		uint32_t	mTriIndex;
+	};
+
+	struct Bins
+	{
+		Aabb		mBboxes[3][MaxNumBins];
+		uint32_t	mCounts[3][MaxNumBins] = {};
+	};
+
+	struct Split
+	{
+		Float	mCost = std::numeric_limits<Float>::infinity();
+		int		mAxis = -1;
+		size_t	mBin = 0;						// references in bins [0, mBin) go left
+		Aabb	mLeftBbox;
+		Aabb	mRightBbox;
+	};
+
+	// a range of mRefs that still has to be built, either a top level node or a subtree task
+	struct Range
+	{
+		size_t	mBegin;
+		size_t	mEnd;
+		Aabb	mBbox;
+		size_t	mDepth;
+	};
+
+	// top levels before they are stitched. mSubtree >= 0 refers to mSubtreeNodes
+	struct TopNode
+	{
+		Aabb	mBbox;
+		uint8_t	mAxis = 0;
+		int		mChildren[2] = { -1, -1 };
+		int		mSubtree = -1;
+	};
+
+	int buildTop(const Range & range);
+	uint32_t buildSubtree(std::vector<Node> * nodesPtr, const Range & range);
+	void flatten(const int topIndex);
+
+	Split findSplit(const Bins & bins, const Aabb & centroidBbox, const Float nodeArea) const;
+	void binReferences(Bins * binsPtr, const Reference * refs, const size_t numRefs, const Aabb & centroidBbox) const;
+	size_t splitMedian(const Range & range, Aabb * leftBboxPtr, Aabb * rightBboxPtr, int * axisPtr);
+	uint32_t createLeaf(std::vector<Node> * nodesPtr, const Range & range) const;
+
+	std::vector<Reference>			mRefs;
+	std::vector<Reference>			mTempRefs;		// scatter target of the parallel partition
+	std::vector<TopNode>			mTopNodes;
+	std::vector<Range>				mSubtreeRanges;
+	std::vector<std::vector<Node>>	mSubtreeNodes;	// child offsets relative to the subtree
+};
@@ -0,0 +1,545 @@
+#include "accel/bvh.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "common/threadpool.h"
+#include "common/util.h"
+#include "math/simd.h"
+
+namespace
+{
+	struct BvhFileHeader
+	{
+		char		mMagic[8];
+		uint32_t	mVersion;
+		uint32_t	mNodeSize;			// changes with Float
+		uint64_t	mKey;
+		uint64_t	mNumTriangles;
+		uint64_t	mNumNodes;
+		uint64_t	mNumReferences;
+		uint64_t	mNodesOffset;
+		uint64_t	mReferencesOffset;
+		uint64_t	mFileSize;
+
+		// BvhAccel::BuildStats of the build that wrote the file
+		uint64_t	mNumLeaves;
+		uint64_t	mNumSpatialSplits;
+		double		mSahCost;
+		int64_t		mBuildTimeMs;
+	};
+
+	inline bool IntersectBbox(const Aabb & bbox, const Ray & ray, const Vec3 & invDir)
+	{
+		Float t0 = ray.tmin;
+		Float t1 = ray.tmax;
+		for (int i = 0;i < 3;i++)
+		{
+			Float tNear = (bbox.pMin[i] - ray.origin[i]) * invDir[i];
+			Float tFar = (bbox.pMax[i] - ray.origin[i]) * invDir[i];
+			if (tNear > tFar) { std::swap(tNear, tFar); }
+			tFar *= Math::RobustFarScale;
+			t0 = std::max(t0, tNear);
+			t1 = std::min(t1, tFar);
+			if (t0 > t1) { return false; }
+		}
+		return true;
+	}
+
+	const size_t PacketSize = BvhAccel::PacketSize;
+	static_assert(PacketSize % Simd::Width == 0, "packets are tested Simd::Width rays at a time");
+
+	// structure of arrays copy of a packet. the lanes past the last ray are never active
+	struct RayPacket
+	{
+		RayPacket(const Ray * rays, const size_t numRays)
+		{
+			for (size_t i = 0;i < PacketSize;i++)
+			{
+				const Ray & ray = rays[std::min(i, numRays - 1)];
+				const Vec3 invDir = Vec3(1.0f) / ray.direction;
+				mOrgX[i] = ray.origin.x;
+				mOrgY[i] = ray.origin.y;
+				mOrgZ[i] = ray.origin.z;
+				mInvDirX[i] = invDir.x;
+				mInvDirY[i] = invDir.y;
+				mInvDirZ[i] = invDir.z;
+				mTMin[i] = ray.tmin;
+				mTMax[i] = ray.tmax;
+			}
+
+			// all rays share the direction signs (IsCoherent)
+			const Vec3 & dir = rays[0].direction;
+			mDirIsNeg[0] = dir.x < 0.0f;
+			mDirIsNeg[1] = dir.y < 0.0f;
+			mDirIsNeg[2] = dir.z < 0.0f;
+		}
+
+		// bit i is set if ray i is active in mask and hits the box
+		inline uint32_t intersect(const Aabb & bbox, const uint32_t mask) const
+		{
+			const Simd::Vfloat minX(bbox.pMin.x), minY(bbox.pMin.y), minZ(bbox.pMin.z);
+			const Simd::Vfloat maxX(bbox.pMax.x), maxY(bbox.pMax.y), maxZ(bbox.pMax.z);
+			const Simd::Vfloat farScale(Math::RobustFarScale);
+			const uint32_t laneMask = (1u << Simd::Width) - 1;
+
+			uint32_t result = 0;
+			for (size_t i = 0;i < PacketSize;i += Simd::Width)
+			{
+				if (((mask >> i) & laneMask) == 0) { continue; }
+
+				const Simd::Vfloat orgX = Simd::Vfloat::Load(mOrgX + i), orgY = Simd::Vfloat::Load(mOrgY + i), orgZ = Simd::Vfloat::Load(mOrgZ + i);
+				const Simd::Vfloat invDirX = Simd::Vfloat::Load(mInvDirX + i), invDirY = Simd::Vfloat::Load(mInvDirY + i), invDirZ = Simd::Vfloat::Load(mInvDirZ + i);
+				const Simd::Vfloat t0X = (minX - orgX) * invDirX, t1X = (maxX - orgX) * invDirX;
+				const Simd::Vfloat t0Y = (minY - orgY) * invDirY, t1Y = (maxY - orgY) * invDirY;
+				const Simd::Vfloat t0Z = (minZ - orgZ) * invDirZ, t1Z = (maxZ - orgZ) * invDirZ;
+
+				const Simd::Vfloat tNear = Simd::Max(Simd::Max(Simd::Min(t0X, t1X), Simd::Min(t0Y, t1Y)), Simd::Max(Simd::Min(t0Z, t1Z), Simd::Vfloat::Load(mTMin + i)));
+				const Simd::Vfloat tFar = Simd::Min(Simd::Min(Simd::Max(t0X, t1X), Simd::Max(t0Y, t1Y)) * farScale, Simd::Min(Simd::Max(t0Z, t1Z) * farScale, Simd::Vfloat::Load(mTMax + i)));
+				result |= static_cast<uint32_t>(Simd::LessEqual(tNear, tFar)) << i;
+			}
+			return result & mask;
+		}
+
+		alignas(32) float	mOrgX[PacketSize], mOrgY[PacketSize], mOrgZ[PacketSize];
+		alignas(32) float	mInvDirX[PacketSize], mInvDirY[PacketSize], mInvDirZ[PacketSize];
+		alignas(32) float	mTMin[PacketSize], mTMax[PacketSize];
+		bool				mDirIsNeg[3];
+	};
+
+	struct PacketStackEntry
+	{
+		uint32_t	mNode;
+		uint32_t	mMask;
+	};
+
+	inline size_t CountRays(const uint32_t mask)
+	{
+		return std::bitset<PacketSize>(mask).count();
+	}
+
+	inline int DirectionOctant(const Vec3 & dir)
+	{
+		return (dir.x < 0.0f ? 1 : 0) | (dir.y < 0.0f ? 2 : 0) | (dir.z < 0.0f ? 4 : 0);
+	}
+
+	// rays heading into different octants split up right below the root, a packet would only add overhead
+	inline bool IsCoherent(const Ray * rays, const size_t numRays)
+	{
+		const int octant = DirectionOctant(rays[0].direction);
+		for (size_t i = 1;i < numRays;i++)
+		{
+			if (DirectionOctant(rays[i].direction) != octant) { return false; }
+		}
+		return true;
+	}
+
+	inline uint32_t FirstRaysMask(const size_t numRays)
+	{
+		return (numRays == PacketSize) ? 0xffffffff : ((1u << numRays) - 1);
+	}
+}
+
+bool BvhAccel::intersect(Intersection * isectPtr, const Ray & r) const
+{
+	Ray ray = r;
+	const bool isHit = intersectSubtree(isectPtr, &ray, 0);
+	if (isHit) { isectPtr->mTrianglePtr->fillIntersection(isectPtr, r); }
+	return isHit;
+}
+
+bool BvhAccel::intersectP(const Ray & ray) const
+{
+	return intersectPSubtree(ray, 0);
+}
+
+bool BvhAccel::intersectSubtree(Intersection * isectPtr, Ray * rayPtr, const uint32_t root) const
+{
+	// mapped arrays check whether they are views on every access
+	const Node * nodes = mNodes.data();
+	const uint32_t * references = mReferences.data();
+	Ray & ray = *rayPtr;
+	const WatertightRay wr(ray);
+	const Vec3 invDir = Vec3(1.0f) / ray.direction;
+	const bool dirIsNeg[3] = { invDir.x < 0.0f, invDir.y < 0.0f, invDir.z < 0.0f };
+
+	bool isHit = false;
+	uint32_t stack[64];
+	size_t stackSize = 0;
+	uint32_t current = root;
+	while (true)
+	{
+		const Node & node = nodes[current];
+		if (IntersectBbox(node.mBbox, ray, invDir))
+		{
+			if (node.mNumRefs > 0)
+			{
+				for (uint32_t i = 0;i < node.mNumRefs;i++)
+				{
+					if (mTriangles[references[node.mOffset + i]]->Triangle::intersect(isectPtr, ray, wr))
+					{
+						isHit = true;
+						ray.tmax = isectPtr->mT;
+					}
+				}
+				if (stackSize == 0) { break; }
+				current = stack[--stackSize];
+			}
+			else if (dirIsNeg[node.mAxis])
+			{
+				stack[stackSize++] = current + 1;
+				current = node.mOffset;
+			}
+			else
+			{
+				stack[stackSize++] = node.mOffset;
+				current = current + 1;
+			}
+		}
+		else
+		{
+			if (stackSize == 0) { break; }
+			current = stack[--stackSize];
+		}
+	}
+
+	return isHit;
+}
+
+bool BvhAccel::intersectPSubtree(const Ray & ray, const uint32_t root) const
+{
+	const Node * nodes = mNodes.data();
+	const uint32_t * references = mReferences.data();
+	const WatertightRay wr(ray);
+	const Vec3 invDir = Vec3(1.0f) / ray.direction;
+	const bool dirIsNeg[3] = { invDir.x < 0.0f, invDir.y < 0.0f, invDir.z < 0.0f };
+
+	uint32_t stack[64];
+	size_t stackSize = 0;
+	uint32_t current = root;
+	while (true)
+	{
+		const Node & node = nodes[current];
+		if (IntersectBbox(node.mBbox, ray, invDir))
+		{
+			if (node.mNumRefs > 0)
+			{
+				for (uint32_t i = 0;i < node.mNumRefs;i++)
+				{
+					if (mTriangles[references[node.mOffset + i]]->Triangle::intersectP(ray, wr)) { return true; }
+				}
+				if (stackSize == 0) { break; }
+				current = stack[--stackSize];
+			}
+			else if (dirIsNeg[node.mAxis])
+			{
+				stack[stackSize++] = current + 1;
+				current = node.mOffset;
+			}
+			else
+			{
+				stack[stackSize++] = node.mOffset;
+				current = current + 1;
+			}
+		}
+		else
+		{
+			if (stackSize == 0) { break; }
+			current = stack[--stackSize];
+		}
+	}
+	return false;
+}
+
+void BvhAccel::traceClosest(Span<const Ray> rays, Span<Intersection> isects) const
+{
+	assert(rays.size() == isects.size());
+	for (size_t i = 0;i < rays.size();i += PacketSize)
+	{
+		traceClosestPacket(&rays[i], &isects[i], std::min(PacketSize, rays.size() - i));
+	}
+}
+
+void BvhAccel::traceOcclusion(Span<const Ray> rays, Span<bool> isOccluded) const
+{
+	assert(rays.size() == isOccluded.size());
+	for (size_t i = 0;i < rays.size();i += PacketSize)
+	{
+		traceOcclusionPacket(&rays[i], &isOccluded[i], std::min(PacketSize, rays.size() - i));
+	}
+}
+
+void BvhAccel::traceClosestPacket(const Ray * rays, Intersection * isects, const size_t numRays) const
+{
+	const Node * nodes = mNodes.data();
+	const uint32_t * references = mReferences.data();
+	for (size_t i = 0;i < numRays;i++) { isects[i] = Intersection(); }
+	if (!IsCoherent(rays, numRays))
+	{
+		for (size_t i = 0;i < numRays;i++) { intersect(&isects[i], rays[i]); }
+		return;
+	}
+
+	RayPacket packet(rays, numRays);
+
+	PacketStackEntry stack[64];
+	size_t stackSize = 0;
+	PacketStackEntry current = { 0, FirstRaysMask(numRays) };
+	while (true)
+	{
+		const Node & node = nodes[current.mNode];
+		const uint32_t mask = packet.intersect(node.mBbox, current.mMask);
+		if (mask != 0 && CountRays(mask) <= SingleRayThreshold)
+		{
+			for (size_t i = 0;i < numRays;i++)
+			{
+				if ((mask & (1u << i)) == 0) { continue; }
+				Ray ray = rays[i];
+				ray.tmax = packet.mTMax[i];
+				intersectSubtree(&isects[i], &ray, current.mNode);
+				packet.mTMax[i] = ray.tmax;
+			}
+		}
+		else if (mask != 0 && node.mNumRefs > 0)
+		{
+			for (size_t i = 0;i < numRays;i++)
+			{
+				if ((mask & (1u << i)) == 0) { continue; }
+				Ray ray = rays[i];
+				ray.tmax = packet.mTMax[i];
+				const WatertightRay wr(ray);
+				for (uint32_t j = 0;j < node.mNumRefs;j++)
+				{
+					if (mTriangles[references[node.mOffset + j]]->Triangle::intersect(&isects[i], ray, wr)) { ray.tmax = isects[i].mT; }
+				}
+				packet.mTMax[i] = ray.tmax;
+			}
+		}
+		else if (mask != 0)
+		{
+			const uint32_t nearChild = packet.mDirIsNeg[node.mAxis] ? node.mOffset : current.mNode + 1;
+			const uint32_t farChild = packet.mDirIsNeg[node.mAxis] ? current.mNode + 1 : node.mOffset;
+			stack[stackSize++] = { farChild, mask };
+			current = { nearChild, mask };
+			continue;
+		}
+
+		if (stackSize == 0) { break; }
+		current = stack[--stackSize];
+	}
+
+	for (size_t i = 0;i < numRays;i++)
+	{
+		if (isects[i].mTrianglePtr != nullptr) { isects[i].mTrianglePtr->fillIntersection(&isects[i], rays[i]); }
+	}
+}
+
+void BvhAccel::traceOcclusionPacket(const Ray * rays, bool * isOccluded, const size_t numRays) const
+{
+	const Node * nodes = mNodes.data();
+	const uint32_t * references = mReferences.data();
+	if (!IsCoherent(rays, numRays))
+	{
+		for (size_t i = 0;i < numRays;i++) { isOccluded[i] = intersectP(rays[i]); }
+		return;
+	}
+
+	RayPacket packet(rays, numRays);
+	for (size_t i = 0;i < numRays;i++) { isOccluded[i] = false; }
+
+	// rays leave the packet as soon as they are occluded
+	uint32_t pending = FirstRaysMask(numRays);
+
+	PacketStackEntry stack[64];
+	size_t stackSize = 0;
+	PacketStackEntry current = { 0, pending };
+	while (true)
+	{
+		const Node & node = nodes[current.mNode];
+		const uint32_t mask = packet.intersect(node.mBbox, current.mMask & pending);
+		if (mask != 0 && CountRays(mask) <= SingleRayThreshold)
+		{
+			for (size_t i = 0;i < numRays;i++)
+			{
+				if ((mask & (1u << i)) == 0) { continue; }
+				if (intersectPSubtree(rays[i], current.mNode))
+				{
+					isOccluded[i] = true;
+					pending &= ~(1u << i);
+				}
+			}
+		}
+		else if (mask != 0 && node.mNumRefs > 0)
+		{
+			for (size_t i = 0;i < numRays;i++)
+			{
+				if ((mask & (1u << i)) == 0) { continue; }
+				const WatertightRay wr(rays[i]);
+				for (uint32_t j = 0;j < node.mNumRefs;j++)
+				{
+					if (mTriangles[references[node.mOffset + j]]->Triangle::intersectP(rays[i], wr))
+					{
+						isOccluded[i] = true;
+						pending &= ~(1u << i);
+						break;
+					}
+				}
+			}
+		}
+		else if (mask != 0)
+		{
+			const uint32_t nearChild = packet.mDirIsNeg[node.mAxis] ? node.mOffset : current.mNode + 1;
+			const uint32_t farChild = packet.mDirIsNeg[node.mAxis] ? current.mNode + 1 : node.mOffset;
+			stack[stackSize++] = { farChild, mask };
+			current = { nearChild, mask };
+			continue;
+		}
+
+		if (stackSize == 0 || pending == 0) { break; }
+		current = stack[--stackSize];
+	}
+}
+
+void BvhAccel::refit()
+{
+	mNodes.detach();
+	Node * nodes = mNodes.data();
+	const uint32_t * references = mReferences.data();
+
+	// leaves in parallel. children always come after their parent, so one backward pass does the interior nodes
+	ThreadPool::Instance().parallelFor(0, mNodes.size(), [&](const size_t i)
+	{
+		Node & node = nodes[i];
+		if (node.mNumRefs == 0) { return; }
+		Aabb bbox;
+		for (uint32_t j = 0;j < node.mNumRefs;j++) { bbox = Aabb::Union(bbox, mTriangles[references[node.mOffset + j]]->computeBbox()); }
+		node.mBbox = bbox;
+	}, 4096);
+
+	for (size_t i = mNodes.size();i-- > 0;)
+	{
+		Node & node = nodes[i];
+		if (node.mNumRefs > 0 || mNodes.size() == 1) { continue; }
+		node.mBbox = Aabb::Union(nodes[i + 1].mBbox, nodes[node.mOffset].mBbox);
+	}
+}
+
+Float BvhAccel::computeSahCost(const Float traversalCost, const Float intersectCost) const
+{
+	// empty leaves have inverted boxes
+	auto area = [](const Aabb & a) { return (a.pMin.x <= a.pMax.x && a.pMin.y <= a.pMax.y && a.pMin.z <= a.pMax.z) ? a.surfaceArea() : 0.0f; };
+
+	const Float rootArea = area(mNodes[0].mBbox);
+	Float result = 0.0f;
+	for (const Node & node : mNodes)
+	{
+		const Float cost = (node.mNumRefs > 0) ? intersectCost * node.mNumRefs : traversalCost;
+		result += (rootArea > 0.0f) ? cost * area(node.mBbox) / rootArea : cost;
+	}
+	return result;
+}
+
+uint64_t BvhAccel::HashGeometry(const std::vector<shared_ptr<TriangleMesh>> & meshes, uint64_t hash)
+{
+	std::vector<uint64_t> meshHashes(meshes.size());
+	ThreadPool::Instance().parallelFor(0, meshes.size(), [&](const size_t i)
+	{
+		const TriangleMesh & mesh = *meshes[i];
+		const uint64_t numVertices = mesh.mVertices.size();
+		const uint64_t numTriangles = mesh.mTriangles.size();
+		uint64_t meshHash = Util::HashFnv1a(&numVertices, sizeof(numVertices));
+		meshHash = Util::HashFnv1a(&numTriangles, sizeof(numTriangles), meshHash);
+		meshHash = Util::HashFnv1a(mesh.mVertices.data(), mesh.mVertices.size() * sizeof(glm::vec3), meshHash);
+		for (const Triangle & triangle : mesh.mTriangles) { meshHash = Util::HashFnv1a(triangle.mVertexIndices, sizeof(triangle.mVertexIndices), meshHash); }
+		meshHashes[i] = meshHash;
+	});
+
+	for (const uint64_t meshHash : meshHashes) { hash = Util::HashFnv1a(&meshHash, sizeof(meshHash), hash); }
+	return hash;
+}
+
+shared_ptr<BvhAccel> BvhAccel::Load(const std::string & filepath, const uint64_t key, const std::vector<shared_ptr<TriangleMesh>> & meshes)
+{
+	shared_ptr<MappedFile> file = MappedFile::Open(filepath);
+	if (file == nullptr || file->size() < sizeof(BvhFileHeader)) { return nullptr; }
+
+	size_t numTriangles = 0;
+	for (const shared_ptr<TriangleMesh> & mesh : meshes) { numTriangles += mesh->mTriangles.size(); }
+
+	const BvhFileHeader & header = *reinterpret_cast<const BvhFileHeader*>(file->data());
+	if (std::memcmp(header.mMagic, "RTBVHBIN", 8) != 0 || header.mVersion != FileVersion || header.mNodeSize != sizeof(Node) || header.mKey != key
+		|| header.mFileSize != file->size() || header.mNumTriangles != numTriangles || header.mNumNodes == 0)
+	{
+		return nullptr;
+	}
+
+	auto isInside = [&](uint64_t offset, uint64_t numBytes) { return offset % 4 == 0 && offset <= file->size() && numBytes <= file->size() - offset; };
+	if (!isInside(header.mNodesOffset, header.mNumNodes * sizeof(Node)) || !isInside(header.mReferencesOffset, header.mNumReferences * sizeof(uint32_t)))
+	{
+		return nullptr;
+	}
+
+	shared_ptr<BvhAccel> result = make_shared<BvhAccel>();
+	result->mTriangles.reserve(numTriangles);
+	for (const shared_ptr<TriangleMesh> & mesh : meshes)
+	{
+		for (const Triangle & triangle : mesh->mTriangles) { result->mTriangles.push_back(&triangle); }
+	}
+	result->mNodes = MappedArray<Node>(file, reinterpret_cast<const Node*>(file->data() + header.mNodesOffset), header.mNumNodes);
+	result->mReferences = MappedArray<uint32_t>(file, reinterpret_cast<const uint32_t*>(file->data() + header.mReferencesOffset), header.mNumReferences);
+
+	BuildStats & stats = result->mStats;
+	stats.mNumTriangles = header.mNumTriangles;
+	stats.mNumReferences = header.mNumReferences;
+	stats.mNumNodes = header.mNumNodes;
+	stats.mNumLeaves = header.mNumLeaves;
+	stats.mNumSpatialSplits = header.mNumSpatialSplits;
+	stats.mSahCost = static_cast<Float>(header.mSahCost);
+	stats.mBuildTimeMs = header.mBuildTimeMs;
+	return result;
+}
+
+bool BvhAccel::save(const std::string & filepath, const uint64_t key) const
+{
+	auto alignUp = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+
+	BvhFileHeader header = {};
+	std::memcpy(header.mMagic, "RTBVHBIN", 8);
+	header.mVersion = FileVersion;
+	header.mNodeSize = sizeof(Node);
+	header.mKey = key;
+	header.mNumTriangles = mTriangles.size();
+	header.mNumNodes = mNodes.size();
+	header.mNumReferences = mReferences.size();
+	header.mNodesOffset = alignUp(sizeof(BvhFileHeader));
+	header.mReferencesOffset = alignUp(header.mNodesOffset + mNodes.size() * sizeof(Node));
+	header.mFileSize = header.mReferencesOffset + mReferences.size() * sizeof(uint32_t);
+	header.mNumLeaves = mStats.mNumLeaves;
+	header.mNumSpatialSplits = mStats.mNumSpatialSplits;
+	header.mSahCost = mStats.mSahCost;
+	header.mBuildTimeMs = mStats.mBuildTimeMs;
+
+	const std::string tempFilepath = filepath + ".tmp";
+	std::ofstream ofs(tempFilepath, std::ios::binary | std::ios::trunc);
+	if (!ofs.is_open()) { return false; }
+
+	const char zeros[16] = {};
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	ofs.write(zeros, header.mNodesOffset - sizeof(header));
+	ofs.write(reinterpret_cast<const char*>(mNodes.data()), mNodes.size() * sizeof(Node));
+	ofs.write(zeros, header.mReferencesOffset - header.mNodesOffset - mNodes.size() * sizeof(Node));
+	ofs.write(reinterpret_cast<const char*>(mReferences.data()), mReferences.size() * sizeof(uint32_t));
+	ofs.close();
+	if (!ofs) { std::remove(tempFilepath.c_str()); return false; }
+
+	std::remove(filepath.c_str());
+	return std::rename(tempFilepath.c_str(), filepath.c_str()) == 0;
+}
+
+Aabb BvhAccel::computeBbox() const
+{
+	return mNodes[0].mBbox;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+
+#include "common/reflectcuts.h"
+#include "common/accel.h"
+#include "common/mappedfile.h"
+#include "shapes/trianglemesh.h"
+
+// binary bvh in depth first order with scalar traversal. filled by the builders (SbvhAccel) and the input of the
+// layouts collapsed from it (WideBvhAccel).
+// the batched queries trace PacketSize rays at a time : each node is fetched once per packet and tested against all
+// its active rays with simd, so coherent rays share most of the traversal. once a subtree is entered by only a few
+// rays of a packet they continue with the single ray traversal from there, and packets whose rays don't share the
+// direction signs are traced ray by ray from the start.
+// a built bvh can be saved and loaded again with Load, its nodes and references are then views into the mapped file.
+class BvhAccel : public Accel
+{
+public:
+	static const uint32_t FileVersion = 1;
+
+	static const size_t MaxLeafRefs = 0xffff;		// Node::mNumRefs
+	static const size_t PacketSize = 32;			// one bit per ray in a uint32_t mask
+	static const size_t SingleRayThreshold = 4;
+
+	// the first child of an interior node directly follows it
+	struct Node
+	{
+		Aabb		mBbox;
+		uint32_t	mOffset;		// interior : second child. leaf : first reference in mReferences
+		uint16_t	mNumRefs;		// 0 for interior nodes
+		uint8_t		mAxis;			// split axis of interior nodes, decides the traversal order
+		uint8_t		mPad;
+	};
+
+	// filled by the builders
+	struct BuildStats
+	{
+		size_t		mNumTriangles = 0;
+		size_t		mNumReferences = 0;		// > mNumTriangles where spatial splits duplicated references
+		size_t		mNumNodes = 0;
+		size_t		mNumLeaves = 0;
+		size_t		mNumSpatialSplits = 0;
+		Float		mSahCost = 0.0f;
+		long long	mBuildTimeMs = 0;
+	};
+
+	bool intersect(Intersection * isectPtr, const Ray & ray) const override;
+	bool intersectP(const Ray & ray) const override;
+	Aabb computeBbox() const override;
+
+	// expected cost of a random ray hitting the root, relative to the root surface area
+	Float computeSahCost(const Float traversalCost, const Float intersectCost) const;
+
+	// recomputes the bounds bottom up after the vertices moved, the topology stays. leaves get the full bounds of their
+	// triangles, also where a spatial split had clipped them. a loaded bvh is copied out of its file first
+	void refit();
+
+	// hash of the triangles in the order the builders see them, part of the key of a saved bvh
+	static uint64_t HashGeometry(const std::vector<shared_ptr<TriangleMesh>> & meshes, uint64_t hash);
+
+	// the meshes have to be the ones the bvh was built over. returns nullptr if the file is missing, stale or broken
+	static shared_ptr<BvhAccel> Load(const std::string & filepath, const uint64_t key, const std::vector<shared_ptr<TriangleMesh>> & meshes);
+
+	// written to a temporary file first and renamed, like the scene cache
+	bool save(const std::string & filepath, const uint64_t key) const;
+
+	void traceClosest(Span<const Ray> rays, Span<Intersection> isects) const override;
+	void traceOcclusion(Span<const Ray> rays, Span<bool> isOccluded) const override;
+
+	std::vector<const Triangle *>	mTriangles;
+	MappedArray<uint32_t>			mReferences;	// triangle indices in leaf order, a triangle may be referenced several times
+	MappedArray<Node>				mNodes;
+	BuildStats						mStats;
+
+private:
+	// single ray traversal of the subtree under root. intersect doesn't fill the intersection and shortens ray.tmax
+	bool intersectSubtree(Intersection * isectPtr, Ray * rayPtr, const uint32_t root) const;
+	bool intersectPSubtree(const Ray & ray, const uint32_t root) const;
+
+	void traceClosestPacket(const Ray * rays, Intersection * isects, const size_t numRays) const;
+	void traceOcclusionPacket(const Ray * rays, bool * isOccluded, const size_t numRays) const;
+};
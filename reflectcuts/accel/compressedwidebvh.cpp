@@ -0,0 +1,341 @@
+#include "accel/compressedwidebvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const uint32_t NoBinaryNode = 0xffffffff;
+
+	// 2^exponent without ldexp, exponent in [-126, 127]
+	inline float StepOf(const int8_t exponent)
+	{
+		const uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+		float result;
+		std::memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
+
+	// the smallest step that covers [lo, hi] with 255 steps from lo
+	int8_t ComputeExponent(const float lo, const float hi)
+	{
+		int exponent;
+		std::frexp((hi - lo) / 255.0f, &exponent);
+		exponent = std::max(-126, std::min(127, exponent));
+		while (exponent < 127 && lo + 255.0f * StepOf(static_cast<int8_t>(exponent)) < hi) { exponent++; }
+		return static_cast<int8_t>(exponent);
+	}
+
+	// rounded outwards, checked against the same decoding as the traversal (origin + q * step)
+	void Quantize(uint8_t * qLoPtr, uint8_t * qHiPtr, const float lo, const float hi, const float origin, const float step)
+	{
+		int qLo = std::max(0, std::min(255, static_cast<int>(std::floor((lo - origin) / step))));
+		while (qLo > 0 && origin + static_cast<float>(qLo) * step > lo) { qLo--; }
+		int qHi = std::max(0, std::min(255, static_cast<int>(std::ceil((hi - origin) / step))));
+		while (qHi < 255 && origin + static_cast<float>(qHi) * step < hi) { qHi++; }
+		*qLoPtr = static_cast<uint8_t>(qLo);
+		*qHiPtr = static_cast<uint8_t>(qHi);
+	}
+
+	struct SimdRay
+	{
+		SimdRay(const Ray & ray)
+		{
+			const Vec3 invDir = Vec3(1.0f) / ray.direction;
+			mInvDirX = Simd::Vfloat(invDir.x);
+			mInvDirY = Simd::Vfloat(invDir.y);
+			mInvDirZ = Simd::Vfloat(invDir.z);
+			mOrgX = Simd::Vfloat(ray.origin.x);
+			mOrgY = Simd::Vfloat(ray.origin.y);
+			mOrgZ = Simd::Vfloat(ray.origin.z);
+			mIsNegX = invDir.x < 0.0f;
+			mIsNegY = invDir.y < 0.0f;
+			mIsNegZ = invDir.z < 0.0f;
+			mFarScale = Simd::Vfloat(Math::RobustFarScale);
+		}
+
+		// same as the box test of WideBvhAccel on the decoded planes
+		inline int intersect(const CompressedWideBvhAccel::Node & node, const float tmin, const float tmax, float * tNears) const
+		{
+			const Simd::Vfloat originX(node.mOrigin[0]), originY(node.mOrigin[1]), originZ(node.mOrigin[2]);
+			const Simd::Vfloat stepX(StepOf(node.mExponents[0])), stepY(StepOf(node.mExponents[1])), stepZ(StepOf(node.mExponents[2]));
+
+			const Simd::Vfloat nearX = ((originX + Simd::Vfloat::LoadU8(mIsNegX ? node.mMaxX : node.mMinX) * stepX) - mOrgX) * mInvDirX;
+			const Simd::Vfloat nearY = ((originY + Simd::Vfloat::LoadU8(mIsNegY ? node.mMaxY : node.mMinY) * stepY) - mOrgY) * mInvDirY;
+			const Simd::Vfloat nearZ = ((originZ + Simd::Vfloat::LoadU8(mIsNegZ ? node.mMaxZ : node.mMinZ) * stepZ) - mOrgZ) * mInvDirZ;
+			const Simd::Vfloat farX = ((originX + Simd::Vfloat::LoadU8(mIsNegX ? node.mMinX : node.mMaxX) * stepX) - mOrgX) * mInvDirX;
+			const Simd::Vfloat farY = ((originY + Simd::Vfloat::LoadU8(mIsNegY ? node.mMinY : node.mMaxY) * stepY) - mOrgY) * mInvDirY;
+			const Simd::Vfloat farZ = ((originZ + Simd::Vfloat::LoadU8(mIsNegZ ? node.mMinZ : node.mMaxZ) * stepZ) - mOrgZ) * mInvDirZ;
+
+			const Simd::Vfloat tNear = Simd::Max(nearX, Simd::Max(nearY, Simd::Max(nearZ, Simd::Vfloat(tmin))));
+			const Simd::Vfloat tFar = Simd::Min(farX * mFarScale, Simd::Min(farY * mFarScale, Simd::Min(farZ * mFarScale, Simd::Vfloat(tmax))));
+			tNear.store(tNears);
+			return Simd::LessEqual(tNear, tFar);
+		}
+
+		Simd::Vfloat	mInvDirX, mInvDirY, mInvDirZ;
+		Simd::Vfloat	mOrgX, mOrgY, mOrgZ;
+		Simd::Vfloat	mFarScale;
+		bool			mIsNegX, mIsNegY, mIsNegZ;
+	};
+
+	struct StackEntry
+	{
+		uint32_t	mIndex;
+		uint32_t	mNumBlocks;		// 0 for nodes
+		float		mTNear;
+	};
+
+	// hit children, nearest first if IsSorted. returns the number of entries
+	template <bool IsSorted>
+	inline size_t CollectHits(StackEntry * entries, const CompressedWideBvhAccel::Node & node, int hitMask, const float * tNears)
+	{
+		size_t numHits = 0;
+		for (size_t slot = 0;hitMask != 0;slot++, hitMask >>= 1)
+		{
+			const uint8_t meta = node.mMeta[slot];
+			if (!(hitMask & 1) || meta == CompressedWideBvhAccel::EmptyMeta) { continue; }
+
+			StackEntry entry;
+			if (meta & CompressedWideBvhAccel::InteriorBit) { entry = { node.mChildBase + (meta & 0x7f), 0, tNears[slot] }; }
+			else { entry = { node.mBlockBase + (meta & 0x1f), static_cast<uint32_t>(meta >> 5), tNears[slot] }; }
+
+			size_t i = numHits++;
+			for (;IsSorted && i > 0 && entries[i - 1].mTNear > entry.mTNear;i--) { entries[i] = entries[i - 1]; }
+			entries[i] = entry;
+		}
+		return numHits;
+	}
+}
+
+CompressedWideBvhAccel::CompressedWideBvhAccel(const BvhAccel & bvh):
+	mBbox(bvh.computeBbox())
+{
+	mNodes.reserve(bvh.mNodes.size() / (Width - 1) + 1);
+	mNodes.emplace_back();
+
+	const BvhAccel::Node & root = bvh.mNodes[0];
+	const Child rootChild = createChild(bvh, 0);
+	if (root.mNumRefs > 0 || bvh.mNodes.size() == 1)
+	{
+		// a single leaf, possibly without triangles
+		build(bvh, 0, rootChild.mTriangles.empty() ? std::vector<Child>() : std::vector<Child>(1, rootChild));
+	}
+	else
+	{
+		build(bvh, 0, collapse(bvh, rootChild));
+	}
+}
+
+CompressedWideBvhAccel::Child CompressedWideBvhAccel::createChild(const BvhAccel & bvh, const uint32_t binaryIndex) const
+{
+	const BvhAccel::Node & binaryNode = bvh.mNodes[binaryIndex];
+	Child child;
+	child.mBbox = binaryNode.mBbox;
+	child.mBinaryIndex = (binaryNode.mNumRefs == 0 && bvh.mNodes.size() > 1) ? binaryIndex : NoBinaryNode;
+	for (uint32_t i = 0;i < binaryNode.mNumRefs;i++)
+	{
+		child.mTriangles.push_back(bvh.mTriangles[bvh.mReferences[binaryNode.mOffset + i]]);
+	}
+	return child;
+}
+
+// the children of an interior slot : the largest binary children are opened until the node is full, leaves that don't
+// fit into MaxLeafBlocks are cut into pieces
+std::vector<CompressedWideBvhAccel::Child> CompressedWideBvhAccel::collapse(const BvhAccel & bvh, const Child & child) const
+{
+	std::vector<Child> children;
+	if (child.mBinaryIndex == NoBinaryNode)
+	{
+		const size_t maxLeafSize = MaxLeafBlocks * Width;
+		const size_t numPieces = std::min(static_cast<size_t>(Width), (child.mTriangles.size() + maxLeafSize - 1) / maxLeafSize);
+		const size_t pieceSize = (child.mTriangles.size() + numPieces - 1) / numPieces;
+		for (size_t i = 0;i < child.mTriangles.size();i += pieceSize)
+		{
+			Child piece;
+			piece.mBinaryIndex = NoBinaryNode;
+			piece.mTriangles.assign(child.mTriangles.begin() + i, child.mTriangles.begin() + std::min(i + pieceSize, child.mTriangles.size()));
+			for (const Triangle * triangle : piece.mTriangles) { piece.mBbox = Aabb::Union(piece.mBbox, triangle->computeBbox()); }
+
+			// spatial splits clip the references to the leaf
+			piece.mBbox = Aabb::Intersect(piece.mBbox, child.mBbox);
+			children.push_back(piece);
+		}
+		return children;
+	}
+
+	const BvhAccel::Node & binaryNode = bvh.mNodes[child.mBinaryIndex];
+	children.push_back(createChild(bvh, child.mBinaryIndex + 1));
+	children.push_back(createChild(bvh, binaryNode.mOffset));
+	while (children.size() < Width)
+	{
+		int largest = -1;
+		Float largestArea = -1.0f;
+		for (size_t i = 0;i < children.size();i++)
+		{
+			if (children[i].mBinaryIndex != NoBinaryNode && children[i].mBbox.surfaceArea() > largestArea)
+			{
+				largest = static_cast<int>(i);
+				largestArea = children[i].mBbox.surfaceArea();
+			}
+		}
+		if (largest < 0) { break; }
+
+		const uint32_t index = children[largest].mBinaryIndex;
+		children[largest] = createChild(bvh, index + 1);
+		children.push_back(createChild(bvh, bvh.mNodes[index].mOffset));
+	}
+	return children;
+}
+
+void CompressedWideBvhAccel::build(const BvhAccel & bvh, const uint32_t nodeIndex, const std::vector<Child> & children)
+{
+	assert(children.size() <= Width);
+
+	Aabb bbox;
+	for (const Child & child : children) { bbox = Aabb::Union(bbox, child.mBbox); }
+	if (children.empty()) { bbox = Aabb(Vec3(0.0f)); }
+
+	Node node;
+	for (size_t axis = 0;axis < 3;axis++)
+	{
+		node.mOrigin[axis] = bbox.pMin[axis];
+		node.mExponents[axis] = ComputeExponent(bbox.pMin[axis], bbox.pMax[axis]);
+	}
+	node.mPad = 0;
+	node.mChildBase = static_cast<uint32_t>(mNodes.size());
+	node.mBlockBase = static_cast<uint32_t>(mBlocks.size());
+
+	uint8_t * const mins[3] = { node.mMinX, node.mMinY, node.mMinZ };
+	uint8_t * const maxs[3] = { node.mMaxX, node.mMaxY, node.mMaxZ };
+	std::vector<size_t> interiorSlots;
+	for (size_t i = 0;i < Width;i++)
+	{
+		if (i >= children.size())
+		{
+			node.mMeta[i] = EmptyMeta;
+			for (size_t axis = 0;axis < 3;axis++) { mins[axis][i] = 255; maxs[axis][i] = 0; }
+			continue;
+		}
+
+		const Child & child = children[i];
+		for (size_t axis = 0;axis < 3;axis++)
+		{
+			Quantize(&mins[axis][i], &maxs[axis][i], child.mBbox.pMin[axis], child.mBbox.pMax[axis], node.mOrigin[axis], StepOf(node.mExponents[axis]));
+		}
+
+		if (child.mBinaryIndex != NoBinaryNode || child.mTriangles.size() > MaxLeafBlocks * Width)
+		{
+			node.mMeta[i] = static_cast<uint8_t>(InteriorBit | interiorSlots.size());
+			interiorSlots.push_back(i);
+			continue;
+		}
+
+		const size_t firstBlock = mBlocks.size() - node.mBlockBase;
+		const size_t numBlocks = (child.mTriangles.size() + Width - 1) / Width;
+		assert(firstBlock < 32 && numBlocks > 0 && numBlocks <= MaxLeafBlocks);
+		node.mMeta[i] = static_cast<uint8_t>((numBlocks << 5) | firstBlock);
+		for (size_t j = 0;j < child.mTriangles.size();j += Width)
+		{
+			mBlocks.emplace_back(&child.mTriangles[j], std::min(static_cast<size_t>(Width), child.mTriangles.size() - j));
+		}
+	}
+
+	// interior children are allocated together so the node only keeps the first index
+	mNodes.resize(mNodes.size() + interiorSlots.size());
+	mNodes[nodeIndex] = node;
+	for (size_t i = 0;i < interiorSlots.size();i++)
+	{
+		build(bvh, node.mChildBase + static_cast<uint32_t>(i), collapse(bvh, children[interiorSlots[i]]));
+	}
+}
+
+// like WideBvhAccel::intersect, with the visiting order sorted per node
+bool CompressedWideBvhAccel::intersect(Intersection * isectPtr, const Ray & r) const
+{
+	SimdWatertightRay watertightRay(r);
+	const Ray & ray = watertightRay.mRay;
+	const SimdRay simdRay(ray);
+
+	bool isHit = false;
+	StackEntry stack[64 * Width];
+	size_t stackSize = 0;
+	StackEntry current = { 0, 0, ray.tmin };
+
+	alignas(32) float tNears[Width];
+	StackEntry hits[Width];
+	while (true)
+	{
+		if (current.mNumBlocks > 0)
+		{
+			for (uint32_t i = 0;i < current.mNumBlocks;i++)
+			{
+				if (mBlocks[current.mIndex + i].intersect(isectPtr, &watertightRay)) { isHit = true; }
+			}
+		}
+		else
+		{
+			const Node & node = mNodes[current.mIndex];
+			const size_t numHits = CollectHits<true>(hits, node, simdRay.intersect(node, ray.tmin, ray.tmax, tNears), tNears);
+			if (numHits > 0)
+			{
+				for (size_t i = numHits - 1;i > 0;i--) { stack[stackSize++] = hits[i]; }
+				current = hits[0];
+				continue;
+			}
+		}
+
+		// skip what lies behind the closest hit so far
+		do
+		{
+			if (stackSize == 0)
+			{
+				if (isHit) { isectPtr->mTrianglePtr->fillIntersection(isectPtr, r); }
+				return isHit;
+			}
+			current = stack[--stackSize];
+		} while (current.mTNear > ray.tmax);
+	}
+}
+
+bool CompressedWideBvhAccel::intersectP(const Ray & ray) const
+{
+	const SimdWatertightRay watertightRay(ray);
+	const SimdRay simdRay(ray);
+
+	StackEntry stack[64 * Width];
+	size_t stackSize = 0;
+	StackEntry current = { 0, 0, ray.tmin };
+
+	alignas(32) float tNears[Width];
+	StackEntry hits[Width];
+	while (true)
+	{
+		if (current.mNumBlocks > 0)
+		{
+			for (uint32_t i = 0;i < current.mNumBlocks;i++)
+			{
+				if (mBlocks[current.mIndex + i].intersectP(watertightRay)) { return true; }
+			}
+		}
+		else
+		{
+			const Node & node = mNodes[current.mIndex];
+			const size_t numHits = CollectHits<false>(hits, node, simdRay.intersect(node, ray.tmin, ray.tmax, tNears), tNears);
+			if (numHits > 0)
+			{
+				for (size_t i = numHits - 1;i > 0;i--) { stack[stackSize++] = hits[i]; }
+				current = hits[0];
+				continue;
+			}
+		}
+
+		if (stackSize == 0) { return false; }
+		current = stack[--stackSize];
+	}
+}
+
+Aabb CompressedWideBvhAccel::computeBbox() const
+{
+	return mBbox;
+}
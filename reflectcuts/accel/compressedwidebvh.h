@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include "common/reflectcuts.h"
+#include "accel/bvh.h"
+#include "accel/triangleblock.h"
+#include "math/simd.h"
+
+// WideBvhAccel with the child bounds quantized to 8 bits inside the node bounds (ylitie et al. 2017, efficient
+// incoherent ray traversal on gpus through compressed wide bvhs). a node is 80 bytes with avx and 52 with sse instead of
+// the 264 / 136 of WideBvhAccel, so much more of a large tree stays in cache. the bounds are decoded in the simd box
+// test, which costs a conversion and a multiply add per plane, and children are sorted by their entry distance as there
+// is no room for the per octant orders. the quantized bounds always contain the real ones.
+class CompressedWideBvhAccel : public Accel
+{
+public:
+	static const size_t Width = Simd::Width;
+	static const size_t MaxLeafBlocks = 3;			// per child slot. larger leaves are split below an extra node
+
+	// child slot meta : 0 empty, InteriorBit | i for the i-th interior child, (numBlocks << 5) | first block for leaves
+	static const uint8_t EmptyMeta = 0;
+	static const uint8_t InteriorBit = 0x80;
+
+	struct Node
+	{
+		float		mOrigin[3];						// node bounds min
+		int8_t		mExponents[3];					// a quantization step is 2^exponent
+		uint8_t		mPad;
+		uint32_t	mChildBase;						// interior children are consecutive nodes from here
+		uint32_t	mBlockBase;						// the blocks of all leaf children are consecutive from here
+		uint8_t		mMeta[Width];
+		uint8_t		mMinX[Width], mMinY[Width], mMinZ[Width];	// empty slots are (255, 0)
+		uint8_t		mMaxX[Width], mMaxY[Width], mMaxZ[Width];
+	};
+
+	explicit CompressedWideBvhAccel(const BvhAccel & bvh);
+
+	bool intersect(Intersection * isectPtr, const Ray & ray) const override;
+	bool intersectP(const Ray & ray) const override;
+	Aabb computeBbox() const override;
+
+	std::vector<TriangleBlock>		mBlocks;
+	std::vector<Node>				mNodes;
+	Aabb							mBbox;
+
+private:
+	// a child slot before quantization : a node of the binary bvh, or the triangles of a leaf
+	struct Child
+	{
+		Aabb							mBbox;
+		uint32_t						mBinaryIndex;		// only for interior nodes
+		std::vector<const Triangle *>	mTriangles;
+	};
+
+	std::vector<Child> collapse(const BvhAccel & bvh, const Child & child) const;
+	void build(const BvhAccel & bvh, const uint32_t nodeIndex, const std::vector<Child> & children);
+	Child createChild(const BvhAccel & bvh, const uint32_t binaryIndex) const;
+};
@@ -0,0 +1,45 @@
+#include "accel/dynamicbvh.h"
+
+#include "common/stopwatch.h"
+
+DynamicBvh::DynamicBvh(shared_ptr<BvhAccel> bvh, const std::vector<shared_ptr<TriangleMesh>> & meshes):
+	DynamicBvh(bvh, meshes, Setting())
+{
+}
+
+DynamicBvh::DynamicBvh(shared_ptr<BvhAccel> bvh, const std::vector<shared_ptr<TriangleMesh>> & meshes, const Setting & setting):
+	mSetting(setting),
+	mBvh(bvh),
+	mMeshes(meshes)
+{
+	assert(mBvh != nullptr);
+
+	// the reference is a refit of the unmoved tree, not the tree as built : a refit replaces the clipped leaf bounds
+	// of an sbvh with whole triangle bounds, which alone can cost more than mMaxSahRatio
+	mBvh->refit();
+	mReferenceSahCost = mBvh->computeSahCost(mSetting.mTraversalCost, mSetting.mIntersectCost);
+	mSahCost = mReferenceSahCost;
+}
+
+bool DynamicBvh::update()
+{
+	StopWatch sw;
+	sw.reset();
+
+	// the cost is relative to the root area, so a scene that only grows or moves as a whole doesn't trigger rebuilds
+	mBvh->refit();
+	mSahCost = mBvh->computeSahCost(mSetting.mTraversalCost, mSetting.mIntersectCost);
+	mNumRefits++;
+
+	const bool isRebuilt = mSahCost > mSetting.mMaxSahRatio * mReferenceSahCost;
+	if (isRebuilt)
+	{
+		mBvh = make_shared<LbvhAccel>(mMeshes, mSetting.mRebuildSetting);
+		mSahCost = mBvh->computeSahCost(mSetting.mTraversalCost, mSetting.mIntersectCost);
+		mReferenceSahCost = mSahCost;
+		mNumRebuilds++;
+	}
+
+	mUpdateTimeMs = sw.timeMilliSec();
+	return isRebuilt;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "common/reflectcuts.h"
+#include "accel/bvh.h"
+#include "accel/lbvh.h"
+
+// keeps a bvh over triangle meshes whose vertices move in place (same triangles, new positions) usable from frame to
+// frame. an update refits the bounds, which keeps the tree valid but lets it degrade as triangles drift apart from
+// their original neighbours. once the sah cost after a refit exceeds mMaxSahRatio times the cost of the refitted tree
+// before anything moved, the tree is rebuilt with LbvhAccel instead. construct it before the meshes move.
+class DynamicBvh
+{
+public:
+	struct Setting
+	{
+		Float						mMaxSahRatio = 1.5f;
+		Float						mTraversalCost = 1.0f;
+		Float						mIntersectCost = 1.0f;
+		LbvhAccel::BuildSetting		mRebuildSetting;
+	};
+
+	DynamicBvh(shared_ptr<BvhAccel> bvh, const std::vector<shared_ptr<TriangleMesh>> & meshes);
+	DynamicBvh(shared_ptr<BvhAccel> bvh, const std::vector<shared_ptr<TriangleMesh>> & meshes, const Setting & setting);
+
+	// after the vertices of the meshes moved. returns true if the bvh was rebuilt, mBvh is a new object then
+	bool update();
+
+	Setting									mSetting;
+	shared_ptr<BvhAccel>					mBvh;
+	std::vector<shared_ptr<TriangleMesh>>	mMeshes;
+	Float									mReferenceSahCost;		// refitted, right after the last (re)build
+	Float									mSahCost;
+	size_t									mNumRefits = 0;
+	size_t									mNumRebuilds = 0;
+	long long								mUpdateTimeMs = 0;		// of the last update
+};
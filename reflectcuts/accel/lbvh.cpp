@@ -0,0 +1,242 @@
+#include "accel/lbvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include "common/stopwatch.h"
+#include "common/threadpool.h"
+
+namespace
+{
+	const uint32_t InvalidTriangle = 0xffffffff;
+
+	inline uint32_t CodeOf(const uint64_t key)
+	{
+		return static_cast<uint32_t>(key >> 32);
+	}
+
+	inline uint32_t IndexOf(const uint64_t key)
+	{
+		return static_cast<uint32_t>(key & 0xffffffff);
+	}
+
+	// index of the highest set bit, v > 0
+	inline int HighestBit(uint32_t v)
+	{
+		int result = 0;
+		while (v >>= 1) { result++; }
+		return result;
+	}
+}
+
+LbvhAccel::LbvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes):
+	LbvhAccel(meshes, BuildSetting())
+{
+}
+
+LbvhAccel::LbvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes, const BuildSetting & setting):
+	mSetting(setting)
+{
+	StopWatch sw;
+	sw.reset();
+	ThreadPool & pool = ThreadPool::Instance();
+
+	for (const shared_ptr<TriangleMesh> & mesh : meshes)
+	{
+		for (const Triangle & triangle : mesh->mTriangles) { mTriangles.push_back(&triangle); }
+	}
+
+	// degenerated triangles can't be hit (same as BinnedBvhAccel)
+	mBboxes.resize(mTriangles.size());
+	std::vector<uint8_t> isValid(mTriangles.size());
+	pool.parallelFor(0, mTriangles.size(), [&](const size_t i)
+	{
+		const Triangle & triangle = *mTriangles[i];
+		const std::vector<glm::vec3> & vertices = triangle.mTriMeshPtr->mVertices;
+		isValid[i] = (Triangle::ComputeArea(vertices[triangle.mVertexIndices[0]], vertices[triangle.mVertexIndices[1]], vertices[triangle.mVertexIndices[2]]) > 0.0f) ? 1 : 0;
+		mBboxes[i] = triangle.computeBbox();
+	}, 4096);
+
+	Aabb centroidBbox;
+	for (size_t i = 0;i < mTriangles.size();i++)
+	{
+		if (isValid[i]) { centroidBbox = Aabb::Union(centroidBbox, mBboxes[i].computeCentroid()); }
+	}
+	const Vec3 extent = centroidBbox.pMax - centroidBbox.pMin;
+	Vec3 invExtent;
+	for (int axis = 0;axis < 3;axis++) { invExtent[axis] = (extent[axis] > 0.0f) ? 1.0f / extent[axis] : 0.0f; }
+
+	mKeys.resize(mTriangles.size());
+	pool.parallelFor(0, mTriangles.size(), [&](const size_t i)
+	{
+		const uint64_t code = isValid[i] ? Math::MortonCode3((mBboxes[i].computeCentroid() - centroidBbox.pMin) * invExtent) : InvalidTriangle;
+		mKeys[i] = (code << 32) | i;
+	}, 4096);
+	std::sort(mKeys.begin(), mKeys.end());
+	mKeys.erase(std::find_if(mKeys.begin(), mKeys.end(), [](const uint64_t key) { return CodeOf(key) == InvalidTriangle; }), mKeys.end());
+
+	mStats.mNumTriangles = mTriangles.size();
+	if (mKeys.empty())
+	{
+		Node node;
+		node.mOffset = 0;
+		node.mNumRefs = 0;
+		node.mAxis = 0;
+		node.mPad = 0;
+		mNodes = MappedArray<Node>(std::vector<Node>(1, node));
+	}
+	else
+	{
+		buildTop(0, mKeys.size());
+
+		std::vector<size_t> order;
+		for (size_t i = 0;i < mTopNodes.size();i++)
+		{
+			if (mTopNodes[i].mSubtree >= 0) { order.push_back(i); }
+		}
+
+		// largest first so the last tasks are short
+		std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b)
+		{
+			return mTopNodes[a].mEnd - mTopNodes[a].mBegin > mTopNodes[b].mEnd - mTopNodes[b].mBegin;
+		});
+
+		mSubtreeNodes.resize(order.size());
+		mSubtreeBboxes.resize(order.size());
+		pool.parallelFor(0, order.size(), [&](const size_t i)
+		{
+			const TopNode & topNode = mTopNodes[order[i]];
+			mSubtreeNodes[topNode.mSubtree].reserve((topNode.mEnd - topNode.mBegin) * 2 / mSetting.mMaxLeafSize + 1);
+			mSubtreeBboxes[topNode.mSubtree] = buildSubtree(&mSubtreeNodes[topNode.mSubtree], topNode.mBegin, topNode.mEnd);
+		});
+
+		size_t numNodes = 0;
+		for (const std::vector<Node> & nodes : mSubtreeNodes) { numNodes += nodes.size(); }
+		mNodes.reserve(mTopNodes.size() + numNodes);
+		flatten(0);
+
+		std::vector<TopNode>().swap(mTopNodes);
+		std::vector<std::vector<Node>>().swap(mSubtreeNodes);
+		std::vector<Aabb>().swap(mSubtreeBboxes);
+	}
+
+	mReferences.resize(mKeys.size());
+	for (size_t i = 0;i < mKeys.size();i++) { mReferences[i] = IndexOf(mKeys[i]); }
+	std::vector<uint64_t>().swap(mKeys);
+	std::vector<Aabb>().swap(mBboxes);
+
+	mStats.mNumReferences = mReferences.size();
+	mStats.mNumNodes = mNodes.size();
+	for (const Node & node : mNodes) { mStats.mNumLeaves += (node.mNumRefs > 0) ? 1 : 0; }
+	mStats.mSahCost = computeSahCost(mSetting.mTraversalCost, mSetting.mIntersectCost);
+	mStats.mBuildTimeMs = sw.timeMilliSec();
+
+	std::cout << "lbvh : " << mStats.mNumTriangles << " triangles, " << mStats.mNumNodes << " nodes, sah " << mStats.mSahCost << ", "
+		<< mStats.mBuildTimeMs << "ms on " << pool.numThreads() << " threads" << std::endl;
+}
+
+// the splits only look at the codes, so the top levels are cheap enough to do on one thread
+int LbvhAccel::buildTop(const size_t begin, const size_t end)
+{
+	const int topIndex = static_cast<int>(mTopNodes.size());
+	mTopNodes.emplace_back();
+	mTopNodes[topIndex].mBegin = begin;
+	mTopNodes[topIndex].mEnd = end;
+
+	if (end - begin <= std::max(mSetting.mMinParallelRefs, mSetting.mMaxLeafSize))
+	{
+		mTopNodes[topIndex].mSubtree = static_cast<int>(mSubtreeNodes.size());
+		mSubtreeNodes.emplace_back();
+		return topIndex;
+	}
+
+	uint8_t axis;
+	const size_t mid = findSplit(begin, end, &axis);
+	mTopNodes[topIndex].mAxis = axis;
+	const int left = buildTop(begin, mid);
+	const int right = buildTop(mid, end);
+	mTopNodes[topIndex].mChildren[0] = left;
+	mTopNodes[topIndex].mChildren[1] = right;
+	return topIndex;
+}
+
+Aabb LbvhAccel::buildSubtree(std::vector<Node> * nodesPtr, const size_t begin, const size_t end) const
+{
+	Node node;
+	node.mOffset = static_cast<uint32_t>(begin);
+	node.mNumRefs = 0;
+	node.mAxis = 0;
+	node.mPad = 0;
+	nodesPtr->push_back(node);
+	const size_t nodeIndex = nodesPtr->size() - 1;
+
+	if (end - begin <= mSetting.mMaxLeafSize)
+	{
+		Aabb bbox;
+		for (size_t i = begin;i < end;i++) { bbox = Aabb::Union(bbox, mBboxes[IndexOf(mKeys[i])]); }
+		(*nodesPtr)[nodeIndex].mBbox = bbox;
+		(*nodesPtr)[nodeIndex].mNumRefs = static_cast<uint16_t>(end - begin);
+		return bbox;
+	}
+
+	uint8_t axis;
+	const size_t mid = findSplit(begin, end, &axis);
+	const Aabb leftBbox = buildSubtree(nodesPtr, begin, mid);
+	const uint32_t rightIndex = static_cast<uint32_t>(nodesPtr->size());
+	const Aabb rightBbox = buildSubtree(nodesPtr, mid, end);
+
+	(*nodesPtr)[nodeIndex].mBbox = Aabb::Union(leftBbox, rightBbox);
+	(*nodesPtr)[nodeIndex].mOffset = rightIndex;
+	(*nodesPtr)[nodeIndex].mAxis = axis;
+	return (*nodesPtr)[nodeIndex].mBbox;
+}
+
+Aabb LbvhAccel::flatten(const int topIndex)
+{
+	const TopNode topNode = mTopNodes[topIndex];
+	if (topNode.mSubtree >= 0)
+	{
+		const uint32_t base = static_cast<uint32_t>(mNodes.size());
+		for (Node node : mSubtreeNodes[topNode.mSubtree])
+		{
+			if (node.mNumRefs == 0) { node.mOffset += base; }
+			mNodes.push_back(node);
+		}
+		std::vector<Node>().swap(mSubtreeNodes[topNode.mSubtree]);
+		return mSubtreeBboxes[topNode.mSubtree];
+	}
+
+	Node node;
+	node.mOffset = 0;
+	node.mNumRefs = 0;
+	node.mAxis = topNode.mAxis;
+	node.mPad = 0;
+	mNodes.push_back(node);
+	const size_t nodeIndex = mNodes.size() - 1;
+
+	const Aabb leftBbox = flatten(topNode.mChildren[0]);
+	mNodes[nodeIndex].mOffset = static_cast<uint32_t>(mNodes.size());
+	const Aabb rightBbox = flatten(topNode.mChildren[1]);
+	mNodes[nodeIndex].mBbox = Aabb::Union(leftBbox, rightBbox);
+	return mNodes[nodeIndex].mBbox;
+}
+
+// the first key with the highest differing bit set starts the right half. ranges of equal codes are halved
+size_t LbvhAccel::findSplit(const size_t begin, const size_t end, uint8_t * axisPtr) const
+{
+	const uint32_t firstCode = CodeOf(mKeys[begin]);
+	const uint32_t lastCode = CodeOf(mKeys[end - 1]);
+	if (firstCode == lastCode)
+	{
+		*axisPtr = 0;
+		return (begin + end) / 2;
+	}
+
+	// MortonCode3 interleaves x, y, z from the top
+	const int bit = HighestBit(firstCode ^ lastCode);
+	*axisPtr = static_cast<uint8_t>(2 - bit % 3);
+	const uint32_t mask = ~((1u << bit) - 1u);
+	const uint32_t rightPrefix = (firstCode & mask) | (1u << bit);
+	return std::lower_bound(mKeys.begin() + begin, mKeys.begin() + end, static_cast<uint64_t>(rightPrefix) << 32) - mKeys.begin();
+}
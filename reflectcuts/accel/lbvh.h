@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+#include "common/reflectcuts.h"
+#include "accel/bvh.h"
+#include "common/util.h"
+
+// linear bvh (lauterbach et al. 2009, fast bvh construction on gpus). the triangles are sorted along the morton curve of
+// their centroids and every node splits its range where the highest differing bit of the codes flips, so there is no
+// cost evaluation at all. builds several times faster than BinnedBvhAccel for a higher sah cost, which makes it the
+// rebuild of animated geometry (DynamicBvh). the top levels are split first, the subtrees below are built in parallel.
+class LbvhAccel : public BvhAccel
+{
+public:
+	struct BuildSetting
+	{
+		size_t	mMaxLeafSize = 4;
+		Float	mTraversalCost = 1.0f;			// only for the reported sah cost
+		Float	mIntersectCost = 1.0f;
+		size_t	mMinParallelRefs = 1 << 14;		// smaller ranges are built as subtree tasks
+
+		// part of the key of a saved bvh
+		uint64_t hash(uint64_t hash) const
+		{
+			const uint64_t sizes[] = { mMaxLeafSize, mMinParallelRefs };
+			const Float costs[] = { mTraversalCost, mIntersectCost };
+			hash = Util::HashFnv1a(sizes, sizeof(sizes), hash);
+			return Util::HashFnv1a(costs, sizeof(costs), hash);
+		}
+	};
+
+	LbvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes);
+	LbvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes, const BuildSetting & setting);
+
+	BuildSetting					mSetting;
+
+private:
+	// top levels before they are stitched. mSubtree >= 0 refers to mSubtreeNodes
+	struct TopNode
+	{
+		size_t		mBegin;
+		size_t		mEnd;
+		uint8_t		mAxis = 0;
+		int			mChildren[2] = { -1, -1 };
+		int			mSubtree = -1;
+	};
+
+	int buildTop(const size_t begin, const size_t end);
+	Aabb buildSubtree(std::vector<Node> * nodesPtr, const size_t begin, const size_t end) const;
+	Aabb flatten(const int topIndex);
+
+	// where [begin, end) is split and along which axis
+	size_t findSplit(const size_t begin, const size_t end, uint8_t * axisPtr) const;
+
+	std::vector<uint64_t>			mKeys;			// morton code << 32 | triangle index, sorted
+	std::vector<Aabb>				mBboxes;		// per triangle index
+	std::vector<TopNode>			mTopNodes;
+	std::vector<std::vector<Node>>	mSubtreeNodes;	// child offsets relative to the subtree
+	std::vector<Aabb>				mSubtreeBboxes;
+};
@@ -0,0 +1,431 @@
+#include "accel/sbvh.h"
+
+#include <algorithm>
+
+#include "common/stopwatch.h"
+
+namespace
+{
+	inline bool IsValid(const Aabb & a)
+	{
+		return a.pMin.x <= a.pMax.x && a.pMin.y <= a.pMax.y && a.pMin.z <= a.pMax.z;
+	}
+
+	// Aabb::surfaceArea of an empty (inverted) box isn't 0
+	inline Float SafeArea(const Aabb & a)
+	{
+		return IsValid(a) ? a.surfaceArea() : 0.0f;
+	}
+
+	// clipping can leave empty boxes behind which must not grow the union
+	inline Aabb UnionValid(const Aabb & a, const Aabb & b)
+	{
+		return IsValid(b) ? Aabb::Union(a, b) : a;
+	}
+}
+
+SbvhAccel::SbvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes):
+	SbvhAccel(meshes, BuildSetting())
+{
+}
+
+SbvhAccel::SbvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes, const BuildSetting & setting):
+	mSetting(setting)
+{
+	StopWatch sw;
+	sw.reset();
+
+	for (const shared_ptr<TriangleMesh> & mesh : meshes)
+	{
+		for (const Triangle & triangle : mesh->mTriangles) { mTriangles.push_back(&triangle); }
+	}
+
+	std::vector<Reference> refs;
+	refs.reserve(mTriangles.size());
+	Aabb bbox;
+	for (size_t i = 0;i < mTriangles.size();i++)
+	{
+		// degenerated triangles can't be hit (same as meshBound)
+		const Triangle & triangle = *mTriangles[i];
+		const std::vector<glm::vec3> & vertices = triangle.mTriMeshPtr->mVertices;
+		if (!(Triangle::ComputeArea(vertices[triangle.mVertexIndices[0]], vertices[triangle.mVertexIndices[1]], vertices[triangle.mVertexIndices[2]]) > 0.0f)) { continue; }
+
+		Reference ref;
+		ref.mBbox = triangle.computeBbox();
+		ref.mTriIndex = static_cast<uint32_t>(i);
+		refs.push_back(ref);
+		bbox = Aabb::Union(bbox, ref.mBbox);
+	}
+
+	mStats.mNumTriangles = mTriangles.size();
+	mRootArea = SafeArea(bbox);
+	mNodes.reserve(refs.size() * 2);
+	mReferences.reserve(refs.size() * 5 / 4);
+	if (refs.size() > computeMaxRefs(0))
+	{
+		throw std::exception(); // "sbvh : too many triangles for mMaxDepth"
+	}
+	if (refs.empty())
+	{
+		createLeaf(refs, bbox);
+	}
+	else
+	{
+		buildNode(refs, bbox, 0);
+	}
+	mNodes.shrink_to_fit();
+
+	mStats.mSahCost = computeSahCost(mSetting.mTraversalCost, mSetting.mIntersectCost);
+	mStats.mNumNodes = mNodes.size();
+	mStats.mNumReferences = mReferences.size();
+	mStats.mBuildTimeMs = sw.timeMilliSec();
+
+	std::cout << "sbvh : " << mStats.mNumTriangles << " triangles, " << mStats.mNumReferences << " references, " << mStats.mNumNodes << " nodes, "
+		<< mStats.mNumSpatialSplits << " spatial splits, sah " << mStats.mSahCost << ", " << mStats.mBuildTimeMs << "ms" << std::endl;
+}
+
+// references a subtree rooted at depth can hold : leaves at the depth limit take MaxLeafRefs, every level above doubles
+size_t SbvhAccel::computeMaxRefs(const size_t depth) const
+{
+	const size_t numLevels = (depth + 1 < mSetting.mMaxDepth) ? mSetting.mMaxDepth - 1 - depth : 0;
+	return (numLevels >= 40) ? std::numeric_limits<size_t>::max() : MaxLeafRefs << numLevels;
+}
+
+uint32_t SbvhAccel::createLeaf(const std::vector<Reference> & refs, const Aabb & bbox)
+{
+	assert(refs.size() <= MaxLeafRefs);
+
+	Node node;
+	node.mBbox = bbox;
+	node.mOffset = static_cast<uint32_t>(mReferences.size());
+	node.mNumRefs = static_cast<uint16_t>(refs.size());
+	node.mAxis = 0;
+	node.mPad = 0;
+	for (const Reference & ref : refs) { mReferences.push_back(ref.mTriIndex); }
+
+	mNodes.push_back(node);
+	mStats.mNumLeaves++;
+	return static_cast<uint32_t>(mNodes.size() - 1);
+}
+
+uint32_t SbvhAccel::buildNode(std::vector<Reference> & refs, const Aabb & bbox, const size_t depth)
+{
+	if (refs.size() <= 1 || depth + 1 >= mSetting.mMaxDepth)
+	{
+		return createLeaf(refs, bbox);
+	}
+
+	const Float nodeArea = SafeArea(bbox);
+	const Float leafCost = mSetting.mIntersectCost * refs.size();
+
+	ObjectSplit objectSplit = findObjectSplit(refs, nodeArea);
+
+	// refs are now sorted along objectSplit.mAxis
+	SpatialSplit spatialSplit;
+	const Aabb overlap = Aabb::Intersect(objectSplit.mLeftBbox, objectSplit.mRightBbox);
+	if (mRootArea > 0.0f && SafeArea(overlap) / mRootArea > mSetting.mAlpha)
+	{
+		spatialSplit = findSpatialSplit(refs, bbox, nodeArea);
+	}
+
+	const Float splitCost = std::min(objectSplit.mCost, spatialSplit.mCost);
+	if (refs.size() <= mSetting.mMaxLeafSize && leafCost <= splitCost)
+	{
+		return createLeaf(refs, bbox);
+	}
+
+	// the sah split may leave a child larger than the levels below can hold, halving never does
+	const size_t maxChildRefs = computeMaxRefs(depth + 1);
+	const bool isTooLarge = std::max(objectSplit.mNumLeft, refs.size() - objectSplit.mNumLeft) > maxChildRefs;
+	if (isTooLarge) { objectSplit = findMedianSplit(refs); }
+
+	std::vector<Reference> left, right;
+	Aabb leftBbox, rightBbox;
+	int axis = objectSplit.mAxis;
+	if (!isTooLarge && spatialSplit.mCost < objectSplit.mCost && performSpatialSplit(&left, &right, refs, spatialSplit)
+		&& std::max(left.size(), right.size()) <= maxChildRefs)
+	{
+		axis = spatialSplit.mAxis;
+		for (const Reference & ref : left) { leftBbox = Aabb::Union(leftBbox, ref.mBbox); }
+		for (const Reference & ref : right) { rightBbox = Aabb::Union(rightBbox, ref.mBbox); }
+		mStats.mNumSpatialSplits++;
+	}
+	else
+	{
+		left.assign(refs.begin(), refs.begin() + objectSplit.mNumLeft);
+		right.assign(refs.begin() + objectSplit.mNumLeft, refs.end());
+		leftBbox = objectSplit.mLeftBbox;
+		rightBbox = objectSplit.mRightBbox;
+	}
+
+	// free the memory of this level before going down
+	std::vector<Reference>().swap(refs);
+
+	Node node;
+	node.mBbox = bbox;
+	node.mOffset = 0;
+	node.mNumRefs = 0;
+	node.mAxis = static_cast<uint8_t>(axis);
+	node.mPad = 0;
+	mNodes.push_back(node);
+	const uint32_t nodeIndex = static_cast<uint32_t>(mNodes.size() - 1);
+
+	buildNode(left, leftBbox, depth + 1);
+	const uint32_t rightIndex = buildNode(right, rightBbox, depth + 1);
+	mNodes[nodeIndex].mOffset = rightIndex;
+	return nodeIndex;
+}
+
+// full sweep over the centroids along every axis
+SbvhAccel::ObjectSplit SbvhAccel::findObjectSplit(std::vector<Reference> & refs, const Float nodeArea) const
+{
+	ObjectSplit result;
+	const size_t n = refs.size();
+	std::vector<Aabb> rightBboxes(n);
+
+	for (int axis = 0;axis < 3;axis++)
+	{
+		std::sort(refs.begin(), refs.end(), [axis](const Reference & a, const Reference & b)
+		{
+			const Float ca = a.mBbox.pMin[axis] + a.mBbox.pMax[axis];
+			const Float cb = b.mBbox.pMin[axis] + b.mBbox.pMax[axis];
+			return (ca < cb) || (ca == cb && a.mTriIndex < b.mTriIndex);
+		});
+
+		Aabb rightBbox;
+		for (size_t i = n - 1;i > 0;i--)
+		{
+			rightBbox = Aabb::Union(rightBbox, refs[i].mBbox);
+			rightBboxes[i] = rightBbox;
+		}
+
+		Aabb leftBbox;
+		for (size_t i = 1;i < n;i++)
+		{
+			leftBbox = Aabb::Union(leftBbox, refs[i - 1].mBbox);
+			const Float cost = mSetting.mTraversalCost + mSetting.mIntersectCost * (SafeArea(leftBbox) * i + SafeArea(rightBboxes[i]) * (n - i)) / nodeArea;
+			if (cost < result.mCost)
+			{
+				result.mCost = cost;
+				result.mAxis = axis;
+				result.mNumLeft = i;
+				result.mLeftBbox = leftBbox;
+				result.mRightBbox = rightBboxes[i];
+			}
+		}
+	}
+
+	// nodes without area end up with nan costs. split in the middle of the last sorted axis
+	if (result.mAxis < 0)
+	{
+		result.mAxis = 2;
+		result.mNumLeft = n / 2;
+		for (size_t i = 0;i < n / 2;i++) { result.mLeftBbox = Aabb::Union(result.mLeftBbox, refs[i].mBbox); }
+		for (size_t i = n / 2;i < n;i++) { result.mRightBbox = Aabb::Union(result.mRightBbox, refs[i].mBbox); }
+	}
+
+	// refs are still sorted along the last axis
+	if (result.mAxis != 2)
+	{
+		const int axis = result.mAxis;
+		std::sort(refs.begin(), refs.end(), [axis](const Reference & a, const Reference & b)
+		{
+			const Float ca = a.mBbox.pMin[axis] + a.mBbox.pMax[axis];
+			const Float cb = b.mBbox.pMin[axis] + b.mBbox.pMax[axis];
+			return (ca < cb) || (ca == cb && a.mTriIndex < b.mTriIndex);
+		});
+	}
+	return result;
+}
+
+// halves refs along the largest extent of their centroids, sah aside
+SbvhAccel::ObjectSplit SbvhAccel::findMedianSplit(std::vector<Reference> & refs) const
+{
+	Aabb centroidBbox;
+	for (const Reference & ref : refs) { centroidBbox = Aabb::Union(centroidBbox, ref.mBbox.computeCentroid()); }
+	const Vec3 extent = centroidBbox.pMax - centroidBbox.pMin;
+	const int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+	const size_t mid = refs.size() / 2;
+	std::nth_element(refs.begin(), refs.begin() + mid, refs.end(), [axis](const Reference & a, const Reference & b)
+	{
+		const Float ca = a.mBbox.pMin[axis] + a.mBbox.pMax[axis];
+		const Float cb = b.mBbox.pMin[axis] + b.mBbox.pMax[axis];
+		return (ca < cb) || (ca == cb && a.mTriIndex < b.mTriIndex);
+	});
+
+	ObjectSplit result;
+	result.mAxis = axis;
+	result.mNumLeft = mid;
+	for (size_t i = 0;i < mid;i++) { result.mLeftBbox = Aabb::Union(result.mLeftBbox, refs[i].mBbox); }
+	for (size_t i = mid;i < refs.size();i++) { result.mRightBbox = Aabb::Union(result.mRightBbox, refs[i].mBbox); }
+	return result;
+}
+
+// binned over the node bounds. a reference contributes its clipped part to every bin it overlaps, is counted as
+// entering in its first bin and exiting in its last one
+SbvhAccel::SpatialSplit SbvhAccel::findSpatialSplit(const std::vector<Reference> & refs, const Aabb & bbox, const Float nodeArea) const
+{
+	struct Bin
+	{
+		Aabb	mBbox;
+		size_t	mNumEnter = 0;
+		size_t	mNumExit = 0;
+	};
+
+	SpatialSplit result;
+	const size_t numBins = mSetting.mNumSpatialBins;
+	std::vector<Bin> bins(numBins);
+	std::vector<Aabb> rightBboxes(numBins);
+
+	for (int axis = 0;axis < 3;axis++)
+	{
+		const Float origin = bbox.pMin[axis];
+		const Float binWidth = (bbox.pMax[axis] - origin) / numBins;
+		if (!(binWidth > 0.0f)) { continue; }
+		const Float invBinWidth = 1.0f / binWidth;
+
+		std::fill(bins.begin(), bins.end(), Bin());
+		for (const Reference & ref : refs)
+		{
+			const size_t first = Math::Clamp<int64_t>(static_cast<int64_t>((ref.mBbox.pMin[axis] - origin) * invBinWidth), 0, numBins - 1);
+			const size_t last = Math::Clamp<int64_t>(static_cast<int64_t>((ref.mBbox.pMax[axis] - origin) * invBinWidth), first, numBins - 1);
+
+			Reference current = ref;
+			for (size_t i = first;i < last;i++)
+			{
+				Reference leftRef, rightRef;
+				splitReference(&leftRef, &rightRef, current, axis, origin + binWidth * (i + 1));
+				bins[i].mBbox = UnionValid(bins[i].mBbox, leftRef.mBbox);
+				current = rightRef;
+			}
+			bins[last].mBbox = UnionValid(bins[last].mBbox, current.mBbox);
+			bins[first].mNumEnter++;
+			bins[last].mNumExit++;
+		}
+
+		Aabb rightBbox;
+		for (size_t i = numBins - 1;i > 0;i--)
+		{
+			rightBbox = Aabb::Union(rightBbox, bins[i].mBbox);
+			rightBboxes[i] = rightBbox;
+		}
+
+		Aabb leftBbox;
+		size_t numLeft = 0;
+		size_t numRight = refs.size();
+		for (size_t i = 1;i < numBins;i++)
+		{
+			leftBbox = Aabb::Union(leftBbox, bins[i - 1].mBbox);
+			numLeft += bins[i - 1].mNumEnter;
+			numRight -= bins[i - 1].mNumExit;
+			const Float cost = mSetting.mTraversalCost + mSetting.mIntersectCost * (SafeArea(leftBbox) * numLeft + SafeArea(rightBboxes[i]) * numRight) / nodeArea;
+			if (cost < result.mCost)
+			{
+				result.mCost = cost;
+				result.mAxis = axis;
+				result.mPosition = origin + binWidth * i;
+			}
+		}
+	}
+	return result;
+}
+
+// references straddling the plane are split, unless putting them whole on one side is cheaper (reference unsplitting)
+bool SbvhAccel::performSpatialSplit(std::vector<Reference> * leftPtr, std::vector<Reference> * rightPtr, const std::vector<Reference> & refs, const SpatialSplit & split) const
+{
+	std::vector<Reference> & left = *leftPtr;
+	std::vector<Reference> & right = *rightPtr;
+	const int axis = split.mAxis;
+
+	Aabb leftBbox, rightBbox;
+	std::vector<const Reference *> straddling;
+	for (const Reference & ref : refs)
+	{
+		if (ref.mBbox.pMax[axis] <= split.mPosition)
+		{
+			left.push_back(ref);
+			leftBbox = Aabb::Union(leftBbox, ref.mBbox);
+		}
+		else if (ref.mBbox.pMin[axis] >= split.mPosition)
+		{
+			right.push_back(ref);
+			rightBbox = Aabb::Union(rightBbox, ref.mBbox);
+		}
+		else
+		{
+			straddling.push_back(&ref);
+		}
+	}
+
+	for (const Reference * ref : straddling)
+	{
+		Reference leftRef, rightRef;
+		splitReference(&leftRef, &rightRef, *ref, axis, split.mPosition);
+		if (!IsValid(leftRef.mBbox) || !IsValid(rightRef.mBbox))
+		{
+			// the triangle only touches the plane
+			std::vector<Reference> & side = IsValid(leftRef.mBbox) ? left : right;
+			Aabb & sideBbox = IsValid(leftRef.mBbox) ? leftBbox : rightBbox;
+			side.push_back(*ref);
+			sideBbox = Aabb::Union(sideBbox, ref->mBbox);
+			continue;
+		}
+
+		const Float numLeft = static_cast<Float>(left.size());
+		const Float numRight = static_cast<Float>(right.size());
+		const Aabb splitLeftBbox = Aabb::Union(leftBbox, leftRef.mBbox);
+		const Aabb splitRightBbox = Aabb::Union(rightBbox, rightRef.mBbox);
+		const Aabb wholeLeftBbox = Aabb::Union(leftBbox, ref->mBbox);
+		const Aabb wholeRightBbox = Aabb::Union(rightBbox, ref->mBbox);
+		const Float splitCost = SafeArea(splitLeftBbox) * (numLeft + 1) + SafeArea(splitRightBbox) * (numRight + 1);
+		const Float leftCost = SafeArea(wholeLeftBbox) * (numLeft + 1) + SafeArea(rightBbox) * numRight;
+		const Float rightCost = SafeArea(leftBbox) * numLeft + SafeArea(wholeRightBbox) * (numRight + 1);
+
+		if (splitCost <= leftCost && splitCost <= rightCost)
+		{
+			left.push_back(leftRef);
+			right.push_back(rightRef);
+			leftBbox = splitLeftBbox;
+			rightBbox = splitRightBbox;
+		}
+		else if (leftCost <= rightCost)
+		{
+			left.push_back(*ref);
+			leftBbox = wholeLeftBbox;
+		}
+		else
+		{
+			right.push_back(*ref);
+			rightBbox = wholeRightBbox;
+		}
+	}
+
+	if (left.empty() || right.empty())
+	{
+		left.clear();
+		right.clear();
+		return false;
+	}
+	return true;
+}
+
+// the clipped bounds of the whole triangle, restricted to the (possibly already clipped) reference bounds
+void SbvhAccel::splitReference(Reference * leftPtr, Reference * rightPtr, const Reference & ref, const int axis, const Float position) const
+{
+	const Triangle & triangle = *mTriangles[ref.mTriIndex];
+
+	Aabb leftBbox, rightBbox;
+	triangle.clipAabb(&leftBbox, ref.mBbox.pMin[axis], position, static_cast<uint8_t>(axis));
+	triangle.clipAabb(&rightBbox, position, ref.mBbox.pMax[axis], static_cast<uint8_t>(axis));
+
+	leftBbox = Aabb::Intersect(leftBbox, ref.mBbox);
+	leftBbox.pMax[axis] = std::min(leftBbox.pMax[axis], position);
+	rightBbox = Aabb::Intersect(rightBbox, ref.mBbox);
+	rightBbox.pMin[axis] = std::max(rightBbox.pMin[axis], position);
+
+	leftPtr->mBbox = leftBbox;
+	leftPtr->mTriIndex = ref.mTriIndex;
+	rightPtr->mBbox = rightBbox;
+	rightPtr->mTriIndex = ref.mTriIndex;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+
+#include "common/reflectcuts.h"
+#include "accel/bvh.h"
+#include "common/util.h"
+
+// split bvh (stich et al. 2009, spatial splits in bounding volume hierarchies).
+// a node is split either by object (sah over sorted centroids) or by a plane, in which case the triangles straddling it
+// are referenced on both sides with their bounds clipped to each side by Triangle::clipAabb. spatial splits are only
+// tried where the children of the best object split overlap by more than mAlpha of the root surface area, which keeps
+// the duplication small and mostly spent on long thin triangles that would otherwise blow up the object split nodes.
+class SbvhAccel : public BvhAccel
+{
+public:
+	struct BuildSetting
+	{
+		size_t	mMaxLeafSize = 4;
+		size_t	mNumSpatialBins = 32;
+		Float	mAlpha = 1e-5f;				// 1 = object bvh only, 0 = try spatial splits everywhere
+		Float	mTraversalCost = 1.0f;
+		Float	mIntersectCost = 1.0f;
+		size_t	mMaxDepth = 64;				// traversal stack size
+
+		// part of the key of a saved bvh
+		uint64_t hash(uint64_t hash) const
+		{
+			const uint64_t sizes[] = { mMaxLeafSize, mNumSpatialBins, mMaxDepth };
+			const Float costs[] = { mAlpha, mTraversalCost, mIntersectCost };
+			hash = Util::HashFnv1a(sizes, sizeof(sizes), hash);
+			return Util::HashFnv1a(costs, sizeof(costs), hash);
+		}
+	};
+
+	SbvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes);
+	SbvhAccel(const std::vector<shared_ptr<TriangleMesh>> & meshes, const BuildSetting & setting);
+
+	BuildSetting					mSetting;
+
+private:
+	struct Reference
+	{
+		Aabb		mBbox;
+		uint32_t	mTriIndex;
+	};
+
+	struct ObjectSplit
+	{
+		Float	mCost = std::numeric_limits<Float>::infinity();
+		int		mAxis = -1;
+		size_t	mNumLeft = 0;
+		Aabb	mLeftBbox;
+		Aabb	mRightBbox;
+	};
+
+	struct SpatialSplit
+	{
+		Float	mCost = std::numeric_limits<Float>::infinity();
+		int		mAxis = -1;
+		Float	mPosition = 0.0f;
+	};
+
+	size_t computeMaxRefs(const size_t depth) const;
+	uint32_t buildNode(std::vector<Reference> & refs, const Aabb & bbox, size_t depth);
+	uint32_t createLeaf(const std::vector<Reference> & refs, const Aabb & bbox);
+	ObjectSplit findObjectSplit(std::vector<Reference> & refs, const Float nodeArea) const;
+	ObjectSplit findMedianSplit(std::vector<Reference> & refs) const;
+	SpatialSplit findSpatialSplit(const std::vector<Reference> & refs, const Aabb & bbox, const Float nodeArea) const;
+	bool performSpatialSplit(std::vector<Reference> * leftPtr, std::vector<Reference> * rightPtr, const std::vector<Reference> & refs, const SpatialSplit & split) const;
+	void splitReference(Reference * leftPtr, Reference * rightPtr, const Reference & ref, const int axis, const Float position) const;
+
+	Float mRootArea;
+};
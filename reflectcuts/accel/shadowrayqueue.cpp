@@ -0,0 +1,72 @@
+#include "accel/shadowrayqueue.h"
+
+#include <algorithm>
+
+#include "common/threadpool.h"
+
+namespace
+{
+	inline uint64_t DirectionOctant(const Vec3 & direction)
+	{
+		return (direction.x < 0.0f ? 1 : 0) | (direction.y < 0.0f ? 2 : 0) | (direction.z < 0.0f ? 4 : 0);
+	}
+}
+
+ShadowRayQueue::ShadowRayQueue(const Aabb & sceneBbox):
+	mBbox(sceneBbox)
+{
+	const Vec3 extent = sceneBbox.pMax - sceneBbox.pMin;
+	for (int axis = 0;axis < 3;axis++) { mInvExtent[axis] = (extent[axis] > 0.0f) ? 1.0f / extent[axis] : 0.0f; }
+}
+
+size_t ShadowRayQueue::pushSegment(const Vec3 & from, const Vec3 & to, const Float epsilon)
+{
+	const Vec3 diff = to - from;
+	const Float length = glm::length(diff);
+	return push(Ray(from, diff / length, epsilon, length - epsilon));
+}
+
+void ShadowRayQueue::flush(const Accel & accel)
+{
+	const size_t numRays = mRays.size();
+	mIsOccluded.assign(numRays, 0);
+	if (numRays == 0) { return; }
+	assert(numRays <= std::numeric_limits<uint32_t>::max());
+
+	// 3 bit octant | 29 bit morton code (the lowest bit of z dropped) | 32 bit push index. the octant in the top bits
+	// so a batch only mixes direction signs where it straddles two octants (see BvhAccel::IsCoherent)
+	ThreadPool & pool = ThreadPool::Instance();
+	mKeys.resize(numRays);
+	pool.parallelFor(0, numRays, [&](const size_t i)
+	{
+		const Ray & ray = mRays[i];
+		const uint64_t morton = Math::MortonCode3((ray.origin - mBbox.pMin) * mInvExtent) >> 1;
+		mKeys[i] = (DirectionOctant(ray.direction) << 61) | (morton << 32) | i;
+	}, BatchSize);
+	std::sort(mKeys.begin(), mKeys.end());
+
+	mSortedRays.assign(numRays, mRays[0]);
+	if (mSortedCapacity < numRays)
+	{
+		mSortedIsOccluded.reset(new bool[numRays]);
+		mSortedCapacity = numRays;
+	}
+
+	const size_t numBatches = (numRays + BatchSize - 1) / BatchSize;
+	pool.parallelFor(0, numBatches, [&](const size_t iBatch)
+	{
+		const size_t begin = iBatch * BatchSize;
+		const size_t end = std::min(begin + BatchSize, numRays);
+		for (size_t i = begin;i < end;i++) { mSortedRays[i] = mRays[mKeys[i] & 0xffffffff]; }
+		for (size_t i = begin + 1;i < end;i++) { assert(DirectionOctant(mSortedRays[i - 1].direction) <= DirectionOctant(mSortedRays[i].direction)); }
+
+		accel.traceOcclusion(Span<const Ray>(&mSortedRays[begin], end - begin), Span<bool>(&mSortedIsOccluded[begin], end - begin));
+		for (size_t i = begin;i < end;i++) { mIsOccluded[mKeys[i] & 0xffffffff] = mSortedIsOccluded[i] ? 1 : 0; }
+	});
+}
+
+void ShadowRayQueue::clear()
+{
+	mRays.clear();
+	mIsOccluded.clear();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "common/reflectcuts.h"
+#include "common/accel.h"
+
+// visibility queries of a whole frame (vpl to pixel connections, next event estimation). the rays are sorted by
+// direction octant and then by the morton code of their origin inside the scene bounds before they are traced, so
+// neighbouring rays share the packets of Accel::traceOcclusion and the cache lines of the tree whatever order they were
+// pushed in. batches of sorted rays are traced in parallel over the thread pool.
+class ShadowRayQueue
+{
+public:
+	static const size_t BatchSize = 1024;		// rays per thread pool task
+
+	explicit ShadowRayQueue(const Aabb & sceneBbox);
+
+	// returns the index of the result after flush
+	inline size_t push(const Ray & ray)
+	{
+		mRays.push_back(ray);
+		return mRays.size() - 1;
+	}
+
+	// segment between two points, epsilon is cut off at both ends
+	size_t pushSegment(const Vec3 & from, const Vec3 & to, const Float epsilon = Ray::Epsilon);
+
+	// traces everything pushed since the last clear
+	void flush(const Accel & accel);
+
+	void clear();
+
+	inline bool isOccluded(const size_t i) const { assert(i < mIsOccluded.size()); return mIsOccluded[i] != 0; }
+	inline size_t size() const { return mRays.size(); }
+
+private:
+	Aabb						mBbox;
+	Vec3						mInvExtent;
+	std::vector<Ray>			mRays;
+	std::vector<uint64_t>		mKeys;				// sort key << 32 | push index
+	std::vector<Ray>			mSortedRays;
+	std::unique_ptr<bool[]>		mSortedIsOccluded;	// Span<bool> can't be backed by std::vector<bool>
+	size_t						mSortedCapacity = 0;
+	std::vector<uint8_t>		mIsOccluded;		// in push order
+};
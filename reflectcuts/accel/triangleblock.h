@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cassert>
+#include <limits>
+
+#include "common/reflectcuts.h"
+#include "common/intersection.h"
+#include "math/simd.h"
+#include "shapes/trianglemesh.h"
+
+// WatertightRay broadcast to all lanes. the origin is stored in the sheared axis order
+struct SimdWatertightRay
+{
+	SimdWatertightRay(const Ray & r):
+		mRay(r),
+		mWatertight(r),
+		mOrgX(r.origin[mWatertight.mKx]),
+		mOrgY(r.origin[mWatertight.mKy]),
+		mOrgZ(r.origin[mWatertight.mKz]),
+		mSx(mWatertight.mSx),
+		mSy(mWatertight.mSy),
+		mSz(mWatertight.mSz)
+	{
+	}
+
+	Ray				mRay;			// tmax is shortened by TriangleBlock::intersect
+	WatertightRay	mWatertight;
+	Simd::Vfloat	mOrgX, mOrgY, mOrgZ;
+	Simd::Vfloat	mSx, mSy, mSz;
+};
+
+// up to Simd::Width triangles of a leaf with their vertices in soa, so the watertight test of Triangle::intersect runs
+// on all of them at once. unused lanes hold nan vertices and never hit. lanes that land exactly on an edge are
+// redone by the scalar test, which falls back to double precision there.
+struct TriangleBlock
+{
+	static const size_t Width = Simd::Width;
+
+	TriangleBlock(const Triangle * const * triangles, const size_t numTriangles)
+	{
+		assert(numTriangles > 0 && numTriangles <= Width);
+		for (size_t i = 0;i < Width;i++)
+		{
+			mTriangles[i] = (i < numTriangles) ? triangles[i] : nullptr;
+			for (size_t v = 0;v < 3;v++)
+			{
+				const Vec3 p = (i < numTriangles) ? triangles[i]->mTriMeshPtr->mVertices[triangles[i]->mVertexIndices[v]] : Vec3(std::numeric_limits<Float>::quiet_NaN());
+				for (size_t axis = 0;axis < 3;axis++) { mVertices[v][axis][i] = p[axis]; }
+			}
+		}
+	}
+
+	// scaled barycentrics of p0, p1 and p2 and t scaled by their sum, as in Triangle::intersect
+	struct Edges
+	{
+		Simd::Vfloat	mU, mV, mW;
+		Simd::Vfloat	mTScaled;
+	};
+
+	// must round like Triangle::intersect, which also rules out fma contraction
+	inline Edges computeEdges(const SimdWatertightRay & r) const
+	{
+		const WatertightRay & wr = r.mWatertight;
+		const Simd::Vfloat az = Simd::Vfloat::Load(mVertices[0][wr.mKz]) - r.mOrgZ;
+		const Simd::Vfloat bz = Simd::Vfloat::Load(mVertices[1][wr.mKz]) - r.mOrgZ;
+		const Simd::Vfloat cz = Simd::Vfloat::Load(mVertices[2][wr.mKz]) - r.mOrgZ;
+		const Simd::Vfloat ax = (Simd::Vfloat::Load(mVertices[0][wr.mKx]) - r.mOrgX) - r.mSx * az;
+		const Simd::Vfloat ay = (Simd::Vfloat::Load(mVertices[0][wr.mKy]) - r.mOrgY) - r.mSy * az;
+		const Simd::Vfloat bx = (Simd::Vfloat::Load(mVertices[1][wr.mKx]) - r.mOrgX) - r.mSx * bz;
+		const Simd::Vfloat by = (Simd::Vfloat::Load(mVertices[1][wr.mKy]) - r.mOrgY) - r.mSy * bz;
+		const Simd::Vfloat cx = (Simd::Vfloat::Load(mVertices[2][wr.mKx]) - r.mOrgX) - r.mSx * cz;
+		const Simd::Vfloat cy = (Simd::Vfloat::Load(mVertices[2][wr.mKy]) - r.mOrgY) - r.mSy * cz;
+
+		Edges result;
+		result.mU = cx * by - cy * bx;
+		result.mV = ax * cy - ay * cx;
+		result.mW = bx * ay - by * ax;
+		result.mTScaled = (result.mU * az + result.mV * bz + result.mW * cz) * r.mSz;
+		return result;
+	}
+
+	static inline Simd::Vmask IsInside(const Edges & e)
+	{
+		const Simd::Vfloat zero(0.0f);
+		return ((e.mU >= zero) & (e.mV >= zero) & (e.mW >= zero)) | ((e.mU <= zero) & (e.mV <= zero) & (e.mW <= zero));
+	}
+
+	static inline int EdgeMask(const Edges & e)
+	{
+		const Simd::Vfloat zero(0.0f);
+		return Simd::Movemask((e.mU == zero) | (e.mV == zero) | (e.mW == zero));
+	}
+
+	// bit i is set for the lanes hit in (tmin, tmax). t and the scaled barycentrics of p1 and p2 go to the arrays
+	inline int intersect(const SimdWatertightRay & r, float * ts, float * b1s, float * b2s, int * edgeMask) const
+	{
+		const Edges e = computeEdges(r);
+		*edgeMask = EdgeMask(e);
+
+		const Simd::Vfloat det = e.mU + e.mV + e.mW;
+		const Simd::Vfloat invDet = Simd::Vfloat(1.0f) / det;
+		const Simd::Vfloat t = e.mTScaled * invDet;
+		const Simd::Vmask isHit = IsInside(e) & (det != Simd::Vfloat(0.0f)) & (t > Simd::Vfloat(r.mRay.tmin)) & (t < Simd::Vfloat(r.mRay.tmax));
+
+		t.store(ts);
+		(e.mV * invDet).store(b1s);
+		(e.mW * invDet).store(b2s);
+		return Simd::Movemask(isHit) & ~*edgeMask;
+	}
+
+	// closest hit among the lanes. only t, barycentrics and mTrianglePtr are written, like Triangle::intersect
+	inline bool intersect(Intersection * isectPtr, SimdWatertightRay * rayPtr) const
+	{
+		alignas(32) float ts[Width], b1s[Width], b2s[Width];
+		int edgeMask;
+		int hitMask = intersect(*rayPtr, ts, b1s, b2s, &edgeMask);
+
+		bool isHit = false;
+		for (size_t i = 0;i < Width && (hitMask | edgeMask) != 0;i++)
+		{
+			const int bit = 1 << i;
+			if (edgeMask & bit)
+			{
+				edgeMask &= ~bit;
+				if (mTriangles[i]->Triangle::intersect(isectPtr, rayPtr->mRay, rayPtr->mWatertight))
+				{
+					isHit = true;
+					rayPtr->mRay.tmax = isectPtr->mT;
+				}
+			}
+			else if ((hitMask & bit) && ts[i] < rayPtr->mRay.tmax)
+			{
+				isHit = true;
+				rayPtr->mRay.tmax = ts[i];
+				isectPtr->mT = ts[i];
+				isectPtr->mB1 = b1s[i];
+				isectPtr->mB2 = b2s[i];
+				isectPtr->mTrianglePtr = mTriangles[i];
+			}
+			hitMask &= ~bit;
+		}
+		return isHit;
+	}
+
+	// any hit. the range test is done on the scaled t so there is no division
+	inline bool intersectP(const SimdWatertightRay & r) const
+	{
+		const Edges e = computeEdges(r);
+		int edgeMask = EdgeMask(e);
+
+		const Simd::Vfloat zero(0.0f);
+		const Simd::Vfloat det = e.mU + e.mV + e.mW;
+		const Simd::Vfloat tMinScaled = Simd::Vfloat(r.mRay.tmin) * det;
+		const Simd::Vfloat tMaxScaled = Simd::Vfloat(r.mRay.tmax) * det;
+		const Simd::Vmask isInRange = ((det > zero) & (e.mTScaled > tMinScaled) & (e.mTScaled < tMaxScaled)) |
+			((det < zero) & (e.mTScaled < tMinScaled) & (e.mTScaled > tMaxScaled));
+		if ((Simd::Movemask(IsInside(e) & isInRange) & ~edgeMask) != 0) { return true; }
+
+		for (size_t i = 0;i < Width && edgeMask != 0;i++)
+		{
+			if ((edgeMask & (1 << i)) && mTriangles[i]->Triangle::intersectP(r.mRay, r.mWatertight)) { return true; }
+			edgeMask &= ~(1 << i);
+		}
+		return false;
+	}
+
+	float				mVertices[3][3][Width];		// [vertex][axis][lane]
+	const Triangle *	mTriangles[Width];
+};
@@ -0,0 +1,343 @@
+#include "accel/widebvh.h"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+	// ray data broadcast once per ray. the near plane of every axis is picked by the direction sign
+	struct SimdRay
+	{
+		SimdRay(const Ray & ray)
+		{
+			const Vec3 invDir = Vec3(1.0f) / ray.direction;
+			mInvDirX = Simd::Vfloat(invDir.x);
+			mInvDirY = Simd::Vfloat(invDir.y);
+			mInvDirZ = Simd::Vfloat(invDir.z);
+			mOrgX = Simd::Vfloat(ray.origin.x);
+			mOrgY = Simd::Vfloat(ray.origin.y);
+			mOrgZ = Simd::Vfloat(ray.origin.z);
+			mIsNegX = invDir.x < 0.0f;
+			mIsNegY = invDir.y < 0.0f;
+			mIsNegZ = invDir.z < 0.0f;
+			mOctant = (mIsNegX ? 1 : 0) | (mIsNegY ? 2 : 0) | (mIsNegZ ? 4 : 0);
+			mFarScale = Simd::Vfloat(Math::RobustFarScale);
+		}
+
+		// bit i is set if child i is hit within [tmin, tmax]. tNears receives the entry distances
+		inline int intersect(const WideBvhAccel::Node & node, const float tmin, const float tmax, float * tNears) const
+		{
+			const Simd::Vfloat nearX = (Simd::Vfloat::Load(mIsNegX ? node.mMaxX : node.mMinX) - mOrgX) * mInvDirX;
+			const Simd::Vfloat nearY = (Simd::Vfloat::Load(mIsNegY ? node.mMaxY : node.mMinY) - mOrgY) * mInvDirY;
+			const Simd::Vfloat nearZ = (Simd::Vfloat::Load(mIsNegZ ? node.mMaxZ : node.mMinZ) - mOrgZ) * mInvDirZ;
+			const Simd::Vfloat farX = (Simd::Vfloat::Load(mIsNegX ? node.mMinX : node.mMaxX) - mOrgX) * mInvDirX;
+			const Simd::Vfloat farY = (Simd::Vfloat::Load(mIsNegY ? node.mMinY : node.mMaxY) - mOrgY) * mInvDirY;
+			const Simd::Vfloat farZ = (Simd::Vfloat::Load(mIsNegZ ? node.mMinZ : node.mMaxZ) - mOrgZ) * mInvDirZ;
+
+			const Simd::Vfloat tNear = Simd::Max(nearX, Simd::Max(nearY, Simd::Max(nearZ, Simd::Vfloat(tmin))));
+			const Simd::Vfloat tFar = Simd::Min(farX * mFarScale, Simd::Min(farY * mFarScale, Simd::Min(farZ * mFarScale, Simd::Vfloat(tmax))));
+			tNear.store(tNears);
+			return Simd::LessEqual(tNear, tFar);
+		}
+
+		Simd::Vfloat	mInvDirX, mInvDirY, mInvDirZ;
+		Simd::Vfloat	mOrgX, mOrgY, mOrgZ;
+		Simd::Vfloat	mFarScale;
+		bool			mIsNegX, mIsNegY, mIsNegZ;
+		int				mOctant;
+	};
+
+	struct StackEntry
+	{
+		uint32_t	mIndex;
+		uint32_t	mNumBlocks;		// 0 for nodes
+		float		mTNear;
+	};
+
+	// a ray travelling along (+-1, +-1, +-1) meets the children roughly in the order of their projected centroids
+	void ComputeOrders(WideBvhAccel::Node * nodePtr, const std::array<Vec3, WideBvhAccel::Width> & centroids, const size_t numChildren)
+	{
+		for (int octant = 0;octant < 8;octant++)
+		{
+			const Vec3 dir((octant & 1) ? -1.0f : 1.0f, (octant & 2) ? -1.0f : 1.0f, (octant & 4) ? -1.0f : 1.0f);
+			std::array<uint32_t, WideBvhAccel::Width> slots;
+			for (uint32_t i = 0;i < WideBvhAccel::Width;i++) { slots[i] = i; }
+			std::stable_sort(slots.begin(), slots.begin() + numChildren, [&](const uint32_t a, const uint32_t b)
+			{
+				return glm::dot(centroids[a], dir) < glm::dot(centroids[b], dir);
+			});
+
+			nodePtr->mOrders[octant] = 0;
+			for (uint32_t i = 0;i < WideBvhAccel::Width;i++) { nodePtr->mOrders[octant] |= slots[i] << (3 * i); }
+		}
+	}
+}
+
+WideBvhAccel::WideBvhAccel(const BvhAccel & bvh):
+	mBbox(bvh.computeBbox())
+{
+	mNodes.reserve(bvh.mNodes.size() / (Width - 1) + 1);
+	collapse(bvh, 0);
+}
+
+// pulls up the grand children of the largest interior children until the node is full
+uint32_t WideBvhAccel::collapse(const BvhAccel & bvh, const uint32_t binaryIndex)
+{
+	std::vector<uint32_t> children;
+	const BvhAccel::Node & binaryNode = bvh.mNodes[binaryIndex];
+	if (binaryNode.mNumRefs > 0 || bvh.mNodes.size() == 1)
+	{
+		// leaf at the root
+		children.push_back(binaryIndex);
+	}
+	else
+	{
+		children.push_back(binaryIndex + 1);
+		children.push_back(binaryNode.mOffset);
+	}
+
+	while (children.size() < Width)
+	{
+		int largest = -1;
+		Float largestArea = -1.0f;
+		for (size_t i = 0;i < children.size();i++)
+		{
+			const BvhAccel::Node & child = bvh.mNodes[children[i]];
+			if (child.mNumRefs == 0 && child.mBbox.surfaceArea() > largestArea)
+			{
+				largest = static_cast<int>(i);
+				largestArea = child.mBbox.surfaceArea();
+			}
+		}
+		if (largest < 0) { break; }
+
+		const uint32_t index = children[largest];
+		children[largest] = index + 1;
+		children.push_back(bvh.mNodes[index].mOffset);
+	}
+
+	const uint32_t nodeIndex = static_cast<uint32_t>(mNodes.size());
+	mNodes.emplace_back();
+
+	Node node;
+	std::array<Vec3, Width> centroids;
+	for (size_t i = 0;i < Width;i++)
+	{
+		// an empty scene has a single leaf without references
+		const bool isLeaf = (i < children.size()) && (bvh.mNodes[children[i]].mNumRefs > 0 || children[i] == binaryIndex);
+		if (i >= children.size() || (isLeaf && bvh.mNodes[children[i]].mNumRefs == 0))
+		{
+			node.mMinX[i] = node.mMinY[i] = node.mMinZ[i] = std::numeric_limits<float>::infinity();
+			node.mMaxX[i] = node.mMaxY[i] = node.mMaxZ[i] = -std::numeric_limits<float>::infinity();
+			node.mChildren[i] = EmptyChild;
+			node.mNumBlocks[i] = 0;
+			centroids[i] = Vec3(0.0f);
+			continue;
+		}
+
+		const BvhAccel::Node & child = bvh.mNodes[children[i]];
+		node.mMinX[i] = child.mBbox.pMin.x;
+		node.mMinY[i] = child.mBbox.pMin.y;
+		node.mMinZ[i] = child.mBbox.pMin.z;
+		node.mMaxX[i] = child.mBbox.pMax.x;
+		node.mMaxY[i] = child.mBbox.pMax.y;
+		node.mMaxZ[i] = child.mBbox.pMax.z;
+		centroids[i] = child.mBbox.computeCentroid();
+		if (isLeaf && child.mNumRefs > MaxLeafBlocks * Width)
+		{
+			node.mChildren[i] = splitLeaf(bvh, child.mOffset, child.mNumRefs, child.mBbox);
+			node.mNumBlocks[i] = 0;
+		}
+		else if (isLeaf)
+		{
+			node.mChildren[i] = appendBlocks(bvh, child.mOffset, child.mNumRefs);
+			node.mNumBlocks[i] = static_cast<uint8_t>((child.mNumRefs + Width - 1) / Width);
+		}
+		else
+		{
+			node.mChildren[i] = collapse(bvh, children[i]);
+			node.mNumBlocks[i] = 0;
+		}
+	}
+
+	ComputeOrders(&node, centroids, children.size());
+	mNodes[nodeIndex] = node;
+	return nodeIndex;
+}
+
+// an extra node over up to Width pieces of a leaf that has more than MaxLeafBlocks blocks, pieces that are still too
+// large get one below them in turn
+uint32_t WideBvhAccel::splitLeaf(const BvhAccel & bvh, const uint32_t offset, const size_t numRefs, const Aabb & bbox)
+{
+	const size_t maxLeafSize = MaxLeafBlocks * Width;
+	const size_t numPieces = std::min(Width, (numRefs + maxLeafSize - 1) / maxLeafSize);
+	const size_t pieceSize = (numRefs + numPieces - 1) / numPieces;
+
+	const uint32_t nodeIndex = static_cast<uint32_t>(mNodes.size());
+	mNodes.emplace_back();
+
+	Node node;
+	std::array<Vec3, Width> centroids;
+	for (size_t i = 0;i < Width;i++)
+	{
+		const size_t first = i * pieceSize;
+		if (i >= numPieces || first >= numRefs)
+		{
+			node.mMinX[i] = node.mMinY[i] = node.mMinZ[i] = std::numeric_limits<float>::infinity();
+			node.mMaxX[i] = node.mMaxY[i] = node.mMaxZ[i] = -std::numeric_limits<float>::infinity();
+			node.mChildren[i] = EmptyChild;
+			node.mNumBlocks[i] = 0;
+			centroids[i] = Vec3(0.0f);
+			continue;
+		}
+
+		const size_t count = std::min(pieceSize, numRefs - first);
+		const uint32_t pieceOffset = offset + static_cast<uint32_t>(first);
+		Aabb pieceBbox;
+		for (size_t j = 0;j < count;j++) { pieceBbox = Aabb::Union(pieceBbox, bvh.mTriangles[bvh.mReferences[pieceOffset + j]]->computeBbox()); }
+
+		// spatial splits clip the references to the leaf
+		pieceBbox = Aabb::Intersect(pieceBbox, bbox);
+		node.mMinX[i] = pieceBbox.pMin.x;
+		node.mMinY[i] = pieceBbox.pMin.y;
+		node.mMinZ[i] = pieceBbox.pMin.z;
+		node.mMaxX[i] = pieceBbox.pMax.x;
+		node.mMaxY[i] = pieceBbox.pMax.y;
+		node.mMaxZ[i] = pieceBbox.pMax.z;
+		centroids[i] = pieceBbox.computeCentroid();
+		if (count > maxLeafSize)
+		{
+			node.mChildren[i] = splitLeaf(bvh, pieceOffset, count, pieceBbox);
+			node.mNumBlocks[i] = 0;
+		}
+		else
+		{
+			node.mChildren[i] = appendBlocks(bvh, pieceOffset, count);
+			node.mNumBlocks[i] = static_cast<uint8_t>((count + Width - 1) / Width);
+		}
+	}
+	ComputeOrders(&node, centroids, numPieces);
+
+	mNodes[nodeIndex] = node;
+	return nodeIndex;
+}
+
+// the references [offset, offset + numRefs) as blocks of Width triangles, returns the first one
+uint32_t WideBvhAccel::appendBlocks(const BvhAccel & bvh, const uint32_t offset, const size_t numRefs)
+{
+	const uint32_t firstBlock = static_cast<uint32_t>(mBlocks.size());
+	for (size_t j = 0;j < numRefs;j += Width)
+	{
+		const Triangle * triangles[Width];
+		const size_t numTriangles = std::min<size_t>(Width, numRefs - j);
+		for (size_t k = 0;k < numTriangles;k++) { triangles[k] = bvh.mTriangles[bvh.mReferences[offset + j + k]]; }
+		mBlocks.emplace_back(triangles, numTriangles);
+	}
+	return firstBlock;
+}
+
+// children are pushed far to near and the nearest one is visited right away
+bool WideBvhAccel::intersect(Intersection * isectPtr, const Ray & r) const
+{
+	SimdWatertightRay watertightRay(r);
+	const Ray & ray = watertightRay.mRay;
+	const SimdRay simdRay(ray);
+
+	bool isHit = false;
+	StackEntry stack[64 * Width];
+	size_t stackSize = 0;
+	StackEntry current = { 0, 0, ray.tmin };
+
+	alignas(32) float tNears[Width];
+	while (true)
+	{
+		if (current.mNumBlocks > 0)
+		{
+			for (uint32_t i = 0;i < current.mNumBlocks;i++)
+			{
+				if (mBlocks[current.mIndex + i].intersect(isectPtr, &watertightRay)) { isHit = true; }
+			}
+		}
+		else
+		{
+			const Node & node = mNodes[current.mIndex];
+			const int hitMask = simdRay.intersect(node, ray.tmin, ray.tmax, tNears);
+			if (hitMask != 0)
+			{
+				const uint32_t order = node.mOrders[simdRay.mOctant];
+				uint32_t hitSlots[Width];
+				size_t numHits = 0;
+				for (size_t i = 0;i < Width;i++)
+				{
+					const uint32_t slot = (order >> (3 * i)) & 7;
+					if (hitMask & (1 << slot)) { hitSlots[numHits++] = slot; }
+				}
+
+				for (size_t i = numHits - 1;i > 0;i--)
+				{
+					const uint32_t slot = hitSlots[i];
+					stack[stackSize++] = { node.mChildren[slot], node.mNumBlocks[slot], tNears[slot] };
+				}
+				current = { node.mChildren[hitSlots[0]], node.mNumBlocks[hitSlots[0]], tNears[hitSlots[0]] };
+				continue;
+			}
+		}
+
+		// skip what lies behind the closest hit so far
+		do
+		{
+			if (stackSize == 0)
+			{
+				if (isHit) { isectPtr->mTrianglePtr->fillIntersection(isectPtr, r); }
+				return isHit;
+			}
+			current = stack[--stackSize];
+		} while (current.mTNear > ray.tmax);
+	}
+}
+
+bool WideBvhAccel::intersectP(const Ray & ray) const
+{
+	const SimdWatertightRay watertightRay(ray);
+	const SimdRay simdRay(ray);
+
+	StackEntry stack[64 * Width];
+	size_t stackSize = 0;
+	StackEntry current = { 0, 0, ray.tmin };
+
+	alignas(32) float tNears[Width];
+	while (true)
+	{
+		if (current.mNumBlocks > 0)
+		{
+			for (uint32_t i = 0;i < current.mNumBlocks;i++)
+			{
+				if (mBlocks[current.mIndex + i].intersectP(watertightRay)) { return true; }
+			}
+		}
+		else
+		{
+			const Node & node = mNodes[current.mIndex];
+			const int hitMask = simdRay.intersect(node, ray.tmin, ray.tmax, tNears);
+			if (hitMask != 0)
+			{
+				const uint32_t order = node.mOrders[simdRay.mOctant];
+				for (int i = Width - 1;i >= 0;i--)
+				{
+					const uint32_t slot = (order >> (3 * i)) & 7;
+					if (hitMask & (1 << slot)) { stack[stackSize++] = { node.mChildren[slot], node.mNumBlocks[slot], tNears[slot] }; }
+				}
+				current = stack[--stackSize];
+				continue;
+			}
+		}
+
+		if (stackSize == 0) { return false; }
+		current = stack[--stackSize];
+	}
+}
+
+Aabb WideBvhAccel::computeBbox() const
+{
+	return mBbox;
+}
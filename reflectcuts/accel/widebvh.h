@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "common/reflectcuts.h"
+#include "accel/bvh.h"
+#include "accel/triangleblock.h"
+#include "math/simd.h"
+
+// Simd::Width-ary bvh collapsed from a binary one. the child bounds of a node are stored per axis (soa) so a ray is
+// tested against all of them with one simd instruction stream. children are visited front to back in an order
+// precomputed per direction octant, so the traversal only needs the signs of the ray direction and no sorting.
+// leaves are stored as TriangleBlocks of Width triangles. with avx, builds with mMaxLeafSize = 8 fill them best.
+class WideBvhAccel : public Accel
+{
+public:
+	static const size_t Width = Simd::Width;
+	static const uint32_t EmptyChild = 0xffffffff;
+	static const size_t MaxLeafBlocks = 0xff;		// Node::mNumBlocks. larger leaves are split below an extra node
+
+	struct Node
+	{
+		float		mMinX[Width], mMinY[Width], mMinZ[Width];	// empty slots are (inf, -inf)
+		float		mMaxX[Width], mMaxY[Width], mMaxZ[Width];
+		uint32_t	mChildren[Width];							// node index, first block of a leaf or EmptyChild
+		uint8_t		mNumBlocks[Width];							// 0 for interior children
+		uint32_t	mOrders[8];									// per octant, 3 bits per child slot, nearest first
+	};
+
+	explicit WideBvhAccel(const BvhAccel & bvh);
+
+	bool intersect(Intersection * isectPtr, const Ray & ray) const override;
+	bool intersectP(const Ray & ray) const override;
+	Aabb computeBbox() const override;
+
+	std::vector<TriangleBlock>		mBlocks;
+	std::vector<Node>				mNodes;
+	Aabb							mBbox;
+
+private:
+	uint32_t collapse(const BvhAccel & bvh, const uint32_t binaryIndex);
+	uint32_t splitLeaf(const BvhAccel & bvh, const uint32_t offset, const size_t numRefs, const Aabb & bbox);
+	uint32_t appendBlocks(const BvhAccel & bvh, const uint32_t offset, const size_t numRefs);
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common/reflectcuts.h"
+#include "common/intersection.h"
+#include "common/span.h"
+
+#include "math/ray.h"
+#include "math/aabb.h"
+
+// cpu ray tracing over world space triangles (see RtScene::createTriangleMeshes)
+class Accel
+{
+public:
+	virtual ~Accel() {}
+
+	// closest hit in (ray.tmin, ray.tmax)
+	virtual bool intersect(Intersection * isectPtr, const Ray & ray) const = 0;
+
+	// any hit in (ray.tmin, ray.tmax)
+	virtual bool intersectP(const Ray & ray) const = 0;
+
+	virtual Aabb computeBbox() const = 0;
+
+	// batched queries for coherent rays (screen tiles, shadow rays of one vpl). neighbouring rays should be next to
+	// each other in the span. isects[i].mTrianglePtr is nullptr if rays[i] misses.
+	virtual void traceClosest(Span<const Ray> rays, Span<Intersection> isects) const
+	{
+		assert(rays.size() == isects.size());
+		for (size_t i = 0;i < rays.size();i++)
+		{
+			isects[i] = Intersection();
+			intersect(&isects[i], rays[i]);
+		}
+	}
+
+	virtual void traceOcclusion(Span<const Ray> rays, Span<bool> isOccluded) const
+	{
+		assert(rays.size() == isOccluded.size());
+		for (size_t i = 0;i < rays.size();i++) { isOccluded[i] = intersectP(rays[i]); }
+	}
+};
@@ -269,7 +269,7 @@ void FloatImage::Save(const FloatImage & fimage, const std::string & filepath)
 	else if (extension == "png")
 		SavePNG(fimage, filepath);
 	else
-		throw std::exception("unsupported file format");
+		throw std::exception(); // "unsupported file format"
 }
 
 FloatImage FloatImage::Pow(const FloatImage & image, const float exponent)
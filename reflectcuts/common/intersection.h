@@ -0,0 +1,27 @@
+#pragma once
+
+#include <numeric>
+
+#include "common/reflectcuts.h"
+#include "math/math.h"
+
+class Triangle;
+
+// closest hit returned by Accel::intersect. the barycentrics follow meshFineIntersect in triangleintersect.cu :
+// p = p0 * (1 - mB1 - mB2) + p1 * mB1 + p2 * mB2
+class Intersection
+{
+public:
+	// set by Shape::intersect
+	Float				mT = std::numeric_limits<Float>::infinity();
+	Float				mB1 = 0.0f;
+	Float				mB2 = 0.0f;
+	const Triangle *	mTrianglePtr = nullptr;
+
+	// filled once the closest hit is known (Triangle::fillIntersection)
+	Vec3				mPosition;
+	Vec3				mGeomNormal;
+	Vec3				mShadingNormal;
+	Vec2				mTexCoord;
+	int32_t				mMatIndex = 0;
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common/reflectcuts.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read only file mapping. pages are mapped copy-on-write so views can still be modified in place (eg. applyTransform)
+// without ever touching the file on disk.
+class MappedFile
+{
+public:
+	static shared_ptr<MappedFile> Open(const std::string & filepath)
+	{
+		shared_ptr<MappedFile> result = make_shared<MappedFile>();
+		if (!result->open(filepath)) { return nullptr; }
+		return result;
+	}
+
+	MappedFile() {}
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+	~MappedFile() { close(); }
+
+	bool open(const std::string & filepath)
+	{
+		close();
+#if defined(_WIN32)
+		mFileHandle = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (mFileHandle == INVALID_HANDLE_VALUE) { return false; }
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(mFileHandle, &fileSize) || fileSize.QuadPart == 0) { close(); return false; }
+		mSize = static_cast<size_t>(fileSize.QuadPart);
+
+		mMappingHandle = CreateFileMappingA(mFileHandle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		if (mMappingHandle == nullptr) { close(); return false; }
+
+		mData = static_cast<uint8_t*>(MapViewOfFile(mMappingHandle, FILE_MAP_COPY, 0, 0, 0));
+		if (mData == nullptr) { close(); return false; }
+#else
+		mFileDescriptor = ::open(filepath.c_str(), O_RDONLY);
+		if (mFileDescriptor < 0) { return false; }
+
+		struct stat fileStat;
+		if (fstat(mFileDescriptor, &fileStat) != 0 || fileStat.st_size == 0) { close(); return false; }
+		mSize = static_cast<size_t>(fileStat.st_size);
+
+		void * data = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, mFileDescriptor, 0);
+		if (data == MAP_FAILED) { close(); return false; }
+		mData = static_cast<uint8_t*>(data);
+#endif
+		return true;
+	}
+
+	void close()
+	{
+#if defined(_WIN32)
+		if (mData != nullptr) { UnmapViewOfFile(mData); }
+		if (mMappingHandle != nullptr) { CloseHandle(mMappingHandle); }
+		if (mFileHandle != INVALID_HANDLE_VALUE) { CloseHandle(mFileHandle); }
+		mMappingHandle = nullptr;
+		mFileHandle = INVALID_HANDLE_VALUE;
+#else
+		if (mData != nullptr) { munmap(mData, mSize); }
+		if (mFileDescriptor >= 0) { ::close(mFileDescriptor); }
+		mFileDescriptor = -1;
+#endif
+		mData = nullptr;
+		mSize = 0;
+	}
+
+	inline uint8_t * data() const { return mData; }
+	inline size_t size() const { return mSize; }
+
+private:
+	uint8_t *	mData = nullptr;
+	size_t		mSize = 0;
+#if defined(_WIN32)
+	HANDLE		mFileHandle = INVALID_HANDLE_VALUE;
+	HANDLE		mMappingHandle = nullptr;
+#else
+	int			mFileDescriptor = -1;
+#endif
+};
+
+// vector-like array which either owns its storage or is a zero-copy view into a MappedFile.
+// growing a view (push_back, resize) detaches it into owned storage first.
+template <typename T>
+class MappedArray
+{
+public:
+	MappedArray() {}
+
+	MappedArray(const std::vector<T> & values) : mOwned(values) {}
+
+	MappedArray(std::vector<T> && values) : mOwned(std::move(values)) {}
+
+	MappedArray(shared_ptr<MappedFile> file, const T * data, size_t size) :
+		mFile(file),
+		mView(const_cast<T*>(data)),
+		mViewSize(size)
+	{
+		assert(file != nullptr);
+		assert(reinterpret_cast<const uint8_t*>(data) >= file->data());
+		assert(reinterpret_cast<const uint8_t*>(data + size) <= file->data() + file->size());
+	}
+
+	inline bool isView() const { return mFile != nullptr; }
+
+	inline T * data() { return isView() ? mView : mOwned.data(); }
+	inline const T * data() const { return isView() ? mView : mOwned.data(); }
+	inline size_t size() const { return isView() ? mViewSize : mOwned.size(); }
+	inline bool empty() const { return size() == 0; }
+
+	inline T & operator[](size_t i) { return data()[i]; }
+	inline const T & operator[](size_t i) const { return data()[i]; }
+
+	inline T * begin() { return data(); }
+	inline T * end() { return data() + size(); }
+	inline const T * begin() const { return data(); }
+	inline const T * end() const { return data() + size(); }
+
+	inline void push_back(const T & value) { detach(); mOwned.push_back(value); }
+	inline void reserve(size_t size) { detach(); mOwned.reserve(size); }
+	inline void resize(size_t size) { detach(); mOwned.resize(size); }
+	inline void resize(size_t size, const T & value) { detach(); mOwned.resize(size, value); }
+	inline void shrink_to_fit() { if (!isView()) { mOwned.shrink_to_fit(); } }
+	inline void clear() { mFile = nullptr; mView = nullptr; mViewSize = 0; mOwned.clear(); }
+
+	// copy the viewed range into owned memory
+	void detach()
+	{
+		if (!isView()) { return; }
+		mOwned.assign(mView, mView + mViewSize);
+		mFile = nullptr;
+		mView = nullptr;
+		mViewSize = 0;
+	}
+
+private:
+	std::vector<T>			mOwned;
+	shared_ptr<MappedFile>	mFile = nullptr;
+	T *						mView = nullptr;
+	size_t					mViewSize = 0;
+};
@@ -145,6 +145,18 @@ public:
 		glfwDestroyWindow(mWindow);
 	}
 
+	// same condition that ends loop()
+	bool isOpen()
+	{
+		return glfwGetKey(mWindow, GLFW_KEY_ESCAPE) != GLFW_PRESS && glfwWindowShouldClose(mWindow) == 0;
+	}
+
+	// keeps the window responsive while nothing is rendered
+	void waitEvents(const double timeoutSec)
+	{
+		glfwWaitEventsTimeout(timeoutSec);
+	}
+
 	//--------------- window stuffs -----------------//
 
 	void setWindowTitle(const std::string & title)
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include "common/reflectcuts.h"
+
+// non owning view of a contiguous array (std::span is c++20). note that std::vector<bool> can't back a Span<bool>
+template <typename T>
+class Span
+{
+public:
+	Span() {}
+
+	Span(T * data, const size_t size):
+		mData(data),
+		mSize(size)
+	{
+	}
+
+	template <typename U>
+	Span(std::vector<U> & vec):
+		mData(vec.data()),
+		mSize(vec.size())
+	{
+	}
+
+	template <typename U>
+	Span(const std::vector<U> & vec):
+		mData(vec.data()),
+		mSize(vec.size())
+	{
+	}
+
+	// Span<T> -> Span<const T>
+	template <typename U>
+	Span(const Span<U> & span):
+		mData(span.data()),
+		mSize(span.size())
+	{
+	}
+
+	inline T & operator[](const size_t i) const { assert(i < mSize); return mData[i]; }
+	inline T * data() const { return mData; }
+	inline size_t size() const { return mSize; }
+	inline bool empty() const { return mSize == 0; }
+	inline T * begin() const { return mData; }
+	inline T * end() const { return mData + mSize; }
+
+	inline Span<T> subspan(const size_t offset, const size_t count) const
+	{
+		assert(offset + count <= mSize);
+		return Span<T>(mData + offset, count);
+	}
+
+private:
+	T *		mData = nullptr;
+	size_t	mSize = 0;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/reflectcuts.h"
+
+// fixed size worker pool. with USE_SINGLE_THREAD every task runs inline on the calling thread.
+class ThreadPool
+{
+public:
+	static size_t DefaultNumThreads()
+	{
+#ifdef USE_SINGLE_THREAD
+		return 1;
+#else
+		return std::max<size_t>(1, std::thread::hardware_concurrency());
+#endif
+	}
+
+	// shared pool for loaders and cpu techniques
+	static ThreadPool & Instance()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	explicit ThreadPool(size_t numThreads = DefaultNumThreads())
+	{
+		// the calling thread always helps out in parallelFor so one thread less is enough
+		for (size_t i = 1;i < numThreads;i++)
+		{
+			mWorkers.emplace_back([this]() { workerLoop(); });
+		}
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool & operator=(const ThreadPool &) = delete;
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mIsStopping = true;
+		}
+		mCondition.notify_all();
+		for (std::thread & worker : mWorkers) { worker.join(); }
+	}
+
+	inline size_t numThreads() const { return mWorkers.size() + 1; }
+
+	void submit(std::function<void()> task)
+	{
+		if (mWorkers.empty()) { task(); return; }
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mTasks.push_back(std::move(task));
+		}
+		mCondition.notify_one();
+	}
+
+	// calls func(i) for i in [begin, end) and blocks until all are done. the first exception thrown is rethrown here.
+	template <typename Func>
+	void parallelFor(size_t begin, size_t end, const Func & func, size_t grainSize = 1)
+	{
+		if (end <= begin) { return; }
+		grainSize = std::max<size_t>(grainSize, 1);
+		const size_t numChunks = (end - begin + grainSize - 1) / grainSize;
+
+		struct State
+		{
+			std::atomic<size_t>		mNextChunk{ 0 };
+			std::atomic<size_t>		mNumDoneChunks{ 0 };
+			std::mutex				mMutex;
+			std::condition_variable	mDone;
+			std::exception_ptr		mException;
+		};
+		shared_ptr<State> state = make_shared<State>();
+
+		// helpers may start after this function returned, so they only touch func while chunks are left
+		auto runChunks = [state, begin, end, grainSize, numChunks, &func]()
+		{
+			size_t chunk;
+			while ((chunk = state->mNextChunk.fetch_add(1)) < numChunks)
+			{
+				const size_t chunkBegin = begin + chunk * grainSize;
+				const size_t chunkEnd = std::min(end, chunkBegin + grainSize);
+				try
+				{
+					for (size_t i = chunkBegin;i < chunkEnd;i++) { func(i); }
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(state->mMutex);
+					if (!state->mException) { state->mException = std::current_exception(); }
+				}
+
+				if (state->mNumDoneChunks.fetch_add(1) + 1 == numChunks)
+				{
+					std::lock_guard<std::mutex> lock(state->mMutex);
+					state->mDone.notify_all();
+				}
+			}
+		};
+
+		const size_t numHelpers = std::min(mWorkers.size(), numChunks - 1);
+		for (size_t i = 0;i < numHelpers;i++) { submit(runChunks); }
+		runChunks();
+
+		std::unique_lock<std::mutex> lock(state->mMutex);
+		state->mDone.wait(lock, [&]() { return state->mNumDoneChunks.load() == numChunks; });
+		if (state->mException) { std::rethrow_exception(state->mException); }
+	}
+
+private:
+	void workerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mCondition.wait(lock, [this]() { return mIsStopping || !mTasks.empty(); });
+				if (mIsStopping && mTasks.empty()) { return; }
+				task = std::move(mTasks.front());
+				mTasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread>			mWorkers;
+	std::deque<std::function<void()>>	mTasks;
+	std::mutex							mMutex;
+	std::condition_variable				mCondition;
+	bool								mIsStopping = false;
+};
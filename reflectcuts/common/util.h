@@ -4,6 +4,8 @@
 #include "math/math.h"
 #include <json/json.hpp>
 
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
@@ -18,10 +20,34 @@ namespace Util
 		return result;
 	}
 
+	// FNV-1a over 64 bit words (tail bytes are folded in one by one). used for cache keys, not for security.
+	inline uint64_t HashFnv1a(const void * data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const uint64_t prime = 1099511628211ull;
+		const uint8_t * bytes = static_cast<const uint8_t*>(data);
+		size_t i = 0;
+		for (;i + 8 <= size;i += 8)
+		{
+			uint64_t word;
+			std::memcpy(&word, bytes + i, 8);
+			hash = (hash ^ word) * prime;
+		}
+		for (;i < size;i++) { hash = (hash ^ bytes[i]) * prime; }
+		return hash;
+	}
+
 	inline Vec4 ToVec4(const nlohmann::json & json)
 	{
 		Vec4 result;
 		for (int i = 0;i < 4;i++) { result[i] = json[i]; }
 		return result;
 	}
+
+	// 16 numbers in reading order (row by row), glm itself is column major
+	inline Mat4 ToMat4(const nlohmann::json & json)
+	{
+		Mat4 result;
+		for (int i = 0;i < 16;i++) { result[i % 4][i / 4] = json[i]; }
+		return result;
+	}
 };
\ No newline at end of file
@@ -35,9 +35,15 @@ namespace fsystem = std::experimental::filesystem;
 // realtime techniques
 #include "json/json.hpp"
 #include "realtimetechniques/rtcommon.h"
+#ifdef USE_CPU_ONLY
+#include "realtimetechniques/rtcputechnique.h"
+#include "realtimetechniques/rtcpu/rtcpucomphoton.h"
+#include "realtimetechniques/rtcpu/rtcpupt.h"
+#else
 #include "realtimetechniques/rtpt/rtpt2.h"
 #include "realtimetechniques/rtcomphoton/rtcomphoton.h"
 #include "realtimetechniques/rtcomphoton/rtlvccomphoton.h"
+#endif
 
 shared_ptr<RtScene> LoadScene(nlohmann::json & json, const std::string& jsonFilename)
 {
@@ -45,16 +51,65 @@ shared_ptr<RtScene> LoadScene(nlohmann::json & json, const std::string& jsonFile
 
 	if (json["scene"].is_null()) { return nullptr; }
 
+	// binary scene cache (*.rtcache next to each obj) is on by default
+	if (json.find("sceneCache") != json.end()) { rtScene->mUseSceneCache = json["sceneCache"]; }
+
+	// assimp-free multi threaded obj reader
+	if (json.find("objLoader") != json.end()) { rtScene->mUseObjLoader = (json["objLoader"] == "fast"); }
+
+	// triangles in morton order and vertex cache friendly clusters, done before the scene cache is written
+	if (json.find("reorderMeshes") != json.end()) { rtScene->mReorderMeshes = json["reorderMeshes"]; }
+
+	// octahedral normals and half float texcoords, optionally 16 bit positions relative to the mesh bbox
+	if (json.find("packVertices") != json.end()) { rtScene->mPackVertices = json["packVertices"]; }
+	if (json.find("quantizePositions") != json.end()) { rtScene->mQuantizePositions = json["quantizePositions"]; }
+
+	// merge all meshes into one vertex/index pool drawn with multi draw indirect and traced as one optix geometry
+	if (json.find("flattenGeometry") != json.end()) { rtScene->mFlattenGeometry = json["flattenGeometry"]; }
+
+	// "binned", "sbvh" or "lbvh" : build (or load) a bvh for the cpu techniques once the scene is loaded
+	if (json.find("cpuAccel") != json.end()) { rtScene->mCpuAccelType = json["cpuAccel"].get<std::string>(); }
+
+	// "binary", "wide" or "compressed" : node layout the cpu techniques trace against
+	if (json.find("cpuTraversal") != json.end()) { rtScene->mCpuTraversalType = json["cpuTraversal"].get<std::string>(); }
+
+	// entries are either a filename or { "obj": filename, "matrix": [16 numbers, row by row] } / { "obj": ..., "instances": [matrix, ...] }.
+	// repeated filenames share one copy of the geometry and are instanced. any entry may also be animated (see below)
 	for (size_t i = 0;i < json["scene"].size();i++)
 	{
-		std::string objFilename = json["scene"][i];
+		const nlohmann::json & entry = json["scene"][i];
+		std::string objFilename = entry.is_string() ? entry.get<std::string>() : entry["obj"].get<std::string>();
 		fsystem::path p = objFilename;
 		if (!p.is_absolute()) {
 			// Use the JSON file as the working directory
 			fsystem::path pJSON = jsonFilename;
 			p = pJSON.parent_path() / fsystem::path(p);
 		}
-		rtScene->addObject(p.string());
+
+		std::vector<glm::mat4> modelMatrices;
+		if (entry.is_object() && entry.find("instances") != entry.end())
+		{
+			for (const nlohmann::json & matrix : entry["instances"]) { modelMatrices.push_back(Util::ToMat4(matrix)); }
+		}
+		else if (entry.is_object() && entry.find("matrix") != entry.end())
+		{
+			modelMatrices.push_back(Util::ToMat4(entry["matrix"]));
+		}
+		else
+		{
+			modelMatrices.push_back(glm::mat4(1.0f));
+		}
+
+		// "animation": [matrix, ...] moves every placement of the entry, frame f by the matrix f % size (RtScene::setFrame)
+		if (entry.is_object() && entry.find("animation") != entry.end())
+		{
+			std::vector<glm::mat4> keyframes;
+			for (const nlohmann::json & matrix : entry["animation"]) { keyframes.push_back(Util::ToMat4(matrix)); }
+			for (const glm::mat4 & modelMatrix : modelMatrices) { rtScene->addAnimatedObject(p.string(), modelMatrix, keyframes); }
+			continue;
+		}
+
+		for (const glm::mat4 & modelMatrix : modelMatrices) { rtScene->addObject(p.string(), modelMatrix); }
 	}
 
 	std::string objFilenameLight = json["arealight"]["obj"];
@@ -81,9 +136,131 @@ shared_ptr<RtScene> LoadScene(nlohmann::json & json, const std::string& jsonFile
 
 	rtScene->setCamera(camera);
 
+#ifdef USE_CPU_ONLY
+	// the cpu techniques need a bvh even if the json doesn't ask for one
+	if (rtScene->mCpuAccelType.empty()) { rtScene->mCpuAccelType = "binned"; }
+#endif
+
+	// the bvh is cached next to the scene json like the object caches
+	if (!rtScene->mCpuAccelType.empty())
+	{
+		rtScene->buildCpuAccel(rtScene->mUseSceneCache ? jsonFilename + "." + rtScene->mCpuAccelType + ".rtbvh" : "");
+	}
+
 	return rtScene;
 }
 
+nlohmann::json WithoutKeys(const nlohmann::json & json, const std::vector<std::string> & keys)
+{
+	nlohmann::json result = json;
+	for (size_t i = 0;i < keys.size();i++)
+	{
+		result.erase(keys[i]);
+	}
+	return result;
+}
+
+// a technique section may contain "sweep" : [{...}, {...}]. every entry overrides some parameters of the section
+// and all resulting parameter sets are rendered with one setup
+std::vector<nlohmann::json> LoadParameterSets(const nlohmann::json & section)
+{
+	nlohmann::json base = WithoutKeys(section, { "sweep" });
+	if (section.find("sweep") == section.end())
+	{
+		return { base };
+	}
+
+	std::vector<nlohmann::json> result;
+	for (size_t i = 0;i < section["sweep"].size();i++)
+	{
+		const nlohmann::json & overrides = section["sweep"][i];
+		nlohmann::json parameters = base;
+		for (nlohmann::json::const_iterator it = overrides.begin();it != overrides.end();++it)
+		{
+			parameters[it.key()] = it.value();
+		}
+		result.push_back(parameters);
+	}
+	return result;
+}
+
+// re-reads the json file whenever it's written and hands out the new parameters of one technique section (sweep ignored).
+// scene, camera and resolution are loaded once. changing them needs a restart
+class ParameterWatcher
+{
+public:
+	ParameterWatcher(const std::string & jsonFilename, const nlohmann::json & json, const std::string & section):
+		mJsonFilename(jsonFilename),
+		mSection(section),
+		mFixedJson(WithoutKeys(json, TechniqueSections))
+	{
+		mLastWriteTime = fsystem::last_write_time(jsonFilename);
+	}
+
+	bool poll(nlohmann::json * parameters)
+	{
+		std::error_code error;
+		fsystem::file_time_type writeTime = fsystem::last_write_time(mJsonFilename, error);
+		if (error || writeTime == mLastWriteTime) { return false; }
+		mLastWriteTime = writeTime;
+
+		nlohmann::json json;
+		try
+		{
+			std::ifstream ifs(mJsonFilename, std::ios::in);
+			ifs >> json;
+		}
+		catch (const std::exception & e)
+		{
+			// the editor may still be writing. wait for the next write
+			std::cout << "watch : failed to parse " << mJsonFilename << " : " << e.what() << std::endl;
+			return false;
+		}
+
+		if (json.find(mSection) == json.end() || json[mSection].is_null())
+		{
+			std::cout << "watch : " << mSection << " is missing, keeping the current parameters" << std::endl;
+			return false;
+		}
+
+		if (WithoutKeys(json, TechniqueSections) != mFixedJson)
+		{
+			std::cout << "watch : only the " << mSection << " parameters are reloaded, restart to apply the other changes" << std::endl;
+		}
+
+		*parameters = WithoutKeys(json[mSection], { "sweep" });
+		std::cout << "watch : reloaded " << mSection << std::endl;
+		return true;
+	}
+
+	static const std::vector<std::string> TechniqueSections;
+
+	std::string mJsonFilename;
+	std::string mSection;
+	nlohmann::json mFixedJson;
+	fsystem::file_time_type mLastWriteTime;
+};
+
+const std::vector<std::string> ParameterWatcher::TechniqueSections = { "pt", "photonfam", "lvcphotonfam" };
+
+template <typename Technique>
+void RenderSection(shared_ptr<RtScene> & scene, nlohmann::json & json, const std::string & jsonFilename, const std::string & section, const bool doWatch)
+{
+	if (json[section].is_null()) { return; }
+
+	Technique technique;
+	glm::uvec2 resolution(json["resX"], json["resY"]);
+	if (doWatch)
+	{
+		ParameterWatcher watcher(jsonFilename, json, section);
+		technique.renderWatch(scene, resolution, WithoutKeys(json[section], { "sweep" }), [&](nlohmann::json * parameters) { return watcher.poll(parameters); });
+	}
+	else
+	{
+		technique.renderSweep(scene, resolution, LoadParameterSets(json[section]));
+	}
+}
+
 int main(int numArg, const char * args[])
 {
 	std::string jsonFilename;
@@ -96,29 +273,29 @@ int main(int numArg, const char * args[])
 	{
 		jsonFilename = "../scene/conference/conference_ours.json";
 	}
+
+	// --watch : keep the window open and re-render whenever the technique parameters in the json file change
+	bool doWatch = false;
+	for (int i = 2;i < numArg;i++)
+	{
+		if (std::string(args[i]) == "--watch") { doWatch = true; }
+	}
+
 	ifs.open(jsonFilename, std::ios::in);
 	// Load JSON file
 	nlohmann::json json;
 	ifs >> json;
 
 	shared_ptr<RtScene> scene = LoadScene(json, jsonFilename);
-	if(!json["pt"].is_null())
-	{
-		RtPt2 rtpt;
-		rtpt.render(scene, glm::uvec2(json["resX"], json["resY"]), json["pt"]);
-	}
-
-	if(!json["photonfam"].is_null())
-	{
-		RtComPhoton rtcomp;
-		rtcomp.render(scene, glm::uvec2(json["resX"], json["resY"]), json["photonfam"]);
-	}
-
-	if(!json["lvcphotonfam"].is_null())
-	{
-		RtLvcComPhoton rtcomp2;
-		rtcomp2.render(scene, glm::uvec2(json["resX"], json["resY"]), json["lvcphotonfam"]);
-	}
+#ifdef USE_CPU_ONLY
+	RenderSection<RtCpuPt>(scene, json, jsonFilename, "pt", doWatch);
+	RenderSection<RtCpuComPhoton>(scene, json, jsonFilename, "photonfam", doWatch);
+	RenderSection<RtCpuLvcComPhoton>(scene, json, jsonFilename, "lvcphotonfam", doWatch);
+#else
+	RenderSection<RtPt2>(scene, json, jsonFilename, "pt", doWatch);
+	RenderSection<RtComPhoton>(scene, json, jsonFilename, "photonfam", doWatch);
+	RenderSection<RtLvcComPhoton>(scene, json, jsonFilename, "lvcphotonfam", doWatch);
+#endif
 
 	return 0;
 }
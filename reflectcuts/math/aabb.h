@@ -95,6 +95,14 @@ public:
 		return Aabb(mm, nn);
 	}
 
+	// affine transform (eg. instance model matrix), the linear part as above plus the translation
+	inline static Aabb Transform(const Aabb & a, const Mat4 & mat)
+	{
+		const Aabb result = Transform(a, Mat3(mat));
+		const Vec3 translation(mat[3]);
+		return Aabb(result.pMin + translation, result.pMax + translation);
+	}
+
 	// same as Transform but surely 100% correct
 	inline static Aabb Transform_Exhaust(const Aabb & a, const Mat3 & mat)
 	{
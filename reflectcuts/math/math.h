@@ -15,6 +15,9 @@ namespace Math
 	const Float InvPi = (Float)(0.318309886183790671537767526745028724068919291480912897495);
 	const Float Epsilon = (Float)(1e-6);
 
+	// far slab distances are scaled by this so that rounding can't cull a box the ray grazes (pbrt 3, 1 + 2 gamma(3))
+	const Float RobustFarScale = (Float)(1.0 + 6.0 * 5.9604644775390625e-08 / (1.0 - 3.0 * 5.9604644775390625e-08));
+
 	inline size_t MaxExtent(const Vec3 & v)
 	{
 		if (v.x >= v.y) 
@@ -25,7 +28,7 @@ namespace Math
 		else // (y > x)
 		{
 			if (v.y >= v.z) { return 1; }
-			else { return 0; }
+			else { return 2; }
 		}
 		assert(false && "code shouldn't have reached this point");
 	}
@@ -46,6 +49,23 @@ namespace Math
 		return (int)std::floor(p);
 	}
 
+	// spreads the low 10 bits of v so there are two zero bits between them
+	inline uint32_t ExpandBits10(uint32_t v)
+	{
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	// 30 bit z-order code of a point in [0, 1]^3, points outside are clamped
+	inline uint32_t MortonCode3(const Vec3 & p)
+	{
+		const Vec3 q = glm::clamp(p * 1024.0f, Vec3(0.0f), Vec3(1023.0f));
+		return (ExpandBits10(static_cast<uint32_t>(q.x)) << 2) | (ExpandBits10(static_cast<uint32_t>(q.y)) << 1) | ExpandBits10(static_cast<uint32_t>(q.z));
+	}
+
 	// normal must be normalized
 	inline void ComputeOrthonormalBasis(Vec3 * xBasis, Vec3 * yBasis, const Vec3 & zBasis)
 	{
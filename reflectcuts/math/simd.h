@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+
+#include "common/reflectcuts.h"
+
+// thin wrappers over sse / avx registers for the cpu accelerators. Simd::Width lanes : 8 if the compiler targets avx
+// (/arch:AVX, -mavx) and 4 (sse) otherwise. loads are unaligned so the data can live in std::vector.
+#if defined(__AVX__)
+#define USE_AVX
+#endif
+
+namespace Simd
+{
+#ifdef USE_AVX
+	const size_t Width = 8;
+
+	struct Vfloat
+	{
+		Vfloat() {}
+		Vfloat(const __m256 & v): v(v) {}
+		explicit Vfloat(const float f): v(_mm256_set1_ps(f)) {}
+
+		static inline Vfloat Load(const float * p) { return _mm256_loadu_ps(p); }
+
+		// Width bytes widened to floats (avx without avx2 : two sse halves)
+		static inline Vfloat LoadU8(const uint8_t * p)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i words = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), zero);
+			const __m256i ints = _mm256_insertf128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(words, zero)), _mm_unpackhi_epi16(words, zero), 1);
+			return _mm256_cvtepi32_ps(ints);
+		}
+		inline void store(float * p) const { _mm256_storeu_ps(p, v); }
+
+		__m256 v;
+	};
+
+	inline Vfloat operator+(const Vfloat & a, const Vfloat & b) { return _mm256_add_ps(a.v, b.v); }
+	inline Vfloat operator-(const Vfloat & a, const Vfloat & b) { return _mm256_sub_ps(a.v, b.v); }
+	inline Vfloat operator*(const Vfloat & a, const Vfloat & b) { return _mm256_mul_ps(a.v, b.v); }
+	inline Vfloat operator/(const Vfloat & a, const Vfloat & b) { return _mm256_div_ps(a.v, b.v); }
+
+	// if a is nan the result is b (so nan slab distances don't decide anything)
+	inline Vfloat Min(const Vfloat & a, const Vfloat & b) { return _mm256_min_ps(a.v, b.v); }
+	inline Vfloat Max(const Vfloat & a, const Vfloat & b) { return _mm256_max_ps(a.v, b.v); }
+
+	// one bit per lane
+	inline int LessEqual(const Vfloat & a, const Vfloat & b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+
+	// lane wise comparison results. comparisons with nan are false (!= included)
+	struct Vmask
+	{
+		Vmask(const __m256 & v): v(v) {}
+		__m256 v;
+	};
+
+	inline Vmask operator&(const Vmask & a, const Vmask & b) { return _mm256_and_ps(a.v, b.v); }
+	inline Vmask operator|(const Vmask & a, const Vmask & b) { return _mm256_or_ps(a.v, b.v); }
+	inline Vmask operator<(const Vfloat & a, const Vfloat & b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+	inline Vmask operator>(const Vfloat & a, const Vfloat & b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+	inline Vmask operator<=(const Vfloat & a, const Vfloat & b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+	inline Vmask operator>=(const Vfloat & a, const Vfloat & b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+	inline Vmask operator==(const Vfloat & a, const Vfloat & b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+	inline Vmask operator!=(const Vfloat & a, const Vfloat & b) { return _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_OQ); }
+	inline int Movemask(const Vmask & m) { return _mm256_movemask_ps(m.v); }
+
+	inline Vfloat Sqrt(const Vfloat & a) { return _mm256_sqrt_ps(a.v); }
+
+	// m ? a : b lane wise
+	inline Vfloat Select(const Vmask & m, const Vfloat & a, const Vfloat & b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+#else
+	const size_t Width = 4;
+
+	struct Vfloat
+	{
+		Vfloat() {}
+		Vfloat(const __m128 & v): v(v) {}
+		explicit Vfloat(const float f): v(_mm_set1_ps(f)) {}
+
+		static inline Vfloat Load(const float * p) { return _mm_loadu_ps(p); }
+
+		// Width bytes widened to floats
+		static inline Vfloat LoadU8(const uint8_t * p)
+		{
+			int32_t bytes;
+			std::memcpy(&bytes, p, sizeof(bytes));
+			const __m128i zero = _mm_setzero_si128();
+			return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero));
+		}
+		inline void store(float * p) const { _mm_storeu_ps(p, v); }
+
+		__m128 v;
+	};
+
+	inline Vfloat operator+(const Vfloat & a, const Vfloat & b) { return _mm_add_ps(a.v, b.v); }
+	inline Vfloat operator-(const Vfloat & a, const Vfloat & b) { return _mm_sub_ps(a.v, b.v); }
+	inline Vfloat operator*(const Vfloat & a, const Vfloat & b) { return _mm_mul_ps(a.v, b.v); }
+	inline Vfloat operator/(const Vfloat & a, const Vfloat & b) { return _mm_div_ps(a.v, b.v); }
+
+	// if a is nan the result is b (so nan slab distances don't decide anything)
+	inline Vfloat Min(const Vfloat & a, const Vfloat & b) { return _mm_min_ps(a.v, b.v); }
+	inline Vfloat Max(const Vfloat & a, const Vfloat & b) { return _mm_max_ps(a.v, b.v); }
+
+	// one bit per lane
+	inline int LessEqual(const Vfloat & a, const Vfloat & b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+
+	// lane wise comparison results. comparisons with nan are false (!= included)
+	struct Vmask
+	{
+		Vmask(const __m128 & v): v(v) {}
+		__m128 v;
+	};
+
+	inline Vmask operator&(const Vmask & a, const Vmask & b) { return _mm_and_ps(a.v, b.v); }
+	inline Vmask operator|(const Vmask & a, const Vmask & b) { return _mm_or_ps(a.v, b.v); }
+	inline Vmask operator<(const Vfloat & a, const Vfloat & b) { return _mm_cmplt_ps(a.v, b.v); }
+	inline Vmask operator>(const Vfloat & a, const Vfloat & b) { return _mm_cmpgt_ps(a.v, b.v); }
+	inline Vmask operator<=(const Vfloat & a, const Vfloat & b) { return _mm_cmple_ps(a.v, b.v); }
+	inline Vmask operator>=(const Vfloat & a, const Vfloat & b) { return _mm_cmpge_ps(a.v, b.v); }
+	inline Vmask operator==(const Vfloat & a, const Vfloat & b) { return _mm_cmpeq_ps(a.v, b.v); }
+	inline Vmask operator!=(const Vfloat & a, const Vfloat & b) { return _mm_andnot_ps(_mm_cmpunord_ps(a.v, b.v), _mm_cmpneq_ps(a.v, b.v)); }
+	inline int Movemask(const Vmask & m) { return _mm_movemask_ps(m.v); }
+
+	inline Vfloat Sqrt(const Vfloat & a) { return _mm_sqrt_ps(a.v); }
+
+	// m ? a : b lane wise (no blendv before sse 4.1)
+	inline Vfloat Select(const Vmask & m, const Vfloat & a, const Vfloat & b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+#endif
+};
@@ -9,6 +9,7 @@
 #include "rtmath.cuh"
 #include "rtlightsource.cuh"
 #include "rtmaterial.cuh"
+#include "rtmaterialrecord.h"
 #include "rtcomphoton/rtphotonrecord.h"
 
 ///// shared info /////
@@ -105,15 +106,16 @@ rtDeclareVariable(optix::Ray, ray, rtCurrentRay, );
 rtDeclareVariable(float2, texcoord, attribute texcoord, );
 rtDeclareVariable(float3, geometryNormal, attribute geometryNormal, );
 rtDeclareVariable(float, tHit, rtIntersectionDistance, );
-rtTextureSampler<float4, 2> lambertReflectanceTexture;
-rtTextureSampler<float4, 2> phongReflectanceTexture;
-rtTextureSampler<float4, 2> phongExponentTexture;
-rtDeclareVariable(float4, lightIntensity, , );
+rtBuffer<RtMaterialRecord, 1> materialBuffer;
+rtDeclareVariable(int, materialIndex, attribute materialIndex, );
 
 RT_PROGRAM void rtMaterialClosestHit()
 {
-	float3 worldGeometryNormal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, geometryNormal));
-	float3 ffNormal = faceforward(worldGeometryNormal, -ray.direction, worldGeometryNormal);
+	const RtMaterialRecord & material = materialBuffer[materialIndex];
+	const float4 lightIntensity = material.mLightIntensity;
+
+	// geometryNormal is already in world space (meshFineIntersect)
+	float3 ffNormal = faceforward(geometryNormal, -ray.direction, geometryNormal);
 
 	// update position and normal
 	float3 position = prdRadiance.nextPosition;
@@ -127,10 +129,10 @@ RT_PROGRAM void rtMaterialClosestHit()
 		return;
 	}
 
-	// fetch all texture information
-	float3 lambertReflectance = make_float3(tex2D(lambertReflectanceTexture, texcoord.x, texcoord.y));
-	float3 phongReflectance = make_float3(tex2D(phongReflectanceTexture, texcoord.x, texcoord.y));
-	float phongExponent = tex2D(phongExponentTexture, texcoord.x, texcoord.y).x;
+	// fetch material information (inline constants, textures only where needed)
+	float3 lambertReflectance, phongReflectance;
+	float phongExponent;
+	FetchMaterial(&lambertReflectance, &phongReflectance, &phongExponent, material, texcoord);
 
 	const unsigned int index = prdRadiance.photonIndex;
 
@@ -9,6 +9,7 @@
 #include "rtmath.cuh"
 #include "rtlightsource.cuh"
 #include "rtmaterial.cuh"
+#include "rtmaterialrecord.h"
 
 using namespace optix;
 
@@ -101,21 +102,22 @@ __device__ float pdfW2A(const float3 & n2, const float3 & v12)
 rtDeclareVariable(float2, texcoord, attribute texcoord, );
 rtDeclareVariable(float3, geometryNormal, attribute geometryNormal, );
 rtDeclareVariable(float, tHit, rtIntersectionDistance, );
-rtTextureSampler<float4, 2> lambertReflectanceTexture;
-rtTextureSampler<float4, 2> phongReflectanceTexture;
-rtTextureSampler<float4, 2> phongExponentTexture;
-rtDeclareVariable(float4, lightIntensity, , );
+rtBuffer<RtMaterialRecord, 1> materialBuffer;
+rtDeclareVariable(int, materialIndex, attribute materialIndex, );
 
 //#define FAVOR_LIGHT_SAMPLE
 //#define FAVOR_BSDF_SAMPLE
 
 RT_PROGRAM void rtMaterialClosestHit()
 {
+	const RtMaterialRecord & material = materialBuffer[materialIndex];
+	const float4 lightIntensity = material.mLightIntensity;
+
 	ASSERT(!isnan(prdRadiance.attenuation.x) && !isnan(prdRadiance.attenuation.y) && !isnan(prdRadiance.attenuation.z), "prdRadiance.atteanuation(1) is nan");
 	//prdRadiance.hit = true;
 
-	float3 worldGeometryNormal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, geometryNormal));
-	float3 ffNormal = faceforward(worldGeometryNormal, -ray.direction, worldGeometryNormal);
+	// geometryNormal is already in world space (meshFineIntersect)
+	float3 ffNormal = faceforward(geometryNormal, -ray.direction, geometryNormal);
 
 	// update position and normal
 	float3 nextPosition = ray.origin + tHit * ray.direction;
@@ -162,9 +164,9 @@ RT_PROGRAM void rtMaterialClosestHit()
 	prd2.hit = false;
 	rtTrace(topObject, ray, prd2);
 
-	float3 lambertReflectance = make_float3(tex2D(lambertReflectanceTexture, texcoord.x, texcoord.y));
-	float3 phongReflectance = make_float3(tex2D(phongReflectanceTexture, texcoord.x, texcoord.y));
-	float phongExponent = tex2D(phongExponentTexture, texcoord.x, texcoord.y).x;
+	float3 lambertReflectance, phongReflectance;
+	float phongExponent;
+	FetchMaterial(&lambertReflectance, &phongReflectance, &phongExponent, material, texcoord);
 
 	// check bad color (for reduce bracnching)
 	float maxLambert = MaxColor(lambertReflectance);
@@ -1,23 +1,115 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <vector>
 #include <map>
+#include <mutex>
 
 #include "common/reflectcuts.h"
+#include "accel/binnedbvh.h"
+#include "accel/compressedwidebvh.h"
+#include "accel/dynamicbvh.h"
+#include "accel/lbvh.h"
+#include "accel/sbvh.h"
+#include "accel/widebvh.h"
+#include "common/floatimage/floatimage.h"
+#include "common/mappedfile.h"
+#include "common/stopwatch.h"
+#include "common/threadpool.h"
 #include "common/util.h"
 #include "math/aabb.h"
+#include "math/mapping.h"
+#include "shapes/glbloader.h"
+#include "shapes/meshreorder.h"
+#include "shapes/objloader.h"
+#include "shapes/trianglemesh.h"
 
+#include "json/json.hpp"
+
+// the cpu only build (USE_CPU_ONLY) has no assimp, opengl or optix. obj files go through ObjLoader, only the import
+// flags of assimp are still needed for the scene cache key
+#ifndef USE_CPU_ONLY
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
+#endif
 #include <assimp/postprocess.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
+#ifndef USE_CPU_ONLY
 #include <vector_types.h>
 
 #include "opengl/buffer.h"
+#include "opengl/shader.h"
+#endif
+#include "realtimetechniques/rtmaterialrecord.h"
+
+// what a material slot refers to before anything is decoded. kept separately from RtTexture so it can be cached on disk.
+struct RtTextureDesc
+{
+	enum class Type : uint32_t
+	{
+		Missing = 0,
+		Constant = 1,
+		Texture = 2
+	};
+
+#ifndef USE_CPU_ONLY
+	static RtTextureDesc FromAiMaterial(const aiMaterial & aiMat, const aiTextureType & textureKey, const char * colorKey, unsigned int type, unsigned int index)
+	{
+		RtTextureDesc result;
+		aiString texturePath;
+		aiColor3D reflectance;	// kd
+
+		if (aiMat.Get(AI_MATKEY_TEXTURE(textureKey, 0), texturePath) == aiReturn_SUCCESS)
+		{
+			result.mType = Type::Texture;
+			result.mTextureName = texturePath.C_Str();
+		}
+		else if (aiMat.Get(colorKey, type, index, reflectance) == aiReturn_SUCCESS)
+		{
+			result.mType = Type::Constant;
+			result.mColor = glm::vec3(reflectance.r, reflectance.g, reflectance.b);
+
+			// fix shininess bug introduced by assimp (they said "to match what most renderers do")
+			if (textureKey == aiTextureType::aiTextureType_SHININESS) { result.mColor /= 4.0f; }
+		}
+
+		return result;
+	}
+#endif
+
+	Type			mType = Type::Missing;
+	glm::vec3		mColor = glm::vec3(0.0f);
+	std::string		mTextureName;	// relative to the directory of the object file
+
+	// gltf only, never stored in the scene cache
+	shared_ptr<MappedFile>	mEmbeddedFile;			// encoded image inside the glb, mTextureName is then just a unique name
+	glm::vec3				mTextureScale = glm::vec3(1.0f);	// the texels are multiplied with it (base color factor)
+	uint64_t				mEmbeddedOffset = 0;
+	uint64_t				mEmbeddedSize = 0;
+	bool					mIsSrgb = false;		// 8 bit srgb color (base color maps)
+	bool					mIsTopDown = false;		// texcoord v = 0 addresses the first row of the image
+};
+
+// storage format of a texture, chosen per texture. texels are decoded on fetch by every sampler (cpu, opengl and optix).
+enum class RtTextureFormat : uint32_t
+{
+	Rgba32f = 0,	// constants
+	R32f,			// constant phong exponent
+	Rgba16f,		// hdr or non-linear 8 bit input
+	R16f,			// phong exponent maps that don't fit in 8 bit
+	Rgba8,			// 8 bit maps loaded with gamma = 1 (bit exact with the source)
+	Rgba8Srgb,		// 8 bit sRGB maps, decoded to linear on fetch
+	R8,				// 8 bit phong exponent maps
+	Rgb9e5			// shared exponent hdr (FloatImage)
+};
 
 struct RtTexture
 {
@@ -27,102 +119,154 @@ struct RtTexture
 		return std::pow((value + (float) 0.055) * (float) (1.0 / 1.055), (float) 2.4);
 	}
 
-	static shared_ptr<RtTexture> LoadRtTexture(const std::string & filedir, const aiMaterial & aiMat, const aiTextureType & textureKey, const char * colorKey, unsigned int type, unsigned int index)
+	inline static size_t BytesPerTexel(const RtTextureFormat format)
 	{
-		stbi_set_flip_vertically_on_load(1);
-		static std::map<const std::string, shared_ptr<RtTexture>> gTexturesMap;
-		aiString texturePath;
-		aiColor3D reflectance;	// kd
+		switch (format)
+		{
+		case RtTextureFormat::Rgba32f:		return 16;
+		case RtTextureFormat::R32f:			return 4;
+		case RtTextureFormat::Rgba16f:		return 8;
+		case RtTextureFormat::R16f:			return 2;
+		case RtTextureFormat::Rgba8:		return 4;
+		case RtTextureFormat::Rgba8Srgb:	return 4;
+		case RtTextureFormat::R8:			return 1;
+		case RtTextureFormat::Rgb9e5:		return 4;
+		}
+		assert(false && "unknown texture format");
+		return 0;
+	}
 
-		if (aiMat.Get(AI_MATKEY_TEXTURE(textureKey, 0), texturePath) == aiReturn_SUCCESS)
+	inline static bool IsSingleChannel(const RtTextureFormat format)
+	{
+		return format == RtTextureFormat::R32f || format == RtTextureFormat::R16f || format == RtTextureFormat::R8;
+	}
+
+	// textures are shared between materials and scenes. the first thread asking for a path decodes it, later ones wait for that result.
+	struct Cache
+	{
+		Cache()
+		{
+			// stb keeps this flag in a global, so set it once before any worker decodes
+			stbi_set_flip_vertically_on_load(1);
+		}
+
+		template <typename LoadFunc>
+		shared_ptr<RtTexture> getOrLoad(const std::string & filepath, const LoadFunc & load)
 		{
-			std::string textureFilepath = filedir + texturePath.C_Str();
-			std::map<const std::string, shared_ptr<RtTexture>>::iterator texturesMapIterator = gTexturesMap.find(textureFilepath);
+			std::promise<shared_ptr<RtTexture>> promise;
+			std::shared_future<shared_ptr<RtTexture>> future;
+			bool isLoader = false;
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				auto texturesIterator = mTextures.find(filepath);
+				if (texturesIterator == mTextures.end())
+				{
+					texturesIterator = mTextures.emplace(filepath, promise.get_future().share()).first;
+					isLoader = true;
+				}
+				future = texturesIterator->second;
+			}
+
+			if (!isLoader) { return future.get(); }
 
-			if (texturesMapIterator == gTexturesMap.end())
+			try
 			{
-				shared_ptr<RtTexture> result = make_shared<RtTexture>(textureFilepath, 1.0f);
-				gTexturesMap[textureFilepath] = result;
+				shared_ptr<RtTexture> result = load();
+				promise.set_value(result);
 				return result;
 			}
-			else
+			catch (...)
 			{
-				return texturesMapIterator->second;
+				promise.set_exception(std::current_exception());
+				throw;
 			}
 		}
-		else if (aiMat.Get(colorKey, type, index, reflectance) == aiReturn_SUCCESS)
+
+		std::mutex																mMutex;
+		std::map<const std::string, std::shared_future<shared_ptr<RtTexture>>>	mTextures;
+	};
+
+	static Cache & GetCache()
+	{
+		static Cache gTexturesCache;
+		return gTexturesCache;
+	}
+
+	// single channel slots (phong exponent) are stored in a one channel format, so they are cached separately
+	static shared_ptr<RtTexture> LoadRtTexture(const std::string & filedir, const RtTextureDesc & desc, const bool isSingleChannel = false)
+	{
+		if (desc.mType == RtTextureDesc::Type::Texture)
 		{
-			if (textureKey == aiTextureType::aiTextureType_SHININESS)
+			std::string textureFilepath = filedir + desc.mTextureName;
+#ifndef _WIN32
+			// material libraries written on windows name their textures with backslashes
+			std::replace(textureFilepath.begin(), textureFilepath.end(), '\\', '/');
+#endif
+			const std::string key = textureFilepath + (isSingleChannel ? "|r" : "") + (desc.mIsSrgb ? "|srgb" : "") + (desc.mIsTopDown ? "|top" : "");
+			if (desc.mEmbeddedFile != nullptr)
 			{
-				// fix shininess bug introduced by assimp (they said "to match what most renderers do")
-				shared_ptr<RtTexture> tex = make_shared<RtTexture>(reflectance, 1.0f);
-				tex->mData[0] /= 4.0f;
-				tex->mData[1] /= 4.0f;
-				tex->mData[2] /= 4.0f;
-				tex->mData[3] /= 4.0f;
-				return tex;
+				const uint8_t * encoded = desc.mEmbeddedFile->data() + desc.mEmbeddedOffset;
+				return GetCache().getOrLoad(key, [&]() { return make_shared<RtTexture>(encoded, desc.mEmbeddedSize, 1.0f, isSingleChannel, desc.mIsSrgb, desc.mIsTopDown); });
 			}
-
-			//return make_shared<RtTexture>(reflectance, true);
-			return make_shared<RtTexture>(reflectance, 1.0f);
-			//return make_shared<RtTexture>(reflectance, 2.2f);
+			return GetCache().getOrLoad(key, [&]() { return make_shared<RtTexture>(textureFilepath, 1.0f, isSingleChannel, desc.mIsSrgb, desc.mIsTopDown); });
+		}
+		else if (desc.mType == RtTextureDesc::Type::Constant)
+		{
+			if (isSingleChannel) { return make_shared<RtTexture>(desc.mColor.r); }
+			//return make_shared<RtTexture>(desc.mColor.r, desc.mColor.g, desc.mColor.b, true);
+			return make_shared<RtTexture>(desc.mColor.r, desc.mColor.g, desc.mColor.b, 1.0f);
+			//return make_shared<RtTexture>(desc.mColor.r, desc.mColor.g, desc.mColor.b, 2.2f);
 		}
 
 		throw std::exception(); // "Loading Texture Error"
 	}
 
+#ifndef USE_CPU_ONLY
+	static shared_ptr<RtTexture> LoadRtTexture(const std::string & filedir, const aiMaterial & aiMat, const aiTextureType & textureKey, const char * colorKey, unsigned int type, unsigned int index)
+	{
+		return LoadRtTexture(filedir, RtTextureDesc::FromAiMaterial(aiMat, textureKey, colorKey, type, index), textureKey == aiTextureType_SHININESS);
+	}
+#endif
+
 	RtTexture()
 	{
+		mFormat = RtTextureFormat::Rgba32f;
 		mIsExistGl = false;
 		mIsExistOptix = false;
 	}
 
 	RtTexture(const float r, const float g, const float b, const float gamma):
-		mSize(glm::uvec2(1, 1)),
-		mIsExistGl(false),
-		mIsExistOptix(false)
+		RtTexture(glm::uvec2(1, 1), RtTextureFormat::Rgba32f)
 	{
-		mData.resize(4);
-		mData[0] = std::pow(r, gamma);
-		mData[1] = std::pow(g, gamma);
-		mData[2] = std::pow(b, gamma);
-		mData[3] = 0.f;
+		store(0, glm::vec4(std::pow(r, gamma), std::pow(g, gamma), std::pow(b, gamma), 0.f));
 	}
 
 	RtTexture(const float r, const float g, const float b, const bool useSrgb):
-		mSize(glm::uvec2(1, 1)),
-		mIsExistGl(false),
-		mIsExistOptix(false)
+		RtTexture(glm::uvec2(1, 1), RtTextureFormat::Rgba32f)
 	{
-		mData.resize(4);
 		if (useSrgb)
 		{
-			mData[0] = FromSRGBComponent(r);
-			mData[1] = FromSRGBComponent(g);
-			mData[2] = FromSRGBComponent(b);
+			store(0, glm::vec4(FromSRGBComponent(r), FromSRGBComponent(g), FromSRGBComponent(b), 0.f));
 		}
 		else
 		{
-			mData[0] = r;
-			mData[1] = g;
-			mData[2] = b;
+			store(0, glm::vec4(r, g, b, 0.f));
 		}
-		mData[3] = 0.f;
 	}
 
-	RtTexture(const FloatImage & image):
-		mSize(image.getSize()),
-		mIsExistGl(false),
-		mIsExistOptix(false)
+	// single channel constant
+	explicit RtTexture(const float value):
+		RtTexture(glm::uvec2(1, 1), RtTextureFormat::R32f)
 	{
-		mData.resize(mSize.x * mSize.y * 4);
+		store(0, glm::vec4(value));
+	}
 
+	RtTexture(const FloatImage & image, const RtTextureFormat format = RtTextureFormat::Rgb9e5):
+		RtTexture(image.getSize(), format)
+	{
 		for (size_t i = 0;i < mSize.x * mSize.y;i++)
 		{
-			for (size_t j = 0;j < 3;j++)
-			{
-				mData[i * 4 + j] = image._mData[i][j];
-			}
+			store(i, glm::vec4(image._mData[i][0], image._mData[i][1], image._mData[i][2], 0.f));
 		}
 	}
 
@@ -136,66 +280,177 @@ struct RtTexture
 	{
 	}
 
-	RtTexture(const std::string & filepath, const float gamma):
+	// 8 bit files loaded with gamma = 1 are kept as they are (Rgba8 / R8), anything else goes through half floats
+	RtTexture(const std::string & filepath, const float gamma, const bool isSingleChannel = false, const bool isSrgb = false, const bool isTopDown = false):
 		mIsExistGl(false),
 		mIsExistOptix(false)
 	{
 		int width = 0, height = 0, channel = 0;
 		stbi_uc * data = stbi_load(filepath.c_str(), &width, &height, &channel, 3);
+		decodeRgb8(data, width, height, channel, gamma, isSingleChannel, isSrgb, isTopDown, filepath);
+	}
+
+	// encoded png / jpeg in memory, eg. embedded in a glb
+	RtTexture(const uint8_t * encoded, const size_t encodedSize, const float gamma, const bool isSingleChannel, const bool isSrgb, const bool isTopDown):
+		mIsExistGl(false),
+		mIsExistOptix(false)
+	{
+		int width = 0, height = 0, channel = 0;
+		stbi_uc * data = stbi_load_from_memory(encoded, int(encodedSize), &width, &height, &channel, 3);
+		decodeRgb8(data, width, height, channel, gamma, isSingleChannel, isSrgb, isTopDown, "embedded texture");
+	}
 
-		assert(data != nullptr);
-		assert(width > 0);
-		assert(height > 0);
+	// rows arrive bottom up (stbi flip is on), top down textures flip them back. srgb color is kept as Rgba8Srgb.
+	// a file stbi can't decode becomes a white 1x1 texture, so the slot is left with its factor alone
+	void decodeRgb8(stbi_uc * data, const int width, const int height, const int channel, const float gamma, const bool isSingleChannel, const bool isSrgb, const bool isTopDown, const std::string & name)
+	{
+		if (data == nullptr || width <= 0 || height <= 0)
+		{
+			std::cout << "failed to load texture : " << name << " (" << stbi_failure_reason() << ")" << std::endl;
+			if (data != nullptr) { stbi_image_free(data); }
+			allocate(glm::uvec2(1, 1), isSingleChannel ? RtTextureFormat::R32f : RtTextureFormat::Rgba32f);
+			store(0, glm::vec4(1.0f, 1.0f, 1.0f, 0.0f));
+			return;
+		}
 		assert(channel == 1 || channel == 3 || channel == 4);
 
 		size_t dataSize = width * height;
-		mSize = glm::uvec2(width, height);
-		mData.resize(dataSize * 4);
+		const bool isLinear = (gamma == 1.0f);
+		if (isSingleChannel)
+		{
+			allocate(glm::uvec2(width, height), isLinear ? RtTextureFormat::R8 : RtTextureFormat::R16f);
+		}
+		else if (isSrgb)
+		{
+			allocate(glm::uvec2(width, height), RtTextureFormat::Rgba8Srgb);
+		}
+		else
+		{
+			allocate(glm::uvec2(width, height), isLinear ? RtTextureFormat::Rgba8 : RtTextureFormat::Rgba16f);
+		}
 
-		if (channel == 1)
+		auto source = [&](const size_t i) { return isTopDown ? (size_t(height - 1) - i / width) * width + i % width : i; };
+
+		if (isLinear || (isSrgb && !isSingleChannel))
 		{
+			// stbi_load was asked for 3 components so data is always rgb regardless of the channel count in the file
 			for (size_t i = 0;i < dataSize;i++)
 			{
-				for (size_t j = 0;j < 3;j++)
+				const size_t s = source(i);
+				if (isSingleChannel)
 				{
-					// convert from rgb to float accurately
-					mData[i * 4 + j] = std::pow(static_cast<float>(data[i * 3]) / 255.0f, gamma);
+					mData[i] = data[s * 3];
 				}
-				mData[i * 4 + 3] = 0.f;
-			}
-		}
-		if (channel == 3)
-		{
-			for (size_t i = 0;i < dataSize;i++)
-			{
-				for (size_t j = 0;j < 3;j++)
+				else
 				{
-					// convert from rgb to float accurately
-					mData[i * 4 + j] = std::pow(static_cast<float>(data[i * 3 + j]) / 255.0f, gamma);
+					for (size_t j = 0;j < 3;j++) { mData[i * 4 + j] = data[s * 3 + j]; }
+					mData[i * 4 + 3] = 0;
 				}
-				mData[i * 4 + 3] = 0.f;
 			}
 		}
-		else if (channel == 4)
+		else
 		{
+			// 8 bit input only has 256 possible values, convert from rgb to float accurately once per value
+			float gammaTable[256];
+			for (size_t i = 0;i < 256;i++) { gammaTable[i] = std::pow(static_cast<float>(i) / 255.0f, gamma); }
+
 			for (size_t i = 0;i < dataSize;i++)
 			{
-				for (size_t j = 0;j < 3;j++)
-				{
-					// convert from rgb to float accurately
-					mData[i * 4 + j] = std::pow(static_cast<float>(data[i * 4 + j]) / 255.0f, gamma);
-				}
-				mData[i * 4 + 3] = 0.f;
+				const size_t s = source(i);
+				store(i, glm::vec4(gammaTable[data[s * 3]], gammaTable[data[s * 3 + 1]], gammaTable[data[s * 3 + 2]], 0.f));
 			}
 		}
 
-
 		stbi_image_free(data);
 	}
 
+	// re-encode an existing texture into another format
+	RtTexture(const RtTexture & source, const RtTextureFormat format):
+		RtTexture(source.mSize, format)
+	{
+		for (size_t i = 0;i < mSize.x * mSize.y;i++)
+		{
+			store(i, source.fetch(i));
+		}
+	}
+
+	inline size_t sizeInBytes() const
+	{
+		return mData.size();
+	}
+
+	// decode texel i (row major). single channel formats return the value in all of rgb, alpha is 0 like the rgb formats.
+	glm::vec4 fetch(const size_t i) const
+	{
+		const uint8_t * texel = &mData[i * BytesPerTexel(mFormat)];
+		switch (mFormat)
+		{
+		case RtTextureFormat::Rgba32f:
+		{
+			glm::vec4 result;
+			std::memcpy(&result[0], texel, sizeof(glm::vec4));
+			return result;
+		}
+		case RtTextureFormat::R32f:
+		{
+			float value;
+			std::memcpy(&value, texel, sizeof(float));
+			return glm::vec4(value, value, value, 0.f);
+		}
+		case RtTextureFormat::Rgba16f:
+		{
+			uint16_t halfs[4];
+			std::memcpy(halfs, texel, sizeof(halfs));
+			return glm::vec4(glm::unpackHalf1x16(halfs[0]), glm::unpackHalf1x16(halfs[1]), glm::unpackHalf1x16(halfs[2]), glm::unpackHalf1x16(halfs[3]));
+		}
+		case RtTextureFormat::R16f:
+		{
+			uint16_t half;
+			std::memcpy(&half, texel, sizeof(half));
+			const float value = glm::unpackHalf1x16(half);
+			return glm::vec4(value, value, value, 0.f);
+		}
+		case RtTextureFormat::Rgba8:
+			return glm::vec4(texel[0], texel[1], texel[2], texel[3]) / 255.0f;
+		case RtTextureFormat::Rgba8Srgb:
+			return glm::vec4(FromSRGBComponent(texel[0] / 255.0f), FromSRGBComponent(texel[1] / 255.0f), FromSRGBComponent(texel[2] / 255.0f), texel[3] / 255.0f);
+		case RtTextureFormat::R8:
+		{
+			const float value = texel[0] / 255.0f;
+			return glm::vec4(value, value, value, 0.f);
+		}
+		case RtTextureFormat::Rgb9e5:
+		{
+			uint32_t packed;
+			std::memcpy(&packed, texel, sizeof(packed));
+			return glm::vec4(glm::unpackF3x9_E1x5(packed), 0.f);
+		}
+		}
+		return glm::vec4(0.f);
+	}
+
+	inline glm::vec4 fetch(const uint32_t x, const uint32_t y) const
+	{
+		return fetch(size_t(y) * mSize.x + x);
+	}
+
+	// same as the gpu samplers : repeat wrapping, linear filtering, texel centers at half integers
+	glm::vec4 evalBilinear(const glm::vec2 & uv) const
+	{
+		const glm::vec2 st = uv * glm::vec2(mSize) - glm::vec2(0.5f);
+		const glm::vec2 base = glm::floor(st);
+		const glm::vec2 t = st - base;
+
+		auto wrap = [](int32_t v, uint32_t size) { int32_t r = v % int32_t(size); return uint32_t(r < 0 ? r + int32_t(size) : r); };
+		const uint32_t x0 = wrap(int32_t(base.x), mSize.x), x1 = wrap(int32_t(base.x) + 1, mSize.x);
+		const uint32_t y0 = wrap(int32_t(base.y), mSize.y), y1 = wrap(int32_t(base.y) + 1, mSize.y);
+
+		return glm::mix(glm::mix(fetch(x0, y0), fetch(x1, y0), t.x), glm::mix(fetch(x0, y1), fetch(x1, y1), t.x), t.y);
+	}
+
+#ifndef USE_CPU_ONLY
 	void createOpenglTexture()
 	{
-		// must create in 4 channels due to optix limitation
 		if (!mIsExistGl)
 		{
 			glGenTextures(1, &mGlHandle);
@@ -205,16 +460,24 @@ struct RtTexture
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, mSize.x, mSize.y, 0, GL_RGBA, GL_FLOAT, mData.data());
-
-			/*if (mUseSrgb)
+			GLenum internalFormat, format, type;
+			switch (mFormat)
 			{
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, mSize.x, mSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, mData.data());
+			case RtTextureFormat::Rgba32f:		internalFormat = GL_RGBA32F;		format = GL_RGBA;	type = GL_FLOAT;						break;
+			case RtTextureFormat::R32f:			internalFormat = GL_R32F;			format = GL_RED;	type = GL_FLOAT;						break;
+			case RtTextureFormat::Rgba16f:		internalFormat = GL_RGBA16F;		format = GL_RGBA;	type = GL_HALF_FLOAT;					break;
+			case RtTextureFormat::R16f:			internalFormat = GL_R16F;			format = GL_RED;	type = GL_HALF_FLOAT;					break;
+			case RtTextureFormat::Rgba8:		internalFormat = GL_RGBA8;			format = GL_RGBA;	type = GL_UNSIGNED_BYTE;				break;
+			case RtTextureFormat::Rgba8Srgb:	internalFormat = GL_SRGB8_ALPHA8;	format = GL_RGBA;	type = GL_UNSIGNED_BYTE;				break;
+			case RtTextureFormat::R8:			internalFormat = GL_R8;				format = GL_RED;	type = GL_UNSIGNED_BYTE;				break;
+			case RtTextureFormat::Rgb9e5:		internalFormat = GL_RGB9_E5;		format = GL_RGB;	type = GL_UNSIGNED_INT_5_9_9_9_REV;		break;
+			default: throw std::exception(); // "unknown texture format"
 			}
-			else
-			{
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, mSize.x, mSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, mData.data());
-			}*/
+
+			// rows of 1 and 2 byte formats are not 4 byte aligned
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, mSize.x, mSize.y, 0, format, type, mData.data());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
 			mIsExistGl = true;
 		}
@@ -222,6 +485,8 @@ struct RtTexture
 
 	void createOptixTexture(optix::Context context)
 	{
+		if (mIsExistOptix) { return; }
+
 		mOptixTexture.mSampler = context->createTextureSampler();
 		mOptixTexture.mSampler->setWrapMode(0, RT_WRAP_REPEAT);
 		mOptixTexture.mSampler->setWrapMode(1, RT_WRAP_REPEAT);
@@ -232,16 +497,38 @@ struct RtTexture
 		mOptixTexture.mSampler->setMipLevelCount(1);
 		mOptixTexture.mSampler->setArraySize(1);
 
-		mOptixTexture.mBuffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT4, mSize.x, mSize.y);
-		float * bufferData = static_cast<float*>(mOptixTexture.mBuffer->map());
-		for (size_t i = 0;i < mSize.x * mSize.y * 4;i++)
+		// optix has no sRGB or shared exponent formats, those two are expanded to half floats for the device
+		RTformat optixFormat;
+		RtTextureFormat uploadFormat = mFormat;
+		switch (mFormat)
+		{
+		case RtTextureFormat::Rgba32f:		optixFormat = RT_FORMAT_FLOAT4;			break;
+		case RtTextureFormat::R32f:			optixFormat = RT_FORMAT_FLOAT;			break;
+		case RtTextureFormat::Rgba16f:		optixFormat = RT_FORMAT_HALF4;			break;
+		case RtTextureFormat::R16f:			optixFormat = RT_FORMAT_HALF;			break;
+		case RtTextureFormat::Rgba8:		optixFormat = RT_FORMAT_UNSIGNED_BYTE4;	break;
+		case RtTextureFormat::R8:			optixFormat = RT_FORMAT_UNSIGNED_BYTE;	break;
+		case RtTextureFormat::Rgba8Srgb:
+		case RtTextureFormat::Rgb9e5:		optixFormat = RT_FORMAT_HALF4; uploadFormat = RtTextureFormat::Rgba16f; break;
+		default: throw std::exception(); // "unknown texture format"
+		}
+
+		mOptixTexture.mBuffer = context->createBuffer(RT_BUFFER_INPUT, optixFormat, mSize.x, mSize.y);
+		uint8_t * bufferData = static_cast<uint8_t*>(mOptixTexture.mBuffer->map());
+		if (uploadFormat == mFormat)
 		{
-			bufferData[i] = mData[i];
+			std::memcpy(bufferData, mData.data(), mData.size());
+		}
+		else
+		{
+			RtTexture expanded(*this, uploadFormat);
+			std::memcpy(bufferData, expanded.mData.data(), expanded.mData.size());
 		}
 		mOptixTexture.mBuffer->unmap();
 
 		mOptixTexture.mSampler->setBuffer(0, 0, mOptixTexture.mBuffer);
 		mOptixTexture.mSampler->setFilteringModes(RT_FILTER_LINEAR, RT_FILTER_LINEAR, RT_FILTER_NONE);
+		mIsExistOptix = true;
 	}
 
 	void createOptixTextureSamplerFromOpenglTexture(optix::Context context)
@@ -261,18 +548,126 @@ struct RtTexture
 			}
 		}
 	}
+#endif
 
 	glm::uvec2					mSize;
-	std::vector<float>			mData;
+	RtTextureFormat				mFormat;
+	std::vector<uint8_t>		mData;		// texels encoded in mFormat, see fetch
+#ifndef USE_CPU_ONLY
 	struct OptixTexture
 	{
 		optix::Buffer			mBuffer;
 		optix::TextureSampler	mSampler;
 	} mOptixTexture;
 	GLuint						mGlHandle;
+#endif
 	bool						mIsExistGl;
 	bool						mIsExistOptix;
 	bool						mUseSrgb;
+
+private:
+	RtTexture(const glm::uvec2 & size, const RtTextureFormat format):
+		mIsExistGl(false),
+		mIsExistOptix(false)
+	{
+		allocate(size, format);
+	}
+
+	void allocate(const glm::uvec2 & size, const RtTextureFormat format)
+	{
+		mSize = size;
+		mFormat = format;
+		mUseSrgb = (format == RtTextureFormat::Rgba8Srgb);
+		mData.assign(size_t(size.x) * size.y * BytesPerTexel(format), 0);
+	}
+
+	// encode texel i. single channel formats keep the red channel.
+	void store(const size_t i, const glm::vec4 & value)
+	{
+		uint8_t * texel = &mData[i * BytesPerTexel(mFormat)];
+		switch (mFormat)
+		{
+		case RtTextureFormat::Rgba32f:
+			std::memcpy(texel, &value[0], sizeof(glm::vec4));
+			break;
+		case RtTextureFormat::R32f:
+			std::memcpy(texel, &value[0], sizeof(float));
+			break;
+		case RtTextureFormat::Rgba16f:
+		{
+			const uint16_t halfs[4] = { glm::packHalf1x16(value[0]), glm::packHalf1x16(value[1]), glm::packHalf1x16(value[2]), glm::packHalf1x16(value[3]) };
+			std::memcpy(texel, halfs, sizeof(halfs));
+			break;
+		}
+		case RtTextureFormat::R16f:
+		{
+			const uint16_t half = glm::packHalf1x16(value[0]);
+			std::memcpy(texel, &half, sizeof(half));
+			break;
+		}
+		case RtTextureFormat::Rgba8:
+			for (size_t j = 0;j < 4;j++) { texel[j] = glm::packUnorm1x8(value[j]); }
+			break;
+		case RtTextureFormat::Rgba8Srgb:
+			for (size_t j = 0;j < 3;j++)
+			{
+				// linear to sRGB
+				const float v = glm::clamp(value[j], 0.0f, 1.0f);
+				texel[j] = glm::packUnorm1x8(v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f);
+			}
+			texel[3] = glm::packUnorm1x8(value[3]);
+			break;
+		case RtTextureFormat::R8:
+			texel[0] = glm::packUnorm1x8(value[0]);
+			break;
+		case RtTextureFormat::Rgb9e5:
+		{
+			const uint32_t packed = glm::packF3x9_E1x5(glm::vec3(value));
+			std::memcpy(texel, &packed, sizeof(packed));
+			break;
+		}
+		}
+	}
+};
+
+// one parameter of a material. constants are kept inline, only real texture maps allocate an RtTexture (shared through RtTexture::Cache).
+// a textured slot keeps the factor of its texels in mConstant, so materials sharing a texture can still differ
+struct RtMaterialSlot
+{
+	static RtMaterialSlot Load(const std::string & filedir, const RtTextureDesc & desc, const bool isSingleChannel = false)
+	{
+		if (desc.mType == RtTextureDesc::Type::Constant) { return RtMaterialSlot(desc.mColor); }
+		RtMaterialSlot result(desc.mTextureScale);
+		result.mTexture = RtTexture::LoadRtTexture(filedir, desc, isSingleChannel);
+		return result;
+	}
+
+	RtMaterialSlot()
+	{}
+
+	RtMaterialSlot(const glm::vec3 & constant):
+		mConstant(constant)
+	{}
+
+	inline bool isTextured() const
+	{
+		return mTexture != nullptr;
+	}
+
+	inline glm::vec4 evalBilinear(const glm::vec2 & uv) const
+	{
+		return isTextured() ? mTexture->evalBilinear(uv) * glm::vec4(mConstant, 1.0f) : glm::vec4(mConstant, 0.0f);
+	}
+
+#ifndef USE_CPU_ONLY
+	inline int getOptixTextureId() const
+	{
+		return isTextured() ? mTexture->mOptixTexture.mSampler->getId() : RT_MATERIAL_NO_TEXTURE;
+	}
+#endif
+
+	glm::vec3				mConstant = glm::vec3(0.0f);
+	shared_ptr<RtTexture>	mTexture;
 };
 
 struct RtMaterial
@@ -280,33 +675,206 @@ struct RtMaterial
 	RtMaterial()
 	{}
 
+#ifndef USE_CPU_ONLY
 	void createOpenglTextures()
 	{
-		mLambertReflectance->createOpenglTexture();
-		mPhongReflectance->createOpenglTexture();
-		mPhongExponent->createOpenglTexture();
+		for (RtMaterialSlot * slot : { &mLambertReflectance, &mPhongReflectance, &mPhongExponent })
+		{
+			if (slot->isTextured()) { slot->mTexture->createOpenglTexture(); }
+		}
 	}
 
+	// textures shared between materials are only created once
 	void createOptixTextures(optix::Context ctx)
 	{
-		mLambertReflectance->createOptixTexture(ctx);
-		mPhongReflectance->createOptixTexture(ctx);
-		mPhongExponent->createOptixTexture(ctx);
+		for (RtMaterialSlot * slot : { &mLambertReflectance, &mPhongReflectance, &mPhongExponent })
+		{
+			if (slot->isTextured()) { slot->mTexture->createOptixTexture(ctx); }
+		}
 	}
 
 	void createOptixTexturesFromOpenglTextures(optix::Context ctx)
 	{
-		mLambertReflectance->createOptixTextureSamplerFromOpenglTexture(ctx);
-		mPhongReflectance->createOptixTextureSamplerFromOpenglTexture(ctx);
-		mPhongExponent->createOptixTextureSamplerFromOpenglTexture(ctx);
+		for (RtMaterialSlot * slot : { &mLambertReflectance, &mPhongReflectance, &mPhongExponent })
+		{
+			if (slot->isTextured()) { slot->mTexture->createOptixTextureSamplerFromOpenglTexture(ctx); }
+		}
+	}
+
+	// entry of the material table, must be called after createOptixTextures
+	RtMaterialRecord createOptixRecord() const
+	{
+		RtMaterialRecord result;
+		result.mLambertReflectance = optix::make_float3(mLambertReflectance.mConstant.x, mLambertReflectance.mConstant.y, mLambertReflectance.mConstant.z);
+		result.mLambertReflectanceTextureId = mLambertReflectance.getOptixTextureId();
+		result.mPhongReflectance = optix::make_float3(mPhongReflectance.mConstant.x, mPhongReflectance.mConstant.y, mPhongReflectance.mConstant.z);
+		result.mPhongReflectanceTextureId = mPhongReflectance.getOptixTextureId();
+		result.mLightIntensity = optix::make_float4(mLightIntensity.x, mLightIntensity.y, mLightIntensity.z, mLightIntensity.w);
+		result.mPhongExponent = mPhongExponent.mConstant.x;
+		result.mPhongExponentTextureId = mPhongExponent.getOptixTextureId();
+		result.padding1 = 0.0f;
+		result.padding2 = 0.0f;
+		return result;
 	}
+#endif
 
-	shared_ptr<RtTexture>	mLambertReflectance;
-	shared_ptr<RtTexture>	mPhongReflectance;
-	shared_ptr<RtTexture>	mPhongExponent;
+	RtMaterialSlot			mLambertReflectance;
+	RtMaterialSlot			mPhongReflectance;
+	RtMaterialSlot			mPhongExponent;		// single channel, constant in mConstant.x
 	glm::vec4				mLightIntensity;
 };
 
+#ifndef USE_CPU_ONLY
+// deferred program uniforms of a material. textured slots are bound to texture units 0-2, constants are passed as plain uniforms.
+struct RtMaterialUniforms
+{
+	void registerUniforms(shared_ptr<OpenglProgram> program)
+	{
+		mLambertReflectance = program->registerUniform("uLambertReflectance");
+		mLambertReflectanceConstant = program->registerUniform("uLambertReflectanceConstant");
+		mHasLambertReflectanceTexture = program->registerUniform("uHasLambertReflectanceTexture");
+		mPhongReflectance = program->registerUniform("uPhongReflectance");
+		mPhongReflectanceConstant = program->registerUniform("uPhongReflectanceConstant");
+		mHasPhongReflectanceTexture = program->registerUniform("uHasPhongReflectanceTexture");
+		mPhongExponent = program->registerUniform("uPhongExponent");
+		mPhongExponentConstant = program->registerUniform("uPhongExponentConstant");
+		mHasPhongExponentTexture = program->registerUniform("uHasPhongExponentTexture");
+		mUseMaterialTable = program->registerUniform("uUseMaterialTable");
+	}
+
+	// pooled draws (RtGeometryPool) read constants and texture flags from the material table instead
+	void setUseMaterialTable(const bool useMaterialTable) const
+	{
+		mUseMaterialTable->setUniform(useMaterialTable);
+	}
+
+	void setUniforms(const RtMaterial & material) const
+	{
+		const RtMaterialSlot * slots[3] = { &material.mLambertReflectance, &material.mPhongReflectance, &material.mPhongExponent };
+		const shared_ptr<OpenglUniform> samplers[3] = { mLambertReflectance, mPhongReflectance, mPhongExponent };
+		const shared_ptr<OpenglUniform> hasTextures[3] = { mHasLambertReflectanceTexture, mHasPhongReflectanceTexture, mHasPhongExponentTexture };
+
+		for (int i = 0;i < 3;i++)
+		{
+			hasTextures[i]->setUniform(slots[i]->isTextured());
+			if (slots[i]->isTextured())
+			{
+				glActiveTexture(GL_TEXTURE0 + i);
+				glBindTexture(GL_TEXTURE_2D, slots[i]->mTexture->mGlHandle);
+				samplers[i]->setUniform(i);
+			}
+		}
+
+		mLambertReflectanceConstant->setUniform(material.mLambertReflectance.mConstant);
+		mPhongReflectanceConstant->setUniform(material.mPhongReflectance.mConstant);
+		mPhongExponentConstant->setUniform(material.mPhongExponent.mConstant.x);
+	}
+
+	shared_ptr<OpenglUniform> mLambertReflectance;
+	shared_ptr<OpenglUniform> mLambertReflectanceConstant;
+	shared_ptr<OpenglUniform> mHasLambertReflectanceTexture;
+	shared_ptr<OpenglUniform> mPhongReflectance;
+	shared_ptr<OpenglUniform> mPhongReflectanceConstant;
+	shared_ptr<OpenglUniform> mHasPhongReflectanceTexture;
+	shared_ptr<OpenglUniform> mPhongExponent;
+	shared_ptr<OpenglUniform> mPhongExponentConstant;
+	shared_ptr<OpenglUniform> mHasPhongExponentTexture;
+	shared_ptr<OpenglUniform> mUseMaterialTable;
+};
+#endif
+
+// compact copy of the vertex streams of a mesh (RtMesh::packVertices). normals are octahedral (Mapping::WorldToOctahedron)
+// in 2x16 bit unorm, texcoords are 2 half floats and positions are optionally 16 bit unorm inside the bounding box.
+// the optix programs (triangleintersect.cu), deferred.vert and the RtMesh accessors decode them.
+struct RtPackedVertices
+{
+	static uint32_t PackNormal(const glm::vec3 & normal)
+	{
+		if (!(glm::length(normal) > 0.0f)) { return 0; }
+		return glm::packUnorm2x16(Mapping::WorldToOctahedron(normal));
+	}
+
+	static glm::vec3 UnpackNormal(const uint32_t packed)
+	{
+		return glm::normalize(Mapping::OctahedronToWorld(glm::unpackUnorm2x16(packed)));
+	}
+
+	void pack(const float * positions, const float * normals, const float * texCoords, const size_t numVertices, const bool quantizePositions)
+	{
+		mNormals.resize(numVertices);
+		mTexCoords.resize(numVertices);
+		mQuantizedPositions.clear();
+
+		Aabb bbox;
+		for (size_t i = 0;i < numVertices && quantizePositions;i++) { bbox = Aabb::Union(bbox, glm::vec3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2])); }
+
+		// one step of the quantization grid. flat dimensions get a step of 0 and decode to the offset exactly
+		const glm::vec3 extent = bbox.pMax - bbox.pMin;
+		mPositionOffset = quantizePositions ? bbox.pMin : glm::vec3(0.0f);
+		mPositionScale = quantizePositions ? extent / 65535.0f : glm::vec3(1.0f);
+		if (quantizePositions) { mQuantizedPositions.resize(numVertices * 3); }
+
+		ThreadPool::Instance().parallelFor(0, numVertices, [&](const size_t i)
+		{
+			mNormals[i] = PackNormal(glm::vec3(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]));
+			mTexCoords[i] = glm::packHalf2x16(glm::vec2(texCoords[i * 2], texCoords[i * 2 + 1]));
+			for (size_t j = 0;j < 3 && quantizePositions;j++)
+			{
+				const float t = (extent[j] > 0.0f) ? (positions[i * 3 + j] - mPositionOffset[j]) / extent[j] : 0.0f;
+				mQuantizedPositions[i * 3 + j] = static_cast<uint16_t>(std::round(glm::clamp(t, 0.0f, 1.0f) * 65535.0f));
+			}
+		}, 4096);
+	}
+
+	inline bool isQuantized() const
+	{
+		return !mQuantizedPositions.empty();
+	}
+
+	inline glm::vec3 getPosition(const size_t i) const
+	{
+		return mPositionOffset + glm::vec3(mQuantizedPositions[i * 3], mQuantizedPositions[i * 3 + 1], mQuantizedPositions[i * 3 + 2]) * mPositionScale;
+	}
+
+	inline glm::vec3 getNormal(const size_t i) const
+	{
+		return UnpackNormal(mNormals[i]);
+	}
+
+	inline glm::vec2 getTexCoord(const size_t i) const
+	{
+		return glm::unpackHalf2x16(mTexCoords[i]);
+	}
+
+	std::vector<uint16_t>	mQuantizedPositions;	// empty if positions stay float
+	std::vector<uint32_t>	mNormals;
+	std::vector<uint32_t>	mTexCoords;
+	glm::vec3				mPositionOffset = glm::vec3(0.0f);
+	glm::vec3				mPositionScale = glm::vec3(1.0f);	// one quantization step
+};
+
+struct RtMesh;
+
+#ifndef USE_CPU_ONLY
+// deferred vertex shader position decode, identity for float positions
+struct RtVertexUniforms
+{
+	void registerUniforms(shared_ptr<OpenglProgram> program)
+	{
+		mPositionOffset = program->registerUniform("uPositionOffset");
+		mPositionScale = program->registerUniform("uPositionScale");
+		mModelMatrix = program->registerUniform("uModelMatrix");
+	}
+
+	// model matrix is the instance transform (RtMeshInstances), identity for meshes placed without one
+	void setUniforms(const RtMesh & mesh, const glm::mat4 & modelMatrix = glm::mat4(1.0f)) const;
+
+	shared_ptr<OpenglUniform> mPositionOffset;
+	shared_ptr<OpenglUniform> mPositionScale;
+	shared_ptr<OpenglUniform> mModelMatrix;
+};
+#endif
+
 struct RtMesh
 {
 	RtMesh(): mNumVertices(0)
@@ -314,12 +882,13 @@ struct RtMesh
 
 	void applyTransform(const glm::mat4 & transformMatrix)
 	{
+		assert(mPacked == nullptr);
 		glm::vec3 * vertices = reinterpret_cast<glm::vec3*>(mVertices.data());
 		glm::vec3 * normals = reinterpret_cast<glm::vec3*>(mNormals.data());
 
 		glm::mat4 transformMatrix_Normal = glm::inverseTranspose(transformMatrix);
 
-		for (size_t i = 0;i < mNumVertices;i++)
+		for (int32_t i = 0;i < mNumVertices;i++)
 		{
 			vertices[i] = transformMatrix * glm::vec4(vertices[i], 1.0f);
 			normals[i] = transformMatrix_Normal * glm::vec4(normals[i], 0.0f);
@@ -327,14 +896,82 @@ struct RtMesh
 		}
 	}
 
-	void createOptixMeshBuffer(optix::Context ctx)
+	// triangles in morton order with vertex cache friendly clusters, vertices in order of first use (see MeshReorder).
+	// all streams are permuted together, so the mesh looks the same to the rasterizer and the ray tracers
+	void reorderForLocality()
 	{
-		try
+		assert(mPacked == nullptr);
+		const size_t numTriangles = mNumTriangles;
+		const size_t numVertices = mNumVertices;
+		const std::vector<uint32_t> triangleOrder = MeshReorder::ComputeTriangleOrder(mVertices.data(), mTriIndices.data(), numTriangles);
+
+		std::vector<int32_t> triIndices(numTriangles * 3);
+		for (size_t i = 0;i < numTriangles;i++)
+		{
+			for (size_t j = 0;j < 3;j++) { triIndices[i * 3 + j] = mTriIndices[size_t(triangleOrder[i]) * 3 + j]; }
+		}
+		const std::vector<uint32_t> vertexOrder = MeshReorder::ReorderVertices(triIndices.data(), triIndices.size(), numVertices);
+
+		std::vector<float> vertices(numVertices * 3), normals(numVertices * 3), texCoords(numVertices * 2);
+		for (size_t i = 0;i < numVertices;i++)
+		{
+			const size_t old = vertexOrder[i];
+			for (size_t j = 0;j < 3;j++)
+			{
+				vertices[i * 3 + j] = mVertices[old * 3 + j];
+				normals[i * 3 + j] = mNormals[old * 3 + j];
+			}
+			texCoords[i * 2] = mTexCoords[old * 2];
+			texCoords[i * 2 + 1] = mTexCoords[old * 2 + 1];
+		}
+
+		mVertices = MappedArray<float>(std::move(vertices));
+		mNormals = MappedArray<float>(std::move(normals));
+		mTexCoords = MappedArray<float>(std::move(texCoords));
+		mTriIndices = MappedArray<int32_t>(std::move(triIndices));
+	}
+
+	// replaces the float normals and texcoords (and positions if quantizePositions) with RtPackedVertices
+	void packVertices(const bool quantizePositions)
+	{
+		assert(mPacked == nullptr);
+		mPacked = make_shared<RtPackedVertices>();
+		mPacked->pack(mVertices.data(), mNormals.data(), mTexCoords.data(), mNumVertices, quantizePositions);
+		mNormals.clear();
+		mTexCoords.clear();
+		if (quantizePositions) { mVertices.clear(); }
+	}
+
+	inline glm::vec3 getPosition(const size_t i) const
+	{
+		if (mPacked != nullptr && mPacked->isQuantized()) { return mPacked->getPosition(i); }
+		return glm::vec3(mVertices[i * 3], mVertices[i * 3 + 1], mVertices[i * 3 + 2]);
+	}
+
+	inline glm::vec3 getNormal(const size_t i) const
+	{
+		if (mPacked != nullptr) { return mPacked->getNormal(i); }
+		return glm::vec3(mNormals[i * 3], mNormals[i * 3 + 1], mNormals[i * 3 + 2]);
+	}
+
+	inline glm::vec2 getTexCoord(const size_t i) const
+	{
+		if (mPacked != nullptr) { return mPacked->getTexCoord(i); }
+		return glm::vec2(mTexCoords[i * 2], mTexCoords[i * 2 + 1]);
+	}
+
+#ifndef USE_CPU_ONLY
+	void createOptixMeshBuffer(optix::Context ctx)
+	{
+		if (mPacked != nullptr) { createOptixPackedMeshBuffer(ctx); return; }
+		try
 		{
 			mOptix.mIndices = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_INT3, this->mNumTriangles);
 			mOptix.mVertices = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, this->mNumVertices);
 			mOptix.mNormals = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, this->mNumVertices);
 			mOptix.mTexCoords = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT2, this->mNumVertices);
+			mOptix.mQuantizedVertices = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_UNSIGNED_SHORT3, 0);
+			mOptix.mPackedTexCoords = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_UNSIGNED_SHORT2, 0);
 
 			// map buffers
 			int32_t* indices = reinterpret_cast<int32_t*>(mOptix.mIndices->map());
@@ -360,8 +997,46 @@ struct RtMesh
 		}
 	}
 
+	// the stream of each kind which isn't used is created with size 0, the programs pick by buffer size
+	void createOptixPackedMeshBuffer(optix::Context ctx)
+	{
+		try
+		{
+			const bool isQuantized = mPacked->isQuantized();
+			mOptix.mIndices = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_INT3, this->mNumTriangles);
+			mOptix.mVertices = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, isQuantized ? 0 : this->mNumVertices);
+			mOptix.mQuantizedVertices = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_UNSIGNED_SHORT3, isQuantized ? this->mNumVertices : 0);
+			mOptix.mNormals = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_UNSIGNED_INT, this->mNumVertices);
+			mOptix.mTexCoords = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT2, 0);
+			mOptix.mPackedTexCoords = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_UNSIGNED_SHORT2, this->mNumVertices);
+
+			std::memcpy(mOptix.mIndices->map(), mTriIndices.data(), 3 * this->mNumTriangles * sizeof(int32_t));
+			if (isQuantized)
+			{
+				std::memcpy(mOptix.mQuantizedVertices->map(), mPacked->mQuantizedPositions.data(), 3 * this->mNumVertices * sizeof(uint16_t));
+				mOptix.mQuantizedVertices->unmap();
+			}
+			else
+			{
+				std::memcpy(mOptix.mVertices->map(), mVertices.data(), 3 * this->mNumVertices * sizeof(float));
+				mOptix.mVertices->unmap();
+			}
+			std::memcpy(mOptix.mNormals->map(), mPacked->mNormals.data(), this->mNumVertices * sizeof(uint32_t));
+			std::memcpy(mOptix.mPackedTexCoords->map(), mPacked->mTexCoords.data(), this->mNumVertices * sizeof(uint32_t));
+
+			mOptix.mIndices->unmap();
+			mOptix.mNormals->unmap();
+			mOptix.mPackedTexCoords->unmap();
+		}
+		catch (const optix::Exception & e)
+		{
+			std::cout << e.what() << std::endl;
+		}
+	}
+
 	void createOpenglBuffer()
 	{
+		if (mPacked != nullptr) { createOpenglPackedBuffer(); return; }
 		assert(mTexCoords.size() / 2 == mVertices.size() / 3);
 
 		mGl.mVerticesBuffer = make_shared<OpenglBuffer>();
@@ -375,6 +1050,39 @@ struct RtMesh
 		glNamedBufferData(mGl.mIndicesBuffer->mHandle, sizeof(uint32_t) * mNumTriangles * 3, &(mTriIndices[0]), GL_STATIC_DRAW);
 	}
 
+	void createOpenglPackedBuffer()
+	{
+		mGl.mVerticesBuffer = make_shared<OpenglBuffer>();
+		mGl.mNormalsBuffer = make_shared<OpenglBuffer>();
+		mGl.mTexCoordsBuffer = make_shared<OpenglBuffer>();
+		mGl.mIndicesBuffer = make_shared<OpenglBuffer>();
+
+		if (mPacked->isQuantized())
+		{
+			glNamedBufferData(mGl.mVerticesBuffer->mHandle, sizeof(uint16_t) * mNumVertices * 3, mPacked->mQuantizedPositions.data(), GL_STATIC_DRAW);
+		}
+		else
+		{
+			glNamedBufferData(mGl.mVerticesBuffer->mHandle, sizeof(float) * mNumVertices * 3, mVertices.data(), GL_STATIC_DRAW);
+		}
+		glNamedBufferData(mGl.mNormalsBuffer->mHandle, sizeof(uint32_t) * mNumVertices, mPacked->mNormals.data(), GL_STATIC_DRAW);
+		glNamedBufferData(mGl.mTexCoordsBuffer->mHandle, sizeof(uint32_t) * mNumVertices, mPacked->mTexCoords.data(), GL_STATIC_DRAW);
+		glNamedBufferData(mGl.mIndicesBuffer->mHandle, sizeof(uint32_t) * mNumTriangles * 3, mTriIndices.data(), GL_STATIC_DRAW);
+	}
+
+	// positions to attribute 0, texcoords to attribute 1. quantized positions still need RtVertexUniforms
+	void bindOpenglAttributes() const
+	{
+		const bool isQuantized = (mPacked != nullptr && mPacked->isQuantized());
+		glEnableVertexAttribArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, mGl.mVerticesBuffer->mHandle);
+		glVertexAttribPointer(0, 3, isQuantized ? GL_UNSIGNED_SHORT : GL_FLOAT, isQuantized ? GL_TRUE : GL_FALSE, 0, (void*) 0);
+
+		glEnableVertexAttribArray(1);
+		glBindBuffer(GL_ARRAY_BUFFER, mGl.mTexCoordsBuffer->mHandle);
+		glVertexAttribPointer(1, 2, (mPacked != nullptr) ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, 0, (void*) 0);
+	}
+
 	// doesn't work
 	void createOptixMeshBufferFromOpenglBuffer(optix::Context context)
 	{
@@ -401,7 +1109,8 @@ struct RtMesh
 		mOptix.mIndices->setSize(mNumTriangles);
 	}
 
-	void createOptixGeometry(optix::Context context, optix::Program meshIntersectProgram, optix::Program boundingBoxProgram, optix::Material optixMaterial, const RtMaterial & rtMaterial)
+	// material parameters come from the scene material table (RtScene::createOptixMaterialBuffer) through mMatIndex
+	void createOptixGeometry(optix::Context context, optix::Program meshIntersectProgram, optix::Program boundingBoxProgram, optix::Material optixMaterial)
 	{
 		try
 		{
@@ -414,12 +1123,18 @@ struct RtMesh
 			mOptix.mGeometry["vertexBuffer"]->setBuffer(mOptix.mVertices);
 			mOptix.mGeometry["normalBuffer"]->setBuffer(mOptix.mNormals);
 			mOptix.mGeometry["texcoordBuffer"]->setBuffer(mOptix.mTexCoords);
+			mOptix.mGeometry["quantizedVertexBuffer"]->setBuffer(mOptix.mQuantizedVertices);
+			mOptix.mGeometry["packedTexcoordBuffer"]->setBuffer(mOptix.mPackedTexCoords);
+			const glm::vec3 positionOffset = (mPacked != nullptr) ? mPacked->mPositionOffset : glm::vec3(0.0f);
+			const glm::vec3 positionScale = (mPacked != nullptr) ? mPacked->mPositionScale : glm::vec3(1.0f);
+			mOptix.mGeometry["positionOffset"]->setFloat(positionOffset.x, positionOffset.y, positionOffset.z);
+			mOptix.mGeometry["positionScale"]->setFloat(positionScale.x, positionScale.y, positionScale.z);
+
+			// whole mesh shares one material, the per triangle table is only used by RtGeometryPool
+			mOptix.mGeometry["triangleMaterialBuffer"]->setBuffer(context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_INT, 0));
+			mOptix.mGeometry["meshMaterialIndex"]->setInt(mMatIndex);
 
 			mOptix.mGeometryInstance = context->createGeometryInstance(mOptix.mGeometry, &optixMaterial, &optixMaterial + 1);
-			mOptix.mGeometryInstance["lambertReflectanceTexture"]->setTextureSampler(rtMaterial.mLambertReflectance->mOptixTexture.mSampler);
-			mOptix.mGeometryInstance["phongReflectanceTexture"]->setTextureSampler(rtMaterial.mPhongReflectance->mOptixTexture.mSampler);
-			mOptix.mGeometryInstance["phongExponentTexture"]->setTextureSampler(rtMaterial.mPhongExponent->mOptixTexture.mSampler);
-			mOptix.mGeometryInstance["lightIntensity"]->set4fv(&(rtMaterial.mLightIntensity[0]));
 		}
 		catch (const optix::Exception & e)
 		{
@@ -427,27 +1142,29 @@ struct RtMesh
 			throw std::exception();
 		}
 	}
+#endif
 
 	Aabb computeBbox()
 	{
 		Aabb result;
-		glm::vec3 * vertices = reinterpret_cast<glm::vec3*>(mVertices.data());
-		for (size_t i = 0;i < mNumVertices;i++) { result = Aabb::Union(result, vertices[i]); }
+		for (int32_t i = 0;i < mNumVertices;i++) { result = Aabb::Union(result, getPosition(i)); }
 		return result;
 	}
 
-	float recomputeArea() const
+	float recomputeArea(const glm::mat4 & modelMatrix = glm::mat4(1.0f)) const
 	{
+		const bool isIdentity = (modelMatrix == glm::mat4(1.0f));
 
+		const size_t numTriangles = mNumTriangles;
 		float sumArea = 0.f;
-		for (size_t i = 0; i < mNumTriangles; i++)
+		for (size_t i = 0; i < numTriangles; i++)
 		{
 			// load indices
 			glm::vec3 vertices[3];
 			for (size_t j = 0; j < 3; j++)
 			{
-				unsigned int index = this->mTriIndices[i * 3 + j];
-				vertices[j] = glm::vec3(this->mVertices[index * 3], this->mVertices[index * 3 + 1], this->mVertices[index * 3 + 2]);
+				vertices[j] = getPosition(this->mTriIndices[i * 3 + j]);
+				if (!isIdentity) { vertices[j] = glm::vec3(modelMatrix * glm::vec4(vertices[j], 1.0f)); }
 			}
 			float area = Triangle::ComputeArea(vertices[0], vertices[1], vertices[2]);
 			sumArea += area;
@@ -456,16 +1173,74 @@ struct RtMesh
 		return sumArea;
 	}
 
+	// world space copy for the cpu accelerators (accel/), packed normals and texcoords decoded
+	shared_ptr<TriangleMesh> createTriangleMesh(const glm::mat4 & modelMatrix = glm::mat4(1.0f)) const
+	{
+		shared_ptr<TriangleMesh> result = make_shared<TriangleMesh>();
+		TriangleMesh & triangleMesh = *result;
+
+		triangleMesh.mTexCoords.resize(mNumVertices);
+		ThreadPool::Instance().parallelFor(0, mNumVertices, [&](const size_t i)
+		{
+			triangleMesh.mTexCoords[i] = getTexCoord(i);
+		}, 4096);
+
+		triangleMesh.mTriangles.resize(mNumTriangles);
+		ThreadPool::Instance().parallelFor(0, mNumTriangles, [&](const size_t i)
+		{
+			Triangle & triangle = triangleMesh.mTriangles[i];
+			for (size_t j = 0;j < 3;j++)
+			{
+				triangle.mVertexIndices[j] = mTriIndices[i * 3 + j];
+				triangle.mNormalIndices[j] = mTriIndices[i * 3 + j];
+				triangle.mTexCoordIndices[j] = mTriIndices[i * 3 + j];
+			}
+			triangle.mTriMeshPtr = result.get();
+		}, 4096);
+
+		triangleMesh.mMatIndex = mMatIndex;
+		updateTriangleMesh(result.get(), modelMatrix);
+		return result;
+	}
+
+	// moves a mesh made by createTriangleMesh to a new placement in place, so the triangle pointers held by a bvh stay valid
+	void updateTriangleMesh(TriangleMesh * triangleMeshPtr, const glm::mat4 & modelMatrix) const
+	{
+		TriangleMesh & triangleMesh = *triangleMeshPtr;
+		const glm::mat4 normalMatrix = glm::inverseTranspose(modelMatrix);
+
+		triangleMesh.mVertices.resize(mNumVertices);
+		triangleMesh.mNormals.resize(mNumVertices);
+		ThreadPool::Instance().parallelFor(0, mNumVertices, [&](const size_t i)
+		{
+			triangleMesh.mVertices[i] = glm::vec3(modelMatrix * glm::vec4(getPosition(i), 1.0f));
+			triangleMesh.mNormals[i] = glm::normalize(glm::vec3(normalMatrix * glm::vec4(getNormal(i), 0.0f)));
+		}, 4096);
+
+		ThreadPool::Instance().parallelFor(0, mNumTriangles, [&](const size_t i)
+		{
+			Triangle & triangle = triangleMesh.mTriangles[i];
+			const glm::vec3 & pos1 = triangleMesh.mVertices[triangle.mVertexIndices[0]];
+			const glm::vec3 & pos2 = triangleMesh.mVertices[triangle.mVertexIndices[1]];
+			const glm::vec3 & pos3 = triangleMesh.mVertices[triangle.mVertexIndices[2]];
+			triangle.mGeomNormal = glm::normalize(glm::cross(pos3 - pos2, pos1 - pos2));
+		}, 4096);
+
+		triangleMesh.recomputeArea();
+	}
 
 	int32_t						mNumVertices;
 	int32_t						mNumTriangles;
 	int32_t						mMatIndex;
 
-	std::vector<float>			mVertices;
-	std::vector<float>			mNormals;
-	std::vector<float>			mTexCoords;
-	std::vector<int32_t>		mTriIndices;
+	// either owned or zero-copy views into a scene cache (see RtScene::LoadSceneCache)
+	MappedArray<float>			mVertices;
+	MappedArray<float>			mNormals;
+	MappedArray<float>			mTexCoords;
+	MappedArray<int32_t>		mTriIndices;
+	shared_ptr<RtPackedVertices> mPacked;		// if set, replaces mNormals, mTexCoords and possibly mVertices
 
+#ifndef USE_CPU_ONLY
 	struct OptixMeshBuffer
 	{
 		optix::GeometryInstance mGeometryInstance;
@@ -474,6 +1249,8 @@ struct RtMesh
 		optix::Buffer			mVertices;
 		optix::Buffer			mNormals;
 		optix::Buffer			mTexCoords;
+		optix::Buffer			mQuantizedVertices;
+		optix::Buffer			mPackedTexCoords;
 	} mOptix;
 
 	struct OpenglMeshBuffers
@@ -483,6 +1260,247 @@ struct RtMesh
 		shared_ptr<OpenglBuffer> mIndicesBuffer;
 		shared_ptr<OpenglBuffer> mTexCoordsBuffer;
 	} mGl;
+#endif
+};
+
+#ifndef USE_CPU_ONLY
+inline void RtVertexUniforms::setUniforms(const RtMesh & mesh, const glm::mat4 & modelMatrix) const
+{
+	const bool isQuantized = (mesh.mPacked != nullptr && mesh.mPacked->isQuantized());
+	mPositionOffset->setUniform(isQuantized ? mesh.mPacked->mPositionOffset : glm::vec3(0.0f));
+	mPositionScale->setUniform(isQuantized ? mesh.mPacked->mPositionScale * 65535.0f : glm::vec3(1.0f));
+	mModelMatrix->setUniform(modelMatrix);
+}
+#endif
+
+// all meshes of a scene concatenated into one set of SoA vertex streams and one index buffer (kept in mMesh, which can be
+// packed like any other mesh). every source mesh becomes a range tagged with its material. rasterization is submitted with glMultiDrawElementsIndirect (one call per textured material,
+// all untextured materials share a single call) and ray tracing sees one geometry with a per triangle material index.
+struct RtGeometryPool
+{
+	struct Range
+	{
+		int32_t		mFirstTriangle;
+		int32_t		mNumTriangles;
+		int32_t		mMatIndex;
+	};
+
+	// consecutive draw commands which share the same texture bindings. mMatIndex is -1 for the untextured batch
+	struct Batch
+	{
+		int32_t		mMatIndex;
+		size_t		mFirstCommand;
+		size_t		mNumCommands;
+	};
+
+	// layout of a GL_DRAW_INDIRECT_BUFFER entry
+	struct DrawElementsIndirectCommand
+	{
+		uint32_t	mCount;
+		uint32_t	mInstanceCount;
+		uint32_t	mFirstIndex;
+		int32_t		mBaseVertex;
+		uint32_t	mBaseInstance;
+	};
+
+	// std430 entry of the deferred shader material table
+	struct MaterialConstants
+	{
+		glm::vec4	mLambertReflectance;	// w = has texture
+		glm::vec4	mPhongReflectance;		// w = has texture
+		glm::vec4	mPhongExponent;			// x = constant (texel factor if textured), y = has texture
+	};
+
+	static bool IsTextured(const RtMaterial & material)
+	{
+		return material.mLambertReflectance.isTextured() || material.mPhongReflectance.isTextured() || material.mPhongExponent.isTextured();
+	}
+
+	void build(const std::vector<shared_ptr<RtMesh>> & meshes, const std::vector<shared_ptr<RtMaterial>> & materials)
+	{
+		mRanges.clear();
+		int32_t numVertices = 0;
+		int32_t numTriangles = 0;
+
+		// prefix sums so every mesh can be copied independently
+		std::vector<int32_t> vertexOffsets(meshes.size());
+		for (size_t i = 0;i < meshes.size();i++)
+		{
+			Range range;
+			range.mFirstTriangle = numTriangles;
+			range.mNumTriangles = meshes[i]->mNumTriangles;
+			range.mMatIndex = meshes[i]->mMatIndex;
+			mRanges.push_back(range);
+
+			vertexOffsets[i] = numVertices;
+			numVertices += meshes[i]->mNumVertices;
+			numTriangles += meshes[i]->mNumTriangles;
+		}
+
+		mMesh = make_shared<RtMesh>();
+		mMesh->mNumVertices = numVertices;
+		mMesh->mNumTriangles = numTriangles;
+		mMesh->mMatIndex = 0;
+		mMesh->mVertices.resize(numVertices * 3);
+		mMesh->mNormals.resize(numVertices * 3);
+		mMesh->mTexCoords.resize(numVertices * 2);
+		mMesh->mTriIndices.resize(numTriangles * 3);
+		mTriMatIndices.resize(numTriangles);
+
+		ThreadPool::Instance().parallelFor(0, meshes.size(), [&](const size_t i)
+		{
+			const RtMesh & mesh = *meshes[i];
+			const Range & range = mRanges[i];
+			const int32_t vertexOffset = vertexOffsets[i];
+
+			// packed meshes are decoded, the pool is packed as a whole afterwards (see RtScene::createGeometryPool)
+			for (size_t j = 0;j < size_t(mesh.mNumVertices);j++)
+			{
+				const glm::vec3 position = mesh.getPosition(j);
+				const glm::vec3 normal = mesh.getNormal(j);
+				const glm::vec2 texCoord = mesh.getTexCoord(j);
+				std::memcpy(&mMesh->mVertices[(vertexOffset + j) * 3], &position, sizeof(float) * 3);
+				std::memcpy(&mMesh->mNormals[(vertexOffset + j) * 3], &normal, sizeof(float) * 3);
+				std::memcpy(&mMesh->mTexCoords[(vertexOffset + j) * 2], &texCoord, sizeof(float) * 2);
+			}
+
+			// indices are rebased here so the optix geometry can use the same buffer, draw commands use a base vertex of 0
+			for (size_t j = 0;j < size_t(mesh.mNumTriangles) * 3;j++)
+			{
+				mMesh->mTriIndices[range.mFirstTriangle * 3 + j] = mesh.mTriIndices[j] + vertexOffset;
+			}
+			std::fill(mTriMatIndices.begin() + range.mFirstTriangle, mTriMatIndices.begin() + range.mFirstTriangle + range.mNumTriangles, range.mMatIndex);
+		});
+
+		// sort draw commands by material so each batch is a contiguous run of the indirect buffer
+		std::vector<size_t> order(mRanges.size());
+		for (size_t i = 0;i < order.size();i++) { order[i] = i; }
+		auto batchKey = [&](const size_t i) { return IsTextured(*materials[mRanges[i].mMatIndex]) ? mRanges[i].mMatIndex : -1; };
+		std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return batchKey(a) < batchKey(b); });
+
+		mCommands.clear();
+		mCommandMatIndices.clear();
+		mBatches.clear();
+		for (size_t i : order)
+		{
+			const Range & range = mRanges[i];
+			if (range.mNumTriangles == 0) { continue; }
+
+			const int32_t key = batchKey(i);
+			if (mBatches.empty() || mBatches.back().mMatIndex != key)
+			{
+				Batch batch;
+				batch.mMatIndex = key;
+				batch.mFirstCommand = mCommands.size();
+				batch.mNumCommands = 0;
+				mBatches.push_back(batch);
+			}
+
+			// base instance picks the material index from the per draw instanced attribute
+			DrawElementsIndirectCommand command;
+			command.mCount = range.mNumTriangles * 3;
+			command.mInstanceCount = 1;
+			command.mFirstIndex = range.mFirstTriangle * 3;
+			command.mBaseVertex = 0;
+			command.mBaseInstance = static_cast<uint32_t>(mCommands.size());
+			mCommands.push_back(command);
+			mCommandMatIndices.push_back(range.mMatIndex);
+			mBatches.back().mNumCommands++;
+		}
+
+		mMaterialConstants.resize(materials.size());
+		for (size_t i = 0;i < materials.size();i++)
+		{
+			const RtMaterial & material = *materials[i];
+			mMaterialConstants[i].mLambertReflectance = glm::vec4(material.mLambertReflectance.mConstant, material.mLambertReflectance.isTextured() ? 1.0f : 0.0f);
+			mMaterialConstants[i].mPhongReflectance = glm::vec4(material.mPhongReflectance.mConstant, material.mPhongReflectance.isTextured() ? 1.0f : 0.0f);
+			mMaterialConstants[i].mPhongExponent = glm::vec4(material.mPhongExponent.mConstant.x, material.mPhongExponent.isTextured() ? 1.0f : 0.0f, 0.0f, 0.0f);
+		}
+	}
+
+#ifndef USE_CPU_ONLY
+	void createOpenglBuffers()
+	{
+		mMesh->createOpenglBuffer();
+		mGl.mCommandsBuffer = make_shared<OpenglBuffer>();
+		mGl.mCommandMatIndicesBuffer = make_shared<OpenglBuffer>();
+		mGl.mMaterialTableBuffer = make_shared<OpenglBuffer>();
+
+		glNamedBufferData(mGl.mCommandsBuffer->mHandle, sizeof(DrawElementsIndirectCommand) * mCommands.size(), mCommands.data(), GL_STATIC_DRAW);
+		glNamedBufferData(mGl.mCommandMatIndicesBuffer->mHandle, sizeof(int32_t) * mCommandMatIndices.size(), mCommandMatIndices.data(), GL_STATIC_DRAW);
+		glNamedBufferData(mGl.mMaterialTableBuffer->mHandle, sizeof(MaterialConstants) * mMaterialConstants.size(), mMaterialConstants.data(), GL_STATIC_DRAW);
+	}
+
+	// the program must already be in use with its mvp set
+	void draw(const RtMaterialUniforms & materialUniforms, const RtVertexUniforms & vertexUniforms, const std::vector<shared_ptr<RtMaterial>> & materials) const
+	{
+		mMesh->bindOpenglAttributes();
+		vertexUniforms.setUniforms(*mMesh);
+
+		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ARRAY_BUFFER, mGl.mCommandMatIndicesBuffer->mHandle);
+		glVertexAttribIPointer(2, 1, GL_INT, 0, (void*) 0);
+		glVertexAttribDivisor(2, 1);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mGl.mMaterialTableBuffer->mHandle);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMesh->mGl.mIndicesBuffer->mHandle);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mGl.mCommandsBuffer->mHandle);
+
+		materialUniforms.setUseMaterialTable(true);
+		for (const Batch & batch : mBatches)
+		{
+			// only textured batches need their own bindings
+			if (batch.mMatIndex >= 0) { materialUniforms.setUniforms(*materials[batch.mMatIndex]); }
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*) (batch.mFirstCommand * sizeof(DrawElementsIndirectCommand)), static_cast<GLsizei>(batch.mNumCommands), 0);
+		}
+		materialUniforms.setUseMaterialTable(false);
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glVertexAttribDivisor(2, 0);
+		glDisableVertexAttribArray(0);
+		glDisableVertexAttribArray(1);
+		glDisableVertexAttribArray(2);
+	}
+
+	void createOptixGeometry(optix::Context context, optix::Program meshIntersectProgram, optix::Program boundingBoxProgram, optix::Material optixMaterial)
+	{
+		mMesh->createOptixMeshBuffer(context);
+		mMesh->createOptixGeometry(context, meshIntersectProgram, boundingBoxProgram, optixMaterial);
+
+		try
+		{
+			mOptixTriMatIndices = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_INT, mTriMatIndices.size());
+			std::memcpy(mOptixTriMatIndices->map(), mTriMatIndices.data(), sizeof(int32_t) * mTriMatIndices.size());
+			mOptixTriMatIndices->unmap();
+			mMesh->mOptix.mGeometry["triangleMaterialBuffer"]->setBuffer(mOptixTriMatIndices);
+		}
+		catch (const optix::Exception & e)
+		{
+			std::cout << e.what() << std::endl;
+			throw std::exception();
+		}
+	}
+#endif
+
+	shared_ptr<RtMesh>							mMesh;				// indices already offset into the shared vertex streams
+	std::vector<int32_t>						mTriMatIndices;
+	std::vector<Range>							mRanges;			// one per source mesh
+
+	std::vector<Batch>							mBatches;
+	std::vector<DrawElementsIndirectCommand>	mCommands;
+	std::vector<int32_t>						mCommandMatIndices;
+	std::vector<MaterialConstants>				mMaterialConstants;
+
+#ifndef USE_CPU_ONLY
+	optix::Buffer								mOptixTriMatIndices;
+
+	struct OpenglPoolBuffers
+	{
+		shared_ptr<OpenglBuffer> mCommandsBuffer;
+		shared_ptr<OpenglBuffer> mCommandMatIndicesBuffer;
+		shared_ptr<OpenglBuffer> mMaterialTableBuffer;
+	} mGl;
+#endif
 };
 
 struct RtAreaLight
@@ -498,12 +1516,12 @@ struct RtAreaLight
 	{
 	}
 
-	void createOptixCdf(optix::Context ctx)
+	// normalized cdf of the triangle areas, light samples pick a triangle with it (LightSample in rtlightsource.cuh)
+	void computeCdf()
 	{
 		const size_t numTriangles = mMesh->mNumTriangles;
-		this->mOptixCdfBuffer = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT, numTriangles);
-
-		float* cdf = reinterpret_cast<float*>(mOptixCdfBuffer->map());
+		mCdf.resize(numTriangles);
+		std::vector<float> & cdf = mCdf;
 
 		float sumArea = 0.f;
 		for (size_t i = 0;i < numTriangles;i++)
@@ -512,8 +1530,7 @@ struct RtAreaLight
 			glm::vec3 vertices[3];
 			for (size_t j = 0;j < 3;j++)
 			{
-				unsigned int index = this->mMesh->mTriIndices[i * 3 + j];
-				vertices[j] = glm::vec3(this->mMesh->mVertices[index * 3], this->mMesh->mVertices[index * 3 + 1], this->mMesh->mVertices[index * 3 + 2]);
+				vertices[j] = this->mMesh->getPosition(this->mMesh->mTriIndices[i * 3 + j]);
 			}
 			float area = Triangle::ComputeArea(vertices[0], vertices[1], vertices[2]);
 			sumArea += area;
@@ -527,14 +1544,26 @@ struct RtAreaLight
 		}
 
 		mMeshArea = sumArea;
+	}
+
+#ifndef USE_CPU_ONLY
+	void createOptixCdf(optix::Context ctx)
+	{
+		computeCdf();
+		this->mOptixCdfBuffer = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT, mCdf.size());
+		std::memcpy(mOptixCdfBuffer->map(), mCdf.data(), sizeof(float) * mCdf.size());
 		mOptixCdfBuffer->unmap();
 	}
+#endif
 
 	float				mMeshArea;
 	shared_ptr<RtMesh>	mMesh;
 	glm::vec4           mLightIntensity;
 	glm::vec4			mPrecomputedLightIntensity;
+	std::vector<float>	mCdf;
+#ifndef USE_CPU_ONLY
 	optix::Buffer		mOptixCdfBuffer;
+#endif
 };
 
 struct RtCameraBase
@@ -628,8 +1657,44 @@ struct RtAnimationCamera : RtCameraBase
 	float               mAspectRatio;
 };
 
+// every placement of one shared mesh. the mesh keeps its object space vertices, so memory and acceleration structure builds
+// scale with the unique geometry. a mesh placed once without a transform is "plain" and handled exactly like before instancing.
+struct RtMeshInstances
+{
+	inline bool isPlain() const
+	{
+		return mModelMatrices.size() == 1 && mModelMatrices[0] == glm::mat4(1.0f);
+	}
+
+#ifndef USE_CPU_ONLY
+	// two level hierarchy: one geometry group (and bvh) per mesh, referenced by one optix transform per placement
+	void createOptixTransforms(optix::Context context, optix::Group parent)
+	{
+		mOptixGeometryGroup = context->createGeometryGroup();
+		mOptixGeometryGroup->addChild(mMesh->mOptix.mGeometryInstance);
+		mOptixGeometryGroup->setAcceleration(context->createAcceleration("Trbvh"));
+
+		for (const glm::mat4 & modelMatrix : mModelMatrices)
+		{
+			const glm::mat4 inverseModelMatrix = glm::inverse(modelMatrix);
+			optix::Transform transform = context->createTransform();
+			transform->setChild(mOptixGeometryGroup);
+			transform->setMatrix(true, glm::value_ptr(modelMatrix), glm::value_ptr(inverseModelMatrix)); // glm is column major
+			parent->addChild(transform);
+		}
+	}
+#endif
+
+	shared_ptr<RtMesh>			mMesh;
+	std::vector<glm::mat4>		mModelMatrices;
+#ifndef USE_CPU_ONLY
+	optix::GeometryGroup		mOptixGeometryGroup;
+#endif
+};
+
 struct RtScene
 {
+#ifndef USE_CPU_ONLY
 	static bool GetTextureFilepath(std::string * filepath, const std::string & filedir, const aiMaterial & aiMat, const aiTextureType & textureKey, const char * colorKey, unsigned int type, unsigned int index)
 	{
 		aiString texturePath;
@@ -640,18 +1705,217 @@ struct RtScene
 		}
 		return false;
 	}
+#endif
 
-	void addObject(const std::string & filepath,
-		const glm::mat4 & modelMatrix = glm::mat4(),
-		const glm::vec4 & lightIntensity = glm::vec4(0.0f),
-		bool overrideMaterial = false,
-		shared_ptr<RtMaterial> defaultMat = make_shared<RtMaterial>())
+	typedef std::array<RtTextureDesc, 3> RtMaterialDesc; // lambert reflectance, phong reflectance, phong exponent
+
+	static const uint32_t SceneCacheVersion = 1;
+
+	struct SceneCacheHeader
 	{
-		const unsigned int aiProcesses = aiProcess_Triangulate
-			| aiProcess_GenSmoothNormals
-			| aiProcess_JoinIdenticalVertices
-			| aiProcessPreset_TargetRealtime_Fast;
+		char		mMagic[8];
+		uint32_t	mVersion;
+		uint32_t	mNumMeshes;
+		uint64_t	mKey;
+		uint32_t	mNumMaterials;
+		uint32_t	mPadding;
+		uint64_t	mMaterialsOffset;
+		uint64_t	mFileSize;
+	};
+
+	struct SceneCacheMeshRecord
+	{
+		int32_t		mNumVertices;
+		int32_t		mNumTriangles;
+		int32_t		mMatIndex;
+		int32_t		mPadding;
+		uint64_t	mVerticesOffset;
+		uint64_t	mNormalsOffset;
+		uint64_t	mTexCoordsOffset;
+		uint64_t	mTriIndicesOffset;
+	};
+
+	// key = hash of the object file, the material libraries an obj names (mtllib), the import flags, whether the meshes
+	// are reordered and the cache version
+	static uint64_t ComputeSceneCacheKey(const std::string & filepath, const unsigned int aiProcesses, const bool useObjLoader, const bool reorderMeshes)
+	{
+		const uint32_t version = SceneCacheVersion;
+		const uint32_t loader = useObjLoader ? 1 : 0;
+		const uint32_t reorder = reorderMeshes ? 1 : 0;
+		uint64_t key = Util::HashFnv1a(&version, sizeof(version));
+		key = Util::HashFnv1a(&aiProcesses, sizeof(aiProcesses), key);
+		key = Util::HashFnv1a(&loader, sizeof(loader), key);
+		key = Util::HashFnv1a(&reorder, sizeof(reorder), key);
+
+		const std::string extension = filepath.substr(filepath.find_last_of('.') + 1);
+		std::vector<std::string> paths = { filepath };
+		if (extension == "obj" || extension == "OBJ")
+		{
+			const std::vector<std::string> libraries = ObjLoader::FindMaterialLibraries(filepath);
+			paths.insert(paths.end(), libraries.begin(), libraries.end());
+		}
+
+		// a library that is missing still counts, so creating it later invalidates the cache
+		for (const std::string & path : paths)
+		{
+			shared_ptr<MappedFile> file = MappedFile::Open(path);
+			const uint64_t fileSize = (file != nullptr) ? file->size() : std::numeric_limits<uint64_t>::max();
+			key = Util::HashFnv1a(&fileSize, sizeof(fileSize), key);
+			if (file != nullptr) { key = Util::HashFnv1a(file->data(), file->size(), key); }
+		}
+
+		return key;
+	}
+
+	// meshes become zero-copy views into the mapped cache. returns false if the cache is missing, stale or broken.
+	static bool LoadSceneCache(std::vector<shared_ptr<RtMesh>> * meshes, std::vector<RtMaterialDesc> * materials, const std::string & cacheFilepath, const uint64_t key)
+	{
+		shared_ptr<MappedFile> file = MappedFile::Open(cacheFilepath);
+		if (file == nullptr || file->size() < sizeof(SceneCacheHeader)) { return false; }
+
+		const uint8_t * data = file->data();
+		const SceneCacheHeader & header = *reinterpret_cast<const SceneCacheHeader*>(data);
+		if (std::memcmp(header.mMagic, "RTSCACHE", 8) != 0 || header.mVersion != SceneCacheVersion || header.mKey != key || header.mFileSize != file->size())
+		{
+			return false;
+		}
+
+		const uint64_t recordsEnd = sizeof(SceneCacheHeader) + uint64_t(header.mNumMeshes) * sizeof(SceneCacheMeshRecord);
+		if (recordsEnd > file->size()) { return false; }
+
+		auto isInside = [&](uint64_t offset, uint64_t numBytes) { return offset % 4 == 0 && offset <= file->size() && numBytes <= file->size() - offset; };
+
+		const SceneCacheMeshRecord * records = reinterpret_cast<const SceneCacheMeshRecord*>(data + sizeof(SceneCacheHeader));
+		std::vector<shared_ptr<RtMesh>> result;
+		for (size_t iMesh = 0;iMesh < header.mNumMeshes;iMesh++)
+		{
+			const SceneCacheMeshRecord & record = records[iMesh];
+			const uint64_t numVertices = record.mNumVertices;
+			const uint64_t numTriangles = record.mNumTriangles;
+			if (!isInside(record.mVerticesOffset, numVertices * 3 * sizeof(float))
+				|| !isInside(record.mNormalsOffset, numVertices * 3 * sizeof(float))
+				|| !isInside(record.mTexCoordsOffset, numVertices * 2 * sizeof(float))
+				|| !isInside(record.mTriIndicesOffset, numTriangles * 3 * sizeof(int32_t)))
+			{
+				return false;
+			}
+
+			shared_ptr<RtMesh> mesh = make_shared<RtMesh>();
+			mesh->mNumVertices = record.mNumVertices;
+			mesh->mNumTriangles = record.mNumTriangles;
+			mesh->mMatIndex = record.mMatIndex;
+			mesh->mVertices = MappedArray<float>(file, reinterpret_cast<const float*>(data + record.mVerticesOffset), numVertices * 3);
+			mesh->mNormals = MappedArray<float>(file, reinterpret_cast<const float*>(data + record.mNormalsOffset), numVertices * 3);
+			mesh->mTexCoords = MappedArray<float>(file, reinterpret_cast<const float*>(data + record.mTexCoordsOffset), numVertices * 2);
+			mesh->mTriIndices = MappedArray<int32_t>(file, reinterpret_cast<const int32_t*>(data + record.mTriIndicesOffset), numTriangles * 3);
+			result.push_back(mesh);
+		}
+
+		// material descs are small, parse them into owned memory
+		uint64_t offset = header.mMaterialsOffset;
+		std::vector<RtMaterialDesc> resultMaterials(header.mNumMaterials);
+		for (size_t iMat = 0;iMat < header.mNumMaterials;iMat++)
+		{
+			for (RtTextureDesc & desc : resultMaterials[iMat])
+			{
+				uint32_t type, nameLength;
+				if (!isInside(offset, 5 * sizeof(uint32_t))) { return false; }
+				std::memcpy(&type, data + offset, sizeof(uint32_t));
+				std::memcpy(&desc.mColor[0], data + offset + 4, 3 * sizeof(float));
+				std::memcpy(&nameLength, data + offset + 16, sizeof(uint32_t));
+				offset += 5 * sizeof(uint32_t);
+
+				if (type > uint32_t(RtTextureDesc::Type::Texture) || nameLength > file->size() - offset) { return false; }
+				desc.mType = RtTextureDesc::Type(type);
+				desc.mTextureName.assign(reinterpret_cast<const char*>(data + offset), nameLength);
+				offset = (offset + nameLength + 3) & ~uint64_t(3);
+			}
+		}
+
+		*meshes = std::move(result);
+		*materials = std::move(resultMaterials);
+		return true;
+	}
+
+	// written to a temporary file first and renamed so a crashed run never leaves a half written cache behind
+	static bool SaveSceneCache(const std::vector<shared_ptr<RtMesh>> & meshes, const std::vector<RtMaterialDesc> & materials, const std::string & cacheFilepath, const uint64_t key)
+	{
+		auto alignUp = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+
+		SceneCacheHeader header = {};
+		std::memcpy(header.mMagic, "RTSCACHE", 8);
+		header.mVersion = SceneCacheVersion;
+		header.mNumMeshes = static_cast<uint32_t>(meshes.size());
+		header.mKey = key;
+		header.mNumMaterials = static_cast<uint32_t>(materials.size());
+
+		// layout
+		uint64_t offset = alignUp(sizeof(SceneCacheHeader) + meshes.size() * sizeof(SceneCacheMeshRecord));
+		std::vector<SceneCacheMeshRecord> records(meshes.size());
+		for (size_t iMesh = 0;iMesh < meshes.size();iMesh++)
+		{
+			const RtMesh & mesh = *meshes[iMesh];
+			SceneCacheMeshRecord & record = records[iMesh];
+			record = {};
+			record.mNumVertices = mesh.mNumVertices;
+			record.mNumTriangles = mesh.mNumTriangles;
+			record.mMatIndex = mesh.mMatIndex;
+			record.mVerticesOffset = offset;	offset = alignUp(offset + mesh.mVertices.size() * sizeof(float));
+			record.mNormalsOffset = offset;		offset = alignUp(offset + mesh.mNormals.size() * sizeof(float));
+			record.mTexCoordsOffset = offset;	offset = alignUp(offset + mesh.mTexCoords.size() * sizeof(float));
+			record.mTriIndicesOffset = offset;	offset = alignUp(offset + mesh.mTriIndices.size() * sizeof(int32_t));
+		}
+		header.mMaterialsOffset = offset;
+
+		const std::string tempFilepath = cacheFilepath + ".tmp";
+		std::ofstream ofs(tempFilepath, std::ios::binary | std::ios::trunc);
+		if (!ofs.is_open()) { return false; }
+
+		const char zeros[16] = {};
+		uint64_t written = 0;
+		auto write = [&](const void * src, uint64_t numBytes) { ofs.write(static_cast<const char*>(src), numBytes); written += numBytes; };
+		auto padTo = [&](uint64_t target) { assert(target >= written); write(zeros, target - written); };
 
+		write(&header, sizeof(header));
+		write(records.data(), records.size() * sizeof(SceneCacheMeshRecord));
+		for (size_t iMesh = 0;iMesh < meshes.size();iMesh++)
+		{
+			const RtMesh & mesh = *meshes[iMesh];
+			padTo(records[iMesh].mVerticesOffset);		write(mesh.mVertices.data(), mesh.mVertices.size() * sizeof(float));
+			padTo(records[iMesh].mNormalsOffset);		write(mesh.mNormals.data(), mesh.mNormals.size() * sizeof(float));
+			padTo(records[iMesh].mTexCoordsOffset);		write(mesh.mTexCoords.data(), mesh.mTexCoords.size() * sizeof(float));
+			padTo(records[iMesh].mTriIndicesOffset);	write(mesh.mTriIndices.data(), mesh.mTriIndices.size() * sizeof(int32_t));
+		}
+		padTo(header.mMaterialsOffset);
+
+		for (const RtMaterialDesc & material : materials)
+		{
+			for (const RtTextureDesc & desc : material)
+			{
+				const uint32_t type = uint32_t(desc.mType);
+				const uint32_t nameLength = static_cast<uint32_t>(desc.mTextureName.size());
+				write(&type, sizeof(type));
+				write(&desc.mColor[0], 3 * sizeof(float));
+				write(&nameLength, sizeof(nameLength));
+				write(desc.mTextureName.data(), nameLength);
+				write(zeros, ((nameLength + 3) & ~3u) - nameLength);
+			}
+		}
+
+		// patch the final size into the header
+		header.mFileSize = written;
+		ofs.seekp(0);
+		ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		ofs.close();
+		if (!ofs) { std::remove(tempFilepath.c_str()); return false; }
+
+		std::remove(cacheFilepath.c_str());
+		return std::rename(tempFilepath.c_str(), cacheFilepath.c_str()) == 0;
+	}
+
+#ifndef USE_CPU_ONLY
+	static void ImportObject(std::vector<shared_ptr<RtMesh>> * meshes, std::vector<RtMaterialDesc> * materials, const std::string & filepath, const unsigned int aiProcesses)
+	{
 		// load aiScene
 		Assimp::Importer importer;
 		const aiScene * scene = importer.ReadFile(filepath.c_str(), aiProcesses);
@@ -660,8 +1924,6 @@ struct RtScene
 			assert(false);
 		}
 
-		const size_t matOffset = this->mMaterials.size();
-
 		// populate rtmesh result vector
 		for (size_t iMesh = 0;iMesh < scene->mNumMeshes;iMesh++)
 		{
@@ -713,24 +1975,287 @@ struct RtScene
 				mesh->mTriIndices.push_back(aiSceneMesh->mFaces[iIdx].mIndices[2]);
 			}
 
-			const size_t matIndex = aiSceneMesh->mMaterialIndex;
 			mesh->mNumVertices		= numVertices;
 			mesh->mNumTriangles		= numTriangles;
+			mesh->mMatIndex			= aiSceneMesh->mMaterialIndex;
+
+			meshes->push_back(mesh);
+		}
+
+		// populate material descs
+		const size_t numMaterials = scene->mNumMaterials;
+		for (size_t iMat = 0;iMat < numMaterials;iMat++)
+		{
+			// note: assimp always generate material index = 0 as DefaultMaterial automatically
+			const auto aiMat = scene->mMaterials[iMat];
+			RtMaterialDesc desc;
+			desc[0] = RtTextureDesc::FromAiMaterial(*aiMat, aiTextureType_DIFFUSE, AI_MATKEY_COLOR_DIFFUSE);
+			desc[1] = RtTextureDesc::FromAiMaterial(*aiMat, aiTextureType_SPECULAR, AI_MATKEY_COLOR_SPECULAR);
+			desc[2] = RtTextureDesc::FromAiMaterial(*aiMat, aiTextureType_SHININESS, AI_MATKEY_SHININESS);
+			materials->push_back(desc);
+		}
+	}
+#endif
+
+	// fast path for wavefront obj files, gives the same meshes and materials as ImportObject with the aiProcesses of addObject
+	static bool ImportObjectWithObjLoader(std::vector<shared_ptr<RtMesh>> * meshes, std::vector<RtMaterialDesc> * materials, const std::string & filepath)
+	{
+		ObjLoader loader;
+		if (!loader.load(filepath)) { return false; }
+
+		for (ObjLoader::Mesh & objMesh : loader.mMeshes)
+		{
+			shared_ptr<RtMesh> mesh = make_shared<RtMesh>();
+			mesh->mNumVertices = int32_t(objMesh.mVertices.size() / 3);
+			mesh->mNumTriangles = int32_t(objMesh.mTriIndices.size() / 3);
+			mesh->mMatIndex = objMesh.mMatIndex;
+			mesh->mVertices = MappedArray<float>(std::move(objMesh.mVertices));
+			mesh->mNormals = MappedArray<float>(std::move(objMesh.mNormals));
+			mesh->mTexCoords = MappedArray<float>(std::move(objMesh.mTexCoords));
+			mesh->mTriIndices = MappedArray<int32_t>(std::move(objMesh.mTriIndices));
+			meshes->push_back(mesh);
+		}
+
+		// assimp always reports colors and shininess for obj materials, so slots are either textures or constants
+		auto toDesc = [](const std::string & textureName, const glm::vec3 & color)
+		{
+			RtTextureDesc result;
+			result.mType = textureName.empty() ? RtTextureDesc::Type::Constant : RtTextureDesc::Type::Texture;
+			result.mColor = textureName.empty() ? color : glm::vec3(0.0f);
+			result.mTextureName = textureName;
+			return result;
+		};
+
+		for (const ObjLoader::Material & objMat : loader.mMaterials)
+		{
+			// the shininess is the plain Ns value, which is what FromAiMaterial ends up with after undoing assimp's scaling
+			RtMaterialDesc desc;
+			desc[0] = toDesc(objMat.mDiffuseTexture, objMat.mDiffuse);
+			desc[1] = toDesc(objMat.mSpecularTexture, objMat.mSpecular);
+			desc[2] = toDesc(objMat.mShininessTexture, glm::vec3(objMat.mShininess));
+			materials->push_back(desc);
+		}
+		return true;
+	}
+
+	// gltf binary. accessors become views into the mapped file, metallic roughness is approximated by lambert + phong:
+	// lambert = base color * (1 - metallic), phong = mix(0.04, base color, metallic) and the exponent matching the
+	// beckmann width of the roughness (alpha = roughness^2, n = 2 / alpha^2 - 2). base color textures replace the factor.
+	static bool ImportGlb(std::vector<shared_ptr<RtMesh>> * meshes, std::vector<RtMaterialDesc> * materials, std::vector<std::vector<glm::mat4>> * meshMatrices, const std::string & filepath)
+	{
+		GlbLoader loader;
+		if (!loader.load(filepath)) { return false; }
+
+		for (GlbLoader::Mesh & glbMesh : loader.mMeshes)
+		{
+			shared_ptr<RtMesh> mesh = make_shared<RtMesh>();
+			mesh->mNumVertices = int32_t(glbMesh.mVertices.size() / 3);
+			mesh->mNumTriangles = int32_t(glbMesh.mTriIndices.size() / 3);
+			mesh->mMatIndex = glbMesh.mMatIndex;
+			mesh->mVertices = std::move(glbMesh.mVertices);
+			mesh->mNormals = std::move(glbMesh.mNormals);
+			mesh->mTexCoords = std::move(glbMesh.mTexCoords);
+			mesh->mTriIndices = std::move(glbMesh.mTriIndices);
+			meshes->push_back(mesh);
+			meshMatrices->push_back(glbMesh.mNodeMatrices);
+		}
+
+		for (const GlbLoader::Material & glbMat : loader.mMaterials)
+		{
+			const glm::vec3 baseColor(glbMat.mBaseColor);
+			const float alpha = std::max(glbMat.mRoughness * glbMat.mRoughness, 1e-2f);
+
+			RtMaterialDesc desc;
+			desc[0].mType = RtTextureDesc::Type::Constant;
+			desc[0].mColor = baseColor * (1.0f - glbMat.mMetallic);
+			if (glbMat.mBaseColorImage >= 0)
+			{
+				const GlbLoader::Image & image = loader.mImages[glbMat.mBaseColorImage];
+				desc[0].mType = RtTextureDesc::Type::Texture;
+				desc[0].mTextureScale = desc[0].mColor;
+				desc[0].mTextureName = image.mUri.empty() ? image.mName : image.mUri;
+				desc[0].mEmbeddedFile = image.mUri.empty() ? loader.mFile : nullptr;
+				desc[0].mEmbeddedOffset = image.mOffset;
+				desc[0].mEmbeddedSize = image.mSize;
+				desc[0].mIsSrgb = true;
+				desc[0].mIsTopDown = true;
+			}
+			desc[1].mType = RtTextureDesc::Type::Constant;
+			desc[1].mColor = glm::mix(glm::vec3(0.04f), baseColor, glbMat.mMetallic);
+			desc[2].mType = RtTextureDesc::Type::Constant;
+			desc[2].mColor = glm::vec3(2.0f / (alpha * alpha) - 2.0f);
+			materials->push_back(desc);
+		}
+
+		std::cout << "glb " << filepath << " : " << loader.mNumViews << " arrays mapped, " << loader.mNumCopies << " converted" << std::endl;
+		return true;
+	}
+
+	// mesh range of an already loaded object file and the local placements (gltf nodes) of each of its meshes
+	struct LoadedObject
+	{
+		size_t									mFirstMesh;
+		size_t									mLastMesh;
+		std::vector<std::vector<glm::mat4>>		mMeshMatrices;	// empty = every mesh placed once without a transform
+	};
+
+	// placements of one scene entry that move from frame to frame : in frame f each of them is placed with
+	// mKeyframes[f % mKeyframes.size()] * its model matrix as loaded
+	struct Animation
+	{
+		std::vector<std::pair<size_t, size_t>>	mPlacements;		// (mesh, placement) in mMeshInstances
+		std::vector<glm::mat4>					mModelMatrices;
+		std::vector<glm::mat4>					mKeyframes;
+	};
+
+	void placeObject(const LoadedObject & object, const glm::mat4 & modelMatrix)
+	{
+		for (size_t i = object.mFirstMesh;i < object.mLastMesh;i++)
+		{
+			std::vector<glm::mat4> & modelMatrices = mMeshInstances[i].mModelMatrices;
+			if (object.mMeshMatrices.empty()) { modelMatrices.push_back(modelMatrix); continue; }
+			for (const glm::mat4 & localMatrix : object.mMeshMatrices[i - object.mFirstMesh]) { modelMatrices.push_back(modelMatrix * localMatrix); }
+		}
+	}
+
+	// addObject, with the new placements animated by keyframes (see setFrame)
+	void addAnimatedObject(const std::string & filepath, const glm::mat4 & modelMatrix, const std::vector<glm::mat4> & keyframes)
+	{
+		assert(!keyframes.empty());
+		std::vector<size_t> numPlacements(mMeshInstances.size());
+		for (size_t i = 0;i < mMeshInstances.size();i++) { numPlacements[i] = mMeshInstances[i].mModelMatrices.size(); }
+		addObject(filepath, modelMatrix);
+
+		Animation animation;
+		animation.mKeyframes = keyframes;
+		for (size_t i = 0;i < mMeshInstances.size();i++)
+		{
+			const std::vector<glm::mat4> & modelMatrices = mMeshInstances[i].mModelMatrices;
+			for (size_t j = (i < numPlacements.size()) ? numPlacements[i] : 0;j < modelMatrices.size();j++)
+			{
+				animation.mPlacements.emplace_back(i, j);
+				animation.mModelMatrices.push_back(modelMatrices[j]);
+			}
+		}
+		mAnimations.push_back(std::move(animation));
+	}
+
+	void addObject(const std::string & filepath,
+		const glm::mat4 & modelMatrix = glm::mat4(),
+		const glm::vec4 & lightIntensity = glm::vec4(0.0f),
+		bool overrideMaterial = false,
+		shared_ptr<RtMaterial> defaultMat = make_shared<RtMaterial>())
+	{
+		// the same object again only adds placements, its meshes and materials are shared
+		auto loadedObject = mLoadedObjects.find(filepath);
+		if (!overrideMaterial && loadedObject != mLoadedObjects.end())
+		{
+			placeObject(loadedObject->second, modelMatrix);
+			return;
+		}
+
+		const unsigned int aiProcesses = aiProcess_Triangulate
+			| aiProcess_GenSmoothNormals
+			| aiProcess_JoinIdenticalVertices
+			| aiProcessPreset_TargetRealtime_Fast;
+
+		// try the binary scene cache first. it is regenerated whenever the object file or its materials change.
+		// glb files are mapped directly and never need the cache.
+		std::vector<shared_ptr<RtMesh>> meshes;
+		std::vector<RtMaterialDesc> materialDescs;
+		std::vector<std::vector<glm::mat4>> meshMatrices;
+		const std::string cacheFilepath = filepath + ".rtcache";
+		const std::string extension = filepath.substr(filepath.find_last_of('.') + 1);
+		const bool isGlb = (extension == "glb" || extension == "GLB");
+#ifdef USE_CPU_ONLY
+		const bool useObjLoader = (extension == "obj" || extension == "OBJ");
+#else
+		const bool useObjLoader = mUseObjLoader && (extension == "obj" || extension == "OBJ");
+#endif
+		const uint64_t cacheKey = (mUseSceneCache && !isGlb) ? ComputeSceneCacheKey(filepath, aiProcesses, useObjLoader, mReorderMeshes) : 0;
+		if (isGlb)
+		{
+			if (!ImportGlb(&meshes, &materialDescs, &meshMatrices, filepath))
+			{
+				std::cerr << "Impossible to load the scene: " << filepath << "\n";
+				assert(false);
+			}
+
+			// no cache to keep the result, the mapped streams are replaced by reordered copies on every load
+			if (mReorderMeshes)
+			{
+				ThreadPool::Instance().parallelFor(0, meshes.size(), [&](const size_t i) { meshes[i]->reorderForLocality(); });
+			}
+		}
+		else if (!mUseSceneCache || !LoadSceneCache(&meshes, &materialDescs, cacheFilepath, cacheKey))
+		{
+			meshes.clear();
+			materialDescs.clear();
+			if (!useObjLoader || !ImportObjectWithObjLoader(&meshes, &materialDescs, filepath))
+			{
+				meshes.clear();
+				materialDescs.clear();
+#ifdef USE_CPU_ONLY
+				std::cerr << "Impossible to load the scene without assimp: " << filepath << "\n";
+				throw std::exception(); // "unsupported object file"
+#else
+				ImportObject(&meshes, &materialDescs, filepath, aiProcesses);
+#endif
+			}
+
+			// done once per asset, the cache keeps the result
+			if (mReorderMeshes)
+			{
+				ThreadPool::Instance().parallelFor(0, meshes.size(), [&](const size_t i) { meshes[i]->reorderForLocality(); });
+			}
+			if (mUseSceneCache && !SaveSceneCache(meshes, materialDescs, cacheFilepath, cacheKey))
+			{
+				std::cout << "unable to write scene cache : " << cacheFilepath << std::endl;
+			}
+		}
+
+		const size_t matOffset = this->mMaterials.size();
+		const size_t meshOffset = this->mMeshes.size();
+
+		for (size_t iMesh = 0;iMesh < meshes.size();iMesh++)
+		{
+			shared_ptr<RtMesh> mesh = meshes[iMesh];
 			if (overrideMaterial)
 			{
 				mesh->mMatIndex = matOffset;
 			}
 			else
 			{ 
-				mesh->mMatIndex = matOffset + matIndex;
+				mesh->mMatIndex = matOffset + mesh->mMatIndex;
 			}
 
-			mesh->applyTransform(modelMatrix);
+			// the area light (overrideMaterial) is sampled in world space, so its transform is baked and it keeps float streams
+			if (overrideMaterial)
+			{
+				const glm::mat4 lightMatrix = meshMatrices.empty() || meshMatrices[iMesh].empty() ? modelMatrix : modelMatrix * meshMatrices[iMesh][0];
+				if (lightMatrix != glm::mat4(1.0f)) { mesh->applyTransform(lightMatrix); }
+			}
+			if (mPackVertices && !overrideMaterial) { mesh->packVertices(mQuantizePositions); }
 
+			RtMeshInstances instances;
+			instances.mMesh = mesh;
+			if (overrideMaterial) { instances.mModelMatrices.push_back(glm::mat4(1.0f)); }
 			this->mMeshes.push_back(mesh);
+			this->mMeshInstances.push_back(instances);
 		}
 
-		std::string filedir = filepath.substr(0, filepath.find_last_of("/\\")) + "\\";
+		if (!overrideMaterial)
+		{
+			LoadedObject object;
+			object.mFirstMesh = meshOffset;
+			object.mLastMesh = mMeshes.size();
+			object.mMeshMatrices = std::move(meshMatrices);
+			placeObject(object, modelMatrix);
+			mLoadedObjects[filepath] = std::move(object);
+		}
+
+		// directory with its trailing separator, empty for a file in the working directory (same as the obj loader)
+		const std::string filedir = filepath.substr(0, filepath.find_last_of("/\\") + 1);
 
 		if (overrideMaterial)
 		{
@@ -738,28 +2263,31 @@ struct RtScene
 		}
 		else
 		{
-			// populate rtmaterial result vector
-			const size_t numMaterials = scene->mNumMaterials;
-			for (size_t iMat = 0;iMat < numMaterials;iMat++)
+			// populate rtmaterial result vector. every slot is decoded on the thread pool, duplicates wait on the texture cache.
+			std::vector<shared_ptr<RtMaterial>> materials(materialDescs.size());
+			for (shared_ptr<RtMaterial> & mat : materials)
 			{
-				// note: assimp always generate material index = 0 as DefaultMaterial automatically
-				const auto aiMat = scene->mMaterials[iMat];
-				shared_ptr<RtMaterial> mat = make_shared<RtMaterial>();
-
-				mat->mLambertReflectance = RtTexture::LoadRtTexture(filedir, *aiMat, aiTextureType_DIFFUSE, AI_MATKEY_COLOR_DIFFUSE);
-				mat->mPhongReflectance = RtTexture::LoadRtTexture(filedir, *aiMat, aiTextureType_SPECULAR, AI_MATKEY_COLOR_SPECULAR);
-				mat->mPhongExponent = RtTexture::LoadRtTexture(filedir, *aiMat, aiTextureType_SHININESS, AI_MATKEY_SHININESS);
+				mat = make_shared<RtMaterial>();
 				mat->mLightIntensity = lightIntensity;
-
-				mMaterials.push_back(mat);
 			}
+
+			ThreadPool::Instance().parallelFor(0, materialDescs.size() * 3, [&](size_t i)
+			{
+				RtMaterial & mat = *materials[i / 3];
+				RtMaterialSlot * slots[3] = { &mat.mLambertReflectance, &mat.mPhongReflectance, &mat.mPhongExponent };
+				*slots[i % 3] = RtMaterialSlot::Load(filedir, materialDescs[i / 3][i % 3], slots[i % 3] == &mat.mPhongExponent);
+			});
+
+			mMaterials.insert(mMaterials.end(), materials.begin(), materials.end());
 		}
 	}
 
 	float totalArea() const {
 		float sumArea = 0.f;
-		for (auto m : mMeshes) {
-			sumArea += m->recomputeArea();
+		for (const RtMeshInstances & instances : mMeshInstances) {
+			for (const glm::mat4 & modelMatrix : instances.mModelMatrices) {
+				sumArea += instances.mMesh->recomputeArea(modelMatrix);
+			}
 		}
 
 		//sumArea += mArealight->mMeshArea;
@@ -782,9 +2310,9 @@ struct RtScene
 		for (size_t i = 0;i < 3;i++) { precomputedLightIntensity[i] = lightIntensity[i] * Math::Pi; }
 
 		shared_ptr<RtMaterial> mat = make_shared<RtMaterial>();
-		mat->mLambertReflectance = make_shared<RtTexture>(0.f, 0.f, 0.f, 1.f);
-		mat->mPhongExponent = make_shared<RtTexture>(0.f, 0.f, 0.f, 1.f);
-		mat->mPhongReflectance = make_shared<RtTexture>(0.f, 0.f, 0.f, 1.f);
+		mat->mLambertReflectance = RtMaterialSlot(glm::vec3(0.f));
+		mat->mPhongExponent = RtMaterialSlot(glm::vec3(0.f));
+		mat->mPhongReflectance = RtMaterialSlot(glm::vec3(0.f));
 		mat->mLightIntensity = precomputedLightIntensity;
 
 		this->addObject(filepath, modelMatrix, precomputedLightIntensity, true, mat);
@@ -797,6 +2325,262 @@ struct RtScene
 		this->mArealight = make_shared<RtAreaLight>(this->mMeshes.back(), lightIntensity, precomputedLightIntensity);
 	}
 
+#ifndef USE_CPU_ONLY
+	// packed material table read by the closest hit programs (materialBuffer[materialIndex])
+	void createOptixMaterialBuffer(optix::Context ctx)
+	{
+		for (shared_ptr<RtMaterial> material : mMaterials) { material->createOptixTextures(ctx); }
+
+		mOptixMaterialBuffer = ctx->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_USER, mMaterials.size());
+		mOptixMaterialBuffer->setElementSize(sizeof(RtMaterialRecord));
+		RtMaterialRecord * records = static_cast<RtMaterialRecord*>(mOptixMaterialBuffer->map());
+		for (size_t i = 0;i < mMaterials.size();i++)
+		{
+			records[i] = mMaterials[i]->createOptixRecord();
+		}
+		mOptixMaterialBuffer->unmap();
+	}
+#endif
+
+	// every plain mesh except the area light (which keeps its own buffers for light sampling and the light pass) goes into one pool.
+	// instanced meshes stay separate so their geometry isn't duplicated.
+	void createGeometryPool()
+	{
+		std::vector<shared_ptr<RtMesh>> pooledMeshes;
+		for (shared_ptr<RtMesh> mesh : getPlainMeshes())
+		{
+			if (mArealight == nullptr || mesh != mArealight->mMesh) { pooledMeshes.push_back(mesh); }
+		}
+
+		mGeometryPool = make_shared<RtGeometryPool>();
+		mGeometryPool->build(pooledMeshes, mMaterials);
+		if (mPackVertices) { mGeometryPool->mMesh->packVertices(mQuantizePositions); }
+	}
+
+	// plain meshes which still need their own opengl buffers and optix geometry in the top geometry group
+	std::vector<shared_ptr<RtMesh>> getUnpooledMeshes() const
+	{
+		if (mGeometryPool == nullptr) { return getPlainMeshes(); }
+		std::vector<shared_ptr<RtMesh>> result;
+		if (mArealight != nullptr) { result.push_back(mArealight->mMesh); }
+		return result;
+	}
+
+	std::vector<shared_ptr<RtMesh>> getPlainMeshes() const
+	{
+		std::vector<shared_ptr<RtMesh>> result;
+		for (const RtMeshInstances & instances : mMeshInstances)
+		{
+			if (instances.isPlain()) { result.push_back(instances.mMesh); }
+		}
+		return result;
+	}
+
+	// meshes placed several times or with a transform
+	std::vector<RtMeshInstances *> getInstancedMeshes()
+	{
+		std::vector<RtMeshInstances *> result;
+		for (RtMeshInstances & instances : mMeshInstances)
+		{
+			if (!instances.isPlain()) { result.push_back(&instances); }
+		}
+		return result;
+	}
+
+#ifndef USE_CPU_ONLY
+	// top object for rtTrace. without instances it is the geometry group of the plain meshes itself, otherwise a group
+	// with that geometry group and one transform per placement. buffers of the instanced meshes are created here.
+	void createOptixTopObject(optix::Context context, optix::GeometryGroup plainGeometryGroup, optix::Program meshIntersectProgram, optix::Program boundingBoxProgram, optix::Material optixMaterial)
+	{
+		mOptixTopGroup = optix::Group();
+		const std::vector<RtMeshInstances *> instancedMeshes = getInstancedMeshes();
+		if (instancedMeshes.empty()) { return; }
+
+		mOptixTopGroup = context->createGroup();
+		mOptixTopGroup->addChild(plainGeometryGroup);
+		for (RtMeshInstances * instances : instancedMeshes)
+		{
+			instances->mMesh->createOpenglBuffer();
+			instances->mMesh->createOptixMeshBuffer(context);
+			instances->mMesh->createOptixGeometry(context, meshIntersectProgram, boundingBoxProgram, optixMaterial);
+			instances->createOptixTransforms(context, mOptixTopGroup);
+		}
+		mOptixTopGroup->setAcceleration(context->createAcceleration("Trbvh"));
+	}
+
+	void setOptixTopObject(optix::Variable variable, optix::GeometryGroup plainGeometryGroup) const
+	{
+		if (mOptixTopGroup) { variable->set(mOptixTopGroup); }
+		else { variable->set(plainGeometryGroup); }
+	}
+#endif
+
+	// every placement baked into world space (area light included). input of the cpu accelerators
+	std::vector<shared_ptr<TriangleMesh>> createTriangleMeshes() const
+	{
+		std::vector<shared_ptr<TriangleMesh>> result;
+		for (const RtMeshInstances & instances : mMeshInstances)
+		{
+			for (const glm::mat4 & modelMatrix : instances.mModelMatrices)
+			{
+				result.push_back(instances.mMesh->createTriangleMesh(modelMatrix));
+			}
+		}
+		return result;
+	}
+
+	// cpu ray tracing over the baked placements. mCpuAccelType picks the builder : "binned", "sbvh" or "lbvh".
+	// with a cache filepath the bvh is saved there and mapped back in later runs over the same geometry and settings
+	void buildCpuAccel(const std::string & cacheFilepath)
+	{
+		StopWatch sw;
+		sw.reset();
+		mCpuTriangleMeshes = createTriangleMeshes();
+
+		uint64_t key = 0;
+		if (mCpuAccelType == "binned")
+		{
+			key = BinnedBvhAccel::BuildSetting().hash(Util::HashFnv1a(mCpuAccelType.data(), mCpuAccelType.size()));
+		}
+		else if (mCpuAccelType == "sbvh")
+		{
+			key = SbvhAccel::BuildSetting().hash(Util::HashFnv1a(mCpuAccelType.data(), mCpuAccelType.size()));
+		}
+		else if (mCpuAccelType == "lbvh")
+		{
+			key = LbvhAccel::BuildSetting().hash(Util::HashFnv1a(mCpuAccelType.data(), mCpuAccelType.size()));
+		}
+		else
+		{
+			std::cout << "unknown cpuAccel : " << mCpuAccelType << std::endl;
+			throw std::exception(); // "unknown cpuAccel"
+		}
+
+		if (!cacheFilepath.empty())
+		{
+			const uint32_t version = BvhAccel::FileVersion;
+			key = BvhAccel::HashGeometry(mCpuTriangleMeshes, Util::HashFnv1a(&version, sizeof(version), key));
+			mCpuAccel = BvhAccel::Load(cacheFilepath, key, mCpuTriangleMeshes);
+			mIsCpuAccelLoaded = (mCpuAccel != nullptr);
+		}
+
+		if (!mIsCpuAccelLoaded)
+		{
+			if (mCpuAccelType == "binned") { mCpuAccel = make_shared<BinnedBvhAccel>(mCpuTriangleMeshes); }
+			else if (mCpuAccelType == "lbvh") { mCpuAccel = make_shared<LbvhAccel>(mCpuTriangleMeshes); }
+			else { mCpuAccel = make_shared<SbvhAccel>(mCpuTriangleMeshes); }
+
+			if (!cacheFilepath.empty() && !mCpuAccel->save(cacheFilepath, key))
+			{
+				std::cout << "unable to write bvh cache : " << cacheFilepath << std::endl;
+			}
+		}
+
+		buildCpuTracer();
+		mCpuAccelSetupTimeMs = sw.timeMilliSec();
+	}
+
+	// places the animated objects as in frame f and moves the cpu accel along. the cpu techniques call it at the start of
+	// every iteration, it does nothing without animations or when no placement changed. the gpu techniques don't
+	// animate, they keep the placements as loaded
+	void setFrame(const size_t frame)
+	{
+		bool hasMoved = false;
+		for (const Animation & animation : mAnimations)
+		{
+			const glm::mat4 & keyframe = animation.mKeyframes[frame % animation.mKeyframes.size()];
+			for (size_t i = 0;i < animation.mPlacements.size();i++)
+			{
+				glm::mat4 & modelMatrix = mMeshInstances[animation.mPlacements[i].first].mModelMatrices[animation.mPlacements[i].second];
+				const glm::mat4 nextMatrix = keyframe * animation.mModelMatrices[i];
+				if (nextMatrix != modelMatrix) { hasMoved = true; }
+				modelMatrix = nextMatrix;
+			}
+		}
+		if (hasMoved && mCpuAccel != nullptr) { updateCpuAccel(); }
+	}
+
+	// per frame update after model matrices in mMeshInstances changed (same meshes and number of placements). the baked
+	// meshes are moved in place and the bvh refitted, or rebuilt as an lbvh once the refits degraded it too much
+	void updateCpuAccel()
+	{
+		StopWatch sw;
+		sw.reset();
+
+		// the reference cost of the dynamic bvh is taken before anything moves
+		if (mCpuDynamicBvh == nullptr) { mCpuDynamicBvh = make_shared<DynamicBvh>(mCpuAccel, mCpuTriangleMeshes); }
+
+		size_t iTriangleMesh = 0;
+		for (const RtMeshInstances & instances : mMeshInstances)
+		{
+			for (const glm::mat4 & modelMatrix : instances.mModelMatrices)
+			{
+				assert(iTriangleMesh < mCpuTriangleMeshes.size());
+				instances.mMesh->updateTriangleMesh(mCpuTriangleMeshes[iTriangleMesh++].get(), modelMatrix);
+			}
+		}
+		assert(iTriangleMesh == mCpuTriangleMeshes.size());
+
+		mCpuDynamicBvh->update();
+		mCpuAccel = mCpuDynamicBvh->mBvh;
+		buildCpuTracer();
+		mCpuAccelUpdateTimeMs = sw.timeMilliSec();
+	}
+
+	// the layout the cpu techniques trace against, collapsed from mCpuAccel. mCpuTraversalType trades memory for
+	// traversal work : "binary" (default), "wide" or "compressed" (wide with 8 bit child bounds, about a third of the
+	// node memory of "wide" for a few more instructions per node)
+	void buildCpuTracer()
+	{
+		if (mCpuTraversalType.empty() || mCpuTraversalType == "binary")
+		{
+			mCpuTracer = mCpuAccel;
+			mCpuTracerNodeBytes = mCpuAccel->mNodes.size() * sizeof(BvhAccel::Node);
+		}
+		else if (mCpuTraversalType == "wide")
+		{
+			shared_ptr<WideBvhAccel> wide = make_shared<WideBvhAccel>(*mCpuAccel);
+			mCpuTracerNodeBytes = wide->mNodes.size() * sizeof(WideBvhAccel::Node);
+			mCpuTracer = wide;
+		}
+		else if (mCpuTraversalType == "compressed")
+		{
+			shared_ptr<CompressedWideBvhAccel> compressed = make_shared<CompressedWideBvhAccel>(*mCpuAccel);
+			mCpuTracerNodeBytes = compressed->mNodes.size() * sizeof(CompressedWideBvhAccel::Node);
+			mCpuTracer = compressed;
+		}
+		else
+		{
+			std::cout << "unknown cpuTraversal : " << mCpuTraversalType << std::endl;
+			throw std::exception(); // "unknown cpuTraversal"
+		}
+	}
+
+	// goes into the stat files of the techniques. buildTimeMs is the one of the original build if the bvh was loaded
+	nlohmann::json createCpuAccelStats() const
+	{
+		nlohmann::json result;
+		result["builder"] = mCpuAccelType;
+		result["isLoadedFromCache"] = mIsCpuAccelLoaded;
+		result["buildTimeMs"] = mCpuAccel->mStats.mBuildTimeMs;
+		result["setupTimeMs"] = mCpuAccelSetupTimeMs;
+		result["numThreads"] = ThreadPool::Instance().numThreads();
+		result["numTriangles"] = mCpuAccel->mStats.mNumTriangles;
+		result["numReferences"] = mCpuAccel->mStats.mNumReferences;
+		result["numNodes"] = mCpuAccel->mStats.mNumNodes;
+		result["sahCost"] = mCpuAccel->mStats.mSahCost;
+		result["traversal"] = mCpuTraversalType.empty() ? "binary" : mCpuTraversalType;
+		result["traversalNodeBytes"] = mCpuTracerNodeBytes;
+		if (mCpuDynamicBvh)
+		{
+			result["numRefits"] = mCpuDynamicBvh->mNumRefits;
+			result["numRebuilds"] = mCpuDynamicBvh->mNumRebuilds;
+			result["currentSahCost"] = mCpuDynamicBvh->mSahCost;
+			result["updateTimeMs"] = mCpuAccelUpdateTimeMs;
+		}
+		return result;
+	}
+
 	void setCamera(shared_ptr<RtCameraBase> camera)
 	{
 		this->mCamera = camera;
@@ -805,16 +2589,44 @@ struct RtScene
 	float findBoundingSphereRadius()
 	{
 		Aabb bbox;
-		for (shared_ptr<RtMesh> mMesh : mMeshes)
+		for (const RtMeshInstances & instances : mMeshInstances)
 		{
-			bbox = Aabb::Union(bbox, mMesh->computeBbox());
+			const Aabb meshBbox = instances.mMesh->computeBbox();
+			for (const glm::mat4 & modelMatrix : instances.mModelMatrices)
+			{
+				bbox = Aabb::Union(bbox, Aabb::Transform(meshBbox, modelMatrix));
+			}
 		}
 		float diameter = std::sqrt(Aabb::DiagonalLength2(bbox));
 		return diameter / 2.0f;
 	}
 
 	shared_ptr<RtAreaLight>					mArealight;
-	std::vector<shared_ptr<RtMesh>>			mMeshes;
+	std::vector<shared_ptr<RtMesh>>			mMeshes;			// unique geometry
+	std::vector<RtMeshInstances>			mMeshInstances;		// placements, same order as mMeshes
+	std::vector<Animation>					mAnimations;
+	std::map<std::string, LoadedObject>		mLoadedObjects;		// filepath -> meshes and their local placements
 	std::vector<shared_ptr<RtMaterial>>		mMaterials;
 	shared_ptr<RtCameraBase>				mCamera;
+	bool									mUseSceneCache = true;
+	bool									mUseObjLoader = false;
+	bool									mReorderMeshes = false;
+	bool									mFlattenGeometry = false;
+	bool									mPackVertices = false;
+	bool									mQuantizePositions = false;
+	std::string								mCpuAccelType;		// empty : no cpu accel
+	std::vector<shared_ptr<TriangleMesh>>	mCpuTriangleMeshes;
+	shared_ptr<BvhAccel>					mCpuAccel;
+	std::string								mCpuTraversalType;
+	shared_ptr<Accel>						mCpuTracer;
+	size_t									mCpuTracerNodeBytes = 0;
+	shared_ptr<DynamicBvh>					mCpuDynamicBvh;		// created by the first updateCpuAccel
+	long long								mCpuAccelUpdateTimeMs = 0;
+	bool									mIsCpuAccelLoaded = false;
+	long long								mCpuAccelSetupTimeMs = 0;	// baking the placements included
+	shared_ptr<RtGeometryPool>				mGeometryPool;
+#ifndef USE_CPU_ONLY
+	optix::Buffer							mOptixMaterialBuffer;
+	optix::Group							mOptixTopGroup;
+#endif
 };
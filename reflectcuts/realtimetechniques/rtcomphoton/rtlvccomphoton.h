@@ -104,12 +104,23 @@ public:
 		}
 	}
 
-	void render(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const nlohmann::json & json) override
+	void configure(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const nlohmann::json & json) override
 	{
 		mScene = scene;
 		mResolution = resolution;
 		mInvResolution = glm::vec2(1.0f) / resolution;
 
+		// optional parameters go back to their defaults if the next parameter set leaves them out
+		mTargetRenderingTime = -1;
+		mDoProgressive = false;
+		mAlphaProgressive = 0.7;
+		mDoDeferredShading = true;
+		mDoLightTracing = true;
+		mDoVplSplat = true;
+		mDoPhotonSplat = true;
+		mDoLightRender = true;
+		mDoFinalize = true;
+
 		// serious parameters
 		mNumLightPaths = json["numLightPaths"];
 		mNumVplLightPaths = json["numVplLightPaths"];
@@ -201,10 +212,6 @@ public:
 			std::cout << "WARN: 0 VPL light paths. Disable mDoVplSplat\n";
 			mDoVplSplat = false;
 		}
-
-		setup();
-		run();
-		destroy();
 	}
 
 	FloatImage dumpImage(const glm::uvec2 & resolution, const std::function<void(void)> & renderFunc)
@@ -301,9 +308,8 @@ public:
 	shared_ptr<OpenglProgram> mDeferredProgram;
 	shared_ptr<OpenglUniform> mDeferredProgram_uMvp;
 	shared_ptr<OpenglUniform> mDeferredProgram_uDiffuse;
-	shared_ptr<OpenglUniform> mDeferredProgram_uLambertReflectance;
-	shared_ptr<OpenglUniform> mDeferredProgram_uPhongReflectance;
-	shared_ptr<OpenglUniform> mDeferredProgram_uPhongExponent;
+	RtMaterialUniforms mDeferredProgram_uMaterial;
+	RtVertexUniforms mDeferredProgram_uVertex;
 	void initDeferredProgram()
 	{
 		mDeferredProgram = make_shared<OpenglProgram>();
@@ -314,9 +320,8 @@ public:
 
 		mDeferredProgram_uMvp = mDeferredProgram->registerUniform("uMVP");
 		mDeferredProgram_uDiffuse = mDeferredProgram->registerUniform("uDiffuse");
-		mDeferredProgram_uLambertReflectance = mDeferredProgram->registerUniform("uLambertReflectance");
-		mDeferredProgram_uPhongReflectance = mDeferredProgram->registerUniform("uPhongReflectance");
-		mDeferredProgram_uPhongExponent = mDeferredProgram->registerUniform("uPhongExponent");
+		mDeferredProgram_uMaterial.registerUniforms(mDeferredProgram);
+		mDeferredProgram_uVertex.registerUniforms(mDeferredProgram);
 	}
 
 	GLuint mBigTriangleBuffer;
@@ -493,6 +498,7 @@ public:
 	}
 
 	GLuint mOptixPhotonSsboHandle;
+	size_t mNumAllocatedPhotonRecords = 0;
 	optix::Buffer mOptixPhotonRecordsBuffer;
 	optix::Buffer mOptixPhotonInfoBuffer;
 	optix::Program mOptixLightTracingProgram;
@@ -502,6 +508,7 @@ public:
 		glGenBuffers(1, &mOptixPhotonSsboHandle);
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mOptixPhotonSsboHandle);
 		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(RtPhotonRecord) * mNumPhotonsPerLightPath * mNumLightPaths, NULL, GL_DYNAMIC_COPY);
+		mNumAllocatedPhotonRecords = mNumPhotonsPerLightPath * mNumLightPaths;
 
 		try
 		{
@@ -621,7 +628,7 @@ public:
 		mIcosohedron.mNumIndices = icosohedronTrimesh.mTriangles.size();
 	}
 
-	void setup()
+	void setup() override
 	{
 		rt.setup(mResolution);
 
@@ -656,18 +663,28 @@ public:
 		for (size_t i = 0;i < mScene->mMaterials.size();i++)
 		{
 			mScene->mMaterials[i]->createOpenglTextures();
-			mScene->mMaterials[i]->createOptixTextures(mOptixContext);
 		}
+		mScene->createOptixMaterialBuffer(mOptixContext);
+		mOptixContext["materialBuffer"]->set(mScene->mOptixMaterialBuffer);
 
 		// put all geometry inside a one group
 		mOptixTopGeometryGroup = mOptixContext->createGeometryGroup();
-		for (size_t i = 0;i < mScene->mMeshes.size();i++)
+		if (mScene->mFlattenGeometry)
+		{
+			mScene->createGeometryPool();
+			mScene->mGeometryPool->createOpenglBuffers();
+			mScene->mGeometryPool->createOptixGeometry(mOptixContext, mOptixMeshIntersectProgram, mOptixMeshBboxProgram, mOptixRtMaterial);
+			mOptixTopGeometryGroup->addChild(mScene->mGeometryPool->mMesh->mOptix.mGeometryInstance);
+		}
+
+		std::vector<shared_ptr<RtMesh>> rtMeshes = mScene->getUnpooledMeshes();
+		for (size_t i = 0;i < rtMeshes.size();i++)
 		{
-			mScene->mMeshes[i]->createOpenglBuffer();
-			mScene->mMeshes[i]->createOptixMeshBuffer(mOptixContext);
-			//mScene->mMeshes[i].createOptixMeshBufferFromOpenglBuffer(mOptixContext); // slow
-			mScene->mMeshes[i]->createOptixGeometry(mOptixContext, mOptixMeshIntersectProgram, mOptixMeshBboxProgram, mOptixRtMaterial, *mScene->mMaterials[mScene->mMeshes[i]->mMatIndex]);
-			mOptixTopGeometryGroup->addChild(mScene->mMeshes[i]->mOptix.mGeometryInstance);
+			rtMeshes[i]->createOpenglBuffer();
+			rtMeshes[i]->createOptixMeshBuffer(mOptixContext);
+			//rtMeshes[i].createOptixMeshBufferFromOpenglBuffer(mOptixContext); // slow
+			rtMeshes[i]->createOptixGeometry(mOptixContext, mOptixMeshIntersectProgram, mOptixMeshBboxProgram, mOptixRtMaterial);
+			mOptixTopGeometryGroup->addChild(rtMeshes[i]->mOptix.mGeometryInstance);
 		}
 
 		mScene->mArealight->createOptixCdf(mOptixContext);
@@ -683,6 +700,9 @@ public:
 		optix::Acceleration accel = mOptixContext->createAcceleration("Trbvh");
 		accel->markDirty();
 		mOptixTopGeometryGroup->setAcceleration(accel);
+
+		// instanced meshes get one bvh each and are placed with optix transforms above the plain geometry
+		mScene->createOptixTopObject(mOptixContext, mOptixTopGeometryGroup, mOptixMeshIntersectProgram, mOptixMeshBboxProgram, mOptixRtMaterial);
 	}
 
 	void runDeferredProgram(const glm::mat4 & mvpMatrix, const glm::mat4 & originalMvpMatrix)
@@ -690,9 +710,15 @@ public:
 		glUseProgram(mDeferredProgram->mHandle);
 		mDeferredProgram_uMvp->setUniform(mvpMatrix);
 
-		std::vector<shared_ptr<RtMesh>> rtMeshes = mScene->mMeshes;
+		std::vector<shared_ptr<RtMesh>> rtMeshes = mScene->getUnpooledMeshes();
 		std::vector<shared_ptr<RtMaterial>> rtMaterials = mScene->mMaterials;
 
+		if (mScene->mGeometryPool != nullptr)
+		{
+			mDeferredProgram_uMvp->setUniform(mvpMatrix);
+			mScene->mGeometryPool->draw(mDeferredProgram_uMaterial, mDeferredProgram_uVertex, rtMaterials);
+		}
+
 		for (size_t i = 0;i < rtMeshes.size();i++)
 		{
 			if (rtMeshes[i] == mScene->mArealight->mMesh)
@@ -704,31 +730,33 @@ public:
 				mDeferredProgram_uMvp->setUniform(mvpMatrix);
 			}
 
-			glEnableVertexAttribArray(0);
-			glBindBuffer(GL_ARRAY_BUFFER, rtMeshes[i]->mGl.mVerticesBuffer->mHandle);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*) 0);
-
-			glEnableVertexAttribArray(1);
-			glBindBuffer(GL_ARRAY_BUFFER, rtMeshes[i]->mGl.mTexCoordsBuffer->mHandle);
-			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*) 0);
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, rtMaterials[rtMeshes[i]->mMatIndex]->mLambertReflectance->mGlHandle);
-			mDeferredProgram_uLambertReflectance->setUniform(0);
+			rtMeshes[i]->bindOpenglAttributes();
+			mDeferredProgram_uVertex.setUniforms(*rtMeshes[i]);
 
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, rtMaterials[rtMeshes[i]->mMatIndex]->mPhongReflectance->mGlHandle);
-			mDeferredProgram_uPhongReflectance->setUniform(1);
-
-			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_2D, rtMaterials[rtMeshes[i]->mMatIndex]->mPhongExponent->mGlHandle);
-			mDeferredProgram_uPhongExponent->setUniform(2);
+			mDeferredProgram_uMaterial.setUniforms(*rtMaterials[rtMeshes[i]->mMatIndex]);
 
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rtMeshes[i]->mGl.mIndicesBuffer->mHandle);
 			glDrawElements(GL_TRIANGLES, rtMeshes[i]->mNumTriangles * 3, GL_UNSIGNED_INT, (void*) 0);
 			glDisableVertexAttribArray(0);
 			glDisableVertexAttribArray(1);
 		}
+
+		// instanced meshes are bound once and drawn once per placement
+		mDeferredProgram_uMvp->setUniform(mvpMatrix);
+		for (const RtMeshInstances * instances : mScene->getInstancedMeshes())
+		{
+			const RtMesh & mesh = *instances->mMesh;
+			mesh.bindOpenglAttributes();
+			mDeferredProgram_uMaterial.setUniforms(*rtMaterials[mesh.mMatIndex]);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.mGl.mIndicesBuffer->mHandle);
+			for (const glm::mat4 & modelMatrix : instances->mModelMatrices)
+			{
+				mDeferredProgram_uVertex.setUniforms(mesh, modelMatrix);
+				glDrawElements(GL_TRIANGLES, mesh.mNumTriangles * 3, GL_UNSIGNED_INT, (void*) 0);
+			}
+			glDisableVertexAttribArray(0);
+			glDisableVertexAttribArray(1);
+		}
 	}
 
 	void runFinalProgram(const float vplScaling, const float photonScaling, const float lightScaling, const bool doGammaCorrection)
@@ -858,7 +886,7 @@ public:
 		}
 	}
 
-	void run()
+	void run() override
 	{
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
@@ -877,7 +905,7 @@ public:
 		mOptixContext["deferredNormalTexture"]->setTextureSampler(mOptixDeferredNormalTextureSampler);
 		mOptixContext["deferredDiffuseTexture"]->setTextureSampler(mOptixDeferredDiffuseTextureSampler);
 		mOptixContext["deferredPhongReflectanceTexture"]->setTextureSampler(mOptixDeferredPhongInfoSampler);
-		mOptixContext["topObject"]->set(mOptixTopGeometryGroup);
+		mScene->setOptixTopObject(mOptixContext["topObject"], mOptixTopGeometryGroup);
 		mOptixContext["boundingValue"]->setFloat(0);
 		mOptixContext["pdfMc"]->setFloat(mPrecomptedPdfMc);
 		mOptixContext["radius"]->setFloat(mPhotonRadius);
@@ -887,7 +915,7 @@ public:
 		// light trace stuffs
 		mOptixContext["photons"]->setBuffer(mOptixPhotonRecordsBuffer);
 		mOptixContext["photonInfo"]->setBuffer(mOptixPhotonInfoBuffer);
-		mOptixContext["topObject"]->set(mOptixTopGeometryGroup);
+		mScene->setOptixTopObject(mOptixContext["topObject"], mOptixTopGeometryGroup);
 		mOptixContext["numVplLightPaths"]->setUint(mNumVplLightPaths);
 		mOptixContext["numLightPaths"]->setUint(mNumLightPaths);
 		mOptixContext["numPhotonsPerLightPath"]->setUint(mNumPhotonsPerLightPath);
@@ -1042,6 +1070,7 @@ public:
 			nlohmann::json result;
 			std::cout << masterWatch.timeMilliSec() << std::endl;
 			result["time"] = masterWatch.timeMilliSec();
+			if (mScene->mCpuAccel) { result["cpuAccel"] = mScene->createCpuAccelStats(); }
 			std::ofstream of(mStatFilename);
 			assert(of.is_open());
 			of << std::setw(4) << result;
@@ -1061,7 +1090,27 @@ public:
 		FloatImage::Save(photonImage, mDumpWeightedPhotonFilename);
 	}
 
-	void destroy()
+	void applyParameters() override
+	{
+		// the photon records are the only buffer sized by the parameters (numLightPaths, numMaxBounces)
+		const size_t numPhotonRecords = mNumPhotonsPerLightPath * mNumLightPaths;
+		if (numPhotonRecords != mNumAllocatedPhotonRecords)
+		{
+			// optix has to let go of the glbo while its storage is replaced
+			mOptixPhotonRecordsBuffer->unregisterGLBuffer();
+			glNamedBufferData(mOptixPhotonSsboHandle, sizeof(RtPhotonRecord) * numPhotonRecords, NULL, GL_DYNAMIC_COPY);
+			mOptixPhotonRecordsBuffer->registerGLBuffer();
+			mOptixPhotonRecordsBuffer->setSize(numPhotonRecords);
+			mNumAllocatedPhotonRecords = numPhotonRecords;
+		}
+
+		// restart the accumulation
+		glClearNamedBufferData(mGlOptixVplResultTbo, GL_RGBA32F, GL_RGBA, GL_FLOAT, NULL);
+		glBindFramebuffer(GL_FRAMEBUFFER, mPhotonSplatFramebuffer);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+
+	void destroy() override
 	{
 		rt.destroy();
 	}
@@ -1109,8 +1158,6 @@ public:
 	std::string mDumpWeightedVplFilename;
 	std::string mStatFilename;
 	shared_ptr<RtScene> mScene;
-
-	RealTime rt;
 };
 
 const std::map<std::string, RtLvcComPhoton::EFrame> RtLvcComPhoton::EFrameModeStrMap = {
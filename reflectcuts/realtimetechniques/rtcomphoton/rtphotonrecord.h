@@ -3,8 +3,7 @@
 //#define NUM_PHOTONS 500000
 //#define NUM_MAX_PHOTONS_PER_LIGHT_PATH 5
 
-#include <optix.h>
-#include <optixu/optixu_math_namespace.h>
+#include "../rtvectortypes.h"
 
 enum PhotonRecordFlag
 {
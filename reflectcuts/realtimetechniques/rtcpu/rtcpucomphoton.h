@@ -0,0 +1,384 @@
+#pragma once
+
+#include "common/reflectcuts.h"
+#include "common/stopwatch.h"
+#include "common/floatimage/floatimage.h"
+#include "sampler/independent.h"
+
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <vector>
+
+#include "../rtcommon.h"
+#include "../rtcputechnique.h"
+#include "../rtcomphoton/rtphotonrecord.h"
+#include "rtcpugbuffer.h"
+#include "rtcpulighttracer.h"
+#include "rtcpuphotongather.h"
+#include "rtcpuvplgather.h"
+
+// RtComPhoton (the "photonfam" section) for the cpu only build. reads the same parameters and writes the same images :
+// the g-buffer, the light paths, the vpl gather and the photon gather run on the cpu, the light source is the unjittered
+// primary hit.
+class RtCpuComPhoton: public RtCpuTechnique
+{
+public:
+	enum EFrame
+	{
+		Accumulate = 1,
+		ClearEveryFrame = 2
+	};
+
+	static const std::map<std::string, EFrame> EFrameModeStrMap;
+	static const std::map<std::string, RtCpuVplGather::EMis> EMisModeStrMap;
+
+protected:
+	void configure(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const nlohmann::json & json) override
+	{
+		mScene = scene;
+		mResolution = resolution;
+		mInvResolution = glm::vec2(1.0f) / resolution;
+
+		// optional parameters go back to their defaults if the next parameter set leaves them out
+		mTargetRenderingTime = -1;
+		mDoProgressive = false;
+		mAlphaProgressive = 0.7f;
+		mDoDeferredShading = true;
+		mDoLightTracing = true;
+		mDoVplSplat = true;
+		mDoPhotonSplat = true;
+		mDoLightRender = true;
+
+		mNumLightPaths = json["numLightPaths"];
+		mNumVplLightPaths = json["numVplLightPaths"];
+		mNumMaxBounce = json["numMaxBounces"];
+		mNumPhotonsPerLightPath = mNumMaxBounce + 1;
+		mRadiusPercentage = json["radiusPercentage"];
+		mPhotonRadius = mScene->findBoundingSphereRadius() * mRadiusPercentage;
+		mPrecomptedPdfMc = static_cast<float>(mNumVplLightPaths) / static_cast<float>(mNumLightPaths) * Math::InvPi / (mPhotonRadius * mPhotonRadius);
+		mDoWriteEveryFrame = false;
+		if (json.find("writeEveryFrame") != json.end()) { mDoWriteEveryFrame = json["writeEveryFrame"]; }
+
+		mNumMaxIteration = json["numMaxIteration"];
+		mTimelimitMs = json["timeLimitMs"];
+
+		mFrameMode = EFrameModeStrMap.at(json["frameMode"]);
+		mMisMode = RtCpuVplGather::EMis::Balance;
+		if (json.find("misMode") != json.end()) { mMisMode = EMisModeStrMap.at(json["misMode"]); }
+
+		if (json.find("clampingStart") != json.end())
+		{
+			std::cerr << "clampingStart option is not use anymore\n";
+			std::cerr << "remove it from your JSON file\n";
+			assert(false);
+		}
+
+		if (json.find("targetRenderingTime") != json.end()) { mTargetRenderingTime = json["targetRenderingTime"]; }
+
+		if (json.find("clampingCoeff") == json.end())
+		{
+			// Automatic clamping value ...
+			float totalArea = scene->totalArea();
+			std::cout << "Total area computation: " << totalArea << "\n";
+			mClampingValue = 1.f / totalArea;
+			mClampingStart = 1.f / totalArea;
+		}
+		else
+		{
+			float clampCoeff = json["clampingCoeff"];
+			mClampingValue = clampCoeff;
+			mClampingStart = clampCoeff;
+		}
+
+		mRngOffset = json["rngOffset"];
+
+		mDumpCombineFilename = json["combinedFilename"].get<std::string>();
+		mDumpWeightedPhotonFilename = json["weightedPhotonFilename"].get<std::string>();
+		mDumpWeightedVplFilename = json["weightedVplFilename"].get<std::string>();
+		mStatFilename = json["statFilename"].get<std::string>();
+
+		mJitter = json["useJitter"];
+		mUseStat = json["useStat"];
+
+		if (json.find("DoProgressive") != json.end()) { mDoProgressive = json["DoProgressive"]; }
+		if (json.find("AlphaProgressive") != json.end()) { mAlphaProgressive = json["AlphaProgressive"]; }
+
+		// "finalize" only draws to the window
+		if (json.find("run") != json.end())
+		{
+			const nlohmann::json & runJson = json["run"];
+			if (runJson.find("deferredShading") != runJson.end()) { mDoDeferredShading = runJson["deferredShading"]; }
+			if (runJson.find("lightTracing") != runJson.end()) { mDoLightTracing = runJson["lightTracing"]; }
+			if (runJson.find("vplSplat") != runJson.end()) { mDoVplSplat = runJson["vplSplat"]; }
+			if (runJson.find("photonSplat") != runJson.end()) { mDoPhotonSplat = runJson["photonSplat"]; }
+			if (runJson.find("lightRender") != runJson.end()) { mDoLightRender = runJson["lightRender"]; }
+		}
+
+		if (mNumVplLightPaths == 0)
+		{
+			std::cout << "WARN: 0 VPL light paths. Disable mDoVplSplat\n";
+			mDoVplSplat = false;
+		}
+
+		if (json.find("forceVsl") != json.end() && json["forceVsl"])
+		{
+			std::cout << "forceVsl : virtual spherical lights are not available in the cpu only build, vpls are used" << std::endl;
+		}
+	}
+
+	void setup() override
+	{
+		mLightTracer = make_unique<RtCpuLightTracer>(mScene);
+		mGBuffer.resize(mResolution);
+		applyParameters();
+	}
+
+	void applyParameters() override
+	{
+		// restart the accumulation
+		const size_t numPixels = static_cast<size_t>(mResolution.x) * mResolution.y;
+		mVplResult.assign(numPixels, glm::vec3(0.0f));
+		mPhotonResult.assign(numPixels, glm::vec3(0.0f));
+		mLightResult.assign(numPixels, glm::vec3(0.0f));
+	}
+
+	void run() override
+	{
+		unique_ptr<Sampler> mainSampler = make_unique<IndependentSampler>(mRngOffset);
+
+		int numIterations = 0;
+		const glm::vec3 origin = mScene->mCamera->getOrigin();
+
+		StopWatch masterWatch;
+		masterWatch.reset();
+		float prevTiming = 0.f;
+		long long deferredMs = 0, lightTracingMs = 0, vplSplatMs = 0, photonSplatMs = 0;
+		StopWatch sw;
+
+		while (numIterations != mNumMaxIteration)
+		{
+			// every iteration is a frame of the animated objects
+			mScene->setFrame(numIterations);
+			const glm::mat4 originalMvpMatrix = mScene->mCamera->computeVpMatrix();
+			glm::vec2 jitter(0.0f);
+			if (mJitter)
+			{
+				// ndc coordinates = ([-1, 1], [-1, 1])
+				jitter = (2.0f * mainSampler->nextVec2() - glm::vec2(1)) * mInvResolution;
+			}
+
+			if (mDoDeferredShading)
+			{
+				sw.reset();
+				mGBuffer.render(*mScene, originalMvpMatrix, jitter);
+				deferredMs += sw.timeMilliSec();
+			}
+
+			if (mDoLightTracing)
+			{
+				sw.reset();
+				mLightTracer->trace(&mPhotons, mNumLightPaths, mNumPhotonsPerLightPath, numIterations + mRngOffset);
+				lightTracingMs += sw.timeMilliSec();
+			}
+
+			if (mDoVplSplat)
+			{
+				sw.reset();
+				if (mFrameMode == EFrame::ClearEveryFrame) { std::fill(mVplResult.begin(), mVplResult.end(), glm::vec3(0.0f)); }
+
+				RtCpuVplGather::Setting setting;
+				setting.mMisMode = mMisMode;
+				setting.mPdfMc = mPrecomptedPdfMc;
+				setting.mClampingValue = mClampingValue;
+				if (mDoSelectLightPaths)
+				{
+					// every tile picks its own mNumVplLightPaths consecutive light paths among all of them
+					mVplGather.setVpls(mPhotons.data(), mPhotons.size(), mNumPhotonsPerLightPath);
+					setting.mNumWindowPaths = mNumVplLightPaths;
+					setting.mWindowSeed = numIterations + mRngOffset;
+				}
+				else
+				{
+					mVplGather.setVpls(mPhotons.data(), std::min(mPhotons.size(), static_cast<size_t>(mNumPhotonsPerLightPath) * mNumVplLightPaths), mNumPhotonsPerLightPath);
+				}
+				mVplGather.gather(&mVplResult, mGBuffer, *mScene, origin, setting, 1.0f / static_cast<float>(mNumVplLightPaths));
+				vplSplatMs += sw.timeMilliSec();
+			}
+
+			if (mDoPhotonSplat)
+			{
+				sw.reset();
+				if (mFrameMode == EFrame::ClearEveryFrame) { std::fill(mPhotonResult.begin(), mPhotonResult.end(), glm::vec3(0.0f)); }
+
+				RtCpuPhotonGather::Setting setting;
+				setting.mMisMode = mMisMode;
+				setting.mPdfMc = mPrecomptedPdfMc;
+				setting.mClampingValue = mClampingValue;
+				setting.mRadius = mPhotonRadius;
+				setting.mInvNumLightPaths = 1.0f / static_cast<float>(mNumLightPaths);
+				mPhotonGather.build(mPhotons.data(), mPhotons.size(), mNumPhotonsPerLightPath, setting);
+				mPhotonGather.gather(&mPhotonResult, mGBuffer, origin, 1.0f);
+				photonSplatMs += sw.timeMilliSec();
+			}
+
+			if (mDoLightRender)
+			{
+				// we don't jitter light source
+				RtCpuGBuffer::RenderLight(&mLightResult, *mScene, originalMvpMatrix, mResolution);
+			}
+
+			numIterations++;
+
+			if (numIterations % 20 == 0)
+			{
+				float currentTiming = masterWatch.timeMilliSec();
+				std::cout << "numIter: " << numIterations << " | raduis: " << mPhotonRadius << " | clamping: " << mClampingValue << " | timing: " << currentTiming - prevTiming << "\n";
+				prevTiming = currentTiming;
+			}
+
+			if (mDoProgressive)
+			{
+				// Knaus and Zwiker start this numIteration == 1
+				Float ratio = (numIterations + mAlphaProgressive) / (numIterations + 1);
+				mPhotonRadius *= std::sqrt(ratio);
+				mClampingValue = mClampingStart * std::pow(numIterations, mAlphaProgressive);
+				mPrecomptedPdfMc = static_cast<float>(mNumVplLightPaths) / static_cast<float>(mNumLightPaths) * Math::InvPi / (mPhotonRadius * mPhotonRadius);
+			}
+
+			if (mDoWriteEveryFrame)
+			{
+				size_t i = mDumpWeightedPhotonFilename.find_last_of('.');
+				assert(i > 0 && i < mDumpWeightedPhotonFilename.length() - 1);
+				std::string dotExtension = mDumpWeightedPhotonFilename.substr(i);
+				FloatImage::Save(createImage(mLightResult, 1.0f) + createImage(mVplResult, frameScale(numIterations)) + createImage(mPhotonResult, frameScale(numIterations)),
+								 mDumpWeightedPhotonFilename.substr(0, i) + "_" + std::to_string(numIterations) + dotExtension);
+			}
+
+			if (masterWatch.timeMilliSec() >= mTimelimitMs) { break; }
+		}
+
+		if (mUseStat)
+		{
+			nlohmann::json result;
+			std::cout << masterWatch.timeMilliSec() << std::endl;
+			result["time"] = masterWatch.timeMilliSec();
+			result["numIterations"] = numIterations;
+			result["deferredShadingMs"] = deferredMs;
+			result["lightTracingMs"] = lightTracingMs;
+			result["vplSplatMs"] = vplSplatMs;
+			result["photonSplatMs"] = photonSplatMs;
+			result["numVpls"] = mVplGather.numVpls();
+			result["numPhotons"] = mPhotonGather.numPhotons();
+			if (mScene->mCpuAccel) { result["cpuAccel"] = mScene->createCpuAccelStats(); }
+			std::ofstream of(mStatFilename);
+			assert(of.is_open());
+			of << std::setw(4) << result;
+		}
+
+		const float param = frameScale(numIterations);
+		const FloatImage lightSourceImage = createImage(mLightResult, 1.0f);
+		const FloatImage photonImage = createImage(mPhotonResult, param);
+		const FloatImage vplImage = createImage(mVplResult, param);
+
+		FloatImage::Save(lightSourceImage + vplImage + photonImage, mDumpCombineFilename);
+		FloatImage::Save(lightSourceImage + vplImage, mDumpWeightedVplFilename);
+		FloatImage::Save(photonImage, mDumpWeightedPhotonFilename);
+	}
+
+	void destroy() override
+	{
+		mLightTracer.reset();
+		mPhotons.clear();
+	}
+
+	inline float frameScale(const int numIterations) const
+	{
+		return (mFrameMode == EFrame::ClearEveryFrame) ? 1.0f : (1.0f / (float)(numIterations));
+	}
+
+	FloatImage createImage(const std::vector<glm::vec3> & pixels, const float scale) const
+	{
+		FloatImage image(mResolution.x, mResolution.y, pixels);
+		image *= scale;
+		return FloatImage::FlipY(image);
+	}
+
+	shared_ptr<RtScene> mScene;
+	bool mDoSelectLightPaths = false;		// RtCpuLvcComPhoton
+
+	// PHOTON configuration
+	int mNumLightPaths = 0;
+	int mNumVplLightPaths = 0;
+	int mNumMaxBounce = 0;
+	int mNumPhotonsPerLightPath = 0;
+	float mRadiusPercentage = 0.f;
+	float mPhotonRadius = 0;
+	float mPrecomptedPdfMc = 0.0f;
+
+	glm::uvec2 mResolution;
+	glm::vec2 mInvResolution;
+
+	unsigned int mRngOffset = 0;
+	int mNumMaxIteration = 0;
+	EFrame mFrameMode;
+	RtCpuVplGather::EMis mMisMode;
+	float mTimelimitMs;
+	float mClampingValue;
+	float mClampingStart;
+	float mTargetRenderingTime = -1;
+	bool mDoProgressive = false;
+	float mAlphaProgressive = 0.7f;
+
+	bool mJitter;
+	bool mUseStat;
+	bool mDoWriteEveryFrame = false;
+
+	bool mDoDeferredShading = true;
+	bool mDoLightTracing = true;
+	bool mDoVplSplat = true;
+	bool mDoPhotonSplat = true;
+	bool mDoLightRender = true;
+
+	std::string mDumpCombineFilename;
+	std::string mDumpWeightedPhotonFilename;
+	std::string mDumpWeightedVplFilename;
+	std::string mStatFilename;
+
+	unique_ptr<RtCpuLightTracer> mLightTracer;
+	std::vector<RtPhotonRecord> mPhotons;
+	RtCpuGBuffer mGBuffer;
+	RtCpuVplGather mVplGather;
+	RtCpuPhotonGather mPhotonGather;
+
+	// bottom up like the opengl framebuffers. vpl and photon images accumulate over the frames
+	std::vector<glm::vec3> mVplResult;
+	std::vector<glm::vec3> mPhotonResult;
+	std::vector<glm::vec3> mLightResult;
+};
+
+const std::map<std::string, RtCpuComPhoton::EFrame> RtCpuComPhoton::EFrameModeStrMap = {
+	{"accumulate", RtCpuComPhoton::EFrame::Accumulate},
+	{"cleareveryframe", RtCpuComPhoton::EFrame::ClearEveryFrame}
+};
+
+const std::map<std::string, RtCpuVplGather::EMis> RtCpuComPhoton::EMisModeStrMap = {
+	{"one", RtCpuVplGather::EMis::One},
+	{"balance", RtCpuVplGather::EMis::Balance},
+	{"max", RtCpuVplGather::EMis::Max},
+	{"power2", RtCpuVplGather::EMis::Power2},
+	{"geometryClamp", RtCpuVplGather::EMis::GeometryClamp},
+	{"geometryBrdfClamp", RtCpuVplGather::EMis::GeometryBrdfClamp}
+};
+
+// RtLvcComPhoton (the "lvcphotonfam" section) for the cpu only build. the vpls come from all the light paths : every
+// screen tile gathers mNumVplLightPaths consecutive ones starting at a random light path. splatColor of
+// lvclighttracing.cu picks the first light path per pixel, here it is per tile so the tile can still share its vpls
+class RtCpuLvcComPhoton: public RtCpuComPhoton
+{
+public:
+	RtCpuLvcComPhoton()
+	{
+		mDoSelectLightPaths = true;
+	}
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "common/reflectcuts.h"
+#include "common/threadpool.h"
+
+#include <vector>
+
+#include "../rtcommon.h"
+#include "rtcpumaterial.h"
+
+// deferred.frag on the cpu : what the camera sees through the center of every pixel. rows are stored bottom up like
+// the opengl framebuffers, so the images made from it need FloatImage::FlipY before they are saved
+struct RtCpuGBuffer
+{
+	// ray through ndc (x, y) from the near to the far plane of vpMatrix
+	static Ray GenerateRay(const glm::mat4 & invVpMatrix, const glm::vec2 & ndc)
+	{
+		const glm::vec4 nearPoint = invVpMatrix * glm::vec4(ndc, -1.0f, 1.0f);
+		const glm::vec4 farPoint = invVpMatrix * glm::vec4(ndc, 1.0f, 1.0f);
+		const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+		const glm::vec3 diff = glm::vec3(farPoint) / farPoint.w - origin;
+		const float length = glm::length(diff);
+		return Ray(origin, diff / length, 0.0f, length);
+	}
+
+	// pixel (x, y) is sampled at ndc ((x + 0.5) / w * 2 - 1, ...) - jitter, the jitter translates the scene in ndc
+	static glm::vec2 PixelToNdc(const glm::uvec2 & pixel, const glm::vec2 & invResolution, const glm::vec2 & jitter)
+	{
+		return (glm::vec2(pixel) + glm::vec2(0.5f)) * invResolution * 2.0f - glm::vec2(1.0f) - jitter;
+	}
+
+	// light.frag : the light intensity where the light source is the closest surface, nothing elsewhere
+	static void RenderLight(std::vector<glm::vec3> * resultPtr, const RtScene & scene, const glm::mat4 & vpMatrix, const glm::uvec2 & resolution)
+	{
+		const Accel & accel = *scene.mCpuTracer;
+		const glm::mat4 invVpMatrix = glm::inverse(vpMatrix);
+		const glm::vec2 invResolution = glm::vec2(1.0f) / glm::vec2(resolution);
+		const glm::vec3 lightIntensity(scene.mArealight->mLightIntensity);
+		std::vector<glm::vec3> & result = *resultPtr;
+		ThreadPool::Instance().parallelFor(0, resolution.y, [&](const size_t y)
+		{
+			std::vector<Ray> rays;
+			rays.reserve(resolution.x);
+			for (uint32_t x = 0;x < resolution.x;x++)
+			{
+				rays.push_back(GenerateRay(invVpMatrix, PixelToNdc(glm::uvec2(x, y), invResolution, glm::vec2(0.0f))));
+			}
+			std::vector<Intersection> isects(resolution.x);
+			accel.traceClosest(rays, isects);
+
+			for (uint32_t x = 0;x < resolution.x;x++)
+			{
+				const Intersection & isect = isects[x];
+				const bool isLight = isect.mTrianglePtr != nullptr && scene.mMaterials[isect.mMatIndex]->mLightIntensity.x > 0.0f;
+				result[y * resolution.x + x] = isLight ? lightIntensity : glm::vec3(0.0f);
+			}
+		});
+	}
+
+	void resize(const glm::uvec2 & resolution)
+	{
+		mResolution = resolution;
+		const size_t numPixels = static_cast<size_t>(resolution.x) * resolution.y;
+		mPosition.assign(numPixels, glm::vec4(0.0f));
+		mNormal.assign(numPixels, glm::vec3(0.0f));
+		mDiffuse.assign(numPixels, glm::vec3(0.0f));
+		mPhongReflectance.assign(numPixels, glm::vec4(0.0f));
+	}
+
+	// one row at a time so that Accel::traceClosest gets neighbouring rays
+	void render(const RtScene & scene, const glm::mat4 & vpMatrix, const glm::vec2 & jitter)
+	{
+		const Accel & accel = *scene.mCpuTracer;
+		const glm::mat4 invVpMatrix = glm::inverse(vpMatrix);
+		const glm::vec2 invResolution = glm::vec2(1.0f) / glm::vec2(mResolution);
+		ThreadPool::Instance().parallelFor(0, mResolution.y, [&](const size_t y)
+		{
+			std::vector<Ray> rays;
+			rays.reserve(mResolution.x);
+			for (uint32_t x = 0;x < mResolution.x;x++)
+			{
+				rays.push_back(GenerateRay(invVpMatrix, PixelToNdc(glm::uvec2(x, y), invResolution, jitter)));
+			}
+			std::vector<Intersection> isects(mResolution.x);
+			accel.traceClosest(rays, isects);
+
+			for (uint32_t x = 0;x < mResolution.x;x++)
+			{
+				const size_t i = y * mResolution.x + x;
+				const Intersection & isect = isects[x];
+				if (isect.mTrianglePtr == nullptr)
+				{
+					mPosition[i] = glm::vec4(0.0f);
+					continue;
+				}
+
+				glm::vec3 phongReflectance;
+				float phongExponent;
+				RtCpu::FetchMaterial(&mDiffuse[i], &phongReflectance, &phongExponent, *scene.mMaterials[isect.mMatIndex], isect.mTexCoord);
+				mPosition[i] = glm::vec4(isect.mPosition, 1.0f);
+				mNormal[i] = isect.mGeomNormal;
+				mPhongReflectance[i] = glm::vec4(phongReflectance, phongExponent);
+			}
+		});
+	}
+
+	inline bool isCovered(const size_t i) const { return mPosition[i].w != 0.0f; }
+
+	glm::uvec2				mResolution = glm::uvec2(0);
+	std::vector<glm::vec4>	mPosition;			// w = 1 where a surface is visible
+	std::vector<glm::vec3>	mNormal;			// geometric normal, not flipped toward the camera
+	std::vector<glm::vec3>	mDiffuse;
+	std::vector<glm::vec4>	mPhongReflectance;	// w = phong exponent
+};
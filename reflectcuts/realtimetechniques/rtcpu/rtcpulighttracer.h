@@ -0,0 +1,141 @@
+#pragma once
+
+#include "common/reflectcuts.h"
+#include "common/threadpool.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "../rtcommon.h"
+#include "../rtcomphoton/rtphotonrecord.h"
+#include "rtcpumaterial.h"
+
+// tracePhotons of lighttracing.cu on the cpu. path i writes the numPhotonsPerLightPath records starting at
+// i * numPhotonsPerLightPath in the layout of rtphotonrecord.h, so the vpl gather and the photon splat read them as they
+// read the optix buffer. every path draws from its own RtCpu::Rng(rngSeed, i) : the records don't depend on the number
+// of threads or on the chunking.
+class RtCpuLightTracer
+{
+public:
+	// records written by one chunk of paths, small enough to stay in the l2 cache of the core tracing it
+	static const size_t ChunkBytes = 64 * 1024;
+
+	RtCpuLightTracer(shared_ptr<RtScene> scene):
+		mScene(scene)
+	{
+		assert(mScene->mArealight != nullptr);
+		assert(mScene->mCpuTracer != nullptr);
+		if (mScene->mArealight->mCdf.empty()) { mScene->mArealight->computeCdf(); }
+	}
+
+	void trace(std::vector<RtPhotonRecord> * photons, const size_t numLightPaths, const size_t numPhotonsPerLightPath, const uint32_t rngSeed) const
+	{
+		assert(numPhotonsPerLightPath > 0);
+		photons->resize(numLightPaths * numPhotonsPerLightPath);
+		RtPhotonRecord * records = photons->data();
+
+		const size_t numPathsPerChunk = std::max<size_t>(1, ChunkBytes / (sizeof(RtPhotonRecord) * numPhotonsPerLightPath));
+		const size_t numChunks = (numLightPaths + numPathsPerChunk - 1) / numPathsPerChunk;
+		ThreadPool::Instance().parallelFor(0, numChunks, [&](const size_t chunk)
+		{
+			const size_t first = chunk * numPathsPerChunk;
+			const size_t last = std::min(numLightPaths, first + numPathsPerChunk);
+			for (size_t i = first;i < last;i++)
+			{
+				tracePath(&records[i * numPhotonsPerLightPath], numPhotonsPerLightPath, RtCpu::Rng(rngSeed, i));
+			}
+		});
+	}
+
+private:
+	void tracePath(RtPhotonRecord * photons, const size_t numPhotonsPerLightPath, RtCpu::Rng rng) const
+	{
+		const RtAreaLight & light = *mScene->mArealight;
+		const Accel & accel = *mScene->mCpuTracer;
+
+		std::fill(photons, photons + numPhotonsPerLightPath, RtPhotonRecord());
+
+		// position and direction of first photon
+		glm::vec3 position, normal;
+		float pdf;
+		glm::vec3 flux = RtCpu::LightSample(&position, &normal, &pdf, light, &rng);
+
+		// sample outgoing direction from cosine weighted
+		glm::vec3 direction;
+		float phongPdf;
+		const glm::vec3 att = RtCpu::PhongSample(&direction, &phongPdf, normal, normal, glm::vec3(1.0f), light.mPrecomputedLightIntensity.w, &rng);
+
+		RtPhotonRecord & photon = photons[0];
+		photon.mPosition = RtCpu::ToFloat3(position);
+		photon.mNormal = RtCpu::ToFloat3(normal);
+		photon.mFlux = RtCpu::ToFloat3(flux);
+		photon.mFlags = PhotonRecordFlag::IsUsableVpl;
+		photon.mPSelectLambert = 0.0f;
+
+		photon.mLambertReflectance = optix::make_float3(0.0f, 0.0f, 0.0f);
+		photon.mPhongReflectance = optix::make_float3(1.0f, 1.0f, 1.0f);
+		photon.mPhongExponent = light.mPrecomputedLightIntensity.w;
+		photon.mFluxDir = photon.mNormal;
+
+		flux *= att;
+		for (size_t i = 1;i < numPhotonsPerLightPath;i++)
+		{
+			const unsigned int flag = (i != numPhotonsPerLightPath - 1) ? (PhotonRecordFlag::IsUsableVpl | PhotonRecordFlag::IsUsablePhoton) : PhotonRecordFlag::IsUsablePhoton;
+
+			// rtMaterialClosestHit. a miss ends the path, there is no miss program either
+			Intersection isect;
+			if (!accel.intersect(&isect, Ray(position, direction, 0.0001f, std::numeric_limits<Float>::infinity()))) { break; }
+
+			const RtMaterial & material = *mScene->mMaterials[isect.mMatIndex];
+
+			// reject the result if normal is in the other direction or it's light source
+			if (glm::dot(isect.mGeomNormal, direction) > 0.0f || material.mLightIntensity.x > 0.01f) { break; }
+
+			glm::vec3 lambertReflectance, phongReflectance;
+			float phongExponent;
+			RtCpu::FetchMaterial(&lambertReflectance, &phongReflectance, &phongExponent, material, isect.mTexCoord);
+
+			const float maxLambert = RtCpu::MaxColor(lambertReflectance);
+			const float maxPhong = RtCpu::MaxColor(phongReflectance);
+			if (maxLambert + maxPhong <= 0.000001f) { break; }
+
+			const glm::vec3 nextPosition = isect.mPosition;
+			const glm::vec3 nextNormal = isect.mGeomNormal;
+			const glm::vec3 in = -direction;
+
+			RtPhotonRecord & record = photons[i];
+			record.mFluxDir = RtCpu::ToFloat3(in);
+			record.mPosition = RtCpu::ToFloat3(nextPosition);
+			record.mNormal = RtCpu::ToFloat3(nextNormal);
+			record.mFlux = RtCpu::ToFloat3(flux);
+			record.mLambertReflectance = RtCpu::ToFloat3(lambertReflectance);
+			record.mPhongReflectance = RtCpu::ToFloat3(phongReflectance);
+			record.mPhongExponent = phongExponent;
+			record.mFlags = flag;
+
+			const float pSelectLambert = maxLambert / (maxPhong + maxLambert);
+			const float chooseMaterial = std::min(rng.nextFloat(), 0.999999f);
+			record.mPSelectLambert = pSelectLambert;
+
+			// russian roulette
+			const float russian = std::min(RtCpu::MaxColor(flux), 0.98f);
+			flux /= russian;
+			if (rng.nextFloat() >= russian) { break; }
+
+			float pdfW;
+			if (chooseMaterial < pSelectLambert)
+			{
+				flux *= RtCpu::LambertSample(&direction, &pdfW, in, nextNormal, lambertReflectance, &rng) / pSelectLambert;
+				record.mFlags = flag | PhotonRecordFlag::LambertOnly;
+			}
+			else
+			{
+				flux *= RtCpu::PhongSample(&direction, &pdfW, in, nextNormal, phongReflectance, phongExponent, &rng) / (1.0f - pSelectLambert);
+				record.mFlags = flag | PhotonRecordFlag::PhongOnly;
+			}
+			position = nextPosition;
+		}
+	}
+
+	shared_ptr<RtScene>	mScene;
+};
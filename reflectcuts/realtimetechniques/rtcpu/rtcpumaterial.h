@@ -0,0 +1,236 @@
+#pragma once
+
+#include "common/reflectcuts.h"
+#include "math/math.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "../rtcommon.h"
+#include "../rtvectortypes.h"
+
+// host versions of rtmath.cuh, rtmaterial.cuh and rtlightsource.cuh for the cpu ports of the techniques. they follow
+// the device code line by line (optix's Onb and cosine_sample_hemisphere included) so both builds sample the same
+// distributions. random numbers come from RtCpu::Rng instead of curand.
+namespace RtCpu
+{
+	inline optix::float3 ToFloat3(const glm::vec3 & v)
+	{
+		return optix::make_float3(v.x, v.y, v.z);
+	}
+
+	inline glm::vec3 ToVec3(const optix::float3 & v)
+	{
+		return glm::vec3(v.x, v.y, v.z);
+	}
+
+	// counter based : the state only depends on (seed, counter), so the numbers drawn for a light path or a pixel don't
+	// depend on the thread that runs it. pcg32 (o'neill 2014) with state and stream from a splitmix64 hash of the counter
+	class Rng
+	{
+	public:
+		Rng(const uint32_t seed, const uint64_t counter)
+		{
+			const uint64_t hash = SplitMix64(counter + SplitMix64(seed));
+			mInc = (SplitMix64(hash) << 1) | 1;
+			mState = hash + mInc;
+			nextUint32();
+		}
+
+		inline uint32_t nextUint32()
+		{
+			const uint64_t old = mState;
+			mState = old * 6364136223846793005ull + mInc;
+			const uint32_t xorShifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+			const uint32_t rot = static_cast<uint32_t>(old >> 59);
+			return (xorShifted >> rot) | (xorShifted << ((32 - rot) & 31));
+		}
+
+		// (0, 1] like curand_uniform
+		inline float nextFloat()
+		{
+			return static_cast<float>((nextUint32() >> 8) + 1) * (1.0f / 16777216.0f);
+		}
+
+	private:
+		static inline uint64_t SplitMix64(uint64_t x)
+		{
+			x += 0x9e3779b97f4a7c15ull;
+			x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+			x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+			return x ^ (x >> 31);
+		}
+
+		uint64_t mState;
+		uint64_t mInc;
+	};
+
+	// optix::Onb::inverse_transform
+	inline glm::vec3 OnbToWorld(const glm::vec3 & local, const glm::vec3 & normal)
+	{
+		glm::vec3 binormal;
+		if (std::abs(normal.x) > std::abs(normal.z)) { binormal = glm::vec3(-normal.y, normal.x, 0.0f); }
+		else { binormal = glm::vec3(0.0f, -normal.z, normal.y); }
+		binormal = glm::normalize(binormal);
+		const glm::vec3 tangent = glm::cross(binormal, normal);
+		return local.x * tangent + local.y * binormal + local.z * normal;
+	}
+
+	// optix::cosine_sample_hemisphere
+	inline glm::vec3 CosineSampleHemisphere(const float u1, const float u2)
+	{
+		const float r = std::sqrt(u1);
+		const float phi = 2.0f * Math::Pi * u2;
+		const float x = r * std::cos(phi);
+		const float y = r * std::sin(phi);
+		return glm::vec3(x, y, std::sqrt(std::max(0.0f, 1.0f - x * x - y * y)));
+	}
+
+	inline void SquareToBarycentric(float * beta, float * gamma, const float x, const float y)
+	{
+		const float sqrtX = std::sqrt(x);
+		*beta = (sqrtX * (1.0f - y));
+		*gamma = (sqrtX * y);
+	}
+
+	inline float MaxColor(const glm::vec3 & color)
+	{
+		return std::max(std::max(color.x, color.y), color.z);
+	}
+
+	inline float GeometryTerm(const glm::vec3 & n1, const glm::vec3 & n2, const glm::vec3 & v12)
+	{
+		const float cos1Unnorm = std::max(glm::dot(n1, v12), 0.0f);
+		const float cos2Unnorm = std::max(-glm::dot(n2, v12), 0.0f);
+		const float d2 = glm::dot(v12, v12);
+
+		assert(d2 > 0.0f);
+		return cos1Unnorm * cos2Unnorm / (d2 * d2);
+	}
+
+	inline float LambertPdfW(const glm::vec3 & n1, const glm::vec3 & v12)
+	{
+		return std::max(glm::dot(n1, glm::normalize(v12)), 0.0f);
+	}
+
+	inline float LambertPdfA(const glm::vec3 & n1, const glm::vec3 & n2, const glm::vec3 & v12)
+	{
+		return GeometryTerm(n1, n2, v12) * Math::InvPi;
+	}
+
+	inline glm::vec3 LambertSample(glm::vec3 * out, float * pdfW, const glm::vec3 & /*in*/, const glm::vec3 & normal, const glm::vec3 & lambertReflectance, Rng * rng)
+	{
+		const float u1 = rng->nextFloat();
+		const float u2 = rng->nextFloat();
+		*out = OnbToWorld(CosineSampleHemisphere(u1, u2), normal);
+		*pdfW = std::max(glm::dot(*out, normal), 0.0f) * Math::InvPi;
+		return lambertReflectance;
+	}
+
+	inline glm::vec3 LambertEval(const glm::vec3 & /*out*/, const glm::vec3 & /*in*/, const glm::vec3 & /*normal*/, const glm::vec3 & lambertReflectance)
+	{
+		return lambertReflectance * Math::InvPi;
+	}
+
+	inline float LambertEvalF(const glm::vec3 & /*out*/, const glm::vec3 & /*in*/, const glm::vec3 & /*normal*/)
+	{
+		return Math::InvPi;
+	}
+
+	inline float PhongPdfW(const glm::vec3 & n1, const glm::vec3 & v12, const glm::vec3 & in, const glm::vec3 & phongReflectance, const float phongExponent)
+	{
+		const glm::vec3 wi12 = glm::normalize(v12);
+		const glm::vec3 reflectVec = glm::normalize(glm::reflect(-in, n1));
+		const float cosReflect = std::max(glm::dot(wi12, reflectVec), 0.0f);
+		if (cosReflect <= 0.000001f || phongReflectance.x <= 0.000001f) { return 0.0f; }
+		return (phongExponent + 1.0f) * 0.5f * Math::InvPi * std::pow(cosReflect, phongExponent);
+	}
+
+	inline float PhongPdfA(const glm::vec3 & n1, const glm::vec3 & n2, const glm::vec3 & v12, const glm::vec3 & in, const glm::vec3 & phongReflectance, const float phongExponent)
+	{
+		const glm::vec3 wi12 = glm::normalize(v12);
+		const float pdfW = PhongPdfW(n1, v12, in, phongReflectance, phongExponent);
+		if (pdfW == 0.0f) { return 0.0f; }
+
+		const float cos2 = std::max(-glm::dot(n2, wi12), 0.0f);
+		const float dist2 = glm::dot(v12, v12);
+
+		assert(dist2 > 0.0f);
+		return pdfW * cos2 / dist2;
+	}
+
+	inline glm::vec3 PhongEval(const glm::vec3 & out, const glm::vec3 & in, const glm::vec3 & normal, const glm::vec3 & phongReflectance, const float phongExponent)
+	{
+		const glm::vec3 reflectVec = glm::reflect(-in, normal);
+		const float dotWrWo = std::max(glm::dot(out, reflectVec), 0.0f);
+		if (dotWrWo <= 0.000001f || phongReflectance.x <= 0.000001f) { return glm::vec3(0.0f); }
+		return phongReflectance * (phongExponent + 2.0f) * std::pow(dotWrWo, phongExponent) * Math::InvPi * 0.5f;
+	}
+
+	inline float PhongEvalF(const glm::vec3 & out, const glm::vec3 & in, const glm::vec3 & normal, const float phongExponent)
+	{
+		const glm::vec3 reflectVec = glm::reflect(-in, normal);
+		const float dotWrWo = std::max(glm::dot(out, reflectVec), 0.0f);
+		if (dotWrWo <= 0.000001f) { return 0.0f; }
+		return (phongExponent + 2.0f) * std::pow(dotWrWo, phongExponent) * Math::InvPi * 0.5f;
+	}
+
+	inline glm::vec3 PhongSample(glm::vec3 * out, float * pdfW, const glm::vec3 & in, const glm::vec3 & normal, const glm::vec3 & phongReflectance, const float phongExponent, Rng * rng)
+	{
+		const glm::vec3 reflectVec = glm::reflect(-in, normal);
+
+		const float sampleX = rng->nextFloat();
+		const float sampleY = rng->nextFloat();
+
+		const float cosTheta = std::pow(sampleX, 1.0f / (phongExponent + 1.0f));
+		const float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+
+		const float phi = 2.0f * Math::Pi * sampleY;
+		*out = OnbToWorld(glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta), reflectVec);
+
+		const float unsafeCosNormal = glm::dot(*out, normal);
+		const float cosNormal = std::max(unsafeCosNormal, 0.0f);
+		const float cosReflect = std::max(glm::dot(*out, reflectVec), 0.0f);
+		*pdfW = (unsafeCosNormal > 0.0f) ? (phongExponent + 1.0f) * 0.5f * std::pow(cosReflect, phongExponent) * Math::InvPi : 0.0f;
+
+		return (phongExponent + 2.0f) / (phongExponent + 1.0f) * cosNormal * phongReflectance;
+	}
+
+	// FetchMaterial of rtmaterialrecord.h
+	inline void FetchMaterial(glm::vec3 * lambertReflectance, glm::vec3 * phongReflectance, float * phongExponent, const RtMaterial & material, const glm::vec2 & texcoord)
+	{
+		*lambertReflectance = glm::vec3(material.mLambertReflectance.evalBilinear(texcoord));
+		*phongReflectance = glm::vec3(material.mPhongReflectance.evalBilinear(texcoord));
+		*phongExponent = material.mPhongExponent.evalBilinear(texcoord).x;
+	}
+
+	// LightSample of rtlightsource.cuh. light.mCdf must be computed (RtAreaLight::computeCdf). positions are the ones of
+	// the light mesh as uploaded to optix
+	inline glm::vec3 LightSample(glm::vec3 * position, glm::vec3 * normal, float * pdf, const RtAreaLight & light, Rng * rng)
+	{
+		assert(!light.mCdf.empty());
+		const float randNum = rng->nextFloat();
+		const size_t indicesIndex = std::min<size_t>(std::lower_bound(light.mCdf.begin(), light.mCdf.end(), randNum) - light.mCdf.begin(), light.mCdf.size() - 1);
+
+		float beta, gamma;
+		const float x = rng->nextFloat();
+		const float y = rng->nextFloat();
+		SquareToBarycentric(&beta, &gamma, x, y);
+
+		const RtMesh & mesh = *light.mMesh;
+		const glm::vec3 pos1 = mesh.getPosition(mesh.mTriIndices[indicesIndex * 3]);
+		const glm::vec3 pos2 = mesh.getPosition(mesh.mTriIndices[indicesIndex * 3 + 1]);
+		const glm::vec3 pos3 = mesh.getPosition(mesh.mTriIndices[indicesIndex * 3 + 2]);
+
+		*position = pos1 * beta + pos2 * gamma + pos3 * (1.0f - gamma - beta);
+		*normal = glm::normalize(glm::cross(pos2 - pos1, pos3 - pos1));
+		*pdf = 1.0f / light.mMeshArea;
+
+		return glm::vec3(light.mPrecomputedLightIntensity) * light.mMeshArea;
+	}
+
+	inline float LightPdfA(const RtAreaLight & light)
+	{
+		return 1.0f / light.mMeshArea;
+	}
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include "common/reflectcuts.h"
+#include "common/threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "../rtcommon.h"
+#include "../rtcomphoton/rtphotonrecord.h"
+#include "rtcpugbuffer.h"
+#include "rtcpumaterial.h"
+#include "rtcpuvplgather.h"
+
+// photonsplatinstanced.frag as a gather. the gpu draws an icosphere of radius r around every photon record and lets the
+// fragments test their distance to the g-buffer position; here the usable photons are hashed once per frame into a grid
+// of cells of size r, and every pixel only visits the photons of the (at most 27, mostly 8) cells its radius overlaps.
+// everything that only depends on a photon and the previous record of its path (the direction toward it, brdf2, the
+// mis weight of modes 0-3) is computed while building the grid.
+class RtCpuPhotonGather
+{
+public:
+	using EMis = RtCpuVplGather::EMis;
+
+	struct Setting
+	{
+		EMis	mMisMode = EMis::Balance;
+		float	mPdfMc = 0.0f;
+		float	mClampingValue = 0.0f;
+		float	mRadius = 0.0f;
+		float	mInvNumLightPaths = 0.0f;
+	};
+
+	// records of numPhotonsPerLightPath-long light paths as written by RtCpuLightTracer
+	void build(const RtPhotonRecord * records, const size_t numRecords, const size_t numPhotonsPerLightPath, const Setting & setting)
+	{
+		assert(setting.mRadius > 0.0f);
+		mSetting = setting;
+		mInvCellSize = 1.0f / setting.mRadius;
+
+		// the photons and their unmasked hashes in record order, NotInGrid where the fragment shader outputs nothing
+		const float scale = Math::InvPi / (setting.mRadius * setting.mRadius) * setting.mInvNumLightPaths;
+		mUnsorted.resize(numRecords);
+		mHashes.resize(numRecords);
+		ThreadPool::Instance().parallelFor(0, numRecords, [&](const size_t i)
+		{
+			// the first record of a path is on the light and never a usable photon, so i - 1 is on the same path
+			const bool isUsable = (i % numPhotonsPerLightPath) != 0 && (records[i].mFlags & PhotonRecordFlag::IsUsablePhoton) != 0;
+			mHashes[i] = (isUsable && makePhoton(&mUnsorted[i], records[i], records[i - 1], scale)) ? hashCell(cellOf(mUnsorted[i].mPosition)) : NotInGrid;
+		}, 1024);
+
+		size_t numPhotons = 0;
+		for (size_t i = 0;i < numRecords;i++)
+		{
+			if (mHashes[i] != NotInGrid) { numPhotons++; }
+		}
+
+		// counting sort into the buckets, in record order within a bucket
+		size_t numBuckets = 1;
+		while (numBuckets < 2 * numPhotons) { numBuckets *= 2; }
+		mBucketMask = static_cast<uint32_t>(numBuckets - 1);
+		mBucketStart.assign(numBuckets + 1, 0);
+		for (size_t i = 0;i < numRecords;i++)
+		{
+			if (mHashes[i] != NotInGrid) { mBucketStart[(mHashes[i] & mBucketMask) + 1]++; }
+		}
+		for (size_t b = 0;b < numBuckets;b++) { mBucketStart[b + 1] += mBucketStart[b]; }
+
+		mPhotons.resize(numPhotons);
+		std::vector<uint32_t> next(mBucketStart.begin(), mBucketStart.end() - 1);
+		for (size_t i = 0;i < numRecords;i++)
+		{
+			if (mHashes[i] != NotInGrid) { mPhotons[next[mHashes[i] & mBucketMask]++] = mUnsorted[i]; }
+		}
+	}
+
+	inline size_t numPhotons() const { return mPhotons.size(); }
+
+	// adds scale * (sum over the photons within the radius) to result, pixels in the order of gbuffer
+	void gather(std::vector<glm::vec3> * resultPtr, const RtCpuGBuffer & gbuffer, const glm::vec3 & cameraPosition, const float scale) const
+	{
+		if (mPhotons.empty()) { return; }
+
+		std::vector<glm::vec3> & result = *resultPtr;
+		ThreadPool::Instance().parallelFor(0, gbuffer.mResolution.y, [&](const size_t y)
+		{
+			for (uint32_t x = 0;x < gbuffer.mResolution.x;x++)
+			{
+				const size_t i = y * gbuffer.mResolution.x + x;
+				if (!gbuffer.isCovered(i)) { continue; }
+				result[i] += gatherPixel(gbuffer, i, cameraPosition) * scale;
+			}
+		});
+	}
+
+private:
+	static const uint32_t NotInGrid = 0xffffffffu;
+
+	struct Photon
+	{
+		glm::vec3	mPosition;
+		glm::vec3	mFlux;			// flux * InvPi / r^2 / numLightPaths, times the mis weight for modes 0-3
+		glm::vec3	mWi12;			// toward the previous record of the path
+		glm::vec3	mBrdf2;			// at the previous record, from its incoming direction toward this photon
+		float		mCos2;			// at the previous record, toward this photon
+		float		mInvDist2;		// to the previous record
+	};
+
+	// the part of main() of photonsplatinstanced.frag which doesn't look at the g-buffer. false where it outputs nothing
+	bool makePhoton(Photon * photon, const RtPhotonRecord & record, const RtPhotonRecord & prev, const float scale) const
+	{
+		const glm::vec3 position = RtCpu::ToVec3(record.mPosition);
+		const glm::vec3 v12 = RtCpu::ToVec3(prev.mPosition) - position;
+		const float dist2 = glm::dot(v12, v12);
+		if (dist2 <= 0.0f) { return false; }
+
+		const glm::vec3 w12 = v12 / std::sqrt(dist2);
+		const glm::vec3 n1 = RtCpu::ToVec3(record.mNormal);
+		const glm::vec3 prevNormal = RtCpu::ToVec3(prev.mNormal);
+		const glm::vec3 prevFluxDir = RtCpu::ToVec3(prev.mFluxDir);
+		const glm::vec3 prevPhongReflectance = RtCpu::ToVec3(prev.mPhongReflectance);
+
+		const float mixPdfW = LambertPdfW(prevNormal, -w12) * prev.mPSelectLambert
+			+ PhongPdfW(prevNormal, -w12, prevFluxDir, prevPhongReflectance, prev.mPhongExponent) * (1.0f - prev.mPSelectLambert);
+		if (mixPdfW <= 0.0f) { return false; }
+
+		const glm::vec3 flux = RtCpu::ToVec3(record.mFlux) * scale;
+		if (RtCpu::MaxColor(flux) <= 0.0f) { return false; }
+
+		const float mixPdfA = mixPdfW * std::max(glm::dot(n1, w12), 0.0f) / dist2;
+		const float pdfMc = mSetting.mPdfMc;
+		float weight = 1.0f;
+		if (mSetting.mMisMode == EMis::Balance) { weight = mixPdfA / (mixPdfA + pdfMc); }
+		else if (mSetting.mMisMode == EMis::Max) { weight = (mixPdfA > pdfMc) ? 1.0f : 0.0f; }
+		else if (mSetting.mMisMode == EMis::Power2) { weight = mixPdfA * mixPdfA / (mixPdfA * mixPdfA + pdfMc * pdfMc); }
+		if (weight <= 0.0f) { return false; }
+
+		photon->mPosition = position;
+		photon->mFlux = flux * weight;
+		photon->mWi12 = w12;
+		photon->mBrdf2 = LambertEval(-w12, prevFluxDir, prevNormal, RtCpu::ToVec3(prev.mLambertReflectance))
+			+ PhongEval(-w12, prevFluxDir, prevNormal, prevPhongReflectance, prev.mPhongExponent);
+		photon->mCos2 = std::max(-glm::dot(prevNormal, w12), 0.0f);
+		photon->mInvDist2 = 1.0f / dist2;
+		return true;
+	}
+
+	glm::vec3 gatherPixel(const RtCpuGBuffer & gbuffer, const size_t i, const glm::vec3 & cameraPosition) const
+	{
+		const glm::vec3 position(gbuffer.mPosition[i]);
+		const glm::vec3 normal = gbuffer.mNormal[i];
+		const glm::vec3 lambertReflectance = gbuffer.mDiffuse[i];
+		const glm::vec3 phongReflectance(gbuffer.mPhongReflectance[i]);
+		const float phongExponent = gbuffer.mPhongReflectance[i].w;
+		const glm::vec3 w10 = glm::normalize(cameraPosition - position);
+		const float radius2 = mSetting.mRadius * mSetting.mRadius;
+
+		// two cells of the grid can share a bucket : visit every bucket once
+		uint32_t buckets[27];
+		size_t numBuckets = 0;
+		const glm::ivec3 lo = cellOf(position - glm::vec3(mSetting.mRadius));
+		const glm::ivec3 hi = glm::min(cellOf(position + glm::vec3(mSetting.mRadius)), lo + glm::ivec3(2)); // rounding
+		for (int z = lo.z;z <= hi.z;z++)
+		{
+			for (int y = lo.y;y <= hi.y;y++)
+			{
+				for (int x = lo.x;x <= hi.x;x++)
+				{
+					const uint32_t bucket = hashCell(glm::ivec3(x, y, z)) & mBucketMask;
+					if (std::find(buckets, buckets + numBuckets, bucket) == buckets + numBuckets) { buckets[numBuckets++] = bucket; }
+				}
+			}
+		}
+
+		glm::vec3 result(0.0f);
+		for (size_t b = 0;b < numBuckets;b++)
+		{
+			for (uint32_t j = mBucketStart[buckets[b]];j < mBucketStart[buckets[b] + 1];j++)
+			{
+				const Photon & photon = mPhotons[j];
+				const glm::vec3 d = photon.mPosition - position;
+				if (glm::dot(d, d) > radius2) { continue; }
+
+				const glm::vec3 brdf1 = LambertEval(w10, photon.mWi12, normal, lambertReflectance)
+					+ PhongEval(w10, photon.mWi12, normal, phongReflectance, phongExponent);
+
+				if (mSetting.mMisMode == EMis::GeometryClamp || mSetting.mMisMode == EMis::GeometryBrdfClamp)
+				{
+					const float cosCos = std::max(glm::dot(normal, photon.mWi12), 0.0f) * photon.mCos2;
+					if (cosCos <= 0.0f) { continue; }
+
+					const float geometryTerm = cosCos * photon.mInvDist2;
+					if (mSetting.mMisMode == EMis::GeometryClamp)
+					{
+						result += brdf1 * photon.mFlux * std::max(geometryTerm - mSetting.mClampingValue, 0.0f) / geometryTerm;
+					}
+					else
+					{
+						// the shader divides 0 by 0 where a channel of brdf2 is 0, that channel gets nothing here
+						const glm::vec3 unclamped = glm::max(brdf1 * photon.mBrdf2 * geometryTerm - glm::vec3(mSetting.mClampingValue), glm::vec3(0.0f));
+						for (int k = 0;k < 3;k++)
+						{
+							if (photon.mBrdf2[k] > 0.0f) { result[k] += photon.mFlux[k] * unclamped[k] / (geometryTerm * photon.mBrdf2[k]); }
+						}
+					}
+				}
+				else
+				{
+					result += brdf1 * photon.mFlux;
+				}
+			}
+		}
+		return result;
+	}
+
+	inline glm::ivec3 cellOf(const glm::vec3 & position) const
+	{
+		return glm::ivec3(glm::floor(position * mInvCellSize));
+	}
+
+	// teschner et al. 2003. never NotInGrid
+	static inline uint32_t hashCell(const glm::ivec3 & cell)
+	{
+		const uint32_t hash = (static_cast<uint32_t>(cell.x) * 73856093u) ^ (static_cast<uint32_t>(cell.y) * 19349663u) ^ (static_cast<uint32_t>(cell.z) * 83492791u);
+		return hash & 0x7fffffffu;
+	}
+
+	// the glsl versions, their thresholds and LambertPdfW differ from the ones of rtmaterial.cuh
+	static inline glm::vec3 LambertEval(const glm::vec3 & w10, const glm::vec3 & w12, const glm::vec3 & normal, const glm::vec3 & lambertReflectance)
+	{
+		if (glm::dot(w10, normal) <= 0.0f || glm::dot(w12, normal) <= 0.0f) { return glm::vec3(0.0f); }
+		return Math::InvPi * lambertReflectance;
+	}
+
+	static inline glm::vec3 PhongEval(const glm::vec3 & outVec, const glm::vec3 & inVec, const glm::vec3 & normal, const glm::vec3 & phongReflectance, const float phongExponent)
+	{
+		if (RtCpu::MaxColor(phongReflectance) <= 0.0f) { return glm::vec3(0.0f); }
+		const float dotWrWo = glm::dot(outVec, glm::reflect(-inVec, normal));
+		if (dotWrWo <= 0.00001f) { return glm::vec3(0.0f); }
+		return phongReflectance * (phongExponent + 2.0f) * std::pow(dotWrWo, phongExponent) * Math::InvPi * 0.5f;
+	}
+
+	static inline float LambertPdfW(const glm::vec3 & normal1, const glm::vec3 & v12)
+	{
+		return std::max(glm::dot(normal1, glm::normalize(v12)), 0.0f) * Math::InvPi;
+	}
+
+	static inline float PhongPdfW(const glm::vec3 & normal1, const glm::vec3 & wi12, const glm::vec3 & inVec, const glm::vec3 & phongReflectance, const float phongExponent)
+	{
+		const float dotWrWo = std::max(glm::dot(wi12, glm::reflect(-inVec, normal1)), 0.0f);
+		if (dotWrWo <= 0.00001f || phongReflectance.x <= 0.00001f) { return 0.0f; }
+		return (phongExponent + 1.0f) * 0.5f * Math::InvPi * std::pow(dotWrWo, phongExponent);
+	}
+
+	Setting					mSetting;
+	float					mInvCellSize = 1.0f;
+	uint32_t				mBucketMask = 0;
+	std::vector<uint32_t>	mBucketStart;		// photons of bucket b are [mBucketStart[b], mBucketStart[b + 1])
+	std::vector<Photon>		mPhotons;			// sorted by bucket
+
+	// scratch of build
+	std::vector<Photon>		mUnsorted;
+	std::vector<uint32_t>	mHashes;
+};
@@ -0,0 +1,375 @@
+#pragma once
+
+#include "common/reflectcuts.h"
+#include "common/stopwatch.h"
+#include "common/threadpool.h"
+#include "common/floatimage/floatimage.h"
+#include "sampler/independent.h"
+
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <vector>
+
+#include "../rtcommon.h"
+#include "../rtcputechnique.h"
+#include "rtcpugbuffer.h"
+#include "rtcpumaterial.h"
+
+// RtPt2 (the "pt" section) for the cpu only build : pathTraceSimple of pathtracing.cu, next event estimation and mis
+// included, from the same g-buffer. same parameters and output as RtPt2, except that numSamplePerPixel paths are traced
+// per pixel and per iteration (the optix program always traces one). the screen is cut into tiles handed out over
+// ThreadPool; tile t of iteration n draws from RtCpu::Rng(n + rngOffset, t), so an image only depends on the parameters.
+class RtCpuPt: public RtCpuTechnique
+{
+public:
+	static const uint32_t TileSize = 16;
+
+	enum EFrame
+	{
+		Accumulate = 1,
+		ClearEveryFrame = 2
+	};
+
+	static const std::map<std::string, EFrame> EFrameModeStrMap;
+
+protected:
+	void configure(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const nlohmann::json & json) override
+	{
+		mScene = scene;
+		mCameraPosition = mScene->mCamera->getOrigin();
+		mResolution = resolution;
+		mInvResolution = glm::vec2(1.0f) / resolution;
+
+		mRngOffset = json["rngOffset"];
+
+		mNumMaxIteration = json["numMaxIteration"];
+		mTimelimitMs = json["timeLimitMs"];
+
+		mFrameMode = EFrameModeStrMap.at(json["frameMode"]);
+
+		mOutputFilename = json["outputFilename"].get<std::string>();
+		mStatFilename = json["statFilename"].get<std::string>();
+
+		mJitter = json["useJitter"];
+		mUseStat = json["useStat"];
+
+		mNumSamplePerPixel = json["numSamplePerPixel"];
+		mNumMaxBounce = json["numMaxBounces"];
+		mDoWriteEveryFrame = false;
+		if (json.find("writeEveryFrame") != json.end()) { mDoWriteEveryFrame = json["writeEveryFrame"]; }
+
+		assert(mNumSamplePerPixel > 0);
+	}
+
+	void setup() override
+	{
+		assert(mScene->mArealight != nullptr);
+		assert(mScene->mCpuTracer != nullptr);
+		if (mScene->mArealight->mCdf.empty()) { mScene->mArealight->computeCdf(); }
+		mGBuffer.resize(mResolution);
+		applyParameters();
+	}
+
+	void applyParameters() override
+	{
+		// restart the accumulation
+		const size_t numPixels = static_cast<size_t>(mResolution.x) * mResolution.y;
+		mPtResult.assign(numPixels, glm::vec3(0.0f));
+		mLightResult.assign(numPixels, glm::vec3(0.0f));
+	}
+
+	void run() override
+	{
+		unique_ptr<Sampler> mainSampler = make_unique<IndependentSampler>(mRngOffset);
+
+		int numIterations = 0;
+
+		StopWatch masterWatch;
+		masterWatch.reset();
+		long long pathTracingMs = 0;
+		StopWatch sw;
+
+		while (numIterations != mNumMaxIteration)
+		{
+			// every iteration is a frame of the animated objects
+			mScene->setFrame(numIterations);
+			const glm::mat4 originalMvpMatrix = mScene->mCamera->computeVpMatrix();
+			glm::vec2 jitter(0.0f);
+			if (mJitter)
+			{
+				// ndc coordinates = ([-1, 1], [-1, 1])
+				jitter = (2.0f * mainSampler->nextVec2() - glm::vec2(1)) * mInvResolution;
+			}
+
+			mGBuffer.render(*mScene, originalMvpMatrix, jitter);
+
+			sw.reset();
+			tracePaths(numIterations + mRngOffset);
+			pathTracingMs += sw.timeMilliSec();
+
+			// we don't jitter light source
+			RtCpuGBuffer::RenderLight(&mLightResult, *mScene, originalMvpMatrix, mResolution);
+
+			numIterations++;
+
+			if (masterWatch.timeMilliSec() >= mTimelimitMs) { break; }
+
+			if (mDoWriteEveryFrame)
+			{
+				size_t i = mOutputFilename.find_last_of('.');
+				assert(i > 0 && i < mOutputFilename.length() - 1);
+				std::string dotExtension = mOutputFilename.substr(i);
+				FloatImage::Save(createResult(numIterations), mOutputFilename.substr(0, i) + "_" + std::to_string(numIterations) + dotExtension);
+			}
+		}
+
+		if (mUseStat)
+		{
+			// write stat
+			nlohmann::json result;
+			std::cout << masterWatch.timeMilliSec() << std::endl;
+			result["time"] = masterWatch.timeMilliSec();
+			result["numIterations"] = numIterations;
+			result["pathTracingMs"] = pathTracingMs;
+			if (mScene->mCpuAccel) { result["cpuAccel"] = mScene->createCpuAccelStats(); }
+			std::ofstream of(mStatFilename);
+			assert(of.is_open());
+			of << std::setw(4) << result;
+		}
+
+		FloatImage::Save(createResult(numIterations), mOutputFilename);
+	}
+
+	void destroy() override
+	{
+	}
+
+	// splatColor for every pixel
+	void tracePaths(const uint32_t rngSeed)
+	{
+		const glm::uvec2 numTiles = (mResolution + glm::uvec2(TileSize - 1)) / glm::uvec2(TileSize);
+		ThreadPool::Instance().parallelFor(0, numTiles.x * numTiles.y, [&](const size_t iTile)
+		{
+			RtCpu::Rng rng(rngSeed, iTile);
+			const glm::uvec2 first = glm::uvec2(iTile % numTiles.x, iTile / numTiles.x) * glm::uvec2(TileSize);
+			const glm::uvec2 last = glm::min(first + glm::uvec2(TileSize), mResolution);
+			for (uint32_t y = first.y;y < last.y;y++)
+			{
+				for (uint32_t x = first.x;x < last.x;x++)
+				{
+					const size_t i = y * mResolution.x + x;
+					glm::vec3 result(0.0f);
+					if (mGBuffer.isCovered(i))
+					{
+						for (int k = 0;k < mNumSamplePerPixel;k++) { result += pathTraceSimple(i, &rng); }
+						result /= static_cast<float>(mNumSamplePerPixel);
+					}
+					mPtResult[i] = (mFrameMode == EFrame::Accumulate) ? mPtResult[i] + result : result;
+				}
+			}
+		});
+	}
+
+	// one path from the g-buffer position of pixel i
+	glm::vec3 pathTraceSimple(const size_t i, RtCpu::Rng * rng) const
+	{
+		const RtAreaLight & light = *mScene->mArealight;
+		const Accel & accel = *mScene->mCpuTracer;
+
+		const glm::vec3 firstPosition(mGBuffer.mPosition[i]);
+		const glm::vec3 normal = mGBuffer.mNormal[i];
+		const glm::vec3 firstLambertReflectance = mGBuffer.mDiffuse[i];
+		const glm::vec3 firstPhongReflectance(mGBuffer.mPhongReflectance[i]);
+		const float firstPhongExponent = mGBuffer.mPhongReflectance[i].w;
+		const glm::vec3 cameraVec = glm::normalize(firstPosition - mCameraPosition);
+
+		glm::vec3 result(0.0f);
+		glm::vec3 position = firstPosition;
+		glm::vec3 attenuation(1.0f);
+		glm::vec3 direction;
+		float brdfPdfW;
+
+		// first bounce
+		{
+			// sample light source
+			float lightPdf;
+			glm::vec3 lightPosition, lightNormal;
+			const glm::vec3 lightValue = RtCpu::LightSample(&lightPosition, &lightNormal, &lightPdf, light, rng);
+
+			const glm::vec3 toLight = lightPosition - position;
+			const glm::vec3 toLightNorm = glm::normalize(toLight);
+			const bool isOccluded = traceShadowRay(lightPosition, -toLight, 0.0001f);
+
+			// select material
+			const float maxLambert = RtCpu::MaxColor(firstLambertReflectance);
+			const float maxPhong = RtCpu::MaxColor(firstPhongReflectance);
+			if (maxLambert + maxPhong <= 0.000001f) { return glm::vec3(0.0f); }
+
+			const float pSelectLambert = maxLambert / (maxPhong + maxLambert);
+			const float chooseMaterial = std::min(rng->nextFloat(), 0.999999f);
+			const float lightMaterial = RtCpu::PhongEvalF(lightNormal, -toLightNorm, lightNormal, light.mPrecomputedLightIntensity.w);
+			if (chooseMaterial < pSelectLambert)
+			{
+				if (!isOccluded)
+				{
+					const float brdfPdf = RtCpu::LambertPdfA(normal, lightNormal, toLight);
+					const float weight = MisWeight(lightPdf, brdfPdf);
+					result += weight * lightValue * RtCpu::LambertEval(-cameraVec, toLightNorm, normal, firstLambertReflectance) * RtCpu::GeometryTerm(normal, lightNormal, toLight) / pSelectLambert * lightMaterial;
+				}
+				attenuation *= RtCpu::LambertSample(&direction, &brdfPdfW, -cameraVec, normal, firstLambertReflectance, rng) / pSelectLambert;
+			}
+			else
+			{
+				if (!isOccluded)
+				{
+					const float brdfPdf = RtCpu::PhongPdfA(normal, lightNormal, toLight, -cameraVec, firstPhongReflectance, firstPhongExponent);
+					const float weight = MisWeight(lightPdf, brdfPdf);
+					result += weight * lightValue * RtCpu::PhongEval(-cameraVec, toLightNorm, normal, firstPhongReflectance, firstPhongExponent) * RtCpu::GeometryTerm(normal, lightNormal, toLight) / (1.0f - pSelectLambert) * lightMaterial;
+				}
+				attenuation *= RtCpu::PhongSample(&direction, &brdfPdfW, -cameraVec, normal, firstPhongReflectance, firstPhongExponent, rng) / (1.0f - pSelectLambert);
+			}
+		}
+
+		// rtMaterialClosestHit. there is no miss program, a miss ends the path
+		for (int bounce = 0;bounce < mNumMaxBounce;bounce++)
+		{
+			const bool isLastBounce = (bounce == mNumMaxBounce - 1);
+
+			Intersection isect;
+			if (!accel.intersect(&isect, Ray(position, direction, 0.00001f, std::numeric_limits<Float>::infinity()))) { break; }
+
+			const RtMaterial & material = *mScene->mMaterials[isect.mMatIndex];
+			const glm::vec3 nextPosition = isect.mPosition;
+			const glm::vec3 nextNormal = isect.mGeomNormal;
+			const glm::vec3 in = glm::normalize(position - nextPosition);
+
+			// reject the result if normal is in the other direction
+			if (glm::dot(nextNormal, direction) > 0.0f) { break; }
+
+			// check if it hit the light source
+			if (material.mLightIntensity.x > 0.01f)
+			{
+				const float brdfPdfA = brdfPdfW * PdfW2A(nextNormal, nextPosition - position);
+				const float weight = MisWeight(brdfPdfA, RtCpu::LightPdfA(light));
+				result += weight * attenuation * RtCpu::PhongEvalF(nextNormal, in, nextNormal, material.mLightIntensity.w) * glm::vec3(material.mLightIntensity);
+				break;
+			}
+
+			// this is last bounce. don't do next event estimation
+			if (isLastBounce) { break; }
+
+			float lightPdf;
+			glm::vec3 lightPosition, lightNormal;
+			const glm::vec3 lightValue = RtCpu::LightSample(&lightPosition, &lightNormal, &lightPdf, light, rng);
+
+			const glm::vec3 toLight = lightPosition - nextPosition;
+			const glm::vec3 toLightNorm = glm::normalize(toLight);
+			const bool isOccluded = traceShadowRay(lightPosition, -toLight, 0.00001f);
+
+			glm::vec3 lambertReflectance, phongReflectance;
+			float phongExponent;
+			RtCpu::FetchMaterial(&lambertReflectance, &phongReflectance, &phongExponent, material, isect.mTexCoord);
+
+			// check bad color
+			const float maxLambert = RtCpu::MaxColor(lambertReflectance);
+			const float maxPhong = RtCpu::MaxColor(phongReflectance);
+			if (maxLambert + maxPhong <= 0.000001f) { break; }
+
+			const float pSelectLambert = maxLambert / (maxPhong + maxLambert);
+			const float chooseMaterial = std::min(rng->nextFloat(), 0.999999f);
+			const float lightMaterial = RtCpu::PhongEvalF(lightNormal, -toLightNorm, lightNormal, light.mPrecomputedLightIntensity.w);
+			if (chooseMaterial < pSelectLambert)
+			{
+				if (!isOccluded)
+				{
+					const float brdfPdf = RtCpu::LambertPdfA(nextNormal, lightNormal, toLight);
+					const float weight = MisWeight(lightPdf, brdfPdf);
+					result += weight * lightValue * RtCpu::LambertEval(toLightNorm, in, nextNormal, lambertReflectance) * RtCpu::GeometryTerm(nextNormal, lightNormal, toLight) * attenuation / pSelectLambert * lightMaterial;
+				}
+				attenuation *= RtCpu::LambertSample(&direction, &brdfPdfW, in, nextNormal, lambertReflectance, rng) / pSelectLambert;
+			}
+			else
+			{
+				if (!isOccluded)
+				{
+					const float brdfPdf = RtCpu::PhongPdfA(nextNormal, lightNormal, toLight, in, phongReflectance, phongExponent);
+					const float weight = MisWeight(lightPdf, brdfPdf);
+					result += weight * lightValue * RtCpu::PhongEval(toLightNorm, in, nextNormal, phongReflectance, phongExponent) * RtCpu::GeometryTerm(nextNormal, lightNormal, toLight) * attenuation / (1.0f - pSelectLambert) * lightMaterial;
+				}
+				attenuation *= RtCpu::PhongSample(&direction, &brdfPdfW, in, nextNormal, phongReflectance, phongExponent, rng) / (1.0f - pSelectLambert);
+			}
+
+			const float russian = RussianProb(attenuation);
+			if (rng->nextFloat() >= russian) { break; }
+
+			position = nextPosition;
+			attenuation /= russian;
+		}
+
+		return result;
+	}
+
+	// Ray(origin, v, 1, epsilon, 1 - epsilon) of optix, whose direction isn't normalized
+	inline bool traceShadowRay(const glm::vec3 & origin, const glm::vec3 & v, const float epsilon) const
+	{
+		const float length = glm::length(v);
+		return mScene->mCpuTracer->intersectP(Ray(origin, v / length, epsilon * length, (1.0f - epsilon) * length));
+	}
+
+	static inline float MisWeight(const float pdf1, const float pdf2)
+	{
+		return pdf1 / (pdf1 + pdf2);
+	}
+
+	static inline float PdfW2A(const glm::vec3 & n2, const glm::vec3 & v12)
+	{
+		return std::max(-glm::dot(n2, glm::normalize(v12)), 0.0f) / glm::dot(v12, v12);
+	}
+
+	// russianProb of pathtracing.cu, never below 0.98
+	static inline float RussianProb(const glm::vec3 & throughput)
+	{
+		return std::max(std::max(throughput.x, 0.98f), std::max(throughput.y, throughput.z));
+	}
+
+	FloatImage createResult(const int numIterations) const
+	{
+		const float ptScale = (mFrameMode == EFrame::ClearEveryFrame) ? 1.0f : (1.0f / (float)(numIterations));
+		FloatImage lightImage(mResolution.x, mResolution.y, mLightResult);
+		FloatImage ptImage(mResolution.x, mResolution.y, mPtResult);
+		ptImage *= ptScale;
+		return FloatImage::FlipY(lightImage + ptImage);
+	}
+
+	glm::vec3 mCameraPosition;
+	glm::uvec2 mResolution;
+	glm::vec2 mInvResolution;
+	float mTimelimitMs;
+
+	int mNumMaxIteration = 0;
+	EFrame mFrameMode;
+	unsigned int mRngOffset = 0;
+
+	int mNumMaxBounce = 0;
+	int mNumSamplePerPixel = 0;
+
+	bool mJitter;
+	bool mUseStat;
+	bool mDoWriteEveryFrame = false;
+
+	std::string mOutputFilename;
+	std::string mStatFilename;
+	shared_ptr<RtScene> mScene;
+
+	RtCpuGBuffer mGBuffer;
+
+	// bottom up like the opengl framebuffers
+	std::vector<glm::vec3> mPtResult;
+	std::vector<glm::vec3> mLightResult;
+};
+
+const std::map<std::string, RtCpuPt::EFrame> RtCpuPt::EFrameModeStrMap = {
+	{ "accumulate", RtCpuPt::EFrame::Accumulate },
+	{ "cleareveryframe", RtCpuPt::EFrame::ClearEveryFrame }
+};
@@ -0,0 +1,354 @@
+#pragma once
+
+#include "common/reflectcuts.h"
+#include "common/threadpool.h"
+#include "accel/shadowrayqueue.h"
+#include "math/simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "../rtcommon.h"
+#include "../rtcomphoton/rtphotonrecord.h"
+#include "rtcpugbuffer.h"
+#include "rtcpumaterial.h"
+
+// splatColor / vplSplat of lighttracing.cu on the cpu. instead of walking every photon record for every pixel, the
+// usable vpls are compacted once per frame into a structure of arrays padded to whole lane groups. screen tiles are
+// handed out dynamically over ThreadPool; a tile walks the vpls one block at a time, evaluates the brdfs, the geometry
+// term and the mis weight for a pixel against LaneGroupSize vpls at once, and traces the shadow rays of the block through
+// a ShadowRayQueue, which sorts them into packets of one direction octant. with Setting::mNumWindowPaths a tile only
+// gathers the vpls of that many consecutive light paths from a random first one (splatColor of lvclighttracing.cu).
+class RtCpuVplGather
+{
+public:
+	static const size_t LaneGroupSize = 8;		// vpls evaluated together : one avx register or two sse registers
+	static const size_t BlockSize = 32;			// vpls per shadow ray batch
+	static const size_t TileSize = 16;			// pixels
+
+	// values of RtComPhoton::EMis / misMode in lighttracing.cu
+	enum EMis
+	{
+		One = 0,
+		Balance = 1,
+		Max = 2,
+		Power2 = 3,
+		GeometryClamp = 4,
+		GeometryBrdfClamp = 5
+	};
+
+	struct Setting
+	{
+		EMis		mMisMode = EMis::Balance;
+		float		mPdfMc = 0.0f;
+		float		mClampingValue = 0.0f;
+		size_t		mNumWindowPaths = 0;		// 0 : every tile gathers all vpls
+		uint32_t	mWindowSeed = 0;			// the first light path of tile t is drawn from RtCpu::Rng(mWindowSeed, 2^32 + t)
+	};
+
+	// records with IsUsableVpl among the first numRecords, in record order. the records of a light path are
+	// numRecordsPerPath consecutive ones
+	void setVpls(const RtPhotonRecord * records, const size_t numRecords, const size_t numRecordsPerPath)
+	{
+		assert(numRecordsPerPath > 0);
+		const size_t numPaths = (numRecords + numRecordsPerPath - 1) / numRecordsPerPath;
+		mPathFirstVpl.assign(numPaths + 1, 0);
+		size_t numVpls = 0;
+		for (size_t i = 0;i < numRecords;i++)
+		{
+			if ((records[i].mFlags & PhotonRecordFlag::IsUsableVpl) != 0) { numVpls++; }
+			mPathFirstVpl[i / numRecordsPerPath + 1] = numVpls;
+		}
+
+		// a lane group may start at any vpl of a window, so there is a group of padding lanes after the last vpl. they
+		// have a zero normal : their cosine is never positive
+		mNumVpls = numVpls;
+		const size_t numPadded = numVpls + LaneGroupSize;
+		for (std::vector<float> * column : { &mPosition[0], &mPosition[1], &mPosition[2], &mNormal[0], &mNormal[1], &mNormal[2], &mReflect[0], &mReflect[1], &mReflect[2],
+			&mFlux[0], &mFlux[1], &mFlux[2], &mLambert[0], &mLambert[1], &mLambert[2], &mPhong[0], &mPhong[1], &mPhong[2], &mPhongExponent, &mPSelectLambert, &mHasPhong })
+		{
+			column->assign(numPadded, 0.0f);
+		}
+
+		size_t j = 0;
+		for (size_t i = 0;i < numRecords;i++)
+		{
+			const RtPhotonRecord & record = records[i];
+			if ((record.mFlags & PhotonRecordFlag::IsUsableVpl) == 0) { continue; }
+
+			const glm::vec3 normal = RtCpu::ToVec3(record.mNormal);
+			const glm::vec3 phongReflectance = RtCpu::ToVec3(record.mPhongReflectance);
+			const glm::vec3 reflectVec = glm::normalize(glm::reflect(-RtCpu::ToVec3(record.mFluxDir), normal));
+			for (int k = 0;k < 3;k++)
+			{
+				mPosition[k][j] = (&record.mPosition.x)[k];
+				mNormal[k][j] = normal[k];
+				mReflect[k][j] = reflectVec[k];
+				mFlux[k][j] = (&record.mFlux.x)[k];
+				mLambert[k][j] = (&record.mLambertReflectance.x)[k] * Math::InvPi;
+				mPhong[k][j] = phongReflectance[k];
+			}
+			mPhongExponent[j] = record.mPhongExponent;
+			mPSelectLambert[j] = record.mPSelectLambert;
+			mHasPhong[j] = (RtCpu::MaxColor(phongReflectance) > 0.0f) ? 1.0f : 0.0f;
+			j++;
+		}
+	}
+
+	inline size_t numVpls() const { return mNumVpls; }
+
+	// adds scale * (sum over the vpls) to result, pixels in the order of gbuffer
+	void gather(std::vector<glm::vec3> * result, const RtCpuGBuffer & gbuffer, const RtScene & scene, const glm::vec3 & cameraPosition, const Setting & setting, const float scale) const
+	{
+		const glm::uvec2 numTiles = (gbuffer.mResolution + glm::uvec2(TileSize - 1)) / glm::uvec2(TileSize);
+		const Aabb sceneBbox = scene.mCpuTracer->computeBbox();
+		ThreadPool::Instance().parallelFor(0, numTiles.x * numTiles.y, [&](const size_t iTile)
+		{
+			const glm::uvec2 tile(iTile % numTiles.x, iTile / numTiles.x);
+			gatherTile(result, gbuffer, scene, sceneBbox, cameraPosition, setting, scale, iTile, tile * glm::uvec2(TileSize), glm::min(tile * glm::uvec2(TileSize) + glm::uvec2(TileSize), gbuffer.mResolution));
+		});
+	}
+
+private:
+	// the shading point of one pixel
+	struct Receiver
+	{
+		size_t		mPixel;
+		glm::vec3	mPosition;
+		glm::vec3	mNormal;
+		glm::vec3	mLambert;			// divided by pi
+		glm::vec3	mPhong;
+		float		mPhongExponent;
+		glm::vec3	mReflect;			// reflect(-wi10, normal) for PhongEvalF
+		bool		mHasPhong;
+	};
+
+	// a connection which still needs its shadow ray
+	struct Candidate
+	{
+		uint32_t	mReceiver;
+		glm::vec3	mContribution;
+	};
+
+	void gatherTile(std::vector<glm::vec3> * resultPtr, const RtCpuGBuffer & gbuffer, const RtScene & scene, const Aabb & sceneBbox, const glm::vec3 & cameraPosition, const Setting & setting, const float scale, const size_t iTile, const glm::uvec2 & first, const glm::uvec2 & last) const
+	{
+		std::vector<Receiver> receivers;
+		for (uint32_t y = first.y;y < last.y;y++)
+		{
+			for (uint32_t x = first.x;x < last.x;x++)
+			{
+				const size_t i = y * gbuffer.mResolution.x + x;
+				if (!gbuffer.isCovered(i)) { continue; }
+
+				Receiver receiver;
+				receiver.mPixel = i;
+				receiver.mPosition = glm::vec3(gbuffer.mPosition[i]);
+				receiver.mNormal = gbuffer.mNormal[i];
+				receiver.mLambert = gbuffer.mDiffuse[i] * Math::InvPi;
+				receiver.mPhong = glm::vec3(gbuffer.mPhongReflectance[i]);
+				receiver.mPhongExponent = gbuffer.mPhongReflectance[i].w;
+				receiver.mReflect = glm::reflect(-glm::normalize(cameraPosition - receiver.mPosition), receiver.mNormal);
+				receiver.mHasPhong = RtCpu::MaxColor(receiver.mPhong) > 0.0f;
+				receivers.push_back(receiver);
+			}
+		}
+		if (receivers.empty() || mNumVpls == 0) { return; }
+
+		const size_t numReceivers = receivers.size();
+		std::vector<glm::vec3> sums(numReceivers, glm::vec3(0.0f));
+
+		// contributions of one lane group, [receiver][lane]
+		std::vector<glm::vec3> groupContributions(numReceivers * LaneGroupSize);
+		std::vector<uint8_t> groupMasks(numReceivers);
+
+		std::vector<Candidate> candidates;
+		candidates.reserve(numReceivers * BlockSize);
+		ShadowRayQueue shadowRays(sceneBbox);
+
+		// vpl index ranges of the window, two if it wraps around the last light path
+		size_t ranges[2][2] = { { 0, mNumVpls }, { 0, 0 } };
+		const size_t numPaths = mPathFirstVpl.size() - 1;
+		if (setting.mNumWindowPaths > 0 && setting.mNumWindowPaths < numPaths)
+		{
+			// above the counters of RtCpuLightTracer, which may use the same seed
+			RtCpu::Rng rng(setting.mWindowSeed, (static_cast<uint64_t>(1) << 32) + iTile);
+			const size_t firstPath = std::min(static_cast<size_t>(std::min(rng.nextFloat(), 0.999999f) * numPaths), numPaths - 1);
+			const size_t lastPath = firstPath + setting.mNumWindowPaths;
+			ranges[0][0] = mPathFirstVpl[firstPath];
+			ranges[0][1] = mPathFirstVpl[std::min(lastPath, numPaths)];
+			if (lastPath > numPaths) { ranges[1][1] = mPathFirstVpl[lastPath - numPaths]; }
+		}
+
+		for (const size_t * range : ranges)
+		{
+			for (size_t block = range[0];block < range[1];block += BlockSize)
+			{
+				candidates.clear();
+				shadowRays.clear();
+				const size_t blockEnd = std::min(block + BlockSize, range[1]);
+				for (size_t group = block;group < blockEnd;group += LaneGroupSize)
+				{
+					for (size_t r = 0;r < numReceivers;r++)
+					{
+						groupMasks[r] = evalLaneGroup(&groupContributions[r * LaneGroupSize], receivers[r], group, blockEnd, setting);
+					}
+
+					// lane major : the rays of one vpl to the neighbouring pixels of the tile follow each other
+					for (size_t lane = 0;lane < LaneGroupSize;lane++)
+					{
+						const size_t vpl = group + lane;
+						const glm::vec3 vplPosition(mPosition[0][vpl], mPosition[1][vpl], mPosition[2][vpl]);
+						for (size_t r = 0;r < numReceivers;r++)
+						{
+							if ((groupMasks[r] & (1 << lane)) == 0) { continue; }
+
+							// Ray(photonRecord.mPosition, -v12, 0.0001, 1 - 0.0001) of vplSplat with a normalized direction
+							const glm::vec3 v21 = receivers[r].mPosition - vplPosition;
+							const float dist = glm::length(v21);
+							shadowRays.push(Ray(vplPosition, v21 / dist, 0.0001f * dist, (1.0f - 0.0001f) * dist));
+							candidates.push_back({ static_cast<uint32_t>(r), groupContributions[r * LaneGroupSize + lane] });
+						}
+					}
+				}
+				if (shadowRays.size() == 0) { continue; }
+
+				shadowRays.flush(*scene.mCpuTracer);
+
+				// candidates of a receiver are in vpl order within the block, the sums don't depend on the scheduling
+				for (size_t i = 0;i < candidates.size();i++)
+				{
+					if (!shadowRays.isOccluded(i)) { sums[candidates[i].mReceiver] += candidates[i].mContribution; }
+				}
+			}
+		}
+
+		std::vector<glm::vec3> & result = *resultPtr;
+		for (size_t r = 0;r < numReceivers;r++) { result[receivers[r].mPixel] += sums[r] * scale; }
+	}
+
+	// vplSplat without the shadow ray for the LaneGroupSize vpls starting at first, lanes from end on are skipped. returns
+	// one bit per lane whose contribution is not zero
+	uint8_t evalLaneGroup(glm::vec3 * contributions, const Receiver & receiver, const size_t first, const size_t end, const Setting & setting) const
+	{
+		using Simd::Vfloat;
+		using Simd::Vmask;
+
+		const Vfloat zero(0.0f);
+		const Vfloat threshold(0.000001f);
+		const Vfloat invPi(Math::InvPi);
+		const Vfloat half(0.5f);
+		const Vfloat one(1.0f);
+		const Vfloat two(2.0f);
+		uint8_t result = 0;
+
+		for (size_t offset = 0;offset < LaneGroupSize;offset += Simd::Width)
+		{
+			const size_t j = first + offset;
+			const Vfloat v12x = Vfloat::Load(&mPosition[0][j]) - Vfloat(receiver.mPosition.x);
+			const Vfloat v12y = Vfloat::Load(&mPosition[1][j]) - Vfloat(receiver.mPosition.y);
+			const Vfloat v12z = Vfloat::Load(&mPosition[2][j]) - Vfloat(receiver.mPosition.z);
+			const Vfloat n2x = Vfloat::Load(&mNormal[0][j]);
+			const Vfloat n2y = Vfloat::Load(&mNormal[1][j]);
+			const Vfloat n2z = Vfloat::Load(&mNormal[2][j]);
+
+			const Vfloat unnormCos1 = Vfloat(receiver.mNormal.x) * v12x + Vfloat(receiver.mNormal.y) * v12y + Vfloat(receiver.mNormal.z) * v12z;
+			const Vfloat unnormCos2 = zero - (n2x * v12x + n2y * v12y + n2z * v12z);
+			const int numLanes = static_cast<int>(std::min<size_t>(end - std::min(end, j), Simd::Width));
+			const int valid = Simd::Movemask((unnormCos1 > zero) & (unnormCos2 > zero)) & ((1 << numLanes) - 1);
+			if (valid == 0) { continue; }
+
+			const Vfloat dist2 = v12x * v12x + v12y * v12y + v12z * v12z;
+			const Vfloat invDist = one / Simd::Sqrt(dist2);
+			const Vfloat wi12x = v12x * invDist;
+			const Vfloat wi12y = v12y * invDist;
+			const Vfloat wi12z = v12z * invDist;
+			const Vfloat g21 = unnormCos1 * unnormCos2 / (dist2 * dist2);
+
+			// cosines of the phong lobes : wi12 against the reflected view direction at the pixel, -wi12 against the
+			// reflected incoming direction at the vpl
+			const Vfloat cosReflect1 = wi12x * Vfloat(receiver.mReflect.x) + wi12y * Vfloat(receiver.mReflect.y) + wi12z * Vfloat(receiver.mReflect.z);
+			const Vfloat cosReflect2 = zero - (wi12x * Vfloat::Load(&mReflect[0][j]) + wi12y * Vfloat::Load(&mReflect[1][j]) + wi12z * Vfloat::Load(&mReflect[2][j]));
+
+			// no pow in the simd wrappers : the phong lobes are evaluated lane by lane, only where there is a lobe
+			alignas(32) float powLanes1[Simd::Width];
+			alignas(32) float powLanes2[Simd::Width];
+			alignas(32) float cosLanes1[Simd::Width];
+			alignas(32) float cosLanes2[Simd::Width];
+			cosReflect1.store(cosLanes1);
+			cosReflect2.store(cosLanes2);
+			for (size_t lane = 0;lane < Simd::Width;lane++)
+			{
+				const bool isValid = (valid & (1 << lane)) != 0;
+				powLanes1[lane] = (isValid && receiver.mHasPhong && cosLanes1[lane] > 0.000001f) ? std::pow(cosLanes1[lane], receiver.mPhongExponent) : 0.0f;
+				powLanes2[lane] = (isValid && mHasPhong[j + lane] != 0.0f && cosLanes2[lane] > 0.000001f) ? std::pow(cosLanes2[lane], mPhongExponent[j + lane]) : 0.0f;
+			}
+			const Vfloat exponent2 = Vfloat::Load(&mPhongExponent[j]);
+			const Vfloat phongF1 = (Vfloat(receiver.mPhongExponent) + two) * Vfloat::Load(powLanes1) * invPi * half;
+			const Vfloat phongF2 = (exponent2 + two) * Vfloat::Load(powLanes2) * invPi * half;
+
+			Vfloat weight = one;
+			if (setting.mMisMode == EMis::Balance || setting.mMisMode == EMis::Max || setting.mMisMode == EMis::Power2)
+			{
+				// LambertPdfA + PhongPdfA from the vpl toward the pixel. PhongPdfA only looks at the red channel
+				const Vfloat pSelectLambert = Vfloat::Load(&mPSelectLambert[j]);
+				const Vfloat lambertPdfA = g21 * invPi;
+				const Vfloat phongPdfW = (exponent2 + one) * half * invPi * Vfloat::Load(powLanes2);
+				const Vmask hasPhongPdf = (Vfloat::Load(&mPhong[0][j]) > threshold) & (cosReflect2 > threshold);
+				const Vfloat phongPdfA = Simd::Select(hasPhongPdf, phongPdfW * Simd::Max(unnormCos1 * invDist, zero) / dist2, zero);
+				const Vfloat pdfDe = lambertPdfA * pSelectLambert + phongPdfA * (one - pSelectLambert);
+
+				const Vfloat pdfMc(setting.mPdfMc);
+				if (setting.mMisMode == EMis::Balance) { weight = pdfMc / (pdfMc + pdfDe); }
+				else if (setting.mMisMode == EMis::Max) { weight = Simd::Select(pdfMc > pdfDe, one, zero); }
+				else { weight = pdfMc * pdfMc / (pdfMc * pdfMc + pdfDe * pdfDe); }
+			}
+
+			Vfloat channels[3];
+			for (int k = 0;k < 3;k++)
+			{
+				const Vfloat brdf1 = Vfloat(receiver.mLambert[k]) + phongF1 * Vfloat(receiver.mPhong[k]);
+				const Vfloat brdf2 = Vfloat::Load(&mLambert[k][j]) + phongF2 * Vfloat::Load(&mPhong[k][j]);
+				const Vfloat flux = Vfloat::Load(&mFlux[k][j]);
+				if (setting.mMisMode == EMis::GeometryClamp)
+				{
+					channels[k] = flux * Simd::Min(g21, Vfloat(setting.mClampingValue)) * brdf1 * brdf2;
+				}
+				else if (setting.mMisMode == EMis::GeometryBrdfClamp)
+				{
+					channels[k] = flux * Simd::Min(g21 * brdf1 * brdf2, Vfloat(setting.mClampingValue));
+				}
+				else
+				{
+					channels[k] = weight * flux * brdf1 * brdf2 * g21;
+				}
+			}
+
+			alignas(32) float lanes[3][Simd::Width];
+			for (int k = 0;k < 3;k++) { channels[k].store(lanes[k]); }
+			for (size_t lane = 0;lane < Simd::Width;lane++)
+			{
+				const glm::vec3 contribution(lanes[0][lane], lanes[1][lane], lanes[2][lane]);
+				if ((valid & (1 << lane)) != 0 && (contribution.x > 0.0f || contribution.y > 0.0f || contribution.z > 0.0f))
+				{
+					contributions[offset + lane] = contribution;
+					result |= static_cast<uint8_t>(1 << (offset + lane));
+				}
+			}
+		}
+		return result;
+	}
+
+	size_t				mNumVpls = 0;
+	std::vector<size_t>	mPathFirstVpl;		// [numPaths + 1], index of the first vpl of every light path
+	std::vector<float>	mPosition[3];
+	std::vector<float>	mNormal[3];
+	std::vector<float>	mReflect[3];		// reflect(-fluxDir, normal), normalized
+	std::vector<float>	mFlux[3];
+	std::vector<float>	mLambert[3];		// divided by pi
+	std::vector<float>	mPhong[3];
+	std::vector<float>	mPhongExponent;
+	std::vector<float>	mPSelectLambert;
+	std::vector<float>	mHasPhong;			// 1 if any channel of mPhong is positive
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "json/json.hpp"
+#include "rtcommon.h"
+
+// RtTechnique without a window, opengl or optix. used by the cpu only build (USE_CPU_ONLY), which runs the same scene
+// json on machines without a gpu or a display. the techniques trace against RtScene::mCpuTracer and spread their
+// work over ThreadPool
+class RtCpuTechnique
+{
+public:
+	virtual ~RtCpuTechnique() {}
+
+	void render(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const nlohmann::json & json)
+	{
+		renderSweep(scene, resolution, { json });
+	}
+
+	// renders the parameter sets one after another with a single setup. between two sets only the state that depends on
+	// the parameters is rebuilt
+	void renderSweep(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const std::vector<nlohmann::json> & jsons)
+	{
+		assert(jsons.size() > 0);
+		configure(scene, resolution, jsons[0]);
+		setup();
+		run();
+		for (size_t i = 1;i < jsons.size();i++)
+		{
+			configure(scene, resolution, jsons[i]);
+			applyParameters();
+			run();
+		}
+		destroy();
+	}
+
+	// renders json, then renders again whenever pollJson hands out a new parameter set. there is no window to close,
+	// the process has to be stopped
+	void renderWatch(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const nlohmann::json & json, const std::function<bool(nlohmann::json * json)> & pollJson)
+	{
+		configure(scene, resolution, json);
+		setup();
+		run();
+		nlohmann::json next;
+		while (true)
+		{
+			if (pollJson(&next))
+			{
+				configure(scene, resolution, next);
+				applyParameters();
+				run();
+			}
+			else
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(250));
+			}
+		}
+	}
+
+protected:
+	// same contract as RtTechnique
+	virtual void configure(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const nlohmann::json & json) = 0;
+
+	virtual void setup() = 0;
+
+	virtual void applyParameters() = 0;
+
+	virtual void run() = 0;
+
+	virtual void destroy() = 0;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "rtvectortypes.h"
+
+// texture id of a slot that holds a constant
+#define RT_MATERIAL_NO_TEXTURE (-1)
+
+// one entry per scene material (64 bytes). constant parameters are stored inline,
+// textured slots refer to bindless optix texture sampler ids shared between materials and keep their texel factor inline.
+struct RtMaterialRecord
+{
+	optix::float3 mLambertReflectance;		int mLambertReflectanceTextureId;
+	optix::float3 mPhongReflectance;		int mPhongReflectanceTextureId;
+	optix::float4 mLightIntensity;
+	float mPhongExponent;					int mPhongExponentTextureId;			float padding1;		float padding2;
+};
+
+#ifdef __CUDACC__
+// one structured load already happened (material), only the slots which are really textured fetch
+__inline__ __device__ void FetchMaterial(optix::float3 * lambertReflectance, optix::float3 * phongReflectance, float * phongExponent, const RtMaterialRecord & material, const optix::float2 & texcoord)
+{
+	*lambertReflectance = material.mLambertReflectance;
+	*phongReflectance = material.mPhongReflectance;
+	*phongExponent = material.mPhongExponent;
+
+	if (material.mLambertReflectanceTextureId != RT_MATERIAL_NO_TEXTURE)
+	{
+		*lambertReflectance *= optix::make_float3(optix::rtTex2D<optix::float4>(material.mLambertReflectanceTextureId, texcoord.x, texcoord.y));
+	}
+	if (material.mPhongReflectanceTextureId != RT_MATERIAL_NO_TEXTURE)
+	{
+		*phongReflectance *= optix::make_float3(optix::rtTex2D<optix::float4>(material.mPhongReflectanceTextureId, texcoord.x, texcoord.y));
+	}
+	if (material.mPhongExponentTextureId != RT_MATERIAL_NO_TEXTURE)
+	{
+		// single channel (R8 / R16F)
+		*phongExponent *= optix::rtTex2D<float>(material.mPhongExponentTextureId, texcoord.x, texcoord.y);
+	}
+}
+#endif
@@ -81,7 +81,7 @@ public:
 
 	static const std::map<std::string, EFrame> EFrameModeStrMap;
 
-	void render(shared_ptr<RtScene> & rtScene, const glm::vec2 & resolution, const nlohmann::json & json) override
+	void configure(shared_ptr<RtScene> & rtScene, const glm::vec2 & resolution, const nlohmann::json & json) override
 	{
 		mScene = rtScene;
 		mCameraPosition = mScene->mCamera->getOrigin();
@@ -109,10 +109,6 @@ public:
 		mNumSamplePerPixel = json["numSamplePerPixel"];
 		mNumMaxBounce = json["numMaxBounces"];
 		mDoWriteEveryFrame = (json.find("writeEveryFrame") == json.end()) ? false : json["writeEveryFrame"];
-
-		this->setup();
-		this->run();
-		this->destroy();
 	}
 
 	FloatImage dumpImage(const glm::uvec2 & resolution, const std::function<void(void)> & renderFunc)
@@ -206,9 +202,8 @@ public:
 	shared_ptr<OpenglProgram> mDeferredProgram;
 	shared_ptr<OpenglUniform> mDeferredProgram_uMvp;
 	shared_ptr<OpenglUniform> mDeferredProgram_uDiffuse;
-	shared_ptr<OpenglUniform> mDeferredProgram_uLambertReflectance;
-	shared_ptr<OpenglUniform> mDeferredProgram_uPhongReflectance;
-	shared_ptr<OpenglUniform> mDeferredProgram_uPhongExponent;
+	RtMaterialUniforms mDeferredProgram_uMaterial;
+	RtVertexUniforms mDeferredProgram_uVertex;
 	void initDeferredProgram()
 	{
 		mDeferredProgram = make_shared<OpenglProgram>();
@@ -219,9 +214,8 @@ public:
 
 		mDeferredProgram_uMvp = mDeferredProgram->registerUniform("uMVP");
 		mDeferredProgram_uDiffuse = mDeferredProgram->registerUniform("uDiffuse");
-		mDeferredProgram_uLambertReflectance = mDeferredProgram->registerUniform("uLambertReflectance");
-		mDeferredProgram_uPhongReflectance = mDeferredProgram->registerUniform("uPhongReflectance");
-		mDeferredProgram_uPhongExponent = mDeferredProgram->registerUniform("uPhongExponent");
+		mDeferredProgram_uMaterial.registerUniforms(mDeferredProgram);
+		mDeferredProgram_uVertex.registerUniforms(mDeferredProgram);
 	}
 
 	GLuint mBigTriangleBuffer;
@@ -399,7 +393,7 @@ public:
 		}
 	}
 
-	void setup()
+	void setup() override
 	{
 		rt.setup(mResolution);
 
@@ -430,18 +424,28 @@ public:
 		for (size_t i = 0;i < mScene->mMaterials.size();i++)
 		{
 			mScene->mMaterials[i]->createOpenglTextures();
-			mScene->mMaterials[i]->createOptixTextures(mOptixContext);
 		}
+		mScene->createOptixMaterialBuffer(mOptixContext);
+		mOptixContext["materialBuffer"]->set(mScene->mOptixMaterialBuffer);
 
 		// put all geometry inside a one group
 		mOptixTopGeometryGroup = mOptixContext->createGeometryGroup();
-		for (size_t i = 0;i < mScene->mMeshes.size();i++)
+		if (mScene->mFlattenGeometry)
+		{
+			mScene->createGeometryPool();
+			mScene->mGeometryPool->createOpenglBuffers();
+			mScene->mGeometryPool->createOptixGeometry(mOptixContext, mOptixMeshIntersectProgram, mOptixMeshBboxProgram, mOptixRtMaterial);
+			mOptixTopGeometryGroup->addChild(mScene->mGeometryPool->mMesh->mOptix.mGeometryInstance);
+		}
+
+		std::vector<shared_ptr<RtMesh>> rtMeshes = mScene->getUnpooledMeshes();
+		for (size_t i = 0;i < rtMeshes.size();i++)
 		{
-			mScene->mMeshes[i]->createOpenglBuffer();
-			mScene->mMeshes[i]->createOptixMeshBuffer(mOptixContext);
-			//mScene->mMeshes[i].createOptixMeshBufferFromOpenglBuffer(mOptixContext); // slow
-			mScene->mMeshes[i]->createOptixGeometry(mOptixContext, mOptixMeshIntersectProgram, mOptixMeshBboxProgram, mOptixRtMaterial, *mScene->mMaterials[mScene->mMeshes[i]->mMatIndex]);
-			mOptixTopGeometryGroup->addChild(mScene->mMeshes[i]->mOptix.mGeometryInstance);
+			rtMeshes[i]->createOpenglBuffer();
+			rtMeshes[i]->createOptixMeshBuffer(mOptixContext);
+			//rtMeshes[i].createOptixMeshBufferFromOpenglBuffer(mOptixContext); // slow
+			rtMeshes[i]->createOptixGeometry(mOptixContext, mOptixMeshIntersectProgram, mOptixMeshBboxProgram, mOptixRtMaterial);
+			mOptixTopGeometryGroup->addChild(rtMeshes[i]->mOptix.mGeometryInstance);
 		}
 
 		mScene->mArealight->createOptixCdf(mOptixContext);
@@ -457,15 +461,24 @@ public:
 		optix::Acceleration accel = mOptixContext->createAcceleration("Trbvh");
 		accel->markDirty();
 		mOptixTopGeometryGroup->setAcceleration(accel);
+
+		// instanced meshes get one bvh each and are placed with optix transforms above the plain geometry
+		mScene->createOptixTopObject(mOptixContext, mOptixTopGeometryGroup, mOptixMeshIntersectProgram, mOptixMeshBboxProgram, mOptixRtMaterial);
 	}
 
 	void runDeferredProgram(const glm::mat4 & mvpMatrix, const glm::mat4 & originalMvpMatrix)
 	{
 		glUseProgram(mDeferredProgram->mHandle);
 
-		std::vector<shared_ptr<RtMesh>> rtMeshes = mScene->mMeshes;
+		std::vector<shared_ptr<RtMesh>> rtMeshes = mScene->getUnpooledMeshes();
 		std::vector<shared_ptr<RtMaterial>> rtMaterials = mScene->mMaterials;
 
+		if (mScene->mGeometryPool != nullptr)
+		{
+			mDeferredProgram_uMvp->setUniform(mvpMatrix);
+			mScene->mGeometryPool->draw(mDeferredProgram_uMaterial, mDeferredProgram_uVertex, rtMaterials);
+		}
+
 		for (size_t i = 0;i < rtMeshes.size();i++)
 		{
 			if (rtMeshes[i] == mScene->mArealight->mMesh)
@@ -477,31 +490,33 @@ public:
 				mDeferredProgram_uMvp->setUniform(mvpMatrix);
 			}
 
-			glEnableVertexAttribArray(0);
-			glBindBuffer(GL_ARRAY_BUFFER, rtMeshes[i]->mGl.mVerticesBuffer->mHandle);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*) 0);
-
-			glEnableVertexAttribArray(1);
-			glBindBuffer(GL_ARRAY_BUFFER, rtMeshes[i]->mGl.mTexCoordsBuffer->mHandle);
-			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*) 0);
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, rtMaterials[rtMeshes[i]->mMatIndex]->mLambertReflectance->mGlHandle);
-			mDeferredProgram_uLambertReflectance->setUniform(0);
-
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, rtMaterials[rtMeshes[i]->mMatIndex]->mPhongReflectance->mGlHandle);
-			mDeferredProgram_uPhongReflectance->setUniform(1);
+			rtMeshes[i]->bindOpenglAttributes();
+			mDeferredProgram_uVertex.setUniforms(*rtMeshes[i]);
 
-			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_2D, rtMaterials[rtMeshes[i]->mMatIndex]->mPhongExponent->mGlHandle);
-			mDeferredProgram_uPhongExponent->setUniform(2);
+			mDeferredProgram_uMaterial.setUniforms(*rtMaterials[rtMeshes[i]->mMatIndex]);
 
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rtMeshes[i]->mGl.mIndicesBuffer->mHandle);
 			glDrawElements(GL_TRIANGLES, rtMeshes[i]->mNumTriangles * 3, GL_UNSIGNED_INT, (void*) 0);
 			glDisableVertexAttribArray(0);
 			glDisableVertexAttribArray(1);
 		}
+
+		// instanced meshes are bound once and drawn once per placement
+		mDeferredProgram_uMvp->setUniform(mvpMatrix);
+		for (const RtMeshInstances * instances : mScene->getInstancedMeshes())
+		{
+			const RtMesh & mesh = *instances->mMesh;
+			mesh.bindOpenglAttributes();
+			mDeferredProgram_uMaterial.setUniforms(*rtMaterials[mesh.mMatIndex]);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.mGl.mIndicesBuffer->mHandle);
+			for (const glm::mat4 & modelMatrix : instances->mModelMatrices)
+			{
+				mDeferredProgram_uVertex.setUniforms(mesh, modelMatrix);
+				glDrawElements(GL_TRIANGLES, mesh.mNumTriangles * 3, GL_UNSIGNED_INT, (void*) 0);
+			}
+			glDisableVertexAttribArray(0);
+			glDisableVertexAttribArray(1);
+		}
 	}
 
 	void runFinalProgram(const float ptScaling, const float lightScaling, const bool doGammaCorrection)
@@ -572,7 +587,7 @@ public:
 		}
 	}
 
-	void run()
+	void run() override
 	{
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
@@ -592,7 +607,7 @@ public:
 		mOptixContext["deferredNormalTexture"]->setTextureSampler(mOptixDeferredNormalTextureSampler);
 		mOptixContext["deferredDiffuseTexture"]->setTextureSampler(mOptixDeferredDiffuseTextureSampler);
 		mOptixContext["deferredPhongReflectanceTexture"]->setTextureSampler(mOptixDeferredPhongReflectanceTextureSampler);
-		mOptixContext["topObject"]->set(mOptixTopGeometryGroup);
+		mScene->setOptixTopObject(mOptixContext["topObject"], mOptixTopGeometryGroup);
 		mOptixContext["boundingValue"]->setFloat(0);
 		mOptixContext["maxBounces"]->setUint(mNumMaxBounce);
 
@@ -698,6 +713,7 @@ public:
 			std::cout << masterWatch.timeMilliSec() << std::endl;
 			result["time"] = masterWatch.timeMilliSec();
 			result["numIterations"] = numIterations;
+			if (mScene->mCpuAccel) { result["cpuAccel"] = mScene->createCpuAccelStats(); }
 			std::ofstream of(mStatFilename);
 			assert(of.is_open());
 			of << std::setw(4) << result;
@@ -719,7 +735,13 @@ public:
 		FloatImage::Save(FloatImage::FlipY(result), mOutputFilename);
 	}
 
-	void destroy()
+	void applyParameters() override
+	{
+		// nothing is sized by the parameters. restart the accumulation
+		glClearNamedBufferData(mGlOptixVplResultTbo, GL_RGBA32F, GL_RGBA, GL_FLOAT, NULL);
+	}
+
+	void destroy() override
 	{
 		rt.destroy();
 	}
@@ -748,8 +770,6 @@ public:
 	std::string mOutputFilename;
 	std::string mStatFilename;
 	shared_ptr<RtScene> mScene;
-
-	RealTime rt;
 };
 
 const std::map<std::string, RtPt2::EFrame> RtPt2::EFrameModeStrMap = {
@@ -1,10 +1,74 @@
 #pragma once
 
+#include <functional>
+#include <vector>
+
 #include "json/json.hpp"
+#include "common/realtime.h"
 #include "rtcommon.h"
 
 class RtTechnique
 {
 public:
-	virtual void render(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const nlohmann::json & json) = 0;
-};
\ No newline at end of file
+	virtual ~RtTechnique() {}
+
+	void render(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const nlohmann::json & json)
+	{
+		renderSweep(scene, resolution, { json });
+	}
+
+	// renders the parameter sets one after another with a single setup (window, opengl, optix context and scene buffers).
+	// between two sets only the state that depends on the parameters is rebuilt
+	void renderSweep(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const std::vector<nlohmann::json> & jsons)
+	{
+		assert(jsons.size() > 0);
+		configure(scene, resolution, jsons[0]);
+		setup();
+		run();
+		for (size_t i = 1;i < jsons.size() && rt.isOpen();i++)
+		{
+			configure(scene, resolution, jsons[i]);
+			applyParameters();
+			run();
+		}
+		destroy();
+	}
+
+	// renders json then keeps the window open. whenever pollJson hands out a new parameter set it's applied and rendered again
+	void renderWatch(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const nlohmann::json & json, const std::function<bool(nlohmann::json * json)> & pollJson)
+	{
+		configure(scene, resolution, json);
+		setup();
+		run();
+		nlohmann::json next;
+		while (rt.isOpen())
+		{
+			if (pollJson(&next))
+			{
+				configure(scene, resolution, next);
+				applyParameters();
+				run();
+			}
+			else
+			{
+				rt.waitEvents(0.25);
+			}
+		}
+		destroy();
+	}
+
+protected:
+	// reads the parameters. called again after setup() for every following parameter set, with the same scene and resolution
+	virtual void configure(shared_ptr<RtScene> & scene, const glm::vec2 & resolution, const nlohmann::json & json) = 0;
+
+	virtual void setup() = 0;
+
+	// brings the live state in line with the last configure() : reallocates buffers whose size changed and clears accumulated results
+	virtual void applyParameters() = 0;
+
+	virtual void run() = 0;
+
+	virtual void destroy() = 0;
+
+	RealTime rt;
+};
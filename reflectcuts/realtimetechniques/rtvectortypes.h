@@ -0,0 +1,28 @@
+#pragma once
+
+// the records shared with the optix programs (RtMaterialRecord, RtPhotonRecord) are declared with the cuda vector types
+// of optix. the cpu only build has neither cuda nor optix and gets plain structs with the same size and alignment, so
+// the records keep their layout and buffers of them can be exchanged between both builds
+#ifdef USE_CPU_ONLY
+
+namespace optix
+{
+	struct alignas(8) float2 { float x, y; };
+	struct float3 { float x, y, z; };
+	struct alignas(16) float4 { float x, y, z, w; };
+	struct uint3 { unsigned int x, y, z; };
+
+	inline float2 make_float2(const float x, const float y) { return { x, y }; }
+	inline float3 make_float3(const float x, const float y, const float z) { return { x, y, z }; }
+	inline float4 make_float4(const float x, const float y, const float z, const float w) { return { x, y, z, w }; }
+	inline uint3 make_uint3(const unsigned int x, const unsigned int y, const unsigned int z) { return { x, y, z }; }
+}
+
+static_assert(sizeof(optix::float2) == 8 && sizeof(optix::float3) == 12 && sizeof(optix::float4) == 16, "cuda vector type sizes");
+
+#else
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#endif
@@ -10,17 +10,53 @@ rtBuffer<float3> vertexBuffer;
 rtBuffer<int3> indexBuffer;
 rtBuffer<float2> texcoordBuffer;
 
+// packed meshes (RtPackedVertices) fill these instead and leave the float buffers above empty
+rtBuffer<ushort3> quantizedVertexBuffer;
+rtBuffer<ushort2> packedTexcoordBuffer;
+rtDeclareVariable(float3, positionOffset, , );
+rtDeclareVariable(float3, positionScale, , );
+rtBuffer<int> triangleMaterialBuffer; // empty unless the geometry is a pool of several meshes
+rtDeclareVariable(int, meshMaterialIndex, , );
+
+rtDeclareVariable(int, materialIndex, attribute materialIndex, );
 rtDeclareVariable(float2, texcoord, attribute texcoord, );
 rtDeclareVariable(float3, geometryNormal, attribute geometryNormal, );
 rtDeclareVariable(optix::Ray, ray, rtCurrentRay, );
 
+static __device__ __inline__ float3 loadPosition(const int index)
+{
+	if (quantizedVertexBuffer.size() > 0)
+	{
+		const ushort3 q = quantizedVertexBuffer[index];
+		return positionOffset + make_float3(q.x, q.y, q.z) * positionScale;
+	}
+	return vertexBuffer[index];
+}
+
+static __device__ __inline__ float decodeHalf(const unsigned short h)
+{
+	float result;
+	asm("cvt.f32.f16 %0, %1;" : "=f"(result) : "h"(h));
+	return result;
+}
+
+static __device__ __inline__ float2 loadTexcoord(const int index)
+{
+	if (packedTexcoordBuffer.size() > 0)
+	{
+		const ushort2 t = packedTexcoordBuffer[index];
+		return make_float2(decodeHalf(t.x), decodeHalf(t.y));
+	}
+	return texcoordBuffer[index];
+}
+
 RT_PROGRAM void meshFineIntersect(int primIndex)
 {
 	int3 vertexIndex = indexBuffer[primIndex];
 
-	float3 p0 = vertexBuffer[vertexIndex.x];
-	float3 p1 = vertexBuffer[vertexIndex.y];
-	float3 p2 = vertexBuffer[vertexIndex.z];
+	float3 p0 = loadPosition(vertexIndex.x);
+	float3 p1 = loadPosition(vertexIndex.y);
+	float3 p2 = loadPosition(vertexIndex.z);
 
 	float3 n;
 	float t, beta, gamma;
@@ -28,12 +64,14 @@ RT_PROGRAM void meshFineIntersect(int primIndex)
 	{
 		if (rtPotentialIntersection(t))
 		{
-			geometryNormal = normalize(n);
+			// instanced meshes are intersected in object space below an optix transform
+			geometryNormal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, n));
 
-			float2 t0 = texcoordBuffer[vertexIndex.x];
-			float2 t1 = texcoordBuffer[vertexIndex.y];
-			float2 t2 = texcoordBuffer[vertexIndex.z];
+			float2 t0 = loadTexcoord(vertexIndex.x);
+			float2 t1 = loadTexcoord(vertexIndex.y);
+			float2 t2 = loadTexcoord(vertexIndex.z);
 			texcoord = t1 * beta + t2 * gamma + t0 * (1.0f - beta - gamma);
+			materialIndex = (triangleMaterialBuffer.size() > 0) ? triangleMaterialBuffer[primIndex] : meshMaterialIndex;
 
 			rtReportIntersection(0);
 		}
@@ -44,9 +82,9 @@ RT_PROGRAM void meshIntersect(int primIndex)
 {
 	int3 vertexIndex = indexBuffer[primIndex];
 
-	float3 p0 = vertexBuffer[vertexIndex.x];
-	float3 p1 = vertexBuffer[vertexIndex.y];
-	float3 p2 = vertexBuffer[vertexIndex.z];
+	float3 p0 = loadPosition(vertexIndex.x);
+	float3 p1 = loadPosition(vertexIndex.y);
+	float3 p2 = loadPosition(vertexIndex.z);
 
 	float3 n;
 	float t, beta, gamma;
@@ -63,9 +101,9 @@ RT_PROGRAM void meshBound(int primIdx, float result[6])
 {
 	const int3 v_idx = indexBuffer[primIdx];
 
-	const float3 v0 = vertexBuffer[v_idx.x];
-	const float3 v1 = vertexBuffer[v_idx.y];
-	const float3 v2 = vertexBuffer[v_idx.z];
+	const float3 v0 = loadPosition(v_idx.x);
+	const float3 v1 = loadPosition(v_idx.y);
+	const float3 v2 = loadPosition(v_idx.z);
 	const float area = length(cross(v1 - v0, v2 - v0));
 
 	optix::Aabb* aabb = (optix::Aabb*)result;
@@ -8,15 +8,56 @@ layout(location = 3) out vec4 fPhongReflectance;
 in vec2 gUv;
 in vec3 gPosition;
 in vec3 gGeomNormal;
+flat in int gMaterialIndex;
 
+// constant material parameters are passed directly, only real texture maps are sampled
 uniform sampler2D uLambertReflectance;
+uniform vec3 uLambertReflectanceConstant;
+uniform bool uHasLambertReflectanceTexture;
 uniform sampler2D uPhongReflectance;
+uniform vec3 uPhongReflectanceConstant;
+uniform bool uHasPhongReflectanceTexture;
 uniform sampler2D uPhongExponent;
+uniform float uPhongExponentConstant;
+uniform bool uHasPhongExponentTexture;
+
+// pooled geometry (RtGeometryPool) is drawn with many materials per call, their constants come from this table
+struct MaterialConstants
+{
+	vec4 lambertReflectance;	// w = has texture
+	vec4 phongReflectance;		// w = has texture
+	vec4 phongExponent;			// x = constant, y = has texture
+};
+layout(std430, binding = 0) readonly buffer MaterialTable
+{
+	MaterialConstants uMaterials[];
+};
+uniform bool uUseMaterialTable;
 
 void main()
 {
+	vec3 lambertReflectanceConstant = uLambertReflectanceConstant;
+	vec3 phongReflectanceConstant = uPhongReflectanceConstant;
+	float phongExponentConstant = uPhongExponentConstant;
+	bool hasLambertReflectanceTexture = uHasLambertReflectanceTexture;
+	bool hasPhongReflectanceTexture = uHasPhongReflectanceTexture;
+	bool hasPhongExponentTexture = uHasPhongExponentTexture;
+	if (uUseMaterialTable)
+	{
+		MaterialConstants material = uMaterials[gMaterialIndex];
+		lambertReflectanceConstant = material.lambertReflectance.xyz;
+		phongReflectanceConstant = material.phongReflectance.xyz;
+		phongExponentConstant = material.phongExponent.x;
+		hasLambertReflectanceTexture = material.lambertReflectance.w > 0.0f;
+		hasPhongReflectanceTexture = material.phongReflectance.w > 0.0f;
+		hasPhongExponentTexture = material.phongExponent.y > 0.0f;
+	}
+
 	fPosition = vec4(gPosition, 1.0f);
 	fNormal = gGeomNormal;
-	fDiffuse = texture(uLambertReflectance, gUv).xyz;
-	fPhongReflectance = vec4(texture(uPhongReflectance, gUv).xyz, texture(uPhongExponent, gUv).x);
+	// the constant of a textured slot is the factor of its texels
+	fDiffuse = hasLambertReflectanceTexture ? texture(uLambertReflectance, gUv).xyz * lambertReflectanceConstant : lambertReflectanceConstant;
+	vec3 phongReflectance = hasPhongReflectanceTexture ? texture(uPhongReflectance, gUv).xyz * phongReflectanceConstant : phongReflectanceConstant;
+	float phongExponent = hasPhongExponentTexture ? texture(uPhongExponent, gUv).x * phongExponentConstant : phongExponentConstant;
+	fPhongReflectance = vec4(phongReflectance, phongExponent);
 }
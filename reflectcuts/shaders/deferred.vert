@@ -2,13 +2,23 @@
 
 layout(location = 0) in vec3 vertexPos;
 layout(location = 1) in vec2 uv;
+layout(location = 2) in int materialIndex; // per draw (instanced) attribute, only bound for pooled geometry
 
 out vec2 vUv;
+flat out int vMaterialIndex;
 
 uniform mat4 uMVP;
 
+// quantized positions arrive normalized to [0, 1] inside the mesh bbox (RtVertexUniforms), float positions use offset 0 and scale 1
+uniform vec3 uPositionOffset;
+uniform vec3 uPositionScale;
+
+// instance transform, identity for meshes placed without one. gl_Position is the world space position the geometry shader expects
+uniform mat4 uModelMatrix;
+
 void main()
 {
     vUv = uv;
-	gl_Position = vec4(vertexPos, 1.0);
+	vMaterialIndex = materialIndex;
+	gl_Position = uModelMatrix * vec4(uPositionOffset + vertexPos * uPositionScale, 1.0);
 }
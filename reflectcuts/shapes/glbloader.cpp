@@ -0,0 +1,507 @@
+#include "shapes/glbloader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+#include "common/threadpool.h"
+#include "glm/gtc/quaternion.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include "json/json.hpp"
+
+namespace
+{
+	const uint32_t GlbMagic = 0x46546C67;		// "glTF"
+	const uint32_t GlbChunkJson = 0x4E4F534A;	// "JSON"
+	const uint32_t GlbChunkBin = 0x004E4942;	// "BIN\0"
+
+	enum GltfComponentType
+	{
+		GltfByte = 5120,
+		GltfUnsignedByte = 5121,
+		GltfShort = 5122,
+		GltfUnsignedShort = 5123,
+		GltfUnsignedInt = 5125,
+		GltfFloat = 5126
+	};
+
+	struct GlbHeader
+	{
+		uint32_t	mMagic;
+		uint32_t	mVersion;
+		uint32_t	mLength;
+	};
+
+	struct GlbChunkHeader
+	{
+		uint32_t	mLength;
+		uint32_t	mType;
+	};
+
+	// accessor resolved to a pointer into the binary chunk (nullptr = all zeros, allowed by the spec)
+	struct GlbAccessor
+	{
+		const uint8_t *	mData = nullptr;
+		size_t			mCount = 0;
+		size_t			mStride = 0;
+		int				mComponentType = GltfFloat;
+		size_t			mNumComponents = 1;
+		bool			mIsNormalized = false;
+	};
+
+	size_t ComponentSize(const int componentType)
+	{
+		switch (componentType)
+		{
+		case GltfByte:
+		case GltfUnsignedByte:		return 1;
+		case GltfShort:
+		case GltfUnsignedShort:		return 2;
+		case GltfUnsignedInt:
+		case GltfFloat:				return 4;
+		}
+		return 0;
+	}
+
+	size_t NumComponents(const std::string & type)
+	{
+		if (type == "SCALAR") { return 1; }
+		if (type == "VEC2") { return 2; }
+		if (type == "VEC3") { return 3; }
+		if (type == "VEC4") { return 4; }
+		if (type == "MAT4") { return 16; }
+		return 0;
+	}
+
+	bool ResolveAccessor(GlbAccessor * result, const nlohmann::json & gltf, const size_t index, const uint8_t * bin, const size_t binSize)
+	{
+		if (index >= gltf.at("accessors").size()) { return false; }
+		const nlohmann::json & accessor = gltf.at("accessors").at(index);
+		if (accessor.find("sparse") != accessor.end()) { return false; }
+
+		result->mCount = accessor.at("count");
+		result->mComponentType = accessor.at("componentType");
+		result->mNumComponents = NumComponents(accessor.at("type"));
+		result->mIsNormalized = accessor.value("normalized", false);
+		const size_t elementSize = ComponentSize(result->mComponentType) * result->mNumComponents;
+		if (elementSize == 0) { return false; }
+
+		result->mStride = elementSize;
+		result->mData = nullptr;
+		if (accessor.find("bufferView") == accessor.end()) { return true; }
+
+		const size_t viewIndex = accessor.at("bufferView");
+		if (viewIndex >= gltf.at("bufferViews").size()) { return false; }
+		const nlohmann::json & bufferView = gltf.at("bufferViews").at(viewIndex);
+
+		// only the binary chunk of the glb itself, external .bin files aren't supported
+		const size_t bufferIndex = bufferView.at("buffer");
+		if (bufferIndex != 0 || bin == nullptr || gltf.at("buffers").at(0).find("uri") != gltf.at("buffers").at(0).end()) { return false; }
+
+		const size_t viewOffset = bufferView.value("byteOffset", size_t(0));
+		const size_t viewLength = bufferView.at("byteLength");
+		const size_t accessorOffset = accessor.value("byteOffset", size_t(0));
+		result->mStride = bufferView.value("byteStride", elementSize);
+		if (result->mStride < elementSize) { return false; }
+
+		// bounded first so that usedLength can't wrap around
+		if (accessorOffset > viewLength || (result->mCount > 0 && result->mCount - 1 > viewLength / result->mStride)) { return false; }
+		const size_t usedLength = (result->mCount == 0) ? 0 : accessorOffset + result->mStride * (result->mCount - 1) + elementSize;
+		if (viewOffset > binSize || viewLength > binSize - viewOffset || usedLength > viewLength) { return false; }
+
+		result->mData = bin + viewOffset + accessorOffset;
+		return true;
+	}
+
+	float ReadFloat(const uint8_t * p, const int componentType, const bool isNormalized)
+	{
+		switch (componentType)
+		{
+		case GltfFloat:				{ float v; std::memcpy(&v, p, 4); return v; }
+		case GltfUnsignedByte:		return isNormalized ? float(p[0]) / 255.0f : float(p[0]);
+		case GltfByte:				return isNormalized ? std::max(float(int8_t(p[0])) / 127.0f, -1.0f) : float(int8_t(p[0]));
+		case GltfUnsignedShort:		{ uint16_t v; std::memcpy(&v, p, 2); return isNormalized ? float(v) / 65535.0f : float(v); }
+		case GltfShort:				{ int16_t v; std::memcpy(&v, p, 2); return isNormalized ? std::max(float(v) / 32767.0f, -1.0f) : float(v); }
+		case GltfUnsignedInt:		{ uint32_t v; std::memcpy(&v, p, 4); return float(v); }
+		}
+		return 0.0f;
+	}
+
+	int32_t ReadInt(const uint8_t * p, const int componentType)
+	{
+		switch (componentType)
+		{
+		case GltfUnsignedByte:		return p[0];
+		case GltfUnsignedShort:		{ uint16_t v; std::memcpy(&v, p, 2); return v; }
+		case GltfUnsignedInt:		{ uint32_t v; std::memcpy(&v, p, 4); return int32_t(v); }
+		}
+		return 0;
+	}
+
+	// view into the mapped file when the accessor is exactly an array of T[numComponents], otherwise a converted copy
+	template <typename T>
+	void ReadAccessor(MappedArray<T> * result, const GlbAccessor & accessor, const size_t numComponents, const shared_ptr<MappedFile> & file, size_t * numViews, size_t * numCopies)
+	{
+		const int matchingType = std::is_same<T, float>::value ? GltfFloat : GltfUnsignedInt;
+		const bool isMatching = accessor.mData != nullptr
+			&& accessor.mComponentType == matchingType
+			&& accessor.mNumComponents == numComponents
+			&& accessor.mStride == sizeof(T) * numComponents
+			&& reinterpret_cast<uintptr_t>(accessor.mData) % alignof(T) == 0;
+		if (isMatching)
+		{
+			*result = MappedArray<T>(file, reinterpret_cast<const T*>(accessor.mData), accessor.mCount * numComponents);
+			(*numViews)++;
+			return;
+		}
+
+		std::vector<T> values(accessor.mCount * numComponents, T(0));
+		if (accessor.mData != nullptr)
+		{
+			const size_t componentSize = ComponentSize(accessor.mComponentType);
+			const size_t numReadComponents = std::min(numComponents, accessor.mNumComponents);
+			for (size_t i = 0;i < accessor.mCount;i++)
+			{
+				const uint8_t * element = accessor.mData + i * accessor.mStride;
+				for (size_t j = 0;j < numReadComponents;j++)
+				{
+					if (std::is_same<T, float>::value) { values[i * numComponents + j] = T(ReadFloat(element + j * componentSize, accessor.mComponentType, accessor.mIsNormalized)); }
+					else { values[i * numComponents + j] = T(ReadInt(element + j * componentSize, accessor.mComponentType)); }
+				}
+			}
+		}
+		*result = MappedArray<T>(std::move(values));
+		(*numCopies)++;
+	}
+
+	// area weighted vertex normals, gltf asks for flat normals but vertices are already shared between faces
+	std::vector<float> ComputeSmoothNormals(const MappedArray<float> & vertices, const MappedArray<int32_t> & triIndices)
+	{
+		const glm::vec3 * positions = reinterpret_cast<const glm::vec3*>(vertices.data());
+		std::vector<glm::vec3> normals(vertices.size() / 3, glm::vec3(0.0f));
+		for (size_t i = 0;i + 2 < triIndices.size();i += 3)
+		{
+			const int32_t i0 = triIndices[i], i1 = triIndices[i + 1], i2 = triIndices[i + 2];
+			const glm::vec3 n = glm::cross(positions[i1] - positions[i0], positions[i2] - positions[i0]);
+			normals[i0] += n;
+			normals[i1] += n;
+			normals[i2] += n;
+		}
+
+		std::vector<float> result(vertices.size());
+		for (size_t i = 0;i < normals.size();i++)
+		{
+			const float length = glm::length(normals[i]);
+			const glm::vec3 n = (length > 0.0f) ? normals[i] / length : glm::vec3(0.0f, 0.0f, 1.0f);
+			std::memcpy(&result[i * 3], &n[0], sizeof(glm::vec3));
+		}
+		return result;
+	}
+
+	glm::mat4 ComputeLocalMatrix(const nlohmann::json & node)
+	{
+		if (node.find("matrix") != node.end())
+		{
+			// column major, same as glm
+			float values[16];
+			for (size_t i = 0;i < 16;i++) { values[i] = node.at("matrix").at(i); }
+			return glm::make_mat4(values);
+		}
+
+		glm::vec3 translation(0.0f), scale(1.0f);
+		glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+		if (node.find("translation") != node.end()) { translation = glm::vec3(node.at("translation").at(0), node.at("translation").at(1), node.at("translation").at(2)); }
+		if (node.find("rotation") != node.end()) { rotation = glm::quat(node.at("rotation").at(3), node.at("rotation").at(0), node.at("rotation").at(1), node.at("rotation").at(2)); }
+		if (node.find("scale") != node.end()) { scale = glm::vec3(node.at("scale").at(0), node.at("scale").at(1), node.at("scale").at(2)); }
+		return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+	}
+}
+
+// the json is read with at() : a missing key or index of a malformed file throws, and so does a value of the wrong type
+bool GlbLoader::load(const std::string & filepath)
+{
+	try
+	{
+		return loadGlb(filepath);
+	}
+	catch (const std::exception & e)
+	{
+		std::cout << "broken glb : " << filepath << " " << e.what() << std::endl;
+		mMeshes.clear();
+		mImages.clear();
+		mMaterials.clear();
+		return false;
+	}
+}
+
+bool GlbLoader::loadGlb(const std::string & filepath)
+{
+	mMeshes.clear();
+	mImages.clear();
+	mMaterials.clear();
+	// primitives without a material look like they do through assimp (diffuse 0.6) rather than the gltf default (white metal)
+	mMaterials.emplace_back();
+	mMaterials.back().mName = "DefaultMaterial";
+	mMaterials.back().mBaseColor = glm::vec4(0.6f, 0.6f, 0.6f, 1.0f);
+	mMaterials.back().mMetallic = 0.0f;
+	mNumViews = 0;
+	mNumCopies = 0;
+
+	mFile = MappedFile::Open(filepath);
+	if (mFile == nullptr || mFile->size() < sizeof(GlbHeader) + sizeof(GlbChunkHeader)) { return false; }
+
+	// header, json chunk, optional binary chunk. chunks are 4 byte aligned so views into the binary chunk are aligned too
+	const uint8_t * data = mFile->data();
+	GlbHeader header;
+	std::memcpy(&header, data, sizeof(GlbHeader));
+	if (header.mMagic != GlbMagic || header.mVersion != 2 || header.mLength > mFile->size()) { return false; }
+
+	GlbChunkHeader jsonChunk;
+	std::memcpy(&jsonChunk, data + sizeof(GlbHeader), sizeof(GlbChunkHeader));
+	const size_t jsonBegin = sizeof(GlbHeader) + sizeof(GlbChunkHeader);
+	if (jsonChunk.mType != GlbChunkJson || jsonChunk.mLength > header.mLength - jsonBegin) { return false; }
+
+	const uint8_t * bin = nullptr;
+	size_t binSize = 0;
+	const size_t binHeaderBegin = jsonBegin + ((jsonChunk.mLength + 3) & ~size_t(3));
+	if (binHeaderBegin + sizeof(GlbChunkHeader) <= header.mLength)
+	{
+		GlbChunkHeader binChunk;
+		std::memcpy(&binChunk, data + binHeaderBegin, sizeof(GlbChunkHeader));
+		const size_t binBegin = binHeaderBegin + sizeof(GlbChunkHeader);
+		if (binChunk.mType == GlbChunkBin && binChunk.mLength <= header.mLength - binBegin)
+		{
+			bin = data + binBegin;
+			binSize = binChunk.mLength;
+		}
+	}
+
+	const nlohmann::json gltf = nlohmann::json::parse(data + jsonBegin, data + jsonBegin + jsonChunk.mLength);
+
+	// images (embedded ones are decoded later by the texture cache straight from the mapping)
+	const std::string filename = filepath.substr(filepath.find_last_of("/\\") + 1);
+	const nlohmann::json emptyArray = nlohmann::json::array();
+	const nlohmann::json & images = (gltf.find("images") != gltf.end()) ? gltf.at("images") : emptyArray;
+	for (size_t iImage = 0;iImage < images.size();iImage++)
+	{
+		Image image;
+		image.mName = filename + "#image" + std::to_string(iImage);
+		if (images[iImage].find("uri") != images[iImage].end())
+		{
+			image.mUri = images[iImage].at("uri").get<std::string>();
+			if (image.mUri.compare(0, 5, "data:") == 0)
+			{
+				std::cout << "data uri images aren't supported, using the base color factor : " << image.mName << std::endl;
+				image.mUri.clear();
+			}
+		}
+		else if (images[iImage].find("bufferView") != images[iImage].end())
+		{
+			const size_t viewIndex = images[iImage].at("bufferView");
+			if (bin == nullptr || viewIndex >= gltf.at("bufferViews").size()) { return false; }
+			const nlohmann::json & bufferView = gltf.at("bufferViews").at(viewIndex);
+			image.mOffset = uint64_t(bin - data) + bufferView.value("byteOffset", size_t(0));
+			image.mSize = bufferView.at("byteLength");
+			if (image.mOffset + image.mSize > mFile->size()) { return false; }
+		}
+		mImages.push_back(image);
+	}
+
+	// materials, shifted by one for the default material
+	const nlohmann::json & textures = (gltf.find("textures") != gltf.end()) ? gltf.at("textures") : emptyArray;
+	const nlohmann::json & materials = (gltf.find("materials") != gltf.end()) ? gltf.at("materials") : emptyArray;
+	for (size_t iMat = 0;iMat < materials.size();iMat++)
+	{
+		Material material;
+		material.mName = materials[iMat].value("name", std::string());
+		if (materials[iMat].find("pbrMetallicRoughness") != materials[iMat].end())
+		{
+			const nlohmann::json & pbr = materials[iMat].at("pbrMetallicRoughness");
+			if (pbr.find("baseColorFactor") != pbr.end())
+			{
+				for (size_t i = 0;i < 4;i++) { material.mBaseColor[i] = pbr.at("baseColorFactor").at(i); }
+			}
+			material.mMetallic = pbr.value("metallicFactor", 1.0f);
+			material.mRoughness = pbr.value("roughnessFactor", 1.0f);
+			if (pbr.find("baseColorTexture") != pbr.end())
+			{
+				const size_t textureIndex = pbr.at("baseColorTexture").at("index");
+				if (textureIndex < textures.size() && textures[textureIndex].find("source") != textures[textureIndex].end())
+				{
+					const size_t imageIndex = textures[textureIndex].at("source");
+					const bool isUsable = imageIndex < mImages.size() && (!mImages[imageIndex].mUri.empty() || mImages[imageIndex].mSize > 0);
+					if (isUsable) { material.mBaseColorImage = int32_t(imageIndex); }
+				}
+			}
+		}
+		mMaterials.push_back(material);
+	}
+
+	// primitives, numbered in file order
+	const nlohmann::json & meshes = (gltf.find("meshes") != gltf.end()) ? gltf.at("meshes") : emptyArray;
+	std::vector<size_t> firstPrimitives(meshes.size() + 1, 0);
+	for (size_t iMesh = 0;iMesh < meshes.size();iMesh++)
+	{
+		firstPrimitives[iMesh + 1] = firstPrimitives[iMesh] + meshes[iMesh].at("primitives").size();
+	}
+
+	// node hierarchy into world matrices per primitive. without nodes every mesh is placed once.
+	std::vector<std::vector<glm::mat4>> primitiveMatrices(firstPrimitives.back());
+	const nlohmann::json & nodes = (gltf.find("nodes") != gltf.end()) ? gltf.at("nodes") : emptyArray;
+	if (nodes.empty())
+	{
+		for (std::vector<glm::mat4> & matrices : primitiveMatrices) { matrices.push_back(glm::mat4(1.0f)); }
+	}
+	else
+	{
+		std::vector<size_t> roots;
+		if (gltf.find("scenes") != gltf.end() && !gltf.at("scenes").empty())
+		{
+			const size_t sceneIndex = gltf.value("scene", size_t(0));
+			if (sceneIndex >= gltf.at("scenes").size()) { return false; }
+			for (const nlohmann::json & root : gltf.at("scenes").at(sceneIndex).at("nodes")) { roots.push_back(root); }
+		}
+		else
+		{
+			std::vector<bool> isChild(nodes.size(), false);
+			for (const nlohmann::json & node : nodes)
+			{
+				if (node.find("children") == node.end()) { continue; }
+				for (const nlohmann::json & child : node.at("children")) { if (size_t(child) < nodes.size()) { isChild[size_t(child)] = true; } }
+			}
+			for (size_t i = 0;i < nodes.size();i++) { if (!isChild[i]) { roots.push_back(i); } }
+		}
+
+		std::vector<std::pair<size_t, glm::mat4>> stack;
+		for (const size_t root : roots) { stack.emplace_back(root, glm::mat4(1.0f)); }
+		size_t numVisited = 0;
+		while (!stack.empty())
+		{
+			const size_t nodeIndex = stack.back().first;
+			const glm::mat4 parentMatrix = stack.back().second;
+			stack.pop_back();
+
+			// gltf node graphs are trees, anything bigger means a cycle
+			if (nodeIndex >= nodes.size() || ++numVisited > nodes.size()) { return false; }
+
+			const nlohmann::json & node = nodes[nodeIndex];
+			const glm::mat4 worldMatrix = parentMatrix * ComputeLocalMatrix(node);
+			if (node.find("mesh") != node.end())
+			{
+				const size_t meshIndex = node.at("mesh");
+				if (meshIndex >= meshes.size()) { return false; }
+				for (size_t i = firstPrimitives[meshIndex];i < firstPrimitives[meshIndex + 1];i++) { primitiveMatrices[i].push_back(worldMatrix); }
+			}
+			if (node.find("children") != node.end())
+			{
+				for (const nlohmann::json & child : node.at("children")) { stack.emplace_back(size_t(child), worldMatrix); }
+			}
+		}
+	}
+
+	// collect placed triangle primitives
+	struct PrimitiveRef
+	{
+		size_t mMesh;
+		size_t mPrimitive;
+		size_t mIndex;
+	};
+	std::vector<PrimitiveRef> primitiveRefs;
+	for (size_t iMesh = 0;iMesh < meshes.size();iMesh++)
+	{
+		for (size_t iPrim = 0;iPrim < meshes[iMesh].at("primitives").size();iPrim++)
+		{
+			const size_t index = firstPrimitives[iMesh] + iPrim;
+			if (primitiveMatrices[index].empty()) { continue; }
+			if (meshes[iMesh].at("primitives").at(iPrim).value("mode", 4) != 4)
+			{
+				std::cout << "skipping non triangle primitive " << iPrim << " of mesh " << iMesh << " : " << filepath << std::endl;
+				continue;
+			}
+			primitiveRefs.push_back(PrimitiveRef{ iMesh, iPrim, index });
+		}
+	}
+
+	// accessors are resolved and converted in parallel, views cost nothing
+	mMeshes.resize(primitiveRefs.size());
+	std::vector<char> isValid(primitiveRefs.size(), 1);
+	std::vector<size_t> numViews(primitiveRefs.size(), 0), numCopies(primitiveRefs.size(), 0);
+	ThreadPool::Instance().parallelFor(0, primitiveRefs.size(), [&](const size_t i)
+	{
+		const nlohmann::json & primitive = meshes[primitiveRefs[i].mMesh].at("primitives").at(primitiveRefs[i].mPrimitive);
+		const nlohmann::json & attributes = primitive.at("attributes");
+		Mesh & mesh = mMeshes[i];
+
+		GlbAccessor positions;
+		if (attributes.find("POSITION") == attributes.end() || !ResolveAccessor(&positions, gltf, attributes.at("POSITION"), bin, binSize) || positions.mNumComponents != 3)
+		{
+			isValid[i] = 0;
+			return;
+		}
+		ReadAccessor(&mesh.mVertices, positions, 3, mFile, &numViews[i], &numCopies[i]);
+		const size_t numVertices = positions.mCount;
+
+		if (primitive.find("indices") != primitive.end())
+		{
+			GlbAccessor indices;
+			if (!ResolveAccessor(&indices, gltf, primitive.at("indices"), bin, binSize) || indices.mNumComponents != 1 || indices.mCount % 3 != 0)
+			{
+				isValid[i] = 0;
+				return;
+			}
+			ReadAccessor(&mesh.mTriIndices, indices, 1, mFile, &numViews[i], &numCopies[i]);
+		}
+		else
+		{
+			std::vector<int32_t> sequence(numVertices - numVertices % 3);
+			for (size_t j = 0;j < sequence.size();j++) { sequence[j] = int32_t(j); }
+			mesh.mTriIndices = MappedArray<int32_t>(std::move(sequence));
+			numCopies[i]++;
+		}
+
+		for (const int32_t index : mesh.mTriIndices)
+		{
+			if (index < 0 || size_t(index) >= numVertices) { isValid[i] = 0; return; }
+		}
+
+		GlbAccessor normals;
+		if (attributes.find("NORMAL") != attributes.end() && ResolveAccessor(&normals, gltf, attributes.at("NORMAL"), bin, binSize) && normals.mCount == numVertices)
+		{
+			ReadAccessor(&mesh.mNormals, normals, 3, mFile, &numViews[i], &numCopies[i]);
+		}
+		else
+		{
+			mesh.mNormals = MappedArray<float>(ComputeSmoothNormals(mesh.mVertices, mesh.mTriIndices));
+			numCopies[i]++;
+		}
+
+		GlbAccessor texCoords;
+		if (attributes.find("TEXCOORD_0") != attributes.end() && ResolveAccessor(&texCoords, gltf, attributes.at("TEXCOORD_0"), bin, binSize) && texCoords.mCount == numVertices)
+		{
+			ReadAccessor(&mesh.mTexCoords, texCoords, 2, mFile, &numViews[i], &numCopies[i]);
+		}
+		else
+		{
+			mesh.mTexCoords = MappedArray<float>(std::vector<float>(numVertices * 2, 0.0f));
+			numCopies[i]++;
+		}
+
+		const size_t matIndex = primitive.value("material", size_t(-1));
+		mesh.mMatIndex = (matIndex < materials.size()) ? int32_t(matIndex + 1) : 0;
+		mesh.mNodeMatrices = primitiveMatrices[primitiveRefs[i].mIndex];
+	});
+
+	for (size_t i = 0;i < primitiveRefs.size();i++)
+	{
+		if (!isValid[i])
+		{
+			std::cout << "invalid accessors in primitive " << primitiveRefs[i].mPrimitive << " of mesh " << primitiveRefs[i].mMesh << " : " << filepath << std::endl;
+			return false;
+		}
+		mNumViews += numViews[i];
+		mNumCopies += numCopies[i];
+	}
+
+	return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common/reflectcuts.h"
+#include "common/mappedfile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// gltf 2.0 binary (glb) reader. the file stays mapped and every accessor whose layout already matches RtMesh
+// (tightly packed float3 positions / normals, float2 texcoords, uint32 indices) becomes a zero-copy view into it.
+// other layouts (strided, normalized, 8/16 bit indices) are converted into owned arrays.
+// one mesh per primitive, placed once per node referencing it.
+class GlbLoader
+{
+public:
+	struct Mesh
+	{
+		MappedArray<float>		mVertices;
+		MappedArray<float>		mNormals;		// smooth normals are generated if the primitive has none
+		MappedArray<float>		mTexCoords;		// (0, 0) where the primitive has none. v = 0 is the top row of the image
+		MappedArray<int32_t>	mTriIndices;
+		int32_t					mMatIndex = 0;
+		std::vector<glm::mat4>	mNodeMatrices;	// world matrix of every node referencing this mesh
+	};
+
+	// encoded png / jpeg, either inside the binary chunk or a file next to the glb
+	struct Image
+	{
+		std::string				mName;			// unique per file, used as texture cache key
+		std::string				mUri;			// relative to the directory of the glb, empty if embedded
+		uint64_t				mOffset = 0;	// embedded range in the mapped file
+		uint64_t				mSize = 0;
+	};
+
+	// metallic roughness parameters with the gltf defaults. material 0 is the default material (same as ObjLoader and assimp)
+	struct Material
+	{
+		std::string				mName;
+		glm::vec4				mBaseColor = glm::vec4(1.0f);
+		int32_t					mBaseColorImage = -1;
+		float					mMetallic = 1.0f;
+		float					mRoughness = 1.0f;
+	};
+
+	// returns false if the file isn't a glb, is malformed, refers to external buffers or has accessors outside of its buffers
+	bool load(const std::string & filepath);
+
+	shared_ptr<MappedFile>		mFile;
+	std::vector<Mesh>			mMeshes;
+	std::vector<Material>		mMaterials;
+	std::vector<Image>			mImages;
+	size_t						mNumViews = 0;		// arrays mapped without copying
+	size_t						mNumCopies = 0;		// arrays that had to be converted
+
+private:
+	bool loadGlb(const std::string & filepath);
+};
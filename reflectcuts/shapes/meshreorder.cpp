@@ -0,0 +1,238 @@
+#include "shapes/meshreorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "math/aabb.h"
+#include "math/math.h"
+
+namespace
+{
+	// forsyth's constants
+	const float CacheDecayPower = 1.5f;
+	const float LastTriScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	float VertexScore(const int cachePosition, const uint32_t numActiveTriangles)
+	{
+		if (numActiveTriangles == 0) { return -1.0f; }
+
+		float score = 0.0f;
+		if (cachePosition >= 0 && cachePosition < 3)
+		{
+			// the vertices of the last triangle are about to be reused anyway, don't favour them too much
+			score = LastTriScore;
+		}
+		else if (cachePosition >= 0)
+		{
+			const float scale = 1.0f / static_cast<float>(MeshReorder::CacheSize - 3);
+			score = std::pow(1.0f - static_cast<float>(cachePosition - 3) * scale, CacheDecayPower);
+		}
+
+		// vertices with few triangles left are worth finishing
+		return score + ValenceBoostScale * std::pow(static_cast<float>(numActiveTriangles), -ValenceBoostPower);
+	}
+}
+
+std::vector<uint32_t> MeshReorder::ComputeTriangleOrder(const float * positions, const int32_t * indices, const size_t numTriangles, const size_t clusterSize)
+{
+	std::vector<Vec3> centroids(numTriangles);
+	Aabb bbox;
+	size_t numVertices = 0;
+	for (size_t i = 0;i < numTriangles;i++)
+	{
+		Vec3 centroid(0.0f);
+		for (size_t k = 0;k < 3;k++)
+		{
+			const int32_t v = indices[i * 3 + k];
+			centroid += Vec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]);
+			numVertices = std::max(numVertices, static_cast<size_t>(v) + 1);
+		}
+		centroids[i] = centroid / 3.0f;
+		bbox = Aabb::Union(bbox, centroids[i]);
+	}
+
+	const Vec3 extent = bbox.pMax - bbox.pMin;
+	Vec3 invExtent;
+	for (int axis = 0;axis < 3;axis++) { invExtent[axis] = (extent[axis] > 0.0f) ? 1.0f / extent[axis] : 0.0f; }
+
+	std::vector<uint64_t> keys(numTriangles);
+	for (size_t i = 0;i < numTriangles;i++)
+	{
+		keys[i] = (static_cast<uint64_t>(Math::MortonCode3((centroids[i] - bbox.pMin) * invExtent)) << 32) | i;
+	}
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<uint32_t> order(numTriangles);
+	for (size_t i = 0;i < numTriangles;i++) { order[i] = static_cast<uint32_t>(keys[i] & 0xffffffff); }
+
+	std::vector<int32_t> localIds(numVertices, -1);
+	for (size_t first = 0;first < numTriangles;first += clusterSize)
+	{
+		OptimizeVertexCache(&order[first], std::min(clusterSize, numTriangles - first), indices, &localIds);
+	}
+	return order;
+}
+
+void MeshReorder::OptimizeVertexCache(uint32_t * order, const size_t n, const int32_t * indices, std::vector<int32_t> * localIdsPtr)
+{
+	std::vector<int32_t> & localIds = *localIdsPtr;
+
+	// vertices of the cluster numbered locally. localIds is all -1 again when this returns
+	std::vector<int32_t> vertices;
+	std::vector<uint32_t> triVertices(n * 3);
+	for (size_t t = 0;t < n;t++)
+	{
+		for (size_t k = 0;k < 3;k++)
+		{
+			const int32_t v = indices[order[t] * 3 + k];
+			if (localIds[v] < 0)
+			{
+				localIds[v] = static_cast<int32_t>(vertices.size());
+				vertices.push_back(v);
+			}
+			triVertices[t * 3 + k] = static_cast<uint32_t>(localIds[v]);
+		}
+	}
+	for (const int32_t v : vertices) { localIds[v] = -1; }
+
+	// triangles of every vertex. the first numActive[v] of each range are the ones not emitted yet
+	const size_t numVertices = vertices.size();
+	std::vector<uint32_t> numActive(numVertices, 0);
+	for (const uint32_t v : triVertices) { numActive[v]++; }
+	std::vector<uint32_t> firstTriangle(numVertices + 1, 0);
+	for (size_t v = 0;v < numVertices;v++) { firstTriangle[v + 1] = firstTriangle[v] + numActive[v]; }
+	std::vector<uint32_t> triangles(n * 3);
+	{
+		std::vector<uint32_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (size_t t = 0;t < n;t++)
+		{
+			for (size_t k = 0;k < 3;k++) { triangles[fill[triVertices[t * 3 + k]]++] = static_cast<uint32_t>(t); }
+		}
+	}
+
+	std::vector<int> cachePositions(numVertices, -1);
+	std::vector<float> vertexScores(numVertices);
+	for (size_t v = 0;v < numVertices;v++) { vertexScores[v] = VertexScore(-1, numActive[v]); }
+
+	std::vector<float> triangleScores(n);
+	std::vector<uint8_t> isEmitted(n, 0);
+	for (size_t t = 0;t < n;t++)
+	{
+		triangleScores[t] = vertexScores[triVertices[t * 3]] + vertexScores[triVertices[t * 3 + 1]] + vertexScores[triVertices[t * 3 + 2]];
+	}
+
+	std::vector<uint32_t> result;
+	result.reserve(n);
+	std::vector<uint32_t> cache, newCache;
+	int bestTriangle = -1;
+	while (result.size() < n)
+	{
+		// nothing good around the cache : start over at the best remaining triangle
+		if (bestTriangle < 0)
+		{
+			float bestScore = -1.0f;
+			for (size_t t = 0;t < n;t++)
+			{
+				if (!isEmitted[t] && triangleScores[t] > bestScore)
+				{
+					bestScore = triangleScores[t];
+					bestTriangle = static_cast<int>(t);
+				}
+			}
+		}
+
+		const uint32_t t = static_cast<uint32_t>(bestTriangle);
+		result.push_back(order[t]);
+		isEmitted[t] = 1;
+
+		newCache.clear();
+		for (size_t k = 0;k < 3;k++)
+		{
+			const uint32_t v = triVertices[t * 3 + k];
+			newCache.push_back(v);
+
+			uint32_t * first = &triangles[firstTriangle[v]];
+			uint32_t * it = std::find(first, first + numActive[v], t);
+			std::swap(*it, first[--numActive[v]]);
+		}
+		for (const uint32_t v : cache)
+		{
+			if (v != newCache[0] && v != newCache[1] && v != newCache[2]) { newCache.push_back(v); }
+		}
+
+		// rescore everything that was or is in the cache, and the triangles around it
+		for (size_t i = 0;i < newCache.size();i++)
+		{
+			cachePositions[newCache[i]] = (i < CacheSize) ? static_cast<int>(i) : -1;
+		}
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (const uint32_t v : newCache)
+		{
+			vertexScores[v] = VertexScore(cachePositions[v], numActive[v]);
+		}
+		for (const uint32_t v : newCache)
+		{
+			for (uint32_t i = 0;i < numActive[v];i++)
+			{
+				const uint32_t adjacent = triangles[firstTriangle[v] + i];
+				const float score = vertexScores[triVertices[adjacent * 3]] + vertexScores[triVertices[adjacent * 3 + 1]] + vertexScores[triVertices[adjacent * 3 + 2]];
+				triangleScores[adjacent] = score;
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = static_cast<int>(adjacent);
+				}
+			}
+		}
+
+		if (newCache.size() > CacheSize) { newCache.resize(CacheSize); }
+		std::swap(cache, newCache);
+	}
+
+	std::copy(result.begin(), result.end(), order);
+}
+
+std::vector<uint32_t> MeshReorder::ReorderVertices(int32_t * indices, const size_t numIndices, const size_t numVertices)
+{
+	const int32_t unused = -1;
+	std::vector<int32_t> newIds(numVertices, unused);
+	std::vector<uint32_t> result;
+	result.reserve(numVertices);
+	for (size_t i = 0;i < numIndices;i++)
+	{
+		int32_t & newId = newIds[indices[i]];
+		if (newId == unused)
+		{
+			newId = static_cast<int32_t>(result.size());
+			result.push_back(static_cast<uint32_t>(indices[i]));
+		}
+		indices[i] = newId;
+	}
+
+	for (size_t v = 0;v < numVertices;v++)
+	{
+		if (newIds[v] == unused) { result.push_back(static_cast<uint32_t>(v)); }
+	}
+	return result;
+}
+
+float MeshReorder::ComputeAcmr(const int32_t * indices, const size_t numTriangles, const size_t numVertices, const size_t cacheSize)
+{
+	// timestamps of the fifo : a vertex is in the cache if it was inserted less than cacheSize misses ago
+	std::vector<size_t> insertedAt(numVertices, 0);
+	size_t numMisses = 0;
+	for (size_t i = 0;i < numTriangles * 3;i++)
+	{
+		const int32_t v = indices[i];
+		if (insertedAt[v] == 0 || numMisses - insertedAt[v] >= cacheSize)
+		{
+			numMisses++;
+			insertedAt[v] = numMisses;
+		}
+	}
+	return (numTriangles > 0) ? static_cast<float>(numMisses) / static_cast<float>(numTriangles) : 0.0f;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common/reflectcuts.h"
+
+#include <cstdint>
+#include <vector>
+
+// offline reordering of indexed triangle meshes for memory locality. triangles are sorted along the morton curve of
+// their centroids so that triangles close in space are close in memory for the cpu bvh builders and the ray tracers,
+// then every cluster of consecutive triangles is reordered for the post transform vertex cache of the rasterizer
+// (forsyth 2006, linear-speed vertex cache optimisation). keeping the clusters small preserves the spatial order.
+// vertices are finally renumbered in the order the triangles first use them.
+class MeshReorder
+{
+public:
+	static const size_t CacheSize = 32;				// simulated lru cache of the vertex cache optimization
+	static const size_t DefaultClusterSize = 256;	// triangles
+
+	// for each new triangle the old one. positions are xyz floats, indices three per triangle
+	static std::vector<uint32_t> ComputeTriangleOrder(const float * positions, const int32_t * indices, const size_t numTriangles, const size_t clusterSize = DefaultClusterSize);
+
+	// renumbers the vertices in order of first use and rewrites the indices. returns for each new vertex the old one,
+	// unreferenced vertices go last
+	static std::vector<uint32_t> ReorderVertices(int32_t * indices, const size_t numIndices, const size_t numVertices);
+
+	// average cache miss ratio : transformed vertices per triangle with a fifo cache of cacheSize entries
+	static float ComputeAcmr(const int32_t * indices, const size_t numTriangles, const size_t numVertices, const size_t cacheSize);
+
+private:
+	// forsyth's greedy order of the triangles [first, first + n) of order, rewritten in place
+	static void OptimizeVertexCache(uint32_t * order, const size_t n, const int32_t * indices, std::vector<int32_t> * localIdsPtr);
+};
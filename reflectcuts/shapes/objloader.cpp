@@ -0,0 +1,679 @@
+#include "shapes/objloader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+#include "common/mappedfile.h"
+#include "common/threadpool.h"
+#include "common/util.h"
+
+namespace
+{
+	// parse result of one chunk. faces are fan triangulated right away, 3 ints (position, texcoord, normal) per corner
+	struct ObjChunk
+	{
+		struct Event
+		{
+			enum class Type { Object, Group, UseMaterial, MaterialLibrary };
+
+			Type				mType;
+			std::string			mName;
+			size_t				mNumCorners;		// corners of this chunk before the event
+		};
+
+		std::vector<float>		mPositions;
+		std::vector<float>		mTexCoords;
+		std::vector<float>		mNormals;
+		std::vector<int32_t>	mCorners;			// -1 = missing
+		std::vector<size_t>		mRelativeSlots;		// negative indices, only known relative to the start of the chunk
+		std::vector<Event>		mEvents;
+	};
+
+	// position, normal, texcoord. compared bitwise when merging identical vertices
+	struct ObjVertex
+	{
+		glm::vec3				mPosition;
+		glm::vec3				mNormal;
+		glm::vec2				mTexCoord;
+	};
+
+	inline bool IsSpace(const char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool IsDigit(const char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline const char * SkipSpaces(const char * p, const char * end)
+	{
+		while (p < end && IsSpace(*p)) { p++; }
+		return p;
+	}
+
+	inline bool StartsWith(const char * p, const char * end, const char * keyword)
+	{
+		const size_t length = std::strlen(keyword);
+		return size_t(end - p) > length && std::memcmp(p, keyword, length) == 0 && IsSpace(p[length]);
+	}
+
+	std::string ParseName(const char * p, const char * end)
+	{
+		p = SkipSpaces(p, end);
+		while (end > p && IsSpace(end[-1])) { end--; }
+		return std::string(p, end);
+	}
+
+	// hand written replacement for strtof. exact whenever the mantissa fits into 19 digits and |exponent| <= 22,
+	// which covers every exported scene. anything else (inf, nan, long mantissas) goes through strtod.
+	const char * ParseFloat(const char * p, const char * end, float * result)
+	{
+		static const double powersOf10[23] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		const char * begin = p;
+		bool isNegative = false;
+		if (p < end && (*p == '-' || *p == '+')) { isNegative = (*p == '-'); p++; }
+
+		uint64_t mantissa = 0;
+		int numDigits = 0;
+		int exponent = 0;
+		bool isExact = true;
+		bool hasDigits = false;
+
+		auto addDigit = [&](const int digit)
+		{
+			if (mantissa == 0 && digit == 0) { return true; }
+			if (numDigits == 19) { isExact = false; return false; }
+			mantissa = mantissa * 10 + digit;
+			numDigits++;
+			return true;
+		};
+
+		for (;p < end && IsDigit(*p);p++)
+		{
+			hasDigits = true;
+			if (!addDigit(*p - '0')) { exponent++; }
+		}
+		if (p < end && *p == '.')
+		{
+			for (p++;p < end && IsDigit(*p);p++)
+			{
+				hasDigits = true;
+				if (addDigit(*p - '0')) { exponent--; }
+			}
+		}
+		if (hasDigits && p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char * q = p + 1;
+			bool isExponentNegative = false;
+			if (q < end && (*q == '-' || *q == '+')) { isExponentNegative = (*q == '-'); q++; }
+			if (q < end && IsDigit(*q))
+			{
+				int value = 0;
+				for (;q < end && IsDigit(*q);q++) { value = std::min(value * 10 + (*q - '0'), 100000); }
+				exponent += isExponentNegative ? -value : value;
+				p = q;
+			}
+		}
+
+		if (hasDigits && isExact && mantissa < (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+		{
+			double value = static_cast<double>(mantissa);
+			value = (exponent < 0) ? value / powersOf10[-exponent] : value * powersOf10[exponent];
+			*result = static_cast<float>(isNegative ? -value : value);
+			return p;
+		}
+
+		// slow path needs a null terminated copy of the token
+		char buffer[128];
+		const char * tokenEnd = begin;
+		while (tokenEnd < end && !IsSpace(*tokenEnd) && tokenEnd - begin < 127) { tokenEnd++; }
+		std::memcpy(buffer, begin, tokenEnd - begin);
+		buffer[tokenEnd - begin] = '\0';
+		char * parsedEnd;
+		*result = static_cast<float>(std::strtod(buffer, &parsedEnd));
+		return begin + (parsedEnd - buffer);
+	}
+
+	const char * ParseInt(const char * p, const char * end, int64_t * result)
+	{
+		bool isNegative = false;
+		if (p < end && (*p == '-' || *p == '+')) { isNegative = (*p == '-'); p++; }
+		int64_t value = 0;
+		for (;p < end && IsDigit(*p);p++) { value = std::min<int64_t>(value * 10 + (*p - '0'), INT32_MAX); }
+		*result = isNegative ? -value : value;
+		return p;
+	}
+
+	const char * ParseFloats(const char * p, const char * end, float * values, const int numValues)
+	{
+		for (int i = 0;i < numValues;i++)
+		{
+			p = SkipSpaces(p, end);
+			values[i] = 0.0f;
+			if (p < end) { p = ParseFloat(p, end, &values[i]); }
+		}
+		return p;
+	}
+
+	void ParseChunk(ObjChunk * chunk, const char * p, const char * end)
+	{
+		std::vector<int32_t> polygon;
+		std::vector<bool> polygonIsRelative;
+		while (p < end)
+		{
+			const char * lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+			if (lineEnd == nullptr) { lineEnd = end; }
+			const char * line = SkipSpaces(p, lineEnd);
+			p = lineEnd + (lineEnd < end ? 1 : 0);
+
+			if (line == lineEnd || *line == '#') { continue; }
+
+			if (StartsWith(line, lineEnd, "v"))
+			{
+				float values[3];
+				ParseFloats(line + 2, lineEnd, values, 3);
+				chunk->mPositions.insert(chunk->mPositions.end(), values, values + 3);
+			}
+			else if (StartsWith(line, lineEnd, "vt"))
+			{
+				float values[2];
+				ParseFloats(line + 3, lineEnd, values, 2);
+				chunk->mTexCoords.insert(chunk->mTexCoords.end(), values, values + 2);
+			}
+			else if (StartsWith(line, lineEnd, "vn"))
+			{
+				float values[3];
+				ParseFloats(line + 3, lineEnd, values, 3);
+				chunk->mNormals.insert(chunk->mNormals.end(), values, values + 3);
+			}
+			else if (StartsWith(line, lineEnd, "f"))
+			{
+				const size_t numLocal[3] = { chunk->mPositions.size() / 3, chunk->mTexCoords.size() / 2, chunk->mNormals.size() / 3 };
+
+				// corners as v, v/t, v//n or v/t/n
+				polygon.clear();
+				polygonIsRelative.clear();
+				const char * q = SkipSpaces(line + 2, lineEnd);
+				while (q < lineEnd)
+				{
+					int64_t indices[3] = { 0, 0, 0 };
+					for (int i = 0;i < 3 && q < lineEnd && !IsSpace(*q);i++)
+					{
+						if (i > 0)
+						{
+							if (*q != '/') { break; }
+							q++;
+						}
+						if (q < lineEnd && *q != '/' && !IsSpace(*q)) { q = ParseInt(q, lineEnd, &indices[i]); }
+					}
+					while (q < lineEnd && !IsSpace(*q)) { q++; }
+					q = SkipSpaces(q, lineEnd);
+
+					// 1 based absolute or negative relative index. relative ones are rebased once all chunks are done
+					for (int i = 0;i < 3;i++)
+					{
+						polygon.push_back(indices[i] > 0 ? int32_t(indices[i] - 1) : (indices[i] < 0 ? int32_t(numLocal[i] + indices[i]) : -1));
+						polygonIsRelative.push_back(indices[i] < 0);
+					}
+				}
+
+				// fan triangulation, same split as assimp for convex polygons. lines and points are dropped
+				const size_t numCorners = polygon.size() / 3;
+				for (size_t i = 1;i + 1 < numCorners;i++)
+				{
+					for (const size_t corner : { size_t(0), i, i + 1 })
+					{
+						for (size_t j = 0;j < 3;j++)
+						{
+							if (polygonIsRelative[corner * 3 + j]) { chunk->mRelativeSlots.push_back(chunk->mCorners.size()); }
+							chunk->mCorners.push_back(polygon[corner * 3 + j]);
+						}
+					}
+				}
+			}
+			else if (StartsWith(line, lineEnd, "o") || StartsWith(line, lineEnd, "g"))
+			{
+				ObjChunk::Event event;
+				event.mType = (*line == 'o') ? ObjChunk::Event::Type::Object : ObjChunk::Event::Type::Group;
+				event.mName = ParseName(line + 2, lineEnd);
+				event.mNumCorners = chunk->mCorners.size() / 3;
+				chunk->mEvents.push_back(event);
+			}
+			else if (StartsWith(line, lineEnd, "usemtl") || StartsWith(line, lineEnd, "mtllib"))
+			{
+				ObjChunk::Event event;
+				event.mType = (*line == 'u') ? ObjChunk::Event::Type::UseMaterial : ObjChunk::Event::Type::MaterialLibrary;
+				event.mName = ParseName(line + 7, lineEnd);
+				event.mNumCorners = chunk->mCorners.size() / 3;
+				chunk->mEvents.push_back(event);
+			}
+		}
+	}
+
+	// splitmix64 finalizer. fnv alone leaves the low bits poorly mixed for word sized input
+	inline uint64_t HashKey(const void * key, const size_t size)
+	{
+		uint64_t hash = Util::HashFnv1a(key, size);
+		hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+		hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+		return hash ^ (hash >> 31);
+	}
+
+	// returns for every key the id of its bitwise identical group. ids are assigned in order of first occurrence and
+	// uniqueKeys receives the first occurrence of every group. hashing, partitioning and the per partition
+	// open addressing tables all run on the thread pool.
+	template <typename Key>
+	std::vector<int32_t> ParallelDedup(const std::vector<Key> & keys, std::vector<int32_t> * uniqueKeys)
+	{
+		const size_t numKeys = keys.size();
+		const size_t grainSize = 1 << 14;
+		const size_t numBlocks = (numKeys + grainSize - 1) / grainSize;
+		const size_t numPartitions = 64;
+		ThreadPool & pool = ThreadPool::Instance();
+
+		std::vector<uint64_t> hashes(numKeys);
+		std::vector<size_t> blockCounts(numBlocks * numPartitions, 0);
+		pool.parallelFor(0, numBlocks, [&](const size_t iBlock)
+		{
+			for (size_t i = iBlock * grainSize;i < std::min(numKeys, (iBlock + 1) * grainSize);i++)
+			{
+				hashes[i] = HashKey(&keys[i], sizeof(Key));
+				blockCounts[iBlock * numPartitions + (hashes[i] >> 58)]++;
+			}
+		});
+
+		// partition major offsets keep every partition in ascending key order
+		std::vector<size_t> blockOffsets(numBlocks * numPartitions);
+		std::vector<size_t> partitionOffsets(numPartitions + 1, 0);
+		size_t offset = 0;
+		for (size_t iPartition = 0;iPartition < numPartitions;iPartition++)
+		{
+			partitionOffsets[iPartition] = offset;
+			for (size_t iBlock = 0;iBlock < numBlocks;iBlock++)
+			{
+				blockOffsets[iBlock * numPartitions + iPartition] = offset;
+				offset += blockCounts[iBlock * numPartitions + iPartition];
+			}
+		}
+		partitionOffsets[numPartitions] = offset;
+
+		std::vector<int32_t> partitioned(numKeys);
+		pool.parallelFor(0, numBlocks, [&](const size_t iBlock)
+		{
+			size_t * offsets = &blockOffsets[iBlock * numPartitions];
+			for (size_t i = iBlock * grainSize;i < std::min(numKeys, (iBlock + 1) * grainSize);i++)
+			{
+				partitioned[offsets[hashes[i] >> 58]++] = int32_t(i);
+			}
+		});
+
+		std::vector<int32_t> firsts(numKeys);
+		pool.parallelFor(0, numPartitions, [&](const size_t iPartition)
+		{
+			const size_t begin = partitionOffsets[iPartition];
+			const size_t end = partitionOffsets[iPartition + 1];
+			size_t capacity = 16;
+			while (capacity < (end - begin) * 2) { capacity *= 2; }
+			std::vector<int32_t> table(capacity, -1);
+
+			for (size_t k = begin;k < end;k++)
+			{
+				const int32_t i = partitioned[k];
+				size_t slot = hashes[i] & (capacity - 1);
+				while (true)
+				{
+					const int32_t j = table[slot];
+					if (j < 0) { table[slot] = i; firsts[i] = i; break; }
+					if (hashes[j] == hashes[i] && std::memcmp(&keys[j], &keys[i], sizeof(Key)) == 0) { firsts[i] = j; break; }
+					slot = (slot + 1) & (capacity - 1);
+				}
+			}
+		});
+
+		// number the first occurrences in key order
+		std::vector<int32_t> blockUniqueOffsets(numBlocks + 1, 0);
+		pool.parallelFor(0, numBlocks, [&](const size_t iBlock)
+		{
+			int32_t count = 0;
+			for (size_t i = iBlock * grainSize;i < std::min(numKeys, (iBlock + 1) * grainSize);i++) { count += (firsts[i] == int32_t(i)); }
+			blockUniqueOffsets[iBlock + 1] = count;
+		});
+		for (size_t iBlock = 0;iBlock < numBlocks;iBlock++) { blockUniqueOffsets[iBlock + 1] += blockUniqueOffsets[iBlock]; }
+
+		std::vector<int32_t> ids(numKeys);
+		uniqueKeys->resize(blockUniqueOffsets[numBlocks]);
+		pool.parallelFor(0, numBlocks, [&](const size_t iBlock)
+		{
+			int32_t id = blockUniqueOffsets[iBlock];
+			for (size_t i = iBlock * grainSize;i < std::min(numKeys, (iBlock + 1) * grainSize);i++)
+			{
+				if (firsts[i] == int32_t(i)) { (*uniqueKeys)[id] = int32_t(i); ids[i] = id++; }
+			}
+		});
+		pool.parallelFor(0, numKeys, [&](const size_t i) { ids[i] = ids[firsts[i]]; }, grainSize);
+
+		return ids;
+	}
+
+	// corner range [mBegin, mEnd) of a chunk
+	struct ObjSegment
+	{
+		size_t mChunk;
+		size_t mBegin;
+		size_t mEnd;
+	};
+
+	struct ObjMeshSegments
+	{
+		int32_t						mMatIndex = 0;
+		size_t						mNumCorners = 0;
+		std::vector<ObjSegment>		mSegments;
+	};
+}
+
+int32_t ObjLoader::findMaterial(const std::string & name) const
+{
+	for (size_t i = 0;i < mMaterials.size();i++)
+	{
+		if (mMaterials[i].mName == name) { return int32_t(i); }
+	}
+	return -1;
+}
+
+void ObjLoader::loadMaterialLibrary(const std::string & filepath)
+{
+	shared_ptr<MappedFile> file = MappedFile::Open(filepath);
+	if (file == nullptr)
+	{
+		std::cout << "couldn't open material library : " << filepath << std::endl;
+		return;
+	}
+
+	// texture options (-bm, -s, ...) are skipped, the filename is the last token
+	auto parseTextureName = [](const char * p, const char * end)
+	{
+		while (end > p && IsSpace(end[-1])) { end--; }
+		const char * begin = end;
+		while (begin > p && !IsSpace(begin[-1])) { begin--; }
+		return std::string(begin, end);
+	};
+
+	Material * material = nullptr;
+	const char * p = reinterpret_cast<const char*>(file->data());
+	const char * end = p + file->size();
+	while (p < end)
+	{
+		const char * lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		if (lineEnd == nullptr) { lineEnd = end; }
+		const char * line = SkipSpaces(p, lineEnd);
+		p = lineEnd + (lineEnd < end ? 1 : 0);
+
+		if (StartsWith(line, lineEnd, "newmtl"))
+		{
+			// redefinitions update the existing material, like assimp
+			const std::string name = ParseName(line + 7, lineEnd);
+			int32_t index = findMaterial(name);
+			if (index < 0)
+			{
+				index = int32_t(mMaterials.size());
+				mMaterials.emplace_back();
+				mMaterials.back().mName = name;
+			}
+			material = &mMaterials[index];
+		}
+		else if (material == nullptr)
+		{
+			continue;
+		}
+		else if (StartsWith(line, lineEnd, "Kd"))
+		{
+			ParseFloats(line + 3, lineEnd, &material->mDiffuse[0], 3);
+		}
+		else if (StartsWith(line, lineEnd, "Ks"))
+		{
+			ParseFloats(line + 3, lineEnd, &material->mSpecular[0], 3);
+		}
+		else if (StartsWith(line, lineEnd, "Ns"))
+		{
+			ParseFloats(line + 3, lineEnd, &material->mShininess, 1);
+		}
+		else if (StartsWith(line, lineEnd, "map_Kd"))
+		{
+			material->mDiffuseTexture = parseTextureName(line + 7, lineEnd);
+		}
+		else if (StartsWith(line, lineEnd, "map_Ks"))
+		{
+			material->mSpecularTexture = parseTextureName(line + 7, lineEnd);
+		}
+		else if (StartsWith(line, lineEnd, "map_Ns"))
+		{
+			material->mShininessTexture = parseTextureName(line + 7, lineEnd);
+		}
+	}
+}
+
+std::vector<std::string> ObjLoader::FindMaterialLibraries(const std::string & filepath)
+{
+	std::vector<std::string> result;
+	shared_ptr<MappedFile> file = MappedFile::Open(filepath);
+	if (file == nullptr) { return result; }
+
+	const std::string filedir = filepath.substr(0, filepath.find_last_of("/\\") + 1);
+	const char * line = reinterpret_cast<const char*>(file->data());
+	const char * dataEnd = line + file->size();
+	while (line < dataEnd)
+	{
+		const char * lineEnd = static_cast<const char*>(std::memchr(line, '\n', dataEnd - line));
+		if (lineEnd == nullptr) { lineEnd = dataEnd; }
+		const char * p = SkipSpaces(line, lineEnd);
+		if (StartsWith(p, lineEnd, "mtllib")) { result.push_back(filedir + ParseName(p + 7, lineEnd)); }
+		line = lineEnd + 1;
+	}
+	return result;
+}
+
+bool ObjLoader::load(const std::string & filepath)
+{
+	mMeshes.clear();
+	mMaterials.clear();
+	mMaterials.emplace_back();
+	mMaterials.back().mName = "DefaultMaterial";
+
+	shared_ptr<MappedFile> file = MappedFile::Open(filepath);
+	if (file == nullptr) { return false; }
+
+	ThreadPool & pool = ThreadPool::Instance();
+
+	// split into chunks which end right after a line break
+	const char * data = reinterpret_cast<const char*>(file->data());
+	const char * dataEnd = data + file->size();
+	const size_t chunkSize = std::max<size_t>(1 << 20, file->size() / (pool.numThreads() * 4) + 1);
+	std::vector<const char *> chunkBegins = { data };
+	while (dataEnd - chunkBegins.back() > ptrdiff_t(chunkSize))
+	{
+		const char * lineBreak = static_cast<const char*>(std::memchr(chunkBegins.back() + chunkSize, '\n', dataEnd - chunkBegins.back() - chunkSize));
+		if (lineBreak == nullptr) { break; }
+		chunkBegins.push_back(lineBreak + 1);
+	}
+	chunkBegins.push_back(dataEnd);
+
+	const size_t numChunks = chunkBegins.size() - 1;
+	std::vector<ObjChunk> chunks(numChunks);
+	pool.parallelFor(0, numChunks, [&](const size_t i) { ParseChunk(&chunks[i], chunkBegins[i], chunkBegins[i + 1]); });
+
+	// concatenate attributes and rebase relative indices
+	std::vector<size_t> bases(numChunks * 3);
+	size_t totals[3] = { 0, 0, 0 };
+	for (size_t i = 0;i < numChunks;i++)
+	{
+		bases[i * 3 + 0] = totals[0];
+		bases[i * 3 + 1] = totals[1];
+		bases[i * 3 + 2] = totals[2];
+		totals[0] += chunks[i].mPositions.size() / 3;
+		totals[1] += chunks[i].mTexCoords.size() / 2;
+		totals[2] += chunks[i].mNormals.size() / 3;
+	}
+
+	std::vector<glm::vec3> positions(totals[0]);
+	std::vector<glm::vec2> texCoords(totals[1]);
+	std::vector<glm::vec3> normals(totals[2]);
+	pool.parallelFor(0, numChunks, [&](const size_t i)
+	{
+		ObjChunk & chunk = chunks[i];
+		for (size_t j = 0;j < chunk.mPositions.size() / 3;j++) { positions[bases[i * 3 + 0] + j] = glm::make_vec3(&chunk.mPositions[j * 3]); }
+		for (size_t j = 0;j < chunk.mTexCoords.size() / 2;j++) { texCoords[bases[i * 3 + 1] + j] = glm::make_vec2(&chunk.mTexCoords[j * 2]); }
+		for (size_t j = 0;j < chunk.mNormals.size() / 3;j++) { normals[bases[i * 3 + 2] + j] = glm::make_vec3(&chunk.mNormals[j * 3]); }
+		for (const size_t slot : chunk.mRelativeSlots) { chunk.mCorners[slot] += int32_t(bases[i * 3 + slot % 3]); }
+	});
+
+	// materials are needed before usemtl can be resolved
+	const std::string filedir = filepath.substr(0, filepath.find_last_of("/\\") + 1);
+	for (const ObjChunk & chunk : chunks)
+	{
+		for (const ObjChunk::Event & event : chunk.mEvents)
+		{
+			if (event.mType == ObjChunk::Event::Type::MaterialLibrary) { loadMaterialLibrary(filedir + event.mName); }
+		}
+	}
+
+	// replay object, group and material changes in file order. a new mesh starts whenever one of them changes
+	std::vector<ObjMeshSegments> meshSegments(1);
+	std::string activeGroup;
+	auto startMesh = [&](const int32_t matIndex)
+	{
+		if (meshSegments.back().mNumCorners > 0) { meshSegments.emplace_back(); }
+		meshSegments.back().mMatIndex = matIndex;
+	};
+	for (size_t iChunk = 0;iChunk < numChunks;iChunk++)
+	{
+		size_t cursor = 0;
+		auto addSegment = [&](const size_t end)
+		{
+			if (end == cursor) { return; }
+			meshSegments.back().mSegments.push_back({ iChunk, cursor, end });
+			meshSegments.back().mNumCorners += end - cursor;
+			cursor = end;
+		};
+
+		for (const ObjChunk::Event & event : chunks[iChunk].mEvents)
+		{
+			addSegment(event.mNumCorners);
+			const int32_t currentMatIndex = meshSegments.back().mMatIndex;
+			if (event.mType == ObjChunk::Event::Type::Object)
+			{
+				startMesh(currentMatIndex);
+			}
+			else if (event.mType == ObjChunk::Event::Type::Group && event.mName != activeGroup)
+			{
+				activeGroup = event.mName;
+				startMesh(currentMatIndex);
+			}
+			else if (event.mType == ObjChunk::Event::Type::UseMaterial)
+			{
+				int32_t matIndex = findMaterial(event.mName);
+				if (matIndex < 0)
+				{
+					std::cout << "unknown material : " << event.mName << std::endl;
+					matIndex = 0;
+				}
+				if (matIndex != currentMatIndex) { startMesh(matIndex); }
+			}
+		}
+		addSegment(chunks[iChunk].mCorners.size() / 3);
+	}
+	meshSegments.erase(std::remove_if(meshSegments.begin(), meshSegments.end(), [](const ObjMeshSegments & m) { return m.mNumCorners == 0; }), meshSegments.end());
+
+	mMeshes.resize(meshSegments.size());
+	try
+	{
+		pool.parallelFor(0, meshSegments.size(), [&](const size_t iMesh)
+		{
+			const ObjMeshSegments & segments = meshSegments[iMesh];
+			const size_t numCorners = segments.mNumCorners;
+			const size_t numTriangles = numCorners / 3;
+
+			std::vector<ObjVertex> vertices(numCorners);
+			bool hasNormals = true;
+			size_t iCorner = 0;
+			for (const ObjSegment & segment : segments.mSegments)
+			{
+				const int32_t * corners = &chunks[segment.mChunk].mCorners[segment.mBegin * 3];
+				for (size_t i = 0;i < segment.mEnd - segment.mBegin;i++, iCorner++)
+				{
+					const int32_t position = corners[i * 3 + 0];
+					const int32_t texCoord = corners[i * 3 + 1];
+					const int32_t normal = corners[i * 3 + 2];
+					if (position < 0 || size_t(position) >= positions.size()) { throw std::exception(); } // "vertex index out of range"
+
+					vertices[iCorner].mPosition = positions[position];
+					vertices[iCorner].mTexCoord = (texCoord >= 0 && size_t(texCoord) < texCoords.size()) ? texCoords[texCoord] : glm::vec2(0.0f);
+					hasNormals = hasNormals && (normal >= 0 && size_t(normal) < normals.size());
+					vertices[iCorner].mNormal = hasNormals ? normals[normal] : glm::vec3(0.0f);
+				}
+			}
+
+			if (!hasNormals)
+			{
+				// GenSmoothNormals: every vertex gets the sum of the normalized normals of all faces touching its position.
+				// assimp's default 175 degree limit takes this same path (no angle test)
+				std::vector<glm::vec3> cornerPositions(numCorners);
+				for (size_t i = 0;i < numCorners;i++) { cornerPositions[i] = vertices[i].mPosition; }
+				std::vector<int32_t> uniquePositions;
+				const std::vector<int32_t> positionIds = ParallelDedup(cornerPositions, &uniquePositions);
+
+				std::vector<glm::vec3> sums(uniquePositions.size(), glm::vec3(0.0f));
+				for (size_t iTriangle = 0;iTriangle < numTriangles;iTriangle++)
+				{
+					const glm::vec3 & p0 = vertices[iTriangle * 3 + 0].mPosition;
+					const glm::vec3 & p1 = vertices[iTriangle * 3 + 1].mPosition;
+					const glm::vec3 & p2 = vertices[iTriangle * 3 + 2].mPosition;
+					const glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+					const float length = glm::length(faceNormal);
+					if (!(length > 0.0f)) { continue; } // degenerate faces don't contribute
+					for (size_t j = 0;j < 3;j++) { sums[positionIds[iTriangle * 3 + j]] += faceNormal / length; }
+				}
+
+				for (size_t i = 0;i < numCorners;i++)
+				{
+					const glm::vec3 & sum = sums[positionIds[i]];
+					const float length = glm::length(sum);
+					vertices[i].mNormal = (length > 0.0f) ? sum / length : glm::vec3(0.0f);
+				}
+			}
+
+			// JoinIdenticalVertices
+			std::vector<int32_t> uniqueVertices;
+			const std::vector<int32_t> vertexIds = ParallelDedup(vertices, &uniqueVertices);
+
+			Mesh & mesh = mMeshes[iMesh];
+			mesh.mMatIndex = segments.mMatIndex;
+			mesh.mVertices.resize(uniqueVertices.size() * 3);
+			mesh.mNormals.resize(uniqueVertices.size() * 3);
+			mesh.mTexCoords.resize(uniqueVertices.size() * 2);
+			for (size_t i = 0;i < uniqueVertices.size();i++)
+			{
+				const ObjVertex & vertex = vertices[uniqueVertices[i]];
+				std::memcpy(&mesh.mVertices[i * 3], &vertex.mPosition, sizeof(float) * 3);
+				std::memcpy(&mesh.mNormals[i * 3], &vertex.mNormal, sizeof(float) * 3);
+				std::memcpy(&mesh.mTexCoords[i * 2], &vertex.mTexCoord, sizeof(float) * 2);
+			}
+			mesh.mTriIndices = vertexIds;
+		});
+	}
+	catch (const std::exception &)
+	{
+		std::cout << "invalid vertex index in : " << filepath << std::endl;
+		mMeshes.clear();
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common/reflectcuts.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// assimp-free wavefront obj/mtl reader. the file is mapped, split into line aligned chunks and parsed on the thread pool.
+// the result follows what assimp gives for Triangulate | GenSmoothNormals | JoinIdenticalVertices:
+// one mesh per object/group and material, smooth normals for meshes without normals and identical vertices merged.
+class ObjLoader
+{
+public:
+	struct Mesh
+	{
+		std::vector<float>		mVertices;
+		std::vector<float>		mNormals;
+		std::vector<float>		mTexCoords;		// (0, 0) where the file has none
+		std::vector<int32_t>	mTriIndices;
+		int32_t					mMatIndex = 0;
+	};
+
+	// values assimp uses when the mtl file doesn't specify them
+	struct Material
+	{
+		std::string				mName;
+		glm::vec3				mDiffuse = glm::vec3(0.6f);
+		glm::vec3				mSpecular = glm::vec3(0.0f);
+		float					mShininess = 0.0f;
+		std::string				mDiffuseTexture;	// relative to the directory of the object file
+		std::string				mSpecularTexture;
+		std::string				mShininessTexture;
+	};
+
+	// returns false if the file can't be read or refers to vertices that don't exist.
+	// material 0 is always DefaultMaterial, the same as assimp.
+	bool load(const std::string & filepath);
+
+	// the material libraries named by the mtllib lines of the file, relative to the working directory like filepath.
+	// only scans for those lines, eg. to key a cache on the materials without loading the file
+	static std::vector<std::string> FindMaterialLibraries(const std::string & filepath);
+
+	std::vector<Mesh>			mMeshes;
+	std::vector<Material>		mMaterials;
+
+private:
+	void loadMaterialLibrary(const std::string & filepath);
+	int32_t findMaterial(const std::string & name) const;
+};
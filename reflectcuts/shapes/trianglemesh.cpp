@@ -2,10 +2,13 @@
 
 #include "shapes/trianglemesh.h"
 #include "common/sampler.h"
+#include "common/intersection.h"
 
+#ifndef USE_CPU_ONLY
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#endif
 
 #include <glm/gtc/matrix_inverse.hpp>
 #include "math/mapping.h"
@@ -99,6 +102,133 @@ bool Triangle::clipAabb(Aabb * resultPtr, Float split1, Float split2, uint8_t di
 	return isIsect;
 }
 
+WatertightRay::WatertightRay(const Ray & r)
+{
+	// z is the dominant axis. swapping x and y for negative directions keeps the winding of the triangles
+	mKz = static_cast<int>(Math::MaxExtent(glm::abs(r.direction)));
+	mKx = (mKz + 1) % 3;
+	mKy = (mKx + 1) % 3;
+	if (r.direction[mKz] < 0.0f) { std::swap(mKx, mKy); }
+
+	mSx = r.direction[mKx] / r.direction[mKz];
+	mSy = r.direction[mKy] / r.direction[mKz];
+	mSz = 1.0f / r.direction[mKz];
+}
+
+bool Triangle::intersect(Intersection * isectPtr, const Ray & r) const
+{
+	return this->intersect(isectPtr, r, WatertightRay(r));
+}
+
+// woop et al. 2013, watertight ray/triangle intersection. only watertight if a * b - c * d isn't contracted to an fma
+// (-ffp-contract=off in CMakeLists.txt), otherwise the two triangles of an edge can both round it away
+bool Triangle::intersect(Intersection * isectPtr, const Ray & r, const WatertightRay & wr) const
+{
+	const Vec3 a = this->mTriMeshPtr->mVertices[this->mVertexIndices[0]] - r.origin;
+	const Vec3 b = this->mTriMeshPtr->mVertices[this->mVertexIndices[1]] - r.origin;
+	const Vec3 c = this->mTriMeshPtr->mVertices[this->mVertexIndices[2]] - r.origin;
+
+	const Float ax = a[wr.mKx] - wr.mSx * a[wr.mKz];
+	const Float ay = a[wr.mKy] - wr.mSy * a[wr.mKz];
+	const Float bx = b[wr.mKx] - wr.mSx * b[wr.mKz];
+	const Float by = b[wr.mKy] - wr.mSy * b[wr.mKz];
+	const Float cx = c[wr.mKx] - wr.mSx * c[wr.mKz];
+	const Float cy = c[wr.mKy] - wr.mSy * c[wr.mKz];
+
+	// scaled barycentrics of p0, p1 and p2. on an edge float isn't precise enough to decide which side gets the hit
+	Float u = cx * by - cy * bx;
+	Float v = ax * cy - ay * cx;
+	Float w = bx * ay - by * ax;
+	if (u == 0.0f || v == 0.0f || w == 0.0f)
+	{
+		u = static_cast<Float>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+		v = static_cast<Float>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+		w = static_cast<Float>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+	}
+
+	if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) { return false; }
+	const Float det = u + v + w;
+	if (det == 0.0f) { return false; }
+
+	const Float invDet = 1.0f / det;
+	const Float t = (u * a[wr.mKz] + v * b[wr.mKz] + w * c[wr.mKz]) * wr.mSz * invDet;
+	if (!(t > r.tmin && t < r.tmax)) { return false; }
+
+	// same convention as meshFineIntersect : p = p0 * (1 - mB1 - mB2) + p1 * mB1 + p2 * mB2
+	isectPtr->mT = t;
+	isectPtr->mB1 = v * invDet;
+	isectPtr->mB2 = w * invDet;
+	isectPtr->mTrianglePtr = this;
+	return true;
+}
+
+bool Triangle::intersectP(const Ray & r) const
+{
+	return this->intersectP(r, WatertightRay(r));
+}
+
+// Triangle::intersect without the division and the barycentrics : the range test is done on t scaled by det
+bool Triangle::intersectP(const Ray & r, const WatertightRay & wr) const
+{
+	const Vec3 a = this->mTriMeshPtr->mVertices[this->mVertexIndices[0]] - r.origin;
+	const Vec3 b = this->mTriMeshPtr->mVertices[this->mVertexIndices[1]] - r.origin;
+	const Vec3 c = this->mTriMeshPtr->mVertices[this->mVertexIndices[2]] - r.origin;
+
+	const Float ax = a[wr.mKx] - wr.mSx * a[wr.mKz];
+	const Float ay = a[wr.mKy] - wr.mSy * a[wr.mKz];
+	const Float bx = b[wr.mKx] - wr.mSx * b[wr.mKz];
+	const Float by = b[wr.mKy] - wr.mSy * b[wr.mKz];
+	const Float cx = c[wr.mKx] - wr.mSx * c[wr.mKz];
+	const Float cy = c[wr.mKy] - wr.mSy * c[wr.mKz];
+
+	Float u = cx * by - cy * bx;
+	Float v = ax * cy - ay * cx;
+	Float w = bx * ay - by * ax;
+	if (u == 0.0f || v == 0.0f || w == 0.0f)
+	{
+		u = static_cast<Float>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+		v = static_cast<Float>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+		w = static_cast<Float>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+	}
+
+	if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) { return false; }
+	const Float det = u + v + w;
+	const Float tScaled = (u * a[wr.mKz] + v * b[wr.mKz] + w * c[wr.mKz]) * wr.mSz;
+	if (det > 0.0f) { return tScaled > r.tmin * det && tScaled < r.tmax * det; }
+	if (det < 0.0f) { return tScaled < r.tmin * det && tScaled > r.tmax * det; }
+	return false;
+}
+
+void Triangle::fillIntersection(Intersection * isectPtr, const Ray & r) const
+{
+	Intersection & isect = *isectPtr;
+	const TriangleMesh & mesh = *this->mTriMeshPtr;
+	const Float b0 = 1.0f - isect.mB1 - isect.mB2;
+
+	isect.mPosition = r.origin + r.direction * isect.mT;
+	isect.mGeomNormal = this->mGeomNormal;
+	isect.mMatIndex = mesh.mMatIndex;
+
+	if (mesh.mNormals.empty())
+	{
+		isect.mShadingNormal = this->mGeomNormal;
+	}
+	else
+	{
+		isect.mShadingNormal = glm::normalize(mesh.mNormals[this->mNormalIndices[0]] * b0 + mesh.mNormals[this->mNormalIndices[1]] * isect.mB1 + mesh.mNormals[this->mNormalIndices[2]] * isect.mB2);
+	}
+
+	if (mesh.mTexCoords.empty())
+	{
+		isect.mTexCoord = Vec2(0.0f);
+	}
+	else
+	{
+		isect.mTexCoord = mesh.mTexCoords[this->mTexCoordIndices[0]] * b0 + mesh.mTexCoords[this->mTexCoordIndices[1]] * isect.mB1 + mesh.mTexCoords[this->mTexCoordIndices[2]] * isect.mB2;
+	}
+}
+
+#ifndef USE_CPU_ONLY
 std::vector<shared_ptr<TriangleMesh>> TriangleMesh::LoadMeshes(const std::string & filepath, const bool forRealtime)
 {
 	Assimp::Importer importer;
@@ -213,6 +343,7 @@ std::vector<shared_ptr<TriangleMesh>> TriangleMesh::LoadMeshes(const std::string
 	importer.FreeScene();
 	return result;
 }
+#endif
 
 void TriangleMesh::applyTransform(const glm::mat4 & transformMatrix)
 {
@@ -282,6 +413,7 @@ void TriangleMesh::samplePosition(Vec3 * position, Vec3 * normal, const Sampler
 	}
 }
 
+#ifndef USE_CPU_ONLY
 void TriangleMesh::uploadOpenglBuffer()
 {
 	mVerticesBuffer = make_shared<OpenglBuffer>();
@@ -305,6 +437,7 @@ void TriangleMesh::uploadOpenglBuffer()
 	assert(mVertices.size() == mTexCoords.size());
 	glNamedBufferData(mTexCoordsBuffer->mHandle, sizeof(float) * mTexCoords.size() * 2, &(mTexCoords[0].x), GL_STATIC_DRAW);
 }
+#endif
 
 void TriangleMesh::recomputeArea()
 {
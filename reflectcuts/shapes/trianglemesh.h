@@ -7,12 +7,24 @@
 #include "math/math.h"
 #include "math/aabb.h"
 
+#ifndef USE_CPU_ONLY
 #include "opengl/buffer.h"
 
 #include "optix.h"
 #include "optixu/optixu.h"
 #include "optixu/optixpp_namespace.h"
 #include "optix_gl_interop.h"
+#endif
+
+// ray sheared so that it runs along +z, shared by all the triangles a ray is tested against
+// (woop et al. 2013, watertight ray/triangle intersection)
+struct WatertightRay
+{
+	WatertightRay(const Ray & r);
+
+	int		mKx, mKy, mKz;
+	Float	mSx, mSy, mSz;
+};
 
 class TriangleMesh;
 class Triangle : public Shape
@@ -25,6 +37,13 @@ public:
 	bool clipAabb(Aabb * resultPtr, Float split1, Float split2, uint8_t dim) const override;
 	inline bool canIntersect() const override { return true; }
 
+	// only t, barycentrics and mTrianglePtr are written. call fillIntersection for the closest one
+	bool intersect(Intersection * isectPtr, const Ray & r) const override;
+	bool intersect(Intersection * isectPtr, const Ray & r, const WatertightRay & wr) const;
+	bool intersectP(const Ray & r) const override;
+	bool intersectP(const Ray & r, const WatertightRay & wr) const;
+	void fillIntersection(Intersection * isectPtr, const Ray & r) const;
+
 	// don't replace this with weak_ptr. performance reasons.
 	TriangleMesh * mTriMeshPtr;
 	uint32_t mVertexIndices[3];
@@ -33,6 +52,7 @@ public:
 	glm::vec3 mGeomNormal;
 };
 
+#ifndef USE_CPU_ONLY
 struct OptixMeshBuffer
 {
 	optix::GeometryInstance mGeometryInstance;
@@ -43,18 +63,23 @@ struct OptixMeshBuffer
 	// we don't need this yet
 	//optix::Buffer mTexCoords;
 };
+#endif
 
 // this is meant for opengl stuff
 
 class TriangleMesh : public Shape
 {
 public:
+#ifndef USE_CPU_ONLY
 	static std::vector<shared_ptr<TriangleMesh>> LoadMeshes(const std::string & filepath, bool forRealtime = false);
+#endif
 
 	void applyTransform(const glm::mat4 & transformMatrix);
 	Aabb computeBbox() const override;
 	void refine(std::vector<shared_ptr<Shape>> * refine) const override;
 	void samplePosition(Vec3 * position, Vec3 * direction, const Sampler & sampler) const override;
+
+#ifndef USE_CPU_ONLY
 	void uploadOpenglBuffer();
 
 	void uploadOptix(optix::Context context, optix::Program meshIntersect, optix::Program bboxIntersect, optix::Material material)
@@ -106,6 +131,7 @@ public:
 
 		mOptix.mGeometryInstance = context->createGeometryInstance(mOptix.mGeometry, &material, &material + 1);
 	}
+#endif
 
 	inline Float mArea() const override { return _mArea; }
 
@@ -120,12 +146,17 @@ public:
 	std::vector<glm::vec2> mTexCoords;
 	std::vector<Triangle> mTriangles;
 
+#ifndef USE_CPU_ONLY
 	shared_ptr<OpenglBuffer> mVerticesBuffer;
 	shared_ptr<OpenglBuffer> mIndicesBuffer;
 	shared_ptr<OpenglBuffer> mTexCoordsBuffer;
 
 	OptixMeshBuffer mOptix;
+#endif
 	
 	std::vector<Float> mAreaCdf;
 	Float _mArea;
+
+	// index into RtScene::mMaterials if the mesh came from RtMesh::createTriangleMesh
+	int32_t mMatIndex = 0;
 };
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <iostream>
+
+// the tests run in release builds too, so they can't rely on assert
+namespace Check
+{
+	inline int & NumFailures()
+	{
+		static int numFailures = 0;
+		return numFailures;
+	}
+
+	inline int Result()
+	{
+		if (NumFailures() > 0) { std::cout << NumFailures() << " checks failed" << std::endl; }
+		return NumFailures() > 0 ? 1 : 0;
+	}
+}
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::cout << __FILE__ << ":" << __LINE__ << " failed : " << #condition << std::endl; \
+			Check::NumFailures()++; \
+		} \
+	} while (false)
@@ -0,0 +1,29 @@
+#include "common/reflectcuts.h"
+#include "accel/dynamicbvh.h"
+#include "accel/sbvh.h"
+
+#include "check.h"
+#include "testmeshes.h"
+
+int main()
+{
+	std::mt19937 rng(1);
+	const std::vector<shared_ptr<TriangleMesh>> meshes = { TestMeshes::CreateSphere(32, 64, &rng), TestMeshes::CreateSlivers(200, &rng) };
+	const shared_ptr<SbvhAccel> sbvh = make_shared<SbvhAccel>(meshes);
+	const Float builtSahCost = sbvh->computeSahCost(1.0f, 1.0f);
+
+	// nothing moved, the refit only drops the clipped bounds of the spatial splits
+	DynamicBvh dynamicBvh(sbvh, meshes);
+	std::cout << "sah : built " << builtSahCost << ", refitted " << dynamicBvh.mReferenceSahCost << std::endl;
+	CHECK(!dynamicBvh.update());
+	CHECK(dynamicBvh.mBvh == sbvh);
+	CHECK(dynamicBvh.mSahCost == dynamicBvh.mReferenceSahCost);
+
+	// scrambling the vertices of the sphere degrades the refitted tree past the limit
+	TriangleMesh & sphere = *meshes[0];
+	std::shuffle(sphere.mVertices.begin(), sphere.mVertices.end(), rng);
+	CHECK(dynamicBvh.update());
+	CHECK(dynamicBvh.mNumRebuilds == 1);
+	CHECK(dynamicBvh.mSahCost == dynamicBvh.mReferenceSahCost);
+	return Check::Result();
+}
@@ -0,0 +1,60 @@
+#include "common/reflectcuts.h"
+#include "accel/binnedbvh.h"
+#include "accel/sbvh.h"
+#include "accel/widebvh.h"
+#include "common/intersection.h"
+
+#include "check.h"
+#include "testmeshes.h"
+
+int main()
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-1.5f, 1.5f);
+
+	// two levels can't hold 130k triangles in sah leaves of at most MaxLeafRefs, the sbvh has to halve the root
+	const std::vector<shared_ptr<TriangleMesh>> meshes = { TestMeshes::CreateSphere(256, 256, &rng) };
+	SbvhAccel::BuildSetting setting;
+	setting.mMaxDepth = 2;
+	const SbvhAccel sbvh(meshes, setting);
+	size_t numLeafRefs = 0;
+	for (const BvhAccel::Node & node : sbvh.mNodes)
+	{
+		CHECK(node.mNumRefs <= BvhAccel::MaxLeafRefs);
+		numLeafRefs += node.mNumRefs;
+	}
+	CHECK(sbvh.mNodes.size() == 3);
+	CHECK(numLeafRefs == meshes[0]->mTriangles.size());
+
+	// its leaves have far more than MaxLeafBlocks blocks each, the wide bvh splits them below extra nodes
+	const WideBvhAccel wide(sbvh);
+	CHECK(wide.mNodes.size() > 1);
+	CHECK(wide.mBlocks.size() >= (meshes[0]->mTriangles.size() + WideBvhAccel::Width - 1) / WideBvhAccel::Width);
+
+	// same hits as a regular tree. t may differ by an ulp where another triangle sharing the edge is found first.
+	// the sbvh scans its two leaves linearly, so only every 25th ray goes through it
+	const BinnedBvhAccel reference(meshes);
+	size_t numMismatches = 0;
+	for (size_t i = 0;i < 5000;i++)
+	{
+		const glm::vec3 origin(uniform(rng), uniform(rng), uniform(rng));
+		const glm::vec3 target(uniform(rng), uniform(rng), uniform(rng));
+		if (glm::length(target - origin) == 0.0f) { continue; }
+		const Ray ray(origin, glm::normalize(target - origin), 0.0f, std::numeric_limits<float>::infinity());
+
+		Intersection expected, sbvhIsect, wideIsect;
+		const bool isHit = reference.intersect(&expected, ray);
+		const bool isSbvhHit = (i % 25 == 0) ? sbvh.intersect(&sbvhIsect, ray) : isHit;
+		const bool isWideHit = wide.intersect(&wideIsect, ray);
+		const Float tolerance = expected.mT * 1e-6f;
+		if (isSbvhHit != isHit || isWideHit != isHit || wide.intersectP(ray) != isHit
+			|| (isHit && std::abs(wideIsect.mT - expected.mT) > tolerance)
+			|| (isHit && i % 25 == 0 && std::abs(sbvhIsect.mT - expected.mT) > tolerance))
+		{
+			numMismatches++;
+		}
+	}
+	std::cout << "sbvh " << sbvh.mNodes.size() << " nodes, wide " << wide.mNodes.size() << " nodes, " << numMismatches << " mismatches" << std::endl;
+	CHECK(numMismatches == 0);
+	return Check::Result();
+}
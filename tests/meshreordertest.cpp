@@ -0,0 +1,136 @@
+#include "common/reflectcuts.h"
+#include "realtimetechniques/rtcommon.h"
+#include "shapes/meshreorder.h"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <random>
+
+#include "check.h"
+
+namespace
+{
+	// grid of (n + 1)^2 vertices on a wavy sheet, two triangles per cell
+	shared_ptr<RtMesh> CreateGrid(const size_t n)
+	{
+		shared_ptr<RtMesh> mesh = make_shared<RtMesh>();
+		for (size_t y = 0;y <= n;y++)
+		{
+			for (size_t x = 0;x <= n;x++)
+			{
+				const glm::vec3 position(float(x), float(y), std::sin(float(x) * 0.3f) * std::cos(float(y) * 0.2f));
+				for (size_t j = 0;j < 3;j++) { mesh->mVertices.push_back(position[j]); }
+				for (size_t j = 0;j < 3;j++) { mesh->mNormals.push_back(j == 2 ? 1.0f : 0.0f); }
+				mesh->mTexCoords.push_back(float(x) / float(n));
+				mesh->mTexCoords.push_back(float(y) / float(n));
+			}
+		}
+		for (size_t y = 0;y < n;y++)
+		{
+			for (size_t x = 0;x < n;x++)
+			{
+				const int32_t v = int32_t(y * (n + 1) + x);
+				const int32_t w = int32_t(n + 1);
+				for (const int32_t i : { v, v + 1, v + w + 1, v, v + w + 1, v + w }) { mesh->mTriIndices.push_back(i); }
+			}
+		}
+		mesh->mNumVertices = int32_t((n + 1) * (n + 1));
+		mesh->mNumTriangles = int32_t(n * n * 2);
+		mesh->mMatIndex = 0;
+		return mesh;
+	}
+
+	// shuffles the triangles and renumbers the vertices randomly
+	void Scramble(RtMesh * mesh, std::mt19937 * rng)
+	{
+		const size_t numTriangles = mesh->mNumTriangles;
+		const size_t numVertices = mesh->mNumVertices;
+		std::vector<uint32_t> triangleOrder(numTriangles), vertexIds(numVertices);
+		std::iota(triangleOrder.begin(), triangleOrder.end(), 0);
+		std::iota(vertexIds.begin(), vertexIds.end(), 0);
+		std::shuffle(triangleOrder.begin(), triangleOrder.end(), *rng);
+		std::shuffle(vertexIds.begin(), vertexIds.end(), *rng);
+
+		MappedArray<float> vertices = mesh->mVertices, normals = mesh->mNormals, texCoords = mesh->mTexCoords;
+		for (size_t i = 0;i < numVertices;i++)
+		{
+			const size_t v = vertexIds[i];
+			for (size_t j = 0;j < 3;j++)
+			{
+				vertices[v * 3 + j] = mesh->mVertices[i * 3 + j];
+				normals[v * 3 + j] = mesh->mNormals[i * 3 + j];
+			}
+			for (size_t j = 0;j < 2;j++) { texCoords[v * 2 + j] = mesh->mTexCoords[i * 2 + j]; }
+		}
+		MappedArray<int32_t> triIndices = mesh->mTriIndices;
+		for (size_t i = 0;i < numTriangles;i++)
+		{
+			for (size_t j = 0;j < 3;j++) { triIndices[i * 3 + j] = int32_t(vertexIds[mesh->mTriIndices[triangleOrder[i] * 3 + j]]); }
+		}
+		mesh->mVertices = vertices;
+		mesh->mNormals = normals;
+		mesh->mTexCoords = texCoords;
+		mesh->mTriIndices = triIndices;
+	}
+
+	// the corners of every triangle with all their attributes, in winding order. sorted, so it doesn't depend on
+	// the order of the triangles or the numbering of the vertices
+	std::vector<std::array<float, 24>> GetTriangles(const RtMesh & mesh)
+	{
+		std::vector<std::array<float, 24>> result(mesh.mNumTriangles);
+		for (size_t i = 0;i < result.size();i++)
+		{
+			for (size_t j = 0;j < 3;j++)
+			{
+				const size_t v = mesh.mTriIndices[i * 3 + j];
+				for (size_t k = 0;k < 3;k++)
+				{
+					result[i][j * 8 + k] = mesh.mVertices[v * 3 + k];
+					result[i][j * 8 + 3 + k] = mesh.mNormals[v * 3 + k];
+				}
+				result[i][j * 8 + 6] = mesh.mTexCoords[v * 2];
+				result[i][j * 8 + 7] = mesh.mTexCoords[v * 2 + 1];
+			}
+		}
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	float ComputeAcmr(const RtMesh & mesh)
+	{
+		return MeshReorder::ComputeAcmr(mesh.mTriIndices.data(), mesh.mNumTriangles, mesh.mNumVertices, MeshReorder::CacheSize);
+	}
+
+	void CheckReorder(RtMesh * mesh)
+	{
+		const std::vector<std::array<float, 24>> triangles = GetTriangles(*mesh);
+		const float acmr = ComputeAcmr(*mesh);
+		mesh->reorderForLocality();
+		std::cout << "acmr : " << acmr << " -> " << ComputeAcmr(*mesh) << std::endl;
+		CHECK(GetTriangles(*mesh) == triangles);
+		CHECK(ComputeAcmr(*mesh) <= acmr);
+
+		// vertices in order of first use
+		int32_t numUsed = 0;
+		for (const int32_t index : mesh->mTriIndices)
+		{
+			CHECK(index <= numUsed);
+			numUsed = std::max(numUsed, index + 1);
+		}
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+
+	// rows of the grid are longer than the cache
+	const shared_ptr<RtMesh> grid = CreateGrid(100);
+	CheckReorder(grid.get());
+
+	const shared_ptr<RtMesh> scrambled = CreateGrid(100);
+	Scramble(scrambled.get(), &rng);
+	CheckReorder(scrambled.get());
+	return Check::Result();
+}
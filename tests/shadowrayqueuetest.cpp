@@ -0,0 +1,54 @@
+#include "common/reflectcuts.h"
+#include "accel/shadowrayqueue.h"
+
+#include <random>
+
+#include "check.h"
+
+namespace
+{
+	int DirectionOctant(const Vec3 & direction)
+	{
+		return (direction.x < 0.0f ? 1 : 0) | (direction.y < 0.0f ? 2 : 0) | (direction.z < 0.0f ? 4 : 0);
+	}
+
+	// checks the packets the queue hands out, a ray is occluded iff its direction points down
+	class PacketCheckAccel : public Accel
+	{
+	public:
+		bool intersect(Intersection *, const Ray &) const override { return false; }
+		bool intersectP(const Ray & ray) const override { return ray.direction.z < 0.0f; }
+		Aabb computeBbox() const override { return Aabb(Vec3(0.0f), Vec3(1.0f)); }
+
+		void traceOcclusion(Span<const Ray> rays, Span<bool> isOccluded) const override
+		{
+			for (size_t i = 1;i < rays.size();i++)
+			{
+				CHECK(DirectionOctant(rays[i - 1].direction) <= DirectionOctant(rays[i].direction));
+			}
+			Accel::traceOcclusion(rays, isOccluded);
+		}
+	};
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+	const PacketCheckAccel accel;
+	ShadowRayQueue queue(accel.computeBbox());
+	std::vector<Ray> rays;
+	for (size_t i = 0;i < 20000;i++)
+	{
+		const Vec3 origin(uniform(rng) * 0.5f + 0.5f, uniform(rng) * 0.5f + 0.5f, uniform(rng) * 0.5f + 0.5f);
+		const Vec3 direction = glm::normalize(Vec3(uniform(rng), uniform(rng), uniform(rng)));
+		rays.push_back(Ray(origin, direction, 0.0f, 1.0f));
+		CHECK(queue.push(rays.back()) == i);
+	}
+	queue.flush(accel);
+
+	// results come back in push order
+	for (size_t i = 0;i < rays.size();i++) { CHECK(queue.isOccluded(i) == (rays[i].direction.z < 0.0f)); }
+	return Check::Result();
+}
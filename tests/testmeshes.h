@@ -0,0 +1,84 @@
+#pragma once
+
+#include <random>
+
+#include "common/reflectcuts.h"
+#include "shapes/trianglemesh.h"
+
+namespace TestMeshes
+{
+	// closed, slightly bumpy uv sphere around the origin
+	inline shared_ptr<TriangleMesh> CreateSphere(const size_t numRings, const size_t numSegments, std::mt19937 * rngPtr)
+	{
+		std::uniform_real_distribution<float> bump(0.9f, 1.1f);
+		shared_ptr<TriangleMesh> result = make_shared<TriangleMesh>();
+		TriangleMesh & mesh = *result;
+
+		mesh.mVertices.push_back(glm::vec3(0.0f, 0.0f, 1.0f));
+		mesh.mVertices.push_back(glm::vec3(0.0f, 0.0f, -1.0f));
+		for (size_t i = 1;i < numRings;i++)
+		{
+			const float theta = Math::Pi * i / numRings;
+			for (size_t j = 0;j < numSegments;j++)
+			{
+				const float phi = 2.0f * Math::Pi * j / numSegments;
+				const glm::vec3 direction(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+				mesh.mVertices.push_back(direction * bump(*rngPtr));
+			}
+		}
+
+		auto vertex = [&](const size_t ring, const size_t segment) -> uint32_t
+		{
+			if (ring == 0) { return 0; }
+			if (ring == numRings) { return 1; }
+			return static_cast<uint32_t>(2 + (ring - 1) * numSegments + segment % numSegments);
+		};
+		auto addTriangle = [&](const uint32_t a, const uint32_t b, const uint32_t c)
+		{
+			Triangle triangle;
+			triangle.mTriMeshPtr = result.get();
+			triangle.mVertexIndices[0] = a;
+			triangle.mVertexIndices[1] = b;
+			triangle.mVertexIndices[2] = c;
+			for (int k = 0;k < 3;k++) { triangle.mNormalIndices[k] = triangle.mTexCoordIndices[k] = 0; }
+			triangle.mGeomNormal = glm::vec3(0.0f, 0.0f, 1.0f);
+			mesh.mTriangles.push_back(triangle);
+		};
+		for (size_t i = 0;i < numRings;i++)
+		{
+			for (size_t j = 0;j < numSegments;j++)
+			{
+				if (i > 0) { addTriangle(vertex(i, j), vertex(i + 1, j), vertex(i, j + 1)); }
+				if (i + 1 < numRings) { addTriangle(vertex(i, j + 1), vertex(i + 1, j), vertex(i + 1, j + 1)); }
+			}
+		}
+		mesh.mMatIndex = 0;
+		mesh.recomputeArea();
+		return result;
+	}
+
+	// thin triangles across the sphere, the kind the spatial splits of an sbvh clip
+	inline shared_ptr<TriangleMesh> CreateSlivers(const size_t numSlivers, std::mt19937 * rngPtr)
+	{
+		std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+		shared_ptr<TriangleMesh> result = make_shared<TriangleMesh>();
+		TriangleMesh & mesh = *result;
+		for (size_t i = 0;i < numSlivers;i++)
+		{
+			const glm::vec3 a(uniform(*rngPtr), uniform(*rngPtr), uniform(*rngPtr));
+			const glm::vec3 b = -a;
+			const glm::vec3 c = a + glm::vec3(uniform(*rngPtr), uniform(*rngPtr), uniform(*rngPtr)) * 0.01f;
+			const uint32_t first = static_cast<uint32_t>(mesh.mVertices.size());
+			mesh.mVertices.insert(mesh.mVertices.end(), { a, b, c });
+
+			Triangle triangle;
+			triangle.mTriMeshPtr = result.get();
+			for (uint32_t k = 0;k < 3;k++) { triangle.mVertexIndices[k] = first + k; triangle.mNormalIndices[k] = triangle.mTexCoordIndices[k] = 0; }
+			triangle.mGeomNormal = glm::vec3(0.0f, 0.0f, 1.0f);
+			mesh.mTriangles.push_back(triangle);
+		}
+		mesh.mMatIndex = 0;
+		mesh.recomputeArea();
+		return result;
+	}
+}
@@ -0,0 +1,64 @@
+#include "common/reflectcuts.h"
+#include "accel/binnedbvh.h"
+#include "accel/widebvh.h"
+#include "common/intersection.h"
+#include "shapes/trianglemesh.h"
+
+#include "check.h"
+#include "testmeshes.h"
+
+int main()
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-0.3f, 0.3f);
+	std::uniform_real_distribution<float> offset(0.0f, 1.0f);
+
+	// rays from inside a closed mesh toward the midpoints of shared edges can't leak through the crack
+	const std::vector<shared_ptr<TriangleMesh>> meshes = { TestMeshes::CreateSphere(64, 128, &rng) };
+	const TriangleMesh & mesh = *meshes[0];
+	const BinnedBvhAccel bvh(meshes);
+	const WideBvhAccel wide(bvh);
+
+	size_t numBvhMisses = 0, numWideMisses = 0, numOcclusionMisses = 0;
+	for (size_t i = 0;i < 200000;i++)
+	{
+		const Triangle & triangle = mesh.mTriangles[i % mesh.mTriangles.size()];
+		const size_t k = (i / mesh.mTriangles.size()) % 3;
+		const glm::vec3 midpoint = (mesh.mVertices[triangle.mVertexIndices[k]] + mesh.mVertices[triangle.mVertexIndices[(k + 1) % 3]]) * 0.5f;
+		const glm::vec3 origin(uniform(rng), uniform(rng), uniform(rng));
+		const Ray ray(origin, glm::normalize(midpoint - origin), 0.0f, std::numeric_limits<float>::infinity());
+
+		Intersection isect;
+		if (!bvh.intersect(&isect, ray)) { numBvhMisses++; }
+		isect = Intersection();
+		if (!wide.intersect(&isect, ray)) { numWideMisses++; }
+		if (!wide.intersectP(ray)) { numOcclusionMisses++; }
+	}
+	CHECK(numBvhMisses == 0);
+	CHECK(numWideMisses == 0);
+	CHECK(numOcclusionMisses == 0);
+	std::cout << "misses : bvh " << numBvhMisses << ", wide " << numWideMisses << ", wide occlusion " << numOcclusionMisses << std::endl;
+
+	// degenerate triangles have no area to hit, even when the ray passes right through them
+	{
+		shared_ptr<TriangleMesh> degenerate = make_shared<TriangleMesh>();
+		degenerate->mVertices = { glm::vec3(0.1f, 0.2f, 0.3f), glm::vec3(0.1f, 0.2f, 0.3f), glm::vec3(0.7f, 0.5f, 0.3f) };
+		const uint32_t indices[2][3] = { { 0, 1, 1 }, { 0, 1, 2 } };	// a point and a segment
+		for (int t = 0;t < 2;t++)
+		{
+			Triangle triangle;
+			triangle.mTriMeshPtr = degenerate.get();
+			for (int k = 0;k < 3;k++) { triangle.mVertexIndices[k] = indices[t][k]; }
+			for (size_t j = 0;j < 1000;j++)
+			{
+				const glm::vec3 origin(uniform(rng), uniform(rng), uniform(rng) - 1.0f);
+				const glm::vec3 target = glm::mix(degenerate->mVertices[0], degenerate->mVertices[2], t == 0 ? 0.0f : offset(rng));
+				const Ray ray(origin, glm::normalize(target - origin), 0.0f, std::numeric_limits<float>::infinity());
+				Intersection isect;
+				CHECK(!triangle.intersect(&isect, ray));
+				CHECK(!triangle.intersectP(ray));
+			}
+		}
+	}
+	return Check::Result();
+}